@@ -0,0 +1,68 @@
+#ifndef ACTagger_hpp
+#define ACTagger_hpp 1
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "ChannelTable.hpp"
+#include "EventData.hpp"
+
+namespace DELILA
+{
+
+// Anti-coincidence tagging of one event in linear time.
+// A hit with hasAC is tagged isWithAC if its AC partner fired in the same
+// event within |t - triggerTime| < window.  The fired channels are marked
+// in a bitmap keyed by the flat channel index, and only the marked words
+// are cleared again after the event.
+// One tagger per thread, all hits must be valid channels of the table.
+class ACTagger
+{
+ public:
+  ACTagger(const ChannelTable &table, const double_t window)
+      : fTable(table), fWindow(window), fFired((table.Size() + 63) / 64, 0) {};
+  ~ACTagger() = default;
+
+  // hits[i].fineTS is relative to the trigger time
+  void Tag(std::vector<RawData_t> &hits)
+  {
+    fTouched.clear();
+    bool anyAC = false;
+    for (const auto &hit : hits) {
+      if (std::fabs(hit.fineTS) < fWindow) {
+        const auto index = fTable.Index(hit.mod, hit.ch);
+        auto &word = fFired[index >> 6];
+        if (word == 0) {
+          fTouched.push_back(index >> 6);
+        }
+        word |= uint64_t(1) << (index & 63);
+      }
+      anyAC |= fTable.Get(hit.mod, hit.ch).hasAC;
+    }
+
+    if (anyAC) {
+      for (auto &hit : hits) {
+        const auto &info = fTable.Get(hit.mod, hit.ch);
+        if (info.hasAC &&
+            ((fFired[info.acIndex >> 6] >> (info.acIndex & 63)) & 1)) {
+          hit.isWithAC = true;
+        }
+      }
+    }
+
+    for (const auto word : fTouched) {
+      fFired[word] = 0;
+    }
+  };
+
+ private:
+  const ChannelTable &fTable;
+  double_t fWindow;
+  std::vector<uint64_t> fFired;
+  std::vector<uint32_t> fTouched;
+};
+
+}  // namespace DELILA
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef AsyncEventWriter_hpp
+#define AsyncEventWriter_hpp 1
+
+#include <TTree.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "EventData.hpp"
+#include "EventIndex.hpp"
+#include "EventTreeIO.hpp"
+#include "L2Selector.hpp"
+#include "RunMetrics.hpp"
+#include "SPSCQueue.hpp"
+
+namespace DELILA
+{
+
+// Fills one output tree on its own thread, so event building and ROOT
+// serialization overlap.  The builder fills a pooled EventData in place
+// (Current()) and hands it over with Commit(); the writer swaps the hits
+// into the event bound to the branches, fills the tree and returns the
+// buffer to the pool.  Both directions are lock-free SPSC queues and no
+// hit is copied on the way, the hit vectors keep circulating with their
+// capacity.  The pool size limits how far the builder can run ahead.
+// One builder thread per writer; the tree must not be touched by anybody
+// else until Close().
+class AsyncEventWriter
+{
+ public:
+  // selector: a copy of the builder's selector, its branches are made here
+  // before the event branches.  Its counter and flag values are set from
+  // every committed event.
+  // metrics: events and fill time are added as they are written
+  // index: every written event is added, with the flags of the selector;
+  // owned by the caller and not touched by it until Close()
+  AsyncEventWriter(TTree *tree, const EventFormat format,
+                   std::unique_ptr<L2Selector> selector = nullptr,
+                   const size_t poolSize = kDefaultPoolSize,
+                   StageMetrics *metrics = nullptr,
+                   EventIndex *index = nullptr)
+      : fSelector(std::move(selector)),
+        fMetrics(metrics),
+        fIndex(index),
+        fPool(poolSize > 1 ? poolSize : 2),
+        fFree(fPool.size()),
+        fFilled(fPool.size())
+  {
+    if (fSelector) {
+      fSelector->Branch(tree);
+    }
+    fWriter = std::make_unique<EventTreeWriter>(tree, fEventData, format);
+    for (size_t i = 1; i < fPool.size(); i++) {
+      fFree.TryPush(&fPool[i]);
+    }
+    fCurrent = &fPool[0];
+    fThread = std::thread(&AsyncEventWriter::WriteLoop, this);
+  };
+  ~AsyncEventWriter() { Close(); };
+
+  AsyncEventWriter(const AsyncEventWriter &) = delete;
+  AsyncEventWriter &operator=(const AsyncEventWriter &) = delete;
+
+  static constexpr size_t kDefaultPoolSize = 1024;
+
+  // Buffer to build the next event in, may hold a discarded event
+  EventData &Current() { return fCurrent->event; };
+
+  // Queues Current() for writing, with the L2 values of the builder's
+  // selector, and takes the next free buffer
+  void Commit(const L2Selector *result = nullptr)
+  {
+    if (result && fSelector) {
+      result->GetResult(fCurrent->result);
+    }
+    fFilled.Push(std::move(fCurrent));
+    // Waits for the writer if the whole pool is queued, fFree is never closed
+    fCurrent = *fFree.Pop();
+  };
+
+  // Writes the pending events and stops the thread
+  void Close()
+  {
+    if (!fThread.joinable()) {
+      return;
+    }
+    fFilled.Close();
+    fThread.join();
+  };
+
+  uint64_t GetNumberOfEvents() const { return fNEvents; };
+  // Committed events not written yet, safe from any thread
+  size_t GetQueueDepth() const { return fFilled.Size(); };
+  // Time spent in TTree::Fill [s], valid after Close()
+  double GetFillTime() const { return fFillTime; };
+
+ private:
+  struct Slot {
+    EventData event;
+    L2Result_t result;
+  };
+
+  std::unique_ptr<L2Selector> fSelector;
+  StageMetrics *fMetrics;
+  EventIndex *fIndex;
+  EventData fEventData;  // Bound to the branches
+  std::unique_ptr<EventTreeWriter> fWriter;
+  std::vector<Slot> fPool;
+  Slot *fCurrent = nullptr;
+  SPSCQueue<Slot *> fFree;    // Writer -> builder
+  SPSCQueue<Slot *> fFilled;  // Builder -> writer
+  std::thread fThread;
+  uint64_t fNEvents = 0;
+  double fFillTime = 0.;
+
+  void WriteLoop()
+  {
+    while (auto slot = fFilled.Pop()) {
+      const auto start = std::chrono::steady_clock::now();
+      fEventData.Swap((*slot)->event);
+      if (fSelector) {
+        fSelector->SetResult((*slot)->result);
+      }
+      fWriter->Fill();
+      if (fIndex) {
+        const auto &flags = (*slot)->result.flags;
+        fIndex->Add(fEventData.triggerTimePs,
+                    flags.empty() ? nullptr : flags.data());
+      }
+      fNEvents++;
+      const auto fillTime = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+      fFillTime += fillTime;
+      if (fMetrics) {
+        fMetrics->events.Add(1);
+        fMetrics->fillTime.Add(fillTime);
+      }
+      (*slot)->event.Clear();
+      fFree.Push(std::move(*slot));
+    }
+  };
+};
+
+}  // namespace DELILA
+
+#endif
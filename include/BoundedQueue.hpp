@@ -0,0 +1,84 @@
+#ifndef BoundedQueue_hpp
+#define BoundedQueue_hpp 1
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace DELILA
+{
+
+// Blocking multi-producer / multi-consumer queue with a fixed capacity.
+// Push() blocks while the queue is full, Pop() blocks while it is empty.
+// Close() wakes everybody up: pending items can still be popped, after that
+// Pop() returns std::nullopt and Push() returns false.
+template <typename T>
+class BoundedQueue
+{
+ public:
+  explicit BoundedQueue(const size_t capacity)
+      : fCapacity(capacity > 0 ? capacity : 1) {};
+  ~BoundedQueue() = default;
+
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+  bool Push(T &&item)
+  {
+    std::unique_lock<std::mutex> lock(fMutex);
+    fNotFull.wait(lock,
+                  [this] { return fClosed || fQueue.size() < fCapacity; });
+    if (fClosed) {
+      return false;
+    }
+    fQueue.emplace_back(std::move(item));
+    lock.unlock();
+    fNotEmpty.notify_one();
+    return true;
+  };
+
+  std::optional<T> Pop()
+  {
+    std::unique_lock<std::mutex> lock(fMutex);
+    fNotEmpty.wait(lock, [this] { return fClosed || !fQueue.empty(); });
+    if (fQueue.empty()) {
+      return std::nullopt;
+    }
+    std::optional<T> item(std::move(fQueue.front()));
+    fQueue.pop_front();
+    lock.unlock();
+    fNotFull.notify_one();
+    return item;
+  };
+
+  void Close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(fMutex);
+      fClosed = true;
+    }
+    fNotFull.notify_all();
+    fNotEmpty.notify_all();
+  };
+
+  size_t Size()
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    return fQueue.size();
+  };
+  size_t Capacity() const { return fCapacity; };
+
+ private:
+  const size_t fCapacity;
+  bool fClosed = false;
+  std::deque<T> fQueue;
+  std::mutex fMutex;
+  std::condition_variable fNotFull;
+  std::condition_variable fNotEmpty;
+};
+
+}  // namespace DELILA
+
+#endif
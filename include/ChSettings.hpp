@@ -7,6 +7,8 @@
 #include <string>
 #include <vector>
 
+#include "SettingsCache.hpp"
+
 namespace DELILA
 {
 
@@ -124,19 +126,23 @@ class ChSettings
     ofs.close();
   };
 
+  // From the binary cache while the JSON is unchanged, see SettingsCache
   static std::vector<std::vector<ChSettings>> GetChSettings(
       const std::string fileName)
   {
     std::vector<std::vector<ChSettings>> chSettingsVec;
 
-    std::ifstream ifs(fileName);
-    if (!ifs) {
+    std::string content;
+    if (!SettingsCache::ReadFile(fileName, content)) {
       std::cerr << "File not found: " << fileName << std::endl;
       return chSettingsVec;
     }
+    const auto hash = SettingsCache::Hash(content);
+    if (ReadCache(fileName, hash, chSettingsVec)) {
+      return chSettingsVec;
+    }
 
-    nlohmann::json j;
-    ifs >> j;
+    auto j = nlohmann::json::parse(content);
 
     for (const auto &mod : j) {
       std::vector<ChSettings> chSettings;
@@ -168,8 +174,97 @@ class ChSettings
       chSettingsVec.push_back(chSettings);
     }
 
+    WriteCache(fileName, hash, chSettingsVec);
     return chSettingsVec;
   };
+
+ private:
+  static constexpr SettingsCache::Magic_t kCacheMagic = {'E', 'L', 'I', 'F',
+                                                         'C', 'H', 'S', '1'};
+
+  static bool ReadCache(const std::string &fileName, const uint64_t hash,
+                        std::vector<std::vector<ChSettings>> &chSettingsVec)
+  {
+    std::ifstream ifs;
+    if (!SettingsCache::Open(ifs, fileName, kCacheMagic, hash)) {
+      return false;
+    }
+    typedef SettingsCache C;
+    // Sizes of a corrupt cache are not allocated
+    const auto nMods = C::Read<uint32_t>(ifs);
+    chSettingsVec.resize(nMods <= UINT16_MAX ? nMods : 0);
+    for (auto &chSettings : chSettingsVec) {
+      const auto nChs = C::Read<uint32_t>(ifs);
+      if (!ifs || nChs > UINT16_MAX) {
+        ifs.setstate(std::ios::failbit);
+        break;
+      }
+      chSettings.resize(nChs);
+      for (auto &ch : chSettings) {
+        ch.isEventTrigger = C::Read<uint8_t>(ifs);
+        ch.ID = C::Read<int32_t>(ifs);
+        ch.mod = C::Read<uint32_t>(ifs);
+        ch.ch = C::Read<uint32_t>(ifs);
+        ch.thresholdADC = C::Read<uint32_t>(ifs);
+        ch.hasAC = C::Read<uint8_t>(ifs);
+        ch.ACMod = C::Read<uint32_t>(ifs);
+        ch.ACCh = C::Read<uint32_t>(ifs);
+        for (auto *value : {&ch.phi, &ch.theta, &ch.distance, &ch.x, &ch.y,
+                            &ch.z, &ch.p0, &ch.p1, &ch.p2, &ch.p3}) {
+          *value = C::Read<double_t>(ifs);
+        }
+        ch.detectorType = C::ReadString(ifs);
+        const auto nTags = C::Read<uint32_t>(ifs);
+        if (!ifs || nTags > UINT16_MAX) {
+          ifs.setstate(std::ios::failbit);
+          break;
+        }
+        ch.tags.resize(nTags);
+        for (auto &tag : ch.tags) {
+          tag = C::ReadString(ifs);
+        }
+      }
+    }
+    if (nMods > UINT16_MAX || !ifs ||
+        ifs.peek() != std::ifstream::traits_type::eof()) {
+      chSettingsVec.clear();  // Parsed from the JSON instead
+      return false;
+    }
+    return true;
+  };
+
+  static void WriteCache(
+      const std::string &fileName, const uint64_t hash,
+      const std::vector<std::vector<ChSettings>> &chSettingsVec)
+  {
+    SettingsCache::Save(
+        fileName, kCacheMagic, hash, [&chSettingsVec](std::ostream &os) {
+          typedef SettingsCache C;
+          C::Write(os, uint32_t(chSettingsVec.size()));
+          for (const auto &chSettings : chSettingsVec) {
+            C::Write(os, uint32_t(chSettings.size()));
+            for (const auto &ch : chSettings) {
+              C::Write(os, uint8_t(ch.isEventTrigger));
+              C::Write(os, ch.ID);
+              C::Write(os, ch.mod);
+              C::Write(os, ch.ch);
+              C::Write(os, ch.thresholdADC);
+              C::Write(os, uint8_t(ch.hasAC));
+              C::Write(os, ch.ACMod);
+              C::Write(os, ch.ACCh);
+              for (const auto value : {ch.phi, ch.theta, ch.distance, ch.x,
+                                       ch.y, ch.z, ch.p0, ch.p1, ch.p2, ch.p3}) {
+                C::Write(os, value);
+              }
+              C::WriteString(os, ch.detectorType);
+              C::Write(os, uint32_t(ch.tags.size()));
+              for (const auto &tag : ch.tags) {
+                C::WriteString(os, tag);
+              }
+            }
+          }
+        });
+  };
 };
 typedef ChSettings ChSettings_t;
 
@@ -0,0 +1,146 @@
+#ifndef ChannelTable_hpp
+#define ChannelTable_hpp 1
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "ChSettings.hpp"
+#include "Timestamp.hpp"
+
+namespace DELILA
+{
+
+// Hot fields of one channel, everything the builders need per hit
+struct ChannelInfo_t {
+  Timestamp_t timeOffset = 0;  // Subtracted from the time stamp [ps]
+  int32_t ID = 0;
+  uint32_t thresholdADC = 0;
+  uint32_t acIndex = 0;  // Flat index of the AC partner, valid if hasAC
+  bool isEventTrigger = false;
+  bool hasAC = false;
+};
+
+// Flat, cache resident copy of the channel settings.
+// Rows are indexed by mod * maxCh + ch.  Any (mod, ch) pair of the raw data
+// is checked with one test against a 64 kbit valid mask, so out of range
+// module or channel numbers need no separate bounds checks.
+class ChannelTable
+{
+ public:
+  ChannelTable() = default;
+  ~ChannelTable() = default;
+
+  void Build(const std::vector<std::vector<ChSettings_t>> &chSettingsVec)
+  {
+    fNModules = chSettingsVec.size();
+    fNChannels = 0;
+    for (const auto &mod : chSettingsVec) {
+      fNChannels = std::max<uint32_t>(fNChannels, mod.size());
+    }
+    fRows.assign(fNModules * fNChannels, ChannelInfo_t());
+    fValidMask.fill(0);
+
+    for (uint32_t iMod = 0; iMod < fNModules && iMod < kMaxIndex; iMod++) {
+      for (uint32_t iCh = 0; iCh < chSettingsVec[iMod].size() && iCh < kMaxIndex;
+           iCh++) {
+        const auto &settings = chSettingsVec[iMod][iCh];
+        auto &row = fRows[Index(iMod, iCh)];
+        row.ID = settings.ID;
+        row.thresholdADC = settings.thresholdADC;
+        row.isEventTrigger = settings.isEventTrigger;
+        SetValid(iMod, iCh, true);
+      }
+    }
+
+    // AC partners only count if they are valid channels themselves
+    for (uint32_t iMod = 0; iMod < fNModules && iMod < kMaxIndex; iMod++) {
+      for (uint32_t iCh = 0; iCh < chSettingsVec[iMod].size() && iCh < kMaxIndex;
+           iCh++) {
+        const auto &settings = chSettingsVec[iMod][iCh];
+        auto &row = fRows[Index(iMod, iCh)];
+        if (settings.hasAC && settings.ACMod < kMaxIndex &&
+            settings.ACCh < kMaxIndex && IsValid(settings.ACMod, settings.ACCh)) {
+          row.hasAC = true;
+          row.acIndex = Index(settings.ACMod, settings.ACCh);
+        }
+      }
+    }
+  };
+
+  // Time offsets [ns] of all channels relative to one reference channel,
+  // offsets[mod][ch], kept rounded to ps.  Channels without an offset
+  // become invalid.
+  void SetTimeOffsets(const std::vector<std::vector<double_t>> &offsets)
+  {
+    for (uint32_t iMod = 0; iMod < fNModules; iMod++) {
+      for (uint32_t iCh = 0; iCh < fNChannels; iCh++) {
+        if (!IsValid(iMod, iCh)) {
+          continue;
+        }
+        if (iMod < offsets.size() && iCh < offsets[iMod].size()) {
+          fRows[Index(iMod, iCh)].timeOffset =
+              NsToTimestamp(offsets[iMod][iCh]);
+        } else {
+          SetValid(iMod, iCh, false);
+        }
+      }
+    }
+    // A partner without time offset can not be matched any more
+    for (auto &row : fRows) {
+      if (row.hasAC && !IsValid(row.acIndex / fNChannels,
+                                row.acIndex % fNChannels)) {
+        row.hasAC = false;
+      }
+    }
+  };
+
+  bool IsValid(const uint32_t mod, const uint32_t ch) const
+  {
+    const uint32_t key = ((mod & 0xFF) << 8) | (ch & 0xFF);
+    return (mod | ch) < kMaxIndex &&
+           ((fValidMask[key >> 6] >> (key & 63)) & 1);
+  };
+
+  // Only meaningful for valid channels
+  uint32_t Index(const uint32_t mod, const uint32_t ch) const
+  {
+    return mod * fNChannels + ch;
+  };
+  const ChannelInfo_t &operator[](const uint32_t index) const
+  {
+    return fRows[index];
+  };
+  const ChannelInfo_t &Get(const uint32_t mod, const uint32_t ch) const
+  {
+    return fRows[Index(mod, ch)];
+  };
+
+  uint32_t GetNModules() const { return fNModules; };
+  uint32_t GetNChannels() const { return fNChannels; };
+  size_t Size() const { return fRows.size(); };
+  bool Empty() const { return fRows.empty(); };
+
+ private:
+  static constexpr uint32_t kMaxIndex = 256;  // Mod and Ch are UChar_t
+
+  uint32_t fNModules = 0;
+  uint32_t fNChannels = 0;  // maxCh: longest module
+  std::vector<ChannelInfo_t> fRows;
+  std::array<uint64_t, (kMaxIndex * kMaxIndex) / 64> fValidMask = {};
+
+  void SetValid(const uint32_t mod, const uint32_t ch, const bool valid)
+  {
+    const uint32_t key = (mod << 8) | ch;
+    if (valid) {
+      fValidMask[key >> 6] |= uint64_t(1) << (key & 63);
+    } else {
+      fValidMask[key >> 6] &= ~(uint64_t(1) << (key & 63));
+    }
+  };
+};
+
+}  // namespace DELILA
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef Checkpoint_hpp
+#define Checkpoint_hpp 1
+
+#include <TFileMerger.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "DELILAExceptions.hpp"
+#include "EventIndex.hpp"
+
+namespace DELILA
+{
+
+// Progress sidecar of a builder, so an interrupted run resumes where the
+// last checkpoint was taken.  A builder works in rounds of tasks, every
+// round closes its own output files.  After a round the number of tasks
+// done, the next output index and (L1) the state the merge carries into
+// the next round are saved.  The sidecar is written to a temporary file
+// and renamed, and the state file has the round in its name, so a crash
+// while saving leaves the previous checkpoint valid.  A checkpoint is only
+// resumed with the same fingerprint (input files and settings).  After
+// the last round the outputs of the rounds are merged into one file per
+// worker, see MergeRoundOutputs.
+class Checkpoint
+{
+ public:
+  explicit Checkpoint(const std::string &fileName) : fFileName(fileName) {};
+  ~Checkpoint() = default;
+
+  void SetFingerprint(const nlohmann::json &fingerprint)
+  {
+    fFingerprint = fingerprint;
+  };
+
+  // Outputs a round writes from its output index on, saved with the
+  // checkpoint: after a resume exactly these are of the interrupted round
+  void SetRoundOutputs(const uint32_t nOutputs) { fRoundOutputs = nOutputs; };
+
+  // Path, size and modification time, a rewritten input is another input
+  static nlohmann::json FileFingerprint(const std::vector<std::string> &files)
+  {
+    auto j = nlohmann::json::array();
+    for (const auto &file : files) {
+      std::error_code error;
+      const auto size = std::filesystem::file_size(file, error);
+      const auto modTime =
+          error ? 0
+                : std::filesystem::last_write_time(file, error)
+                      .time_since_epoch()
+                      .count();
+      j.push_back({file, error ? -1 : int64_t(size), int64_t(modTime)});
+    }
+    return j;
+  };
+
+  // True with a checkpoint of the same fingerprint, its state file exists
+  bool Load()
+  {
+    fTasksDone = 0;
+    fOutputIndex = 0;
+    fRound = 0;
+    fInterruptedOutputs = 0;
+    fStateFileName.clear();
+    std::ifstream ifs(fFileName);
+    if (!ifs) {
+      return false;
+    }
+    try {
+      nlohmann::json j;
+      ifs >> j;
+      // Also of another fingerprint, the next Save / Remove deletes it
+      fStateFileName = j.value("StateFile", std::string());
+      if (j.at("Fingerprint") != fFingerprint) {
+        std::cout << "Checkpoint " << fFileName
+                  << " is of other inputs or settings, starting over"
+                  << std::endl;
+        return false;
+      }
+      fTasksDone = j.at("TasksDone").get<uint64_t>();
+      fOutputIndex = j.at("OutputIndex").get<uint32_t>();
+      fRound = j.at("Round").get<uint32_t>();
+      fInterruptedOutputs = j.at("RoundOutputs").get<uint32_t>();
+    } catch (const std::exception &e) {
+      std::cerr << "Warning: Ignoring " << fFileName << ": " << e.what()
+                << std::endl;
+      return false;
+    }
+    if (!fStateFileName.empty() && !std::filesystem::exists(fStateFileName)) {
+      std::cerr << "Warning: Ignoring " << fFileName << ", "
+                << fStateFileName << " is missing" << std::endl;
+      fStateFileName.clear();
+      return false;
+    }
+    return true;
+  };
+
+  // writeState (may be empty) writes the carried state to the given stream
+  void Save(const uint64_t tasksDone, const uint32_t outputIndex,
+            const std::function<void(std::ostream &)> &writeState = {})
+  {
+    const auto round = fRound + 1;
+    std::string stateFileName;
+    if (writeState) {
+      stateFileName = fFileName + "." + std::to_string(round) + ".state";
+      std::ofstream ofs(stateFileName + ".tmp", std::ios::binary);
+      writeState(ofs);
+      ofs.close();
+      if (!ofs) {
+        throw DELILA::FileException("Could not write checkpoint state: " +
+                                    stateFileName);
+      }
+      std::filesystem::rename(stateFileName + ".tmp", stateFileName);
+    }
+
+    nlohmann::json j;
+    j["Fingerprint"] = fFingerprint;
+    j["TasksDone"] = tasksDone;
+    j["OutputIndex"] = outputIndex;
+    j["Round"] = round;
+    j["RoundOutputs"] = fRoundOutputs;
+    j["StateFile"] = stateFileName;
+    std::ofstream ofs(fFileName + ".tmp");
+    ofs << j.dump() << std::endl;
+    ofs.close();
+    if (!ofs) {
+      throw DELILA::FileException("Could not write checkpoint: " + fFileName);
+    }
+    std::filesystem::rename(fFileName + ".tmp", fFileName);
+
+    // The previous state is not referenced any more
+    std::error_code error;
+    if (!fStateFileName.empty() && fStateFileName != stateFileName) {
+      std::filesystem::remove(fStateFileName, error);
+    }
+    fTasksDone = tasksDone;
+    fOutputIndex = outputIndex;
+    fRound = round;
+    fStateFileName = stateFileName;
+  };
+
+  // After a complete run, nothing to resume any more
+  void Remove()
+  {
+    std::error_code error;
+    std::filesystem::remove(fFileName, error);
+    if (!fStateFileName.empty()) {
+      std::filesystem::remove(fStateFileName, error);
+    }
+    fStateFileName.clear();
+  };
+
+  // Before the first round.  The outputs the interrupted round may have
+  // written (from outputIndex on, as listed by the checkpoint) are removed,
+  // they are written again.  Outputs after them are of an older run, they
+  // are only reported: the ones of the same name are overwritten.
+  static void RemoveInterruptedOutputs(const std::string &level,
+                                       const uint32_t outputIndex,
+                                       const uint32_t nInterrupted)
+  {
+    const auto outputName = [&level](const uint32_t i) {
+      return level + "_" + std::to_string(i) + ".root";
+    };
+    std::error_code error;
+    const auto end = outputIndex + nInterrupted;
+    for (auto i = outputIndex; i < end; i++) {
+      std::filesystem::remove(outputName(i), error);
+      EventIndex::RemoveIndexFile(outputName(i));
+    }
+    uint32_t nOther = 0;
+    while (std::filesystem::exists(outputName(end + nOther), error)) {
+      nOther++;
+    }
+    if (nOther > 0) {
+      std::cerr << "Warning: " << nOther << " " << level
+                << " output file(s) from " << outputName(end)
+                << " on are not of this run, they are overwritten or left as "
+                   "they are"
+                << std::endl;
+    }
+  };
+
+  // Output i goes to group i % nFiles, in order
+  static std::vector<std::vector<std::string>> GroupRoundOutputs(
+      const std::vector<std::string> &outputs, const uint32_t nFiles)
+  {
+    std::vector<std::vector<std::string>> groups(
+        std::min<size_t>(outputs.size(), std::max<uint32_t>(1, nFiles)));
+    for (size_t i = 0; i < outputs.size(); i++) {
+      groups[i % groups.size()].push_back(outputs[i]);
+    }
+    return groups;
+  };
+
+  // Every round writes nFiles new outputs, they are merged into nFiles
+  // outputs again (baskets copied, see L2EventBuilder::FastMerge).  A
+  // group keeps the name of its first output, outputs is set to the merged
+  // files.  compression: ROOT setting, -1 for the default.  On failure
+  // the round outputs are kept.
+  static bool MergeRoundOutputs(std::vector<std::string> &outputs,
+                                const uint32_t nFiles,
+                                const int32_t compression,
+                                const bool withIndex)
+  {
+    const auto groups = GroupRoundOutputs(outputs, nFiles);
+    if (groups.size() == outputs.size()) {
+      return true;
+    }
+    std::cout << "Merging the outputs of the checkpoint rounds into "
+              << groups.size() << " files..." << std::endl;
+
+    // All groups are merged before any round output is removed
+    std::error_code error;
+    for (const auto &group : groups) {
+      const auto tmpName = group.front() + ".tmp";
+      TFileMerger merger(kFALSE, kFALSE);
+      merger.SetFastMethod(kTRUE);
+      merger.SetPrintLevel(0);
+      auto merged =
+          compression >= 0
+              ? merger.OutputFile(tmpName.c_str(), "RECREATE", compression)
+              : merger.OutputFile(tmpName.c_str(), "RECREATE");
+      for (const auto &file : group) {
+        merged = merged && merger.AddFile(file.c_str(), kFALSE);
+      }
+      if (!merged || !merger.Merge()) {
+        std::cerr << "Error: Merging the round outputs into " << group.front()
+                  << " failed, the round outputs are kept" << std::endl;
+        for (const auto &other : groups) {
+          std::filesystem::remove(other.front() + ".tmp", error);
+        }
+        return false;
+      }
+    }
+
+    outputs.clear();
+    for (const auto &group : groups) {
+      std::unique_ptr<EventIndex> index;
+      if (withIndex) {
+        try {
+          index = std::make_unique<EventIndex>(EventIndex::Load(group));
+        } catch (const DELILA::DELILAException &e) {
+          std::cerr << "Warning: No index of " << group.front() << ": "
+                    << e.what() << std::endl;
+        }
+      }
+      for (const auto &file : group) {
+        std::filesystem::remove(file, error);
+        EventIndex::RemoveIndexFile(file);
+      }
+      std::filesystem::rename(group.front() + ".tmp", group.front());
+      try {
+        if (index) {
+          index->Save(EventIndex::GetIndexFileName(group.front()));
+        }
+      } catch (const DELILA::FileException &e) {
+        std::cerr << "Warning: " << e.what() << std::endl;
+      }
+      outputs.push_back(group.front());
+    }
+    return true;
+  };
+
+  uint64_t GetTasksDone() const { return fTasksDone; };
+  uint32_t GetOutputIndex() const { return fOutputIndex; };
+  // Outputs from GetOutputIndex() on the interrupted round may have written
+  uint32_t GetInterruptedOutputs() const { return fInterruptedOutputs; };
+  const std::string &GetStateFileName() const { return fStateFileName; };
+
+ private:
+  std::string fFileName;
+  nlohmann::json fFingerprint;
+  uint64_t fTasksDone = 0;
+  uint32_t fOutputIndex = 0;
+  uint32_t fRound = 0;
+  uint32_t fRoundOutputs = 0;
+  uint32_t fInterruptedOutputs = 0;
+  std::string fStateFileName;
+};
+
+}  // namespace DELILA
+
+#endif
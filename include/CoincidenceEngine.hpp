@@ -0,0 +1,108 @@
+#ifndef CoincidenceEngine_hpp
+#define CoincidenceEngine_hpp 1
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace DELILA
+{
+
+// Single pass coincidence search over time sorted hits.
+// For every trigger hit i at time t the hits in the closed window
+// [t - window, t + window] are reported as one event.  With the veto
+// enabled, a trigger is skipped if another trigger with an ID greater or
+// equal to its own lies in the open window (t - window, t + window), so
+// triggers with the same ID veto each other.
+// The window edges only move forward, and the highest trigger ID in the
+// open window is kept in a monotonic deque, so every hit is visited a
+// constant number of times however dense the triggers are.
+class CoincidenceEngine
+{
+ public:
+  static constexpr int64_t kNoTrigger = std::numeric_limits<int64_t>::min();
+
+  explicit CoincidenceEngine(const double window = 0., const bool veto = true)
+      : fWindow(window), fVeto(veto) {};
+  ~CoincidenceEngine() = default;
+
+  void SetWindow(const double window) { fWindow = window; };
+  void SetVeto(const bool veto) { fVeto = veto; };
+
+  // time(j)      -> time stamp of hit j, non decreasing in j.  The window
+  //                 is in the same unit and converted to its type, so
+  //                 integer time stamps (Timestamp_t) give exact edges.
+  // triggerID(j) -> ID if hit j is a trigger, kNoTrigger otherwise
+  // onEvent(i, lo, hi) is called for every accepted trigger i in
+  // [begin, end).  The event is the hits [lo, hi), including i itself.
+  template <typename TimeFn, typename TriggerFn, typename EventFn>
+  void Run(const size_t nHits, const size_t begin, const size_t end,
+           TimeFn &&time, TriggerFn &&triggerID, EventFn &&onEvent)
+  {
+    // Edges are compared as differences to the trigger time, exactly like
+    // the per trigger scans did.  An empty open window can not veto.
+    using Time_t = std::decay_t<decltype(time(size_t(0)))>;
+    const auto window = static_cast<Time_t>(fWindow);
+    const bool useVeto = fVeto && window > 0;
+    fDeque.clear();
+    size_t lo = 0;      // First hit with ts >= t - window
+    size_t hi = 0;      // First hit with ts > t + window
+    size_t openLo = 0;  // First hit with ts > t - window
+    size_t openHi = 0;  // First hit with ts >= t + window
+
+    for (size_t i = begin; i < end && i < nHits; i++) {
+      const auto id = triggerID(i);
+      if (id == kNoTrigger) {
+        continue;
+      }
+      const auto t = time(i);
+
+      while (lo < nHits && time(lo) - t < -window) lo++;
+      while (hi < nHits && time(hi) - t <= window) hi++;
+
+      if (useVeto) {
+        while (openHi < nHits && time(openHi) - t < window) {
+          const auto newID = triggerID(openHi);
+          if (newID != kNoTrigger) {
+            // Keep equal IDs, they veto each other
+            while (!fDeque.empty() && fDeque.back().first < newID) {
+              fDeque.pop_back();
+            }
+            fDeque.emplace_back(newID, openHi);
+          }
+          openHi++;
+        }
+        while (openLo < nHits && time(openLo) - t <= -window) openLo++;
+        while (!fDeque.empty() && fDeque.front().second < openLo) {
+          fDeque.pop_front();
+        }
+
+        // Trigger i itself is in the open window.  If it is not the front,
+        // the front is another trigger with an ID >= id.  If it is, every
+        // earlier trigger has a lower ID and fDeque[1] holds the highest ID
+        // after i.
+        const auto &front = fDeque.front();
+        if (front.second != i) {
+          continue;
+        }
+        if (fDeque.size() > 1 && fDeque[1].first >= id) {
+          continue;
+        }
+      }
+
+      onEvent(i, lo, hi);
+    }
+  };
+
+ private:
+  double fWindow;
+  bool fVeto;
+  std::deque<std::pair<int64_t, size_t>> fDeque;  // (ID, hit index)
+};
+
+}  // namespace DELILA
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef CompactHistogram_hpp
+#define CompactHistogram_hpp 1
+
+#include <TH1.h>
+#include <TH2.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace DELILA
+{
+
+// Integer bin counts with a uniform x axis and, optionally, integer rows
+// (the channel IDs of the time alignment).  The binning and the under /
+// overflow bins are the same as TH1D / TH2D with the same axes.
+// A row is only allocated by its first fill, so a histogram costs the IDs
+// that actually appear instead of the full ID range.
+// Not thread safe, every thread fills its own copy and Add merges them.
+class CompactHistogram
+{
+ public:
+  CompactHistogram() = default;
+  // nRows == 0: 1D histogram, otherwise rows 0 ... nRows - 1 like
+  // TH2D(..., nRows, 0, nRows) filled with integer values
+  CompactHistogram(const int32_t nBinsX, const double xMin, const double xMax,
+                   const int32_t nRows = 0)
+      : fNBinsX(nBinsX > 0 ? nBinsX : 1),
+        fXMin(xMin),
+        fXMax(xMax),
+        fNRows(nRows > 0 ? nRows : 0)
+  {
+    fRows.resize(fNRows > 0 ? fNRows + 2 : 1);
+  };
+  ~CompactHistogram() = default;
+
+  void Fill(const double x, const int32_t row = 0)
+  {
+    auto &bins = fRows[RowBin(row)];
+    if (bins.empty()) {
+      bins.assign(fNBinsX + 2, 0);
+    }
+    bins[XBin(x)]++;
+    fEntries++;
+  };
+
+  // The axes must be the same
+  void Add(const CompactHistogram &other)
+  {
+    for (size_t r = 0; r < fRows.size() && r < other.fRows.size(); r++) {
+      const auto &src = other.fRows[r];
+      if (src.empty()) {
+        continue;
+      }
+      auto &dst = fRows[r];
+      if (dst.empty()) {
+        dst = src;
+        continue;
+      }
+      for (size_t b = 0; b < dst.size(); b++) {
+        dst[b] += src[b];
+      }
+    }
+    fEntries += other.fEntries;
+  };
+
+  uint64_t GetEntries() const { return fEntries; };
+  int32_t GetNbinsX() const { return fNBinsX; };
+  int32_t GetNRows() const { return fNRows; };
+
+  // ROOT bin numbers, 0 and nBins + 1 are under / overflow.
+  // binY is ignored for a 1D histogram.
+  uint32_t GetBinContent(const int32_t binX, const int32_t binY = 0) const
+  {
+    const auto &bins = fRows[fNRows > 0 ? binY : 0];
+    return bins.empty() ? 0 : bins[binX];
+  };
+
+  size_t GetNAllocatedRows() const
+  {
+    size_t n = 0;
+    for (const auto &bins : fRows) {
+      n += !bins.empty();
+    }
+    return n;
+  };
+  size_t GetMemoryBytes() const
+  {
+    return GetNAllocatedRows() * (fNBinsX + 2) * sizeof(uint32_t) +
+           fRows.size() * sizeof(fRows[0]);
+  };
+
+  // Conversion for writing, the histograms are not attached to a directory
+  std::unique_ptr<TH1D> ToTH1D(const std::string &name) const
+  {
+    auto hist = std::make_unique<TH1D>(name.c_str(), name.c_str(), fNBinsX,
+                                       fXMin, fXMax);
+    hist->SetDirectory(0);
+    const auto &bins = fRows[0];
+    if (fNRows == 0 && !bins.empty()) {
+      for (int32_t b = 0; b < fNBinsX + 2; b++) {
+        if (bins[b] > 0) hist->SetBinContent(b, bins[b]);
+      }
+    }
+    hist->ResetStats();
+    hist->SetEntries(fEntries);
+    return hist;
+  };
+  std::unique_ptr<TH2D> ToTH2D(const std::string &name) const
+  {
+    const auto nRows = fNRows > 0 ? fNRows : 1;
+    auto hist = std::make_unique<TH2D>(name.c_str(), name.c_str(), fNBinsX,
+                                       fXMin, fXMax, nRows, 0, nRows);
+    hist->SetDirectory(0);
+    for (int32_t r = 0; r < int32_t(fRows.size()); r++) {
+      const auto &bins = fRows[r];
+      if (bins.empty()) {
+        continue;
+      }
+      // A 1D histogram goes to the first row
+      const auto binY = fNRows > 0 ? r : 1;
+      for (int32_t b = 0; b < fNBinsX + 2; b++) {
+        if (bins[b] > 0) hist->SetBinContent(b, binY, bins[b]);
+      }
+    }
+    hist->ResetStats();
+    hist->SetEntries(fEntries);
+    return hist;
+  };
+
+ private:
+  int32_t fNBinsX = 1;
+  double fXMin = 0.;
+  double fXMax = 1.;
+  int32_t fNRows = 0;
+  uint64_t fEntries = 0;
+  // fNRows + 2 rows (1 for 1D), empty until filled.
+  // 32 bit counts, one bin of one channel pair would need 4e9 entries.
+  std::vector<std::vector<uint32_t>> fRows;
+
+  // Same as TAxis::FindFixBin
+  int32_t XBin(const double x) const
+  {
+    if (x < fXMin) {
+      return 0;
+    }
+    if (!(x < fXMax)) {
+      return fNBinsX + 1;
+    }
+    return 1 + int32_t(fNBinsX * (x - fXMin) / (fXMax - fXMin));
+  };
+  int32_t RowBin(const int32_t row) const
+  {
+    if (fNRows == 0) {
+      return 0;
+    }
+    if (row < 0) {
+      return 0;
+    }
+    return row < fNRows ? row + 1 : fNRows + 1;
+  };
+};
+
+}  // namespace DELILA
+
+#endif
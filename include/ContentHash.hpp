@@ -0,0 +1,37 @@
+#ifndef ContentHash_hpp
+#define ContentHash_hpp 1
+
+#include <cstdint>
+#include <cstring>
+
+namespace DELILA
+{
+
+// FNV-1a on 64 bit words, the key of the settings and time alignment
+// caches.  Not cryptographic, it only tells an unchanged input apart.
+constexpr uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+
+inline uint64_t HashWord(const uint64_t hash, const uint64_t word)
+{
+  return (hash ^ word) * 0x100000001b3ULL;
+}
+
+// Word by word, the tail byte by byte, then the length
+inline uint64_t HashBytes(const char *data, const size_t size)
+{
+  auto hash = kHashSeed;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    hash = HashWord(hash, word);
+  }
+  for (; i < size; i++) {
+    hash = HashWord(hash, uint8_t(data[i]));
+  }
+  return HashWord(hash, size);
+}
+
+}  // namespace DELILA
+
+#endif
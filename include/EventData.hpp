@@ -5,6 +5,7 @@
 
 #include <memory>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 namespace DELILA
@@ -46,23 +47,56 @@ class RawData_t
 class EventData
 {
  public:
-  EventData() { eventDataVec = new std::vector<RawData_t>(); };
-  EventData(const EventData &other) = default;
-  EventData(EventData &&other) = default;
-  EventData &operator=(const EventData &other) = default;
-  EventData &operator=(EventData &&other) = default;
-  ~EventData() = default;
+  // The event owns its hit vector.  The vector itself is never replaced,
+  // copies and moves only exchange its content, so the address given to a
+  // branch stays valid for the lifetime of the event.
+  EventData() : eventDataVec(new std::vector<RawData_t>()) {};
+  EventData(const EventData &other)
+      : triggerTime(other.triggerTime),
+        triggerTimePs(other.triggerTimePs),
+        eventDataVec(new std::vector<RawData_t>(*other.eventDataVec)) {};
+  EventData(EventData &&other) noexcept
+      : triggerTime(other.triggerTime),
+        triggerTimePs(other.triggerTimePs),
+        eventDataVec(
+            new std::vector<RawData_t>(std::move(*other.eventDataVec))) {};
+  EventData &operator=(const EventData &other)
+  {
+    triggerTime = other.triggerTime;
+    triggerTimePs = other.triggerTimePs;
+    *eventDataVec = *other.eventDataVec;
+    return *this;
+  };
+  EventData &operator=(EventData &&other) noexcept
+  {
+    triggerTime = other.triggerTime;
+    triggerTimePs = other.triggerTimePs;
+    *eventDataVec = std::move(*other.eventDataVec);
+    return *this;
+  };
+  ~EventData() { delete eventDataVec; };
+
+  // Exchanges the content with another event, no hit is copied
+  void Swap(EventData &other) noexcept
+  {
+    std::swap(triggerTime, other.triggerTime);
+    std::swap(triggerTimePs, other.triggerTimePs);
+    eventDataVec->swap(*other.eventDataVec);
+  };
 
   void Clear()
   {
     triggerTime = 0.;
+    triggerTimePs = 0;
     eventDataVec->clear();
   };
 
-  double_t triggerTime = 0.;
+  double_t triggerTime = 0.;  // [ns]
+  // Exact trigger time [ps], hit times are relative to it in ns
+  Long64_t triggerTimePs = 0;
   std::vector<RawData_t> *eventDataVec;
 
-  ClassDef(EventData, 1);
+  ClassDef(EventData, 2);
 };
 typedef EventData EventData_t;
 
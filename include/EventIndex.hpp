@@ -0,0 +1,269 @@
+#ifndef EventIndex_hpp
+#define EventIndex_hpp 1
+
+#include <RtypesCore.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "DELILAExceptions.hpp"
+#include "Timestamp.hpp"
+
+namespace DELILA
+{
+
+// Sidecar of an L1 / L2 output file: the trigger time of every entry and
+// one bitmap per L2 flag (a flag is a counter threshold), so a time range
+// or a flag selection is found without reading the tree.  The entries of
+// one file are time ordered in runs (one per task or slice of the writing
+// thread), every run is searched by bisection.  The file is native endian
+// binary, next to the output: L2_0.root -> L2_0.idx.
+class EventIndex
+{
+ public:
+  explicit EventIndex(std::vector<std::string> flagNames = {})
+      : fFlagNames(std::move(flagNames)), fFlagBits(fFlagNames.size()) {};
+  ~EventIndex() = default;
+
+  static std::string GetIndexFileName(const std::string &outputFileName)
+  {
+    return std::filesystem::path(outputFileName).replace_extension(".idx");
+  };
+  // With the output file, there may be none
+  static void RemoveIndexFile(const std::string &outputFileName)
+  {
+    std::error_code error;
+    std::filesystem::remove(GetIndexFileName(outputFileName), error);
+  };
+
+  // Next entry of the output.  flags: one value per flag name, in order,
+  // nullptr for none set
+  template <typename T>
+  void Add(const Timestamp_t triggerTime, const T *flags)
+  {
+    const auto entry = fTimes.size();
+    if (entry == 0 || triggerTime < fTimes.back()) {
+      fRunStarts.push_back(entry);
+    }
+    fTimes.push_back(triggerTime);
+    if (entry % 64 == 0) {
+      for (auto &bits : fFlagBits) {
+        bits.push_back(0);
+      }
+    }
+    for (size_t f = 0; flags && f < fFlagBits.size(); f++) {
+      fFlagBits[f].back() |= uint64_t(flags[f] ? 1 : 0) << (entry % 64);
+    }
+  };
+  void Add(const Timestamp_t triggerTime)
+  {
+    Add<uint8_t>(triggerTime, nullptr);
+  };
+
+  // Entries of a following file, for a merged file or a chain of files
+  void Append(const EventIndex &other)
+  {
+    if (other.fFlagNames != fFlagNames) {
+      throw DELILA::ValidationException(
+          "Event indices of different L2 flags can not be joined");
+    }
+    std::vector<uint8_t> flags(fFlagNames.size());
+    for (size_t i = 0; i < other.fTimes.size(); i++) {
+      for (size_t f = 0; f < flags.size(); f++) {
+        flags[f] = other.IsSet(f, i);
+      }
+      Add(other.fTimes[i], flags.data());
+    }
+  };
+
+  // Entries with triggerTime in [startTS, endTS) and all given flags set,
+  // in entry order
+  std::vector<Long64_t> Select(
+      const Timestamp_t startTS = kMinTimestamp,
+      const Timestamp_t endTS = kMaxTimestamp,
+      const std::vector<std::string> &flagNames = {}) const
+  {
+    std::vector<const std::vector<uint64_t> *> required;
+    for (const auto &name : flagNames) {
+      const auto it = std::find(fFlagNames.begin(), fFlagNames.end(), name);
+      if (it == fFlagNames.end()) {
+        throw DELILA::ValidationException("No L2 flag " + name +
+                                          " in the event index");
+      }
+      required.push_back(&fFlagBits[it - fFlagNames.begin()]);
+    }
+
+    std::vector<Long64_t> entries;
+    for (size_t r = 0; r < fRunStarts.size(); r++) {
+      const auto runBegin = fTimes.begin() + fRunStarts[r];
+      const auto runEnd = r + 1 < fRunStarts.size()
+                              ? fTimes.begin() + fRunStarts[r + 1]
+                              : fTimes.end();
+      const size_t first =
+          std::lower_bound(runBegin, runEnd, startTS) - fTimes.begin();
+      const size_t last =
+          std::lower_bound(runBegin, runEnd, endTS) - fTimes.begin();
+      if (required.empty()) {
+        for (auto i = first; i < last; i++) {
+          entries.push_back(i);
+        }
+        continue;
+      }
+      // A word of 64 entries at a time, only the set bits are visited
+      for (auto w = first / 64; first < last && w <= (last - 1) / 64; w++) {
+        auto mask = ~uint64_t(0);
+        if (w == first / 64) {
+          mask &= ~uint64_t(0) << (first % 64);
+        }
+        if (w == (last - 1) / 64 && last % 64 != 0) {
+          mask &= ~uint64_t(0) >> (64 - last % 64);
+        }
+        for (const auto *bits : required) {
+          mask &= (*bits)[w];
+        }
+        for (; mask != 0; mask &= mask - 1) {
+          entries.push_back(w * 64 + std::countr_zero(mask));
+        }
+      }
+    }
+    return entries;
+  };
+
+  size_t GetEntries() const { return fTimes.size(); };
+  // Time ordered runs of the entries
+  size_t GetNumberOfRuns() const { return fRunStarts.size(); };
+  Timestamp_t GetTriggerTime(const Long64_t entry) const
+  {
+    return fTimes.at(entry);
+  };
+  bool IsSet(const size_t flag, const Long64_t entry) const
+  {
+    return (fFlagBits.at(flag).at(entry / 64) >> (entry % 64)) & 1;
+  };
+  const std::vector<std::string> &GetFlagNames() const { return fFlagNames; };
+
+  void Save(const std::string &fileName) const
+  {
+    std::ofstream ofs(fileName + ".tmp", std::ios::binary);
+    ofs.write(kMagic, sizeof(kMagic));
+    Write(ofs, uint64_t(fTimes.size()));
+    Write(ofs, uint32_t(fFlagNames.size()));
+    for (const auto &name : fFlagNames) {
+      Write(ofs, uint32_t(name.size()));
+      ofs.write(name.data(), name.size());
+    }
+    ofs.write(reinterpret_cast<const char *>(fTimes.data()),
+              fTimes.size() * sizeof(Timestamp_t));
+    for (const auto &bits : fFlagBits) {
+      ofs.write(reinterpret_cast<const char *>(bits.data()),
+                bits.size() * sizeof(uint64_t));
+    }
+    ofs.close();
+    if (!ofs) {
+      throw DELILA::FileException("Could not write event index: " + fileName);
+    }
+    // A reader never sees a half written index
+    std::filesystem::rename(fileName + ".tmp", fileName);
+  };
+
+  static EventIndex Load(const std::string &fileName)
+  {
+    std::ifstream ifs(fileName, std::ios::binary);
+    if (!ifs) {
+      throw DELILA::FileException("Could not open event index: " + fileName);
+    }
+    char magic[sizeof(kMagic)];
+    ifs.read(magic, sizeof(magic));
+    if (!ifs || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+      throw DELILA::FileException("Not an event index: " + fileName);
+    }
+    // Sizes are checked before anything is allocated for them
+    std::error_code error;
+    const auto fileSize = std::filesystem::file_size(fileName, error);
+    const auto nEntries = Read<uint64_t>(ifs);
+    const auto nFlags = Read<uint32_t>(ifs);
+    if (!ifs || error || nFlags > fileSize) {
+      throw DELILA::FileException("Truncated event index: " + fileName);
+    }
+    std::vector<std::string> flagNames(nFlags);
+    for (auto &name : flagNames) {
+      const auto length = Read<uint32_t>(ifs);
+      if (!ifs || length > fileSize) {
+        throw DELILA::FileException("Truncated event index: " + fileName);
+      }
+      name.resize(length);
+      ifs.read(name.data(), name.size());
+    }
+    const auto nWords = (nEntries + 63) / 64;
+    if (!ifs || nEntries > fileSize ||
+        fileSize != uint64_t(ifs.tellg()) + nEntries * sizeof(Timestamp_t) +
+                        flagNames.size() * nWords * sizeof(uint64_t)) {
+      throw DELILA::FileException("Truncated event index: " + fileName);
+    }
+
+    EventIndex index(std::move(flagNames));
+    index.fTimes.resize(nEntries);
+    ifs.read(reinterpret_cast<char *>(index.fTimes.data()),
+             nEntries * sizeof(Timestamp_t));
+    for (auto &bits : index.fFlagBits) {
+      bits.resize(nWords);
+      ifs.read(reinterpret_cast<char *>(bits.data()),
+               nWords * sizeof(uint64_t));
+    }
+    if (!ifs) {
+      throw DELILA::FileException("Could not read event index: " + fileName);
+    }
+    for (size_t i = 0; i < nEntries; i++) {
+      if (i == 0 || index.fTimes[i] < index.fTimes[i - 1]) {
+        index.fRunStarts.push_back(i);
+      }
+    }
+    return index;
+  };
+
+  // Index of a TChain of the output files, in the same order: the selected
+  // entries are entries of the chain
+  static EventIndex Load(const std::vector<std::string> &outputFileNames)
+  {
+    EventIndex chain;
+    for (size_t i = 0; i < outputFileNames.size(); i++) {
+      auto index = Load(GetIndexFileName(outputFileNames[i]));
+      if (i == 0) {
+        chain = EventIndex(index.fFlagNames);
+      }
+      chain.Append(index);
+    }
+    return chain;
+  };
+
+ private:
+  static constexpr char kMagic[8] = {'E', 'L', 'I', 'F', 'I', 'D', 'X', '1'};
+
+  std::vector<std::string> fFlagNames;
+  std::vector<Timestamp_t> fTimes;
+  std::vector<std::vector<uint64_t>> fFlagBits;  // Per flag, bit = entry
+  std::vector<size_t> fRunStarts;
+
+  template <typename T>
+  static void Write(std::ostream &os, const T value)
+  {
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  };
+  template <typename T>
+  static T Read(std::istream &is)
+  {
+    T value{};
+    is.read(reinterpret_cast<char *>(&value), sizeof(T));
+    return value;
+  };
+};
+
+}  // namespace DELILA
+
+#endif
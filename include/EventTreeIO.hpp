@@ -0,0 +1,229 @@
+#ifndef EventTreeIO_hpp
+#define EventTreeIO_hpp 1
+
+#include <TBranch.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "DELILAExceptions.hpp"
+#include "EventData.hpp"
+#include "Timestamp.hpp"
+
+namespace DELILA
+{
+
+// Layout of the L1EventData / L2EventData trees
+//   Object  TriggerTime/D + EventDataVec (std::vector<RawData_t>, dictionary)
+//   Flat    TriggerTime/D + nHits/i + one array branch per RawData_t member:
+//           IsWithAC[nHits]/O Mod[nHits]/b Ch[nHits]/b ChargeLong[nHits]/s
+//           ChargeShort[nHits]/s FineTS[nHits]/D
+// Both have TriggerTimePs/L, the exact trigger time in integer ps.
+// The flat layout needs no dictionary and every column can be read alone.
+enum class EventFormat { Object = 0, Flat = 1 };
+
+inline EventFormat GetEventFormat(std::string name)
+{
+  std::transform(name.begin(), name.end(), name.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  if (name == "object") {
+    return EventFormat::Object;
+  } else if (name == "flat") {
+    return EventFormat::Flat;
+  }
+  throw ConfigException("Unknown output format: " + name +
+                        " (Object or Flat)");
+}
+
+inline std::string GetEventFormatName(const EventFormat format)
+{
+  return format == EventFormat::Flat ? "Flat" : "Object";
+}
+
+// Column buffers of the flat layout
+struct FlatEventColumns {
+  UInt_t nHits = 0;
+  std::vector<UChar_t> isWithAC;  // std::vector<Bool_t> has no data()
+  std::vector<UChar_t> mod;
+  std::vector<UChar_t> ch;
+  std::vector<UShort_t> chargeLong;
+  std::vector<UShort_t> chargeShort;
+  std::vector<Double_t> fineTS;
+
+  void Resize(const size_t n)
+  {
+    isWithAC.resize(n);
+    mod.resize(n);
+    ch.resize(n);
+    chargeLong.resize(n);
+    chargeShort.resize(n);
+    fineTS.resize(n);
+  };
+  // One byte Bool_t, the type check of SetBranchAddress needs the exact type
+  Bool_t *IsWithACBuffer()
+  {
+    return reinterpret_cast<Bool_t *>(isWithAC.data());
+  };
+  // Buffers may move when they grow
+  void SetAddresses(TTree *tree)
+  {
+    tree->SetBranchAddress("IsWithAC", IsWithACBuffer());
+    tree->SetBranchAddress("Mod", mod.data());
+    tree->SetBranchAddress("Ch", ch.data());
+    tree->SetBranchAddress("ChargeLong", chargeLong.data());
+    tree->SetBranchAddress("ChargeShort", chargeShort.data());
+    tree->SetBranchAddress("FineTS", fineTS.data());
+  };
+};
+
+// Creates the event branches and fills one entry per Fill().
+// Other branches (L2 flags and counters) can be added to the tree as usual.
+class EventTreeWriter
+{
+ public:
+  EventTreeWriter(TTree *tree, EventData &eventData,
+                  const EventFormat format = EventFormat::Object)
+      : fTree(tree), fEventData(eventData), fFormat(format)
+  {
+    fTree->Branch("TriggerTime", &fEventData.triggerTime, "TriggerTime/D");
+    fTree->Branch("TriggerTimePs", &fEventData.triggerTimePs,
+                  "TriggerTimePs/L");
+    if (fFormat == EventFormat::Object) {
+      fTree->Branch("EventDataVec", &fEventData.eventDataVec);
+      return;
+    }
+
+    fColumns.Resize(kInitialHits);
+    fCapacity = kInitialHits;
+    fTree->Branch("nHits", &fColumns.nHits, "nHits/i");
+    fTree->Branch("IsWithAC", fColumns.IsWithACBuffer(), "IsWithAC[nHits]/O");
+    fTree->Branch("Mod", fColumns.mod.data(), "Mod[nHits]/b");
+    fTree->Branch("Ch", fColumns.ch.data(), "Ch[nHits]/b");
+    fTree->Branch("ChargeLong", fColumns.chargeLong.data(),
+                  "ChargeLong[nHits]/s");
+    fTree->Branch("ChargeShort", fColumns.chargeShort.data(),
+                  "ChargeShort[nHits]/s");
+    fTree->Branch("FineTS", fColumns.fineTS.data(), "FineTS[nHits]/D");
+  };
+  ~EventTreeWriter() = default;
+
+  EventFormat GetFormat() const { return fFormat; };
+
+  Int_t Fill()
+  {
+    if (fFormat == EventFormat::Flat) {
+      const auto &hits = *fEventData.eventDataVec;
+      const auto n = hits.size();
+      if (n > fCapacity) {
+        fCapacity = std::max(n, 2 * fCapacity);
+        fColumns.Resize(fCapacity);
+        fColumns.SetAddresses(fTree);
+      }
+      fColumns.nHits = n;
+      for (size_t i = 0; i < n; i++) {
+        fColumns.isWithAC[i] = hits[i].isWithAC;
+        fColumns.mod[i] = hits[i].mod;
+        fColumns.ch[i] = hits[i].ch;
+        fColumns.chargeLong[i] = hits[i].chargeLong;
+        fColumns.chargeShort[i] = hits[i].chargeShort;
+        fColumns.fineTS[i] = hits[i].fineTS;
+      }
+    }
+    return fTree->Fill();
+  };
+
+ private:
+  static constexpr size_t kInitialHits = 256;
+
+  TTree *fTree;
+  EventData &fEventData;
+  EventFormat fFormat;
+  FlatEventColumns fColumns;
+  size_t fCapacity = 0;
+};
+
+// Reads either layout into an EventData, so the caller does not need to
+// know how the file was written.  TTree::GetEntry is used, so any other
+// branch with an address (L2 counters, flags) is read as well.
+// Works with TChain.
+class EventTreeReader
+{
+ public:
+  enum Column : uint32_t {
+    kIsWithAC = 1 << 0,
+    kMod = 1 << 1,
+    kCh = 1 << 2,
+    kChargeLong = 1 << 3,
+    kChargeShort = 1 << 4,
+    kFineTS = 1 << 5,
+    kAll = 0x3F,
+  };
+
+  // Columns which are not requested stay 0 (flat layout only)
+  EventTreeReader(TTree *tree, EventData &eventData,
+                  const uint32_t columns = kAll)
+      : fTree(tree), fEventData(eventData)
+  {
+    fFormat = tree->GetBranch("nHits") ? EventFormat::Flat
+                                       : EventFormat::Object;
+    fTree->SetBranchAddress("TriggerTime", &fEventData.triggerTime);
+    // Files written before TriggerTimePs get it rounded from TriggerTime
+    fHasTriggerTimePs = (tree->GetBranch("TriggerTimePs") != nullptr);
+    if (fHasTriggerTimePs) {
+      fTree->SetBranchAddress("TriggerTimePs", &fEventData.triggerTimePs);
+    }
+    if (fFormat == EventFormat::Object) {
+      fTree->SetBranchAddress("EventDataVec", &fEventData.eventDataVec);
+      return;
+    }
+
+    // Variable length arrays are read into fixed buffers
+    const auto maxHits = std::max<Long64_t>(1, fTree->GetMaximum("nHits"));
+    fColumns.Resize(maxHits);
+    fTree->SetBranchAddress("nHits", &fColumns.nHits);
+    fColumns.SetAddresses(fTree);
+    const std::pair<Column, const char *> names[] = {
+        {kIsWithAC, "IsWithAC"},     {kMod, "Mod"},
+        {kCh, "Ch"},                 {kChargeLong, "ChargeLong"},
+        {kChargeShort, "ChargeShort"}, {kFineTS, "FineTS"}};
+    for (const auto &[column, name] : names) {
+      fTree->SetBranchStatus(name, (columns & column) ? kTRUE : kFALSE);
+    }
+  };
+  ~EventTreeReader() = default;
+
+  EventFormat GetFormat() const { return fFormat; };
+
+  Int_t GetEntry(const Long64_t entry)
+  {
+    const auto nBytes = fTree->GetEntry(entry);
+    if (!fHasTriggerTimePs && nBytes > 0) {
+      fEventData.triggerTimePs = NsToTimestamp(fEventData.triggerTime);
+    }
+    if (fFormat == EventFormat::Flat && nBytes > 0) {
+      auto &hits = *fEventData.eventDataVec;
+      const size_t n = fColumns.nHits;
+      hits.resize(n);
+      for (size_t i = 0; i < n; i++) {
+        hits[i] = RawData_t(fColumns.isWithAC[i] != 0, fColumns.mod[i],
+                            fColumns.ch[i], fColumns.chargeLong[i],
+                            fColumns.chargeShort[i], fColumns.fineTS[i]);
+      }
+    }
+    return nBytes;
+  };
+
+ private:
+  TTree *fTree;
+  EventData &fEventData;
+  EventFormat fFormat = EventFormat::Object;
+  bool fHasTriggerTimePs = false;
+  FlatEventColumns fColumns;
+};
+
+}  // namespace DELILA
+
+#endif
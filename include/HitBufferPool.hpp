@@ -0,0 +1,88 @@
+#ifndef HitBufferPool_hpp
+#define HitBufferPool_hpp 1
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "RawHit.hpp"
+
+namespace DELILA
+{
+
+// Contiguous value buffer of hits, no per hit heap allocation
+typedef std::vector<RawHit_t> HitVec_t;
+
+// Recycles hit buffers between the readers, the merger and the builders.
+// Released buffers are cleared but keep their capacity, so after the first
+// few chunks no buffer is allocated or grown any more.
+class HitBufferPool
+{
+ public:
+  explicit HitBufferPool(const size_t maxBuffers = 64)
+      : fMaxBuffers(maxBuffers) {};
+  ~HitBufferPool() = default;
+
+  HitBufferPool(const HitBufferPool &) = delete;
+  HitBufferPool &operator=(const HitBufferPool &) = delete;
+
+  // Returns an empty buffer with at least the requested capacity
+  HitVec_t Acquire(const size_t capacity = 0)
+  {
+    HitVec_t buffer;
+    {
+      std::lock_guard<std::mutex> lock(fMutex);
+      // Prefer a buffer that is already large enough
+      for (size_t i = fBuffers.size(); i > 0; i--) {
+        if (fBuffers[i - 1].capacity() >= capacity) {
+          buffer.swap(fBuffers[i - 1]);
+          fBuffers[i - 1].swap(fBuffers.back());
+          fBuffers.pop_back();
+          break;
+        }
+      }
+      if (buffer.capacity() == 0 && !fBuffers.empty()) {
+        buffer.swap(fBuffers.back());
+        fBuffers.pop_back();
+      }
+    }
+    buffer.reserve(capacity);
+    return buffer;
+  };
+
+  void Release(HitVec_t &&buffer)
+  {
+    if (buffer.capacity() == 0) {
+      return;
+    }
+    buffer.clear();
+    std::lock_guard<std::mutex> lock(fMutex);
+    if (fBuffers.size() < fMaxBuffers) {
+      fBuffers.emplace_back(std::move(buffer));
+    }
+  };
+
+  void SetMaxBuffers(const size_t maxBuffers)
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    fMaxBuffers = maxBuffers;
+    if (fBuffers.size() > fMaxBuffers) {
+      fBuffers.resize(fMaxBuffers);
+    }
+  };
+
+  size_t Size()
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    return fBuffers.size();
+  };
+
+ private:
+  size_t fMaxBuffers;
+  std::vector<HitVec_t> fBuffers;
+  std::mutex fMutex;
+};
+
+}  // namespace DELILA
+
+#endif
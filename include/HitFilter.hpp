@@ -0,0 +1,233 @@
+#ifndef HitFilter_hpp
+#define HitFilter_hpp 1
+
+#include <RtypesCore.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ChannelTable.hpp"
+#include "RawTreeReader.hpp"
+#include "Timestamp.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define DELILA_HIT_FILTER_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace DELILA
+{
+
+// Hits of one RawColumns block which pass the filter, in entry order
+struct FilteredHits {
+  size_t nHits = 0;
+  std::vector<uint32_t> entry;     // Index in the block
+  std::vector<uint32_t> index;     // Flat channel index of the ChannelTable
+  std::vector<Timestamp_t> time;  // [ps], time offset subtracted
+
+  size_t size() const { return nHits; };
+};
+
+// Ingestion step shared by L1EventBuilder and TimeAlignment: drops unknown
+// channels and hits with chargeLong <= thresholdADC, rounds FineTS to an
+// integer ps time stamp and subtracts the channel time offset.
+// Channel lookups are two table reads per hit (key mod << 8 | ch -> flat
+// index -> threshold / offset), there is no branch per hit.  Unknown
+// channels point to a sentinel row whose threshold no charge exceeds.
+// The AVX2 kernel does the lookups and the threshold of 8 hits per step
+// with gathers and compacts the survivors with a permutation table; it is
+// chosen at run time if the CPU has AVX2.  The time stamps of the
+// survivors are converted afterwards (AVX2 has no double -> int64), so
+// both kernels give identical results.
+// Filter() is const, one filter can be shared by all threads.
+class HitFilter
+{
+ public:
+  enum class Kernel : uint8_t {
+    Scalar = 0,
+    AVX2,
+  };
+
+  HitFilter() = default;
+  // applyTimeOffset == false: times are only converted to integer ps
+  explicit HitFilter(const ChannelTable &table,
+                     const bool applyTimeOffset = true)
+  {
+    Build(table, applyTimeOffset);
+  };
+  ~HitFilter() = default;
+
+  void Build(const ChannelTable &table, const bool applyTimeOffset = true)
+  {
+    const auto sentinel = int32_t(table.Size());
+    fKeyIndex.assign(kNKeys, sentinel);
+    fThreshold.assign(table.Size() + 1, kMaxCharge);
+    fOffset.assign(table.Size() + 1, 0);
+    for (uint32_t mod = 0; mod < table.GetNModules(); mod++) {
+      for (uint32_t ch = 0; ch < table.GetNChannels(); ch++) {
+        if (!table.IsValid(mod, ch)) {
+          continue;
+        }
+        const auto index = table.Index(mod, ch);
+        const auto &info = table[index];
+        fKeyIndex[(mod << 8) | ch] = index;
+        fThreshold[index] = std::min<uint32_t>(info.thresholdADC, kMaxCharge);
+        fOffset[index] = applyTimeOffset ? info.timeOffset : 0;
+      }
+    }
+    fKernel = GetBestKernel();
+  };
+
+  static Kernel GetBestKernel()
+  {
+#ifdef DELILA_HIT_FILTER_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+      return Kernel::AVX2;
+    }
+#endif
+    return Kernel::Scalar;
+  };
+  static std::string GetKernelName(const Kernel kernel)
+  {
+    return kernel == Kernel::AVX2 ? "AVX2" : "Scalar";
+  };
+
+  // Kernels the CPU can not run fall back to the scalar one
+  void SetKernel(const Kernel kernel)
+  {
+    fKernel = (kernel == Kernel::AVX2 && GetBestKernel() != Kernel::AVX2)
+                  ? Kernel::Scalar
+                  : kernel;
+  };
+  Kernel GetKernel() const { return fKernel; };
+
+  // Needs the Mod, Ch, FineTS and ChargeLong columns.  Returns out.size().
+  size_t Filter(const RawColumns &block, FilteredHits &out) const
+  {
+    const auto n = block.size();
+    // The kernels store whole vectors and advance by the survivors
+    if (out.entry.size() < n + kVectorHits) {
+      out.entry.resize(n + kVectorHits);
+      out.index.resize(n + kVectorHits);
+      out.time.resize(n + kVectorHits);
+    }
+    out.nHits = 0;
+    if (fKeyIndex.empty()) {
+      return 0;
+    }
+    size_t begin = 0;
+#ifdef DELILA_HIT_FILTER_AVX2
+    if (fKernel == Kernel::AVX2) {
+      begin = FilterAVX2(block, out);
+      for (size_t k = 0; k < out.nHits; k++) {
+        out.time[k] =
+            ToTimestamp(block.fineTS[out.entry[k]]) - fOffset[out.index[k]];
+      }
+    }
+#endif
+    FilterScalar(block, begin, out);
+    return out.nHits;
+  };
+
+ private:
+  static constexpr size_t kNKeys = 1 << 16;
+  static constexpr int32_t kMaxCharge = 0xFFFF;  // No UShort_t is above
+  static constexpr size_t kVectorHits = 8;
+
+  Kernel fKernel = Kernel::Scalar;
+  std::vector<int32_t> fKeyIndex;   // mod << 8 | ch -> flat index
+  std::vector<int32_t> fThreshold;  // Per flat index, + sentinel row
+  std::vector<Timestamp_t> fOffset;
+
+  void FilterScalar(const RawColumns &block, const size_t begin,
+                    FilteredHits &out) const
+  {
+    auto k = out.nHits;
+    for (size_t i = begin; i < block.size(); i++) {
+      const auto index =
+          fKeyIndex[(uint32_t(block.mod[i]) << 8) | block.ch[i]];
+      // Written unconditionally, kept only if the hit passes
+      out.entry[k] = i;
+      out.index[k] = index;
+      out.time[k] = ToTimestamp(block.fineTS[i]) - fOffset[index];
+      k += (int32_t(block.chargeLong[i]) > fThreshold[index]);
+    }
+    out.nHits = k;
+  };
+
+#ifdef DELILA_HIT_FILTER_AVX2
+  // Lane indices of the set bits of a mask, low lanes first
+  struct CompressTables {
+    std::array<std::array<int32_t, 8>, 256> lanes8;
+    CompressTables()
+    {
+      for (uint32_t mask = 0; mask < 256; mask++) {
+        uint32_t k = 0;
+        lanes8[mask].fill(0);
+        for (uint32_t lane = 0; lane < 8; lane++) {
+          if (mask & (1 << lane)) lanes8[mask][k++] = lane;
+        }
+      }
+    };
+  };
+  static const CompressTables &GetCompressTables()
+  {
+    static const CompressTables tables;
+    return tables;
+  };
+
+  // Whole steps of 8 hits, returns the first entry left for the scalar tail
+  __attribute__((target("avx2"))) size_t FilterAVX2(const RawColumns &block,
+                                                    FilteredHits &out) const
+  {
+    const auto &tables = GetCompressTables();
+    const auto n = block.size() / kVectorHits * kVectorHits;
+    const auto *mod = block.mod.data();
+    const auto *ch = block.ch.data();
+    const auto *charge = block.chargeLong.data();
+    const auto laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    auto k = out.nHits;
+
+    for (size_t i = 0; i < n; i += kVectorHits) {
+      const auto modBytes =
+          _mm_loadl_epi64(reinterpret_cast<const __m128i *>(mod + i));
+      const auto chBytes =
+          _mm_loadl_epi64(reinterpret_cast<const __m128i *>(ch + i));
+      const auto key = _mm256_or_si256(
+          _mm256_slli_epi32(_mm256_cvtepu8_epi32(modBytes), 8),
+          _mm256_cvtepu8_epi32(chBytes));
+      const auto index = _mm256_i32gather_epi32(fKeyIndex.data(), key, 4);
+      const auto threshold =
+          _mm256_i32gather_epi32(fThreshold.data(), index, 4);
+      const auto charges = _mm256_cvtepu16_epi32(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(charge + i)));
+      const uint32_t mask = _mm256_movemask_ps(
+          _mm256_castsi256_ps(_mm256_cmpgt_epi32(charges, threshold)));
+      if (mask == 0) {
+        continue;
+      }
+
+      const auto lanes8 = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(tables.lanes8[mask].data()));
+      const auto entries = _mm256_add_epi32(
+          _mm256_set1_epi32(int32_t(i)), laneOffsets);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(&out.entry[k]),
+                          _mm256_permutevar8x32_epi32(entries, lanes8));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(&out.index[k]),
+                          _mm256_permutevar8x32_epi32(index, lanes8));
+
+      k += __builtin_popcount(mask);
+    }
+    out.nHits = k;
+    return n;
+  };
+#endif
+};
+
+}  // namespace DELILA
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef HitSorter_hpp
+#define HitSorter_hpp 1
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace DELILA
+{
+
+// Time stamp sort for raw hit chunks.
+// DAQ data arrive almost in time order: hits of every channel are written
+// in order and only the channels are interleaved.  The sorter checks this
+// first and uses the cheapest method that is still exact:
+//   Sorted        nothing to do
+//   ChannelMerge  every (mod, ch) stream is monotone -> k-way merge of them
+//   Radix         out of order data -> LSD radix sort on the integer key
+//   Comparison    small inputs -> std::sort
+// One sorter per thread, the scratch buffers are kept between chunks.
+template <typename T>
+class HitSorter
+{
+ public:
+  enum class Method { Sorted = 0, ChannelMerge, Radix, Comparison };
+
+  HitSorter() = default;
+  ~HitSorter() = default;
+
+  // Order preserving map of a double time stamp to an unsigned integer
+  static uint64_t OrderedKey(const double ts)
+  {
+    uint64_t bits;
+    std::memcpy(&bits, &ts, sizeof(bits));
+    constexpr uint64_t signBit = uint64_t(1) << 63;
+    return (bits & signBit) ? ~bits : (bits ^ signBit);
+  };
+  // Same for an integer time stamp (Timestamp_t)
+  static uint64_t OrderedKey(const int64_t ts)
+  {
+    constexpr uint64_t signBit = uint64_t(1) << 63;
+    return uint64_t(ts) ^ signBit;
+  };
+
+  // timeKey(const T &) -> uint64_t, channelKey(const T &) -> uint16_t
+  template <typename TimeKey, typename ChannelKey>
+  Method Sort(std::vector<T> &hits, TimeKey timeKey, ChannelKey channelKey)
+  {
+    const auto nHits = hits.size();
+    Method method = Method::Sorted;
+    if (nHits < 2) {
+      // Nothing to do
+    } else if (IsSorted(hits, timeKey)) {
+      method = Method::Sorted;
+    } else if (nHits < kMinRadixSize) {
+      std::sort(hits.begin(), hits.end(), [&timeKey](const T &a, const T &b) {
+        return timeKey(a) < timeKey(b);
+      });
+      method = Method::Comparison;
+    } else if (ChannelMerge(hits, timeKey, channelKey)) {
+      method = Method::ChannelMerge;
+    } else {
+      RadixSort(hits, timeKey);
+      method = Method::Radix;
+    }
+    fCounter[static_cast<int>(method)]++;
+    return method;
+  };
+
+  uint64_t GetNumberOfSorts(const Method method) const
+  {
+    return fCounter[static_cast<int>(method)];
+  };
+
+ private:
+  static constexpr size_t kMinRadixSize = 256;
+  static constexpr uint32_t kNoStream = 0xFFFFFFFF;
+
+  std::vector<T> fScratch;
+  std::vector<uint32_t> fStreamID;  // channel key -> dense stream index
+  std::vector<uint64_t> fStreamLast;
+  std::vector<size_t> fStreamBegin;
+  std::vector<size_t> fStreamEnd;
+  std::vector<std::pair<uint64_t, uint32_t>> fHeap;
+  std::array<uint64_t, 4> fCounter = {0, 0, 0, 0};
+
+  template <typename TimeKey>
+  static bool IsSorted(const std::vector<T> &hits, TimeKey &timeKey)
+  {
+    auto last = timeKey(hits[0]);
+    for (size_t i = 1; i < hits.size(); i++) {
+      const auto key = timeKey(hits[i]);
+      if (key < last) {
+        return false;
+      }
+      last = key;
+    }
+    return true;
+  };
+
+  template <typename TimeKey, typename ChannelKey>
+  bool ChannelMerge(std::vector<T> &hits, TimeKey &timeKey,
+                    ChannelKey &channelKey)
+  {
+    // Pass 1: find the channel streams and check that each is monotone
+    fStreamID.assign(1 << 16, kNoStream);
+    fStreamLast.clear();
+    fStreamEnd.clear();  // Used as counter first
+    for (const auto &hit : hits) {
+      const uint16_t channel = channelKey(hit);
+      auto &id = fStreamID[channel];
+      const auto key = timeKey(hit);
+      if (id == kNoStream) {
+        id = fStreamLast.size();
+        fStreamLast.push_back(key);
+        fStreamEnd.push_back(0);
+      } else if (key < fStreamLast[id]) {
+        return false;  // Out of order inside one channel
+      }
+      fStreamLast[id] = key;
+      fStreamEnd[id]++;
+    }
+    const auto nStreams = fStreamLast.size();
+
+    // Pass 2: stable scatter into contiguous streams
+    fStreamBegin.resize(nStreams);
+    size_t offset = 0;
+    for (size_t i = 0; i < nStreams; i++) {
+      fStreamBegin[i] = offset;
+      offset += fStreamEnd[i];
+      fStreamEnd[i] = fStreamBegin[i];
+    }
+    fScratch.resize(hits.size());
+    for (const auto &hit : hits) {
+      const auto id = fStreamID[channelKey(hit)];
+      fScratch[fStreamEnd[id]++] = hit;
+    }
+
+    // Pass 3: k-way merge back.  Runs of one stream are copied in one go as
+    // long as they are earlier than the head of all other streams.
+    fHeap.clear();
+    for (uint32_t i = 0; i < nStreams; i++) {
+      fHeap.emplace_back(timeKey(fScratch[fStreamBegin[i]]), i);
+    }
+    std::make_heap(fHeap.begin(), fHeap.end(), std::greater<>());
+    size_t out = 0;
+    while (!fHeap.empty()) {
+      std::pop_heap(fHeap.begin(), fHeap.end(), std::greater<>());
+      const auto stream = fHeap.back().second;
+      fHeap.pop_back();
+      auto &pos = fStreamBegin[stream];
+      const auto end = fStreamEnd[stream];
+      if (fHeap.empty()) {
+        std::copy(fScratch.begin() + pos, fScratch.begin() + end,
+                  hits.begin() + out);
+        out += end - pos;
+        break;
+      }
+      const auto next = fHeap.front().first;
+      do {
+        hits[out++] = fScratch[pos++];
+      } while (pos < end && timeKey(fScratch[pos]) <= next);
+      if (pos < end) {
+        fHeap.emplace_back(timeKey(fScratch[pos]), stream);
+        std::push_heap(fHeap.begin(), fHeap.end(), std::greater<>());
+      }
+    }
+
+    return true;
+  };
+
+  template <typename TimeKey>
+  void RadixSort(std::vector<T> &hits, TimeKey &timeKey)
+  {
+    constexpr int nDigits = 8;
+    const auto nHits = hits.size();
+
+    // All digit histograms in one pass
+    std::vector<std::array<size_t, 256>> count(nDigits);
+    for (auto &c : count) {
+      c.fill(0);
+    }
+    for (const auto &hit : hits) {
+      auto key = timeKey(hit);
+      for (int d = 0; d < nDigits; d++) {
+        count[d][(key >> (8 * d)) & 0xFF]++;
+      }
+    }
+
+    fScratch.resize(nHits);
+    auto *src = &hits;
+    auto *dst = &fScratch;
+    for (int d = 0; d < nDigits; d++) {
+      auto &c = count[d];
+      // The high digits of a chunk are usually all the same, skip them
+      if (std::any_of(c.begin(), c.end(),
+                      [nHits](size_t n) { return n == nHits; })) {
+        continue;
+      }
+      std::array<size_t, 256> offset;
+      size_t sum = 0;
+      for (int b = 0; b < 256; b++) {
+        offset[b] = sum;
+        sum += c[b];
+      }
+      const int shift = 8 * d;
+      for (const auto &hit : *src) {
+        (*dst)[offset[(timeKey(hit) >> shift) & 0xFF]++] = hit;
+      }
+      std::swap(src, dst);
+    }
+    if (src != &hits) {
+      hits.swap(fScratch);
+    }
+  };
+};
+
+}  // namespace DELILA
+
+#endif
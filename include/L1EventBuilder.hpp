@@ -11,10 +11,23 @@
 #include <string>
 #include <thread>
 #include <tuple>
+#include <nlohmann/json.hpp>
 #include <vector>
 
+#include "ACTagger.hpp"
+#include "AsyncEventWriter.hpp"
+#include "BoundedQueue.hpp"
 #include "ChSettings.hpp"
+#include "ChannelTable.hpp"
 #include "EventData.hpp"
+#include "EventTreeIO.hpp"
+#include "HitFilter.hpp"
+#include "L2Selector.hpp"
+#include "OutputSettings.hpp"
+#include "RunMetrics.hpp"
+#include "TimeOrderedMerger.hpp"
+#include "TimeSettings.hpp"
+#include "WorkerTiming.hpp"
 
 namespace DELILA
 {
@@ -26,7 +39,10 @@ class L1EventBuilder
   ~L1EventBuilder();
 
   void LoadChSettings(const std::string &fileName);
-  void LoadFileList(const std::vector<std::string> &fileList);
+  // Entries per file (from the run catalog, -1: unknown) save opening
+  // every file before the build
+  void LoadFileList(const std::vector<std::string> &fileList,
+                    const std::vector<int64_t> &fileEntries = {});
   void LoadTimeSettings(const std::string &fileName);
   void SetTimeWindow(double_t timeWindow) { fTimeWindow = timeWindow; }
   void SetCoincidenceWindow(double_t coincidenceWindow)
@@ -35,26 +51,110 @@ class L1EventBuilder
   }
   void SetRefMod(uint8_t mod) { fRefMod = mod; }
   void SetRefCh(uint8_t ch) { fRefCh = ch; }
+  void SetOutputFormat(const EventFormat format) { fOutputFormat = format; }
+  void SetOutputSettings(const OutputSettings &settings)
+  {
+    fOutputSettings = settings;
+  }
+  // Fused L1 -> L2 mode: apply the L2 selection to the built events and
+  // write L2_N.root instead of L1_N.root
+  void SetL2Selector(const L2Selector &selector)
+  {
+    fL2Selector = std::make_unique<L2Selector>(selector);
+  }
+
+  // Sharded mode: only triggers in [startTS, endTS) [ps] are built, the
+  // hits outside still complete the events at the edges
+  void SetOwnedRange(const Timestamp_t startTS, const Timestamp_t endTS)
+  {
+    fOwnedStartTS = startTS;
+    fOwnedEndTS = endTS;
+  }
+  // Checkpoints every nTasks chunks (0: none), see Checkpoint.hpp.  An
+  // interrupted BuildEvent of the same files and settings resumes there.
+  void SetCheckpointTasks(const uint32_t nTasks) { fCheckpointTasks = nTasks; }
+  // L1_N.idx / L2_N.idx next to every output, see EventIndex.hpp
+  void SetWriteEventIndex(const bool write) { fWriteEventIndex = write; }
+  // true: a line for every chunk read, besides the metrics
+  void SetVerbose(const bool verbose) { fVerbose = verbose; }
 
   void BuildEvent(const uint32_t nThreads);
+  // Follow mode: builds the given files (the next closed versions of the
+  // run) on top of the ones before.  The merge state at the end of the
+  // files is carried over, events across the file boundary are built once,
+  // by a later increment.  Every increment writes its own output files,
+  // L1_N.root numbered on from the last increment.
+  void BuildIncrement(const std::vector<std::string> &fileList,
+                      const std::vector<int64_t> &fileEntries,
+                      const uint32_t nThreads);
+  // Builds what the increments kept back, after the last one
+  void FinishIncrements(const uint32_t nThreads);
   void Cancel() { fCancelled.store(true); }
+  // Set by Ctrl-C, the follow mode stops waiting for files on it
+  const std::atomic<bool> &GetCancelFlag() const { return fCancelled; }
+  // Stages read (merger readers), build and write (per worker)
+  RunMetrics &GetMetrics() { return fMetrics; }
 
  private:
   std::vector<std::vector<ChSettings_t>> fChSettingsVec;
-  std::vector<std::vector<std::vector<std::vector<double_t>>>> fTimeSettingsVec;
+  TimeSettings fTimeSettings;
+  std::vector<std::vector<double_t>> fTimeOffsets;  // Of the reference
+  ChannelTable fChannelTable;  // Hot path copy, offsets of the reference row
+  HitFilter fHitFilter;        // Threshold and offset step of the reader
   double_t fTimeWindow = 0.;
   double_t fCoincidenceWindow = 0.;
   uint8_t fRefMod = 0;
   uint8_t fRefCh = 0;
+  EventFormat fOutputFormat = EventFormat::Object;
+  OutputSettings fOutputSettings;
+  std::unique_ptr<L2Selector> fL2Selector;  // Prototype, copied per worker
   std::vector<std::string> fFileList;
+  std::vector<int64_t> fFileEntries;
   std::mutex fFileListMutex;
+  std::vector<WorkerTiming_t> fWorkerTimings;
   std::atomic<bool> fCancelled{false};
+  RunMetrics fMetrics;
+  // Follow mode: merge state between the increments, next output file
+  std::unique_ptr<TimeOrderedMerger> fMerger;
+  uint32_t fOutputIndex = 0;
+  uint32_t fCheckpointTasks = 0;
+  bool fWriteEventIndex = true;
+  bool fVerbose = false;
+  Timestamp_t fOwnedStartTS = kMinTimestamp;
+  Timestamp_t fOwnedEndTS = kMaxTimestamp;
 
   // Chunked processing configuration to limit memory usage
   static constexpr Long64_t CHUNK_SIZE = 10000000;  // 10M entries per chunk
-  static constexpr Long64_t OVERLAP_SIZE = 10000;    // 10k entries overlap for coincidence window
+  // Time slices of 1M merged hits per builder task, padded by exactly
+  // +-fCoincidenceWindow so no event is cut at a slice edge
+  static constexpr size_t SLICE_SIZE = 1000000;
+
+  // Timestamp reset detection with 10-second threshold
+  // Electronics/DAQ can have small timing variations, so only consider it a
+  // reset if timestamp jumped backwards by more than 10 seconds
+  static constexpr Timestamp_t TIMESTAMP_RESET_THRESHOLD =
+      Timestamp_t(10e9) * kPsPerNs;  // 10 seconds in ps
+
 
-  void DataReader(int threadID, std::vector<std::string> fileList);
+  void Prepare(const uint32_t nThreads);
+  std::unique_ptr<TimeOrderedMerger> MakeMerger(std::vector<ChunkTask> tasks);
+  // Builds the slices of one merger run on nThreads workers
+  void RunSlices(TimeOrderedMerger &merger, const uint32_t nThreads,
+                 const bool endOfData);
+  // Rounds of fCheckpointTasks chunks, resumed from the last checkpoint
+  std::unique_ptr<TimeOrderedMerger> RunCheckpointed(
+      const std::vector<ChunkTask> &tasks, const uint32_t nThreads);
+  nlohmann::json MakeFingerprint(const size_t nTasks) const;
+  std::vector<ChunkTask> MakeChunkTasks(const size_t firstFile = 0);
+  void AddChunkTasks(std::vector<ChunkTask> &tasks, const size_t fileIndex,
+                     const Long64_t nEntries);
+  HitVec_t DataReader(const ChunkTask &task, HitVec_t &&rawDataVec);
+  void EventWorker(int threadID, uint32_t outputIndex,
+                   BoundedQueue<HitSlice> &sliceQueue,
+                   HitBufferPool &bufferPool);
+  void BuildSlice(const HitSlice &slice, ACTagger &acTagger,
+                  L2Selector *selector, AsyncEventWriter &writer,
+                  StageMetrics &metrics);
 };
 
 }  // namespace DELILA
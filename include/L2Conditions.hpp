@@ -31,6 +31,10 @@ class L2Counter
     }
   };
   void ResetCounter() { counter = 0; };
+  const std::vector<std::vector<bool>> &GetConditionTable() const
+  {
+    return fConditionTable;
+  };
 
   std::string name;
   uint64_t counter;
@@ -55,6 +59,10 @@ class L2Flag
   std::string name;
   bool flag;
 
+  const std::string &GetMonitorName() const { return fMonitorName; };
+  const std::string &GetCondition() const { return fCondition; };
+  int32_t GetValue() const { return fValue; };
+
   void Check(std::vector<L2Counter> &counterVec)
   {
     flag = false;
@@ -97,6 +105,9 @@ class L2DataAcceptance
       : fMonitorVec(monitorVec), fLogicalOperator(logicalOperator) {};
   ~L2DataAcceptance() = default;
 
+  const std::vector<std::string> &GetMonitors() const { return fMonitorVec; };
+  const std::string &GetLogicalOperator() const { return fLogicalOperator; };
+
   bool Check(std::vector<L2Flag> &flagVec)
   {
     uint32_t checkCounter = 0;
@@ -11,12 +11,27 @@
 #include <vector>
 
 #include "ChSettings.hpp"
+#include "ChannelTable.hpp"
 #include "EventData.hpp"
+#include "EventTreeIO.hpp"
 #include "L2Conditions.hpp"
+#include "L2Selector.hpp"
+#include "OutputSettings.hpp"
+#include "RunMetrics.hpp"
+#include "WorkStealingQueue.hpp"
 
 namespace DELILA
 {
 
+const std::string kL2MergedFileName = "L2Event.root";
+
+// Entry range [firstEntry, lastEntry) of one L1 file, whole clusters
+struct L2Task {
+  size_t fileIndex = 0;
+  Long64_t firstEntry = 0;
+  Long64_t lastEntry = 0;
+};
+
 class L2EventBuilder
 {
  public:
@@ -25,32 +40,76 @@ class L2EventBuilder
 
   void LoadChSettings(const std::string &fileName);
   void LoadL2Settings(const std::string &fileName);
+  // false: LoadL2Settings prints a summary instead of every condition
+  void SetVerbose(const bool verbose) { fVerbose = verbose; }
   void SetCoincidenceWindow(double_t coincidenceWindow)
   {
     fCoincidenceWindow = coincidenceWindow;
   }
+  // Layout of L2EventData, the L1 input is read in either layout
+  void SetOutputFormat(const EventFormat format) { fOutputFormat = format; }
+  void SetOutputSettings(const OutputSettings &settings)
+  {
+    fOutputSettings = settings;
+  }
+  // Merge the per thread L2_N.root files into L2Event.root, basket by
+  // basket, or event by event in TriggerTimePs order
+  void SetMergeOutput(const bool merge) { fMergeOutput = merge; }
+  void SetMergeSorted(const bool sorted) { fMergeSorted = sorted; }
+
+  // Per thread copy of the loaded conditions, also used by the fused L1 mode
+  L2Selector MakeSelector() const;
+
+  // Checkpoints every nTasks tasks (0: none), see Checkpoint.hpp.  An
+  // interrupted BuildEvent of the same L1 files and settings resumes there.
+  void SetCheckpointTasks(const uint32_t nTasks) { fCheckpointTasks = nTasks; }
+  // L2_N.idx (and L2Event.idx) next to every output, see EventIndex.hpp
+  void SetWriteEventIndex(const bool write) { fWriteEventIndex = write; }
 
   void BuildEvent(uint32_t nThreads);
   void Cancel() { fCancelled.store(true); }
+  // Stages l2 (per thread) and merge
+  RunMetrics &GetMetrics() { return fMetrics; }
 
  private:
   std::vector<std::vector<ChSettings_t>> fChSettingsVec;
+  ChannelTable fChannelTable;  // Hot path copy of fChSettingsVec
   double_t fCoincidenceWindow = 0.;
+  EventFormat fOutputFormat = EventFormat::Object;
+  OutputSettings fOutputSettings;
+  bool fMergeOutput = false;
+  bool fMergeSorted = false;
+  uint32_t fCheckpointTasks = 0;
+  bool fWriteEventIndex = true;
+  bool fVerbose = true;
+
+  // L1 events per task, rounded up to whole clusters
+  static constexpr Long64_t TASK_SIZE = 200000;
 
   std::vector<std::string> fFileList;
   std::atomic<bool> fCancelled{false};
+  RunMetrics fMetrics;
   void GetFileList(const std::string &key);
-  void ProcessData(const uint32_t threadID, const std::string &fileName,
-                   std::vector<L2Counter> localCounterVec,
-                   std::vector<L2Flag> localFlagVec,
-                   std::vector<L2DataAcceptance> localDataAcceptanceVec);
+  std::vector<std::string> fOutputFileList;
+  Long64_t fTotalEntries = 0;
+  std::atomic<Long64_t> fProcessedEntries{0};
+  std::vector<L2Task> MakeTasks();
+  // One round: the tasks on nThreads workers, each with a new output file
+  void RunTasks(std::vector<L2Task> tasks, uint32_t nThreads);
+  void RunCheckpointed(const std::vector<L2Task> &tasks,
+                       const uint32_t nThreads);
+  void ProcessData(const uint32_t threadID, const size_t outputIndex,
+                   WorkStealingQueue<L2Task> &taskQueue);
   std::mutex fMutex;
 
   std::vector<L2Counter> fCounterVec;
   std::vector<L2Flag> fFlagVec;
   std::vector<L2DataAcceptance> fDataAcceptanceVec;
+  L2Selector fSelector;  // Compiled from the three vectors above
 
-  void MergeFiles();
+  bool MergeFiles();
+  bool FastMerge();
+  bool MergeSorted();
 };
 
 }  // namespace DELILA
@@ -0,0 +1,328 @@
+#ifndef L2Selector_hpp
+#define L2Selector_hpp 1
+
+#include <TTree.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "ChannelTable.hpp"
+#include "EventData.hpp"
+#include "L2Conditions.hpp"
+
+namespace DELILA
+{
+
+enum class L2Operator : uint8_t {
+  Equal = 0,
+  Less,
+  Greater,
+  LessEqual,
+  GreaterEqual,
+  NotEqual,
+  Invalid,
+};
+
+inline L2Operator GetL2Operator(const std::string &condition)
+{
+  if (condition == "==") {
+    return L2Operator::Equal;
+  } else if (condition == "<") {
+    return L2Operator::Less;
+  } else if (condition == ">") {
+    return L2Operator::Greater;
+  } else if (condition == "<=") {
+    return L2Operator::LessEqual;
+  } else if (condition == ">=") {
+    return L2Operator::GreaterEqual;
+  } else if (condition == "!=") {
+    return L2Operator::NotEqual;
+  }
+  return L2Operator::Invalid;
+}
+
+// Counter and flag values of one event, to hand it to another thread
+struct L2Result_t {
+  std::vector<uint64_t> counters;
+  std::vector<uint8_t> flags;
+};
+
+// L2 counters, flags and acceptance of one event.
+// The conditions are compiled once: every channel gets a bitmask of the
+// counters it belongs to, so one pass over the hits updates all counters.
+// Flags and acceptances refer to counters and flags by index and operators
+// are enums, so no name is compared per event.  The results
+// are identical to L2Counter / L2Flag / L2DataAcceptance::Check.
+// Each thread works on its own copy, the counter and flag values of the
+// last event are the addresses of the L2 branches.
+class L2Selector
+{
+ public:
+  L2Selector() {};
+  L2Selector(const ChannelTable &table, std::vector<L2Counter> counterVec,
+             std::vector<L2Flag> flagVec,
+             std::vector<L2DataAcceptance> dataAcceptanceVec)
+      : fChannelTable(table),
+        fCounterVec(std::move(counterVec)),
+        fFlagVec(std::move(flagVec))
+  {
+    Compile(dataAcceptanceVec);
+  };
+  ~L2Selector() = default;
+
+  // Flag (/O) and counter (/l) branches, before the event branches.
+  // The selector must not be moved or copied afterwards.
+  void Branch(TTree *tree)
+  {
+    for (auto &flag : fFlagVec) {
+      tree->Branch(flag.name.c_str(), &flag.flag, (flag.name + "/O").c_str());
+    }
+    for (auto &counter : fCounterVec) {
+      tree->Branch(counter.name.c_str(), &counter.counter,
+                   (counter.name + "/l").c_str());
+    }
+  };
+
+  bool Accept(const std::vector<RawData_t> &hits)
+  {
+    fNEvaluated++;
+    if (hits.size() == 0) {
+      return false;
+    }
+
+    std::fill(fCounts.begin(), fCounts.end(), 0);
+    for (const auto &rawData : hits) {
+      // Unknown channels are ignored
+      if (!fChannelTable.IsValid(rawData.mod, rawData.ch)) {
+        continue;
+      }
+      const auto *masks =
+          &fChannelCounters[fChannelTable.Index(rawData.mod, rawData.ch) *
+                            fCounterWords];
+      for (uint32_t w = 0; w < fCounterWords; w++) {
+        for (auto mask = masks[w]; mask != 0; mask &= mask - 1) {
+          fCounts[w * 64 + std::countr_zero(mask)]++;
+        }
+      }
+    }
+    for (size_t c = 0; c < fCounterVec.size(); c++) {
+      fCounterVec[c].counter = fCounts[c];
+    }
+
+    for (size_t f = 0; f < fFlagVec.size(); f++) {
+      const auto &flag = fFlags[f];
+      fFlagVec[f].flag =
+          flag.counter >= 0 &&
+          Compare(flag.op, fCounterVec[flag.counter].counter, flag.value);
+      fFlagCounts[f] += fFlagVec[f].flag;
+    }
+
+    auto fillFlag = false;
+    for (const auto &accept : fAcceptances) {
+      fillFlag |= Check(accept);
+    }
+    fNAccepted += fillFlag;
+    return fillFlag;
+  };
+
+  // Statistics of all Accept() calls of this copy, for the run metrics
+  uint64_t GetNumberOfEvaluated() const { return fNEvaluated; };
+  uint64_t GetNumberOfAccepted() const { return fNAccepted; };
+  // Events with the flag set, in the order of the settings
+  const std::vector<uint64_t> &GetFlagCounts() const { return fFlagCounts; };
+  std::vector<std::string> GetFlagNames() const
+  {
+    std::vector<std::string> names;
+    for (const auto &flag : fFlagVec) {
+      names.push_back(flag.name);
+    }
+    return names;
+  };
+
+  // The compiled selection: counter membership of every channel, flag
+  // comparisons and acceptances.  Equal for settings selecting the same
+  // events, for the checkpoint fingerprints.
+  nlohmann::json ToJSON() const
+  {
+    nlohmann::json j;
+    auto counters = nlohmann::json::array();
+    for (const auto &counter : fCounterVec) {
+      counters.push_back(counter.name);
+    }
+    j["Counters"] = counters;
+    j["ChannelCounters"] = fChannelCounters;
+    auto flags = nlohmann::json::array();
+    for (size_t f = 0; f < fFlags.size(); f++) {
+      flags.push_back({fFlagVec[f].name, fFlags[f].counter,
+                       int(fFlags[f].op), fFlags[f].value});
+    }
+    j["Flags"] = flags;
+    auto acceptances = nlohmann::json::array();
+    for (const auto &accept : fAcceptances) {
+      acceptances.push_back({accept.isAND, accept.valid, accept.flags});
+    }
+    j["Acceptances"] = acceptances;
+    return j;
+  };
+
+  // Values of the last Accept(), and back into the branches of another
+  // copy of the same selector (the one bound to the tree)
+  void GetResult(L2Result_t &result) const
+  {
+    result.counters.resize(fCounterVec.size());
+    for (size_t c = 0; c < fCounterVec.size(); c++) {
+      result.counters[c] = fCounterVec[c].counter;
+    }
+    result.flags.resize(fFlagVec.size());
+    for (size_t f = 0; f < fFlagVec.size(); f++) {
+      result.flags[f] = fFlagVec[f].flag;
+    }
+  };
+  void SetResult(const L2Result_t &result)
+  {
+    for (size_t c = 0; c < fCounterVec.size() && c < result.counters.size();
+         c++) {
+      fCounterVec[c].counter = result.counters[c];
+    }
+    for (size_t f = 0; f < fFlagVec.size() && f < result.flags.size(); f++) {
+      fFlagVec[f].flag = result.flags[f];
+    }
+  };
+
+ private:
+  struct CompiledFlag {
+    int32_t counter = -1;  // Index in fCounterVec, -1: no such counter
+    L2Operator op = L2Operator::Invalid;
+    uint64_t value = 0;  // L2Flag compares uint64_t with int32_t
+  };
+  struct CompiledAcceptance {
+    bool isAND = true;
+    bool valid = true;           // Unknown operator or no monitor found
+    std::vector<uint32_t> flags;  // Index in fFlagVec, for every monitor
+  };
+
+  ChannelTable fChannelTable;
+  std::vector<L2Counter> fCounterVec;
+  std::vector<L2Flag> fFlagVec;
+  // Counter membership, fCounterWords words per flat channel index
+  std::vector<uint64_t> fChannelCounters;
+  uint32_t fCounterWords = 0;
+  std::vector<uint64_t> fCounts;
+  std::vector<CompiledFlag> fFlags;
+  std::vector<CompiledAcceptance> fAcceptances;
+  uint64_t fNEvaluated = 0;
+  uint64_t fNAccepted = 0;
+  std::vector<uint64_t> fFlagCounts;
+
+  void Compile(const std::vector<L2DataAcceptance> &dataAcceptanceVec)
+  {
+    fCounterWords = (fCounterVec.size() + 63) / 64;
+    fChannelCounters.assign(fChannelTable.Size() * fCounterWords, 0);
+    fCounts.assign(fCounterWords * 64, 0);
+    fFlagCounts.assign(fFlagVec.size(), 0);
+    for (size_t c = 0; c < fCounterVec.size(); c++) {
+      const auto &table = fCounterVec[c].GetConditionTable();
+      for (uint32_t mod = 0; mod < table.size(); mod++) {
+        for (uint32_t ch = 0; ch < table[mod].size(); ch++) {
+          if (table[mod][ch] && fChannelTable.IsValid(mod, ch)) {
+            const auto index = fChannelTable.Index(mod, ch);
+            fChannelCounters[index * fCounterWords + c / 64] |=
+                uint64_t(1) << (c % 64);
+          }
+        }
+      }
+    }
+
+    for (const auto &flag : fFlagVec) {
+      CompiledFlag compiled;
+      // The last counter with the name decides, like L2Flag::Check
+      for (size_t c = 0; c < fCounterVec.size(); c++) {
+        if (fCounterVec[c].name == flag.GetMonitorName()) {
+          compiled.counter = c;
+        }
+      }
+      compiled.op = GetL2Operator(flag.GetCondition());
+      if (compiled.op == L2Operator::Invalid) {
+        std::cerr << "Error: Unknown condition: " << flag.GetCondition()
+                  << std::endl;
+      }
+      compiled.value = flag.GetValue();
+      fFlags.push_back(compiled);
+    }
+
+    for (const auto &accept : dataAcceptanceVec) {
+      CompiledAcceptance compiled;
+      const auto &logic = accept.GetLogicalOperator();
+      if (logic == "AND" || logic == "OR") {
+        compiled.isAND = (logic == "AND");
+      } else {
+        std::cerr << "Error: Unknown logical operator: " << logic
+                  << std::endl;
+        compiled.valid = false;
+      }
+      for (const auto &monitor : accept.GetMonitors()) {
+        for (size_t f = 0; f < fFlagVec.size(); f++) {
+          if (fFlagVec[f].name == monitor) {
+            compiled.flags.push_back(f);
+          }
+        }
+      }
+      if (compiled.valid && compiled.flags.empty()) {
+        std::cerr << "Error: No monitors found in flag vector." << std::endl;
+        compiled.valid = false;
+      }
+      fAcceptances.push_back(std::move(compiled));
+    }
+  };
+
+  static bool Compare(const L2Operator op, const uint64_t counter,
+                      const uint64_t value)
+  {
+    switch (op) {
+      case L2Operator::Equal:
+        return counter == value;
+      case L2Operator::Less:
+        return counter < value;
+      case L2Operator::Greater:
+        return counter > value;
+      case L2Operator::LessEqual:
+        return counter <= value;
+      case L2Operator::GreaterEqual:
+        return counter >= value;
+      case L2Operator::NotEqual:
+        return counter != value;
+      default:
+        return false;
+    }
+  };
+
+  bool Check(const CompiledAcceptance &accept) const
+  {
+    if (!accept.valid) {
+      return false;
+    }
+    if (accept.isAND) {
+      for (const auto f : accept.flags) {
+        if (!fFlagVec[f].flag) {
+          return false;
+        }
+      }
+      return true;
+    }
+    for (const auto f : accept.flags) {
+      if (fFlagVec[f].flag) {
+        return true;
+      }
+    }
+    return false;
+  };
+};
+
+}  // namespace DELILA
+
+#endif
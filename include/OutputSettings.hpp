@@ -0,0 +1,188 @@
+#ifndef OutputSettings_hpp
+#define OutputSettings_hpp 1
+
+#include <Compression.h>
+#include <TFile.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include "DELILAExceptions.hpp"
+
+namespace DELILA
+{
+
+enum class CompressionType {
+  Default = 0,  // ROOT default, nothing is changed
+  None = 1,     // Uncompressed, for intermediate files read straight away
+  ZLIB = 2,
+  LZMA = 3,
+  LZ4 = 4,
+  ZSTD = 5,
+};
+
+// Writer tuning of one output stage ("L1Output" / "L2Output" in
+// settings.json).  Every key is optional, missing keys keep ROOT defaults.
+//   "Compression"      Default, None, ZLIB, LZMA, LZ4 or ZSTD
+//   "CompressionLevel" 1 - 9, 0 or missing: default level of the algorithm
+//   "BasketSize"       Bytes per branch buffer, 0: ROOT default
+//   "AutoFlush"        TTree::SetAutoFlush, also the cluster size.
+//                      > 0 entries, < 0 bytes, 0: ROOT default
+class OutputSettings
+{
+ public:
+  OutputSettings() {};
+  ~OutputSettings() {};
+
+  CompressionType compression = CompressionType::Default;
+  int32_t compressionLevel = 0;
+  int32_t basketSize = 0;
+  Long64_t autoFlush = 0;
+
+  static CompressionType GetCompressionType(std::string type)
+  {
+    std::transform(type.begin(), type.end(), type.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (type == "default") {
+      return CompressionType::Default;
+    } else if (type == "none") {
+      return CompressionType::None;
+    } else if (type == "zlib") {
+      return CompressionType::ZLIB;
+    } else if (type == "lzma") {
+      return CompressionType::LZMA;
+    } else if (type == "lz4") {
+      return CompressionType::LZ4;
+    } else if (type == "zstd") {
+      return CompressionType::ZSTD;
+    }
+    throw ConfigException("Unknown compression algorithm: " + type +
+                          " (Default, None, ZLIB, LZMA, LZ4 or ZSTD)");
+  };
+
+  static std::string GetCompressionName(const CompressionType type)
+  {
+    switch (type) {
+      case CompressionType::None:
+        return "None";
+      case CompressionType::ZLIB:
+        return "ZLIB";
+      case CompressionType::LZMA:
+        return "LZMA";
+      case CompressionType::LZ4:
+        return "LZ4";
+      case CompressionType::ZSTD:
+        return "ZSTD";
+      default:
+        return "Default";
+    }
+  };
+
+  static OutputSettings FromJSON(const nlohmann::json &j)
+  {
+    OutputSettings settings;
+    if (!j.is_object()) {
+      throw ConfigException("Output settings must be a JSON object");
+    }
+    try {
+      if (j.contains("Compression")) {
+        settings.compression = GetCompressionType(j["Compression"]);
+      }
+      settings.compressionLevel =
+          j.value("CompressionLevel", settings.compressionLevel);
+      settings.basketSize = j.value("BasketSize", settings.basketSize);
+      settings.autoFlush = j.value("AutoFlush", settings.autoFlush);
+    } catch (const nlohmann::json::exception &e) {
+      throw ConfigException(std::string("Invalid output settings: ") +
+                            e.what());
+    }
+
+    if (settings.compressionLevel < 0 || settings.compressionLevel > 9) {
+      throw ConfigException("CompressionLevel must be between 0 and 9");
+    }
+    if (settings.basketSize < 0) {
+      throw ConfigException("BasketSize must not be negative");
+    }
+    return settings;
+  };
+
+  nlohmann::json ToJSON() const
+  {
+    nlohmann::json j;
+    j["Compression"] = GetCompressionName(compression);
+    j["CompressionLevel"] = compressionLevel;
+    j["BasketSize"] = basketSize;
+    j["AutoFlush"] = autoFlush;
+    return j;
+  };
+
+  // ROOT setting (algorithm * 100 + level), -1 keeps the file default
+  int32_t GetCompressionSettings() const
+  {
+    switch (compression) {
+      case CompressionType::None:
+        return 0;
+      case CompressionType::ZLIB:
+        return ROOT::CompressionSettings(
+            ROOT::RCompressionSetting::EAlgorithm::kZLIB, Level(1));
+      case CompressionType::LZMA:
+        return ROOT::CompressionSettings(
+            ROOT::RCompressionSetting::EAlgorithm::kLZMA, Level(7));
+      case CompressionType::LZ4:
+        return ROOT::CompressionSettings(
+            ROOT::RCompressionSetting::EAlgorithm::kLZ4, Level(4));
+      case CompressionType::ZSTD:
+        return ROOT::CompressionSettings(
+            ROOT::RCompressionSetting::EAlgorithm::kZSTD, Level(5));
+      default:
+        return -1;
+    }
+  };
+
+  // Call before the tree is created, branches take the file setting
+  void Apply(TFile *file) const
+  {
+    const auto setting = GetCompressionSettings();
+    if (file && setting >= 0) {
+      file->SetCompressionSettings(setting);
+    }
+  };
+
+  // Call after all branches are created
+  void Apply(TTree *tree) const
+  {
+    if (!tree) {
+      return;
+    }
+    if (basketSize > 0) {
+      tree->SetBasketSize("*", basketSize);
+    }
+    if (autoFlush != 0) {
+      tree->SetAutoFlush(autoFlush);
+    }
+  };
+
+  void Print() const
+  {
+    std::cout << "Compression: " << GetCompressionName(compression);
+    if (compressionLevel > 0) {
+      std::cout << " (level " << compressionLevel << ")";
+    }
+    std::cout << "\tBasket size: " << basketSize
+              << "\tAuto flush: " << autoFlush << std::endl;
+  };
+
+ private:
+  int32_t Level(const int32_t defaultLevel) const
+  {
+    return compressionLevel > 0 ? compressionLevel : defaultLevel;
+  };
+};
+
+}  // namespace DELILA
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef RawHit_hpp
+#define RawHit_hpp 1
+
+#include <cstdint>
+
+#include "Timestamp.hpp"
+
+namespace DELILA
+{
+
+// One raw hit inside the L1 pipeline (reader -> merger -> builder).
+// The absolute time stamp is integer ps with the time offset applied;
+// RawData_t, with the time relative to the trigger in ns, is only made
+// when the event is filled.
+struct RawHit_t {
+  RawHit_t() = default;
+  RawHit_t(const bool isWithAC, const uint8_t mod, const uint8_t ch,
+           const uint16_t chargeLong, const uint16_t chargeShort,
+           const Timestamp_t ts)
+      : ts(ts),
+        chargeLong(chargeLong),
+        chargeShort(chargeShort),
+        mod(mod),
+        ch(ch),
+        isWithAC(isWithAC) {};
+
+  Timestamp_t ts = 0;  // [ps]
+  uint16_t chargeLong = 0;
+  uint16_t chargeShort = 0;
+  uint8_t mod = 0;
+  uint8_t ch = 0;
+  bool isWithAC = false;
+};
+static_assert(sizeof(RawHit_t) == 16, "RawHit_t should stay 16 bytes");
+
+}  // namespace DELILA
+
+#endif
@@ -0,0 +1,372 @@
+#ifndef RawTreeReader_hpp
+#define RawTreeReader_hpp 1
+
+#include <Bytes.h>
+#include <RVersion.h>
+#include <TBranch.h>
+#include <TBufferFile.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace DELILA
+{
+
+// One block of raw hits as column arrays, index i is entry firstEntry + i
+struct RawColumns {
+  Long64_t firstEntry = 0;
+  size_t nEntries = 0;
+  std::vector<UChar_t> mod;
+  std::vector<UChar_t> ch;
+  std::vector<Double_t> fineTS;
+  std::vector<UShort_t> chargeLong;
+  std::vector<UShort_t> chargeShort;
+  std::vector<ULong64_t> timeStamp;
+  std::vector<UInt_t> recordLength;
+
+  size_t size() const { return nEntries; };
+};
+
+// Reads the raw ELIADE_Tree cluster by cluster into column arrays.
+// Baskets are decoded as a whole with the ROOT bulk I/O.  If a branch does
+// not support it (or ROOT is too old), each branch is read entry by entry
+// instead of the full TTree::GetEntry.  With prefetch, the next cluster is
+// read and decompressed on a background thread while the current one is
+// processed.
+// Header only so the macros can use it without the library.
+class RawTreeReader
+{
+ public:
+  enum Column : uint32_t {
+    kMod = 1 << 0,
+    kCh = 1 << 1,
+    kFineTS = 1 << 2,
+    kChargeLong = 1 << 3,
+    kChargeShort = 1 << 4,
+    kTimeStamp = 1 << 5,
+    kRecordLength = 1 << 6,
+    kHit = 0x1F,  // Everything the event building uses
+    kAll = 0x7F,
+  };
+
+  // The tree (and its file) must outlive the reader
+  explicit RawTreeReader(TTree *tree, const uint32_t columns = kHit)
+      : fTree(tree), fColumns(columns)
+  {
+    fEntries = tree->GetEntries();
+    fLastEntry = fEntries;
+    tree->SetBranchStatus("*", kFALSE);
+    AddColumn(kMod, "Mod");
+    AddColumn(kCh, "Ch");
+    AddColumn(kFineTS, "FineTS");
+    AddColumn(kChargeLong, "ChargeLong");
+    AddColumn(kChargeShort, "ChargeShort");
+    AddColumn(kTimeStamp, "TimeStamp");
+    AddColumn(kRecordLength, "RecordLength");
+    tree->SetCacheSize(kCacheSize);
+    for (const auto &column : fColumnInfo) {
+      tree->AddBranchToCache(column.name.c_str(), kTRUE);
+    }
+    tree->StopCacheLearningPhase();
+  };
+  ~RawTreeReader()
+  {
+    if (fAhead.valid()) {
+      fAhead.wait();
+    }
+  };
+
+  RawTreeReader(const RawTreeReader &) = delete;
+  RawTreeReader &operator=(const RawTreeReader &) = delete;
+
+  Long64_t GetEntries() const { return fEntries; };
+  bool IsBulk() const { return fBulk; };
+
+  // Entries [first, last) are read, call before the first Next()
+  void SetRange(const Long64_t first, const Long64_t last)
+  {
+    fNextEntry = std::max<Long64_t>(0, first);
+    fLastEntry = std::min(last, fEntries);
+    fTree->SetCacheEntryRange(fNextEntry, fLastEntry);
+  };
+  void SetPrefetch(const bool prefetch) { fPrefetch = prefetch; };
+
+  // Fills the next block, false at the end of the range
+  bool Next(RawColumns &block)
+  {
+    if (!fPrefetch) {
+      return ReadBlock(block);
+    }
+
+    if (!fAhead.valid()) {
+      fAhead = std::async(std::launch::async,
+                          [this]() { return ReadBlock(fSpare); });
+    }
+    if (!fAhead.get()) {
+      return false;
+    }
+    // The block given back by the caller is filled next in the background
+    std::swap(block, fSpare);
+    fAhead =
+        std::async(std::launch::async, [this]() { return ReadBlock(fSpare); });
+    return true;
+  };
+
+ private:
+  static constexpr Long64_t kCacheSize = 64 * 1024 * 1024;
+  static constexpr Long64_t kMaxBlockSize = 1 << 20;
+
+  struct ColumnInfo_t {
+    Column column;
+    std::string name;
+    TBranch *branch = nullptr;
+    // Last decoded basket
+    Long64_t basketStart = -1;
+    Long64_t basketEnd = -1;
+    std::unique_ptr<TBufferFile> buffer;
+    std::vector<char> data;  // Host byte order
+  };
+
+  TTree *fTree;
+  uint32_t fColumns;
+  Long64_t fEntries = 0;
+  Long64_t fNextEntry = 0;
+  Long64_t fLastEntry = 0;
+  bool fBulk = true;
+  bool fPrefetch = false;
+  bool fAddressSet = false;
+  Long64_t fClusterEnd = 0;
+  std::vector<ColumnInfo_t> fColumnInfo;
+  RawColumns fSpare;
+  std::future<bool> fAhead;
+
+  // Scalars for the entry by entry fallback
+  UChar_t fMod = 0;
+  UChar_t fCh = 0;
+  Double_t fFineTS = 0.;
+  UShort_t fChargeLong = 0;
+  UShort_t fChargeShort = 0;
+  ULong64_t fTimeStamp = 0;
+  UInt_t fRecordLength = 0;
+
+  void AddColumn(const Column column, const char *name)
+  {
+    if (!(fColumns & column)) {
+      return;
+    }
+    ColumnInfo_t info;
+    info.column = column;
+    info.name = name;
+    fTree->SetBranchStatus(name, kTRUE);
+    info.branch = fTree->GetBranch(name);
+    if (!info.branch) {
+      fBulk = false;
+    }
+    info.buffer.reset(new TBufferFile(TBuffer::kWrite, 32 * 1024));
+    fColumnInfo.push_back(std::move(info));
+  };
+
+  bool ReadBlock(RawColumns &block)
+  {
+    if (fNextEntry >= fLastEntry) {
+      return false;
+    }
+
+    // Blocks follow the clusters, so every basket is decoded once
+    if (fNextEntry >= fClusterEnd) {
+      auto cluster = fTree->GetClusterIterator(fNextEntry);
+      cluster.Next();
+      fClusterEnd = cluster.GetNextEntry();
+      if (fClusterEnd <= fNextEntry) {
+        fClusterEnd = fLastEntry;  // No cluster information
+      }
+    }
+    const auto first = fNextEntry;
+    const auto last =
+        std::min({fClusterEnd, fLastEntry, first + kMaxBlockSize});
+    fNextEntry = last;
+
+    const size_t n = last - first;
+    block.firstEntry = first;
+    block.nEntries = n;
+    Resize(block, n);
+
+    if (fBulk) {
+      for (auto &column : fColumnInfo) {
+        if (!ReadColumnBulk(column, first, last, block)) {
+          fBulk = false;  // Fall back for the rest of the tree
+          break;
+        }
+      }
+    }
+    if (!fBulk) {
+      ReadEntryByEntry(first, last, block);
+    }
+    return true;
+  };
+
+  void Resize(RawColumns &block, const size_t n)
+  {
+    if (fColumns & kMod) block.mod.resize(n);
+    if (fColumns & kCh) block.ch.resize(n);
+    if (fColumns & kFineTS) block.fineTS.resize(n);
+    if (fColumns & kChargeLong) block.chargeLong.resize(n);
+    if (fColumns & kChargeShort) block.chargeShort.resize(n);
+    if (fColumns & kTimeStamp) block.timeStamp.resize(n);
+    if (fColumns & kRecordLength) block.recordLength.resize(n);
+  };
+
+  template <typename T>
+  static void Decode(char *serialized, const Int_t n, std::vector<char> &data)
+  {
+    // Baskets are stored big endian
+    data.resize(n * sizeof(T));
+    auto values = reinterpret_cast<T *>(data.data());
+    for (Int_t i = 0; i < n; i++) {
+      frombuf(serialized, &values[i]);
+    }
+  };
+
+  template <typename T>
+  static void CopyColumn(const ColumnInfo_t &column, const Long64_t from,
+                         const Long64_t to, T *out)
+  {
+    auto values = reinterpret_cast<const T *>(column.data.data());
+    std::copy(values + (from - column.basketStart),
+              values + (to - column.basketStart), out);
+  };
+
+  bool ReadColumnBulk(ColumnInfo_t &column, const Long64_t first,
+                      const Long64_t last, RawColumns &block)
+  {
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 20, 0)
+    if (!column.branch->SupportsBulkRead()) {
+      return false;
+    }
+    auto entry = first;
+    while (entry < last) {
+      if (entry < column.basketStart || entry >= column.basketEnd) {
+        // The bulk read only starts at a basket boundary
+        const auto nBaskets = column.branch->GetWriteBasket() + 1;
+        const auto basketEntry = column.branch->GetBasketEntry();
+        const auto iBasket =
+            std::upper_bound(basketEntry, basketEntry + nBaskets, entry) -
+            basketEntry - 1;
+        if (iBasket < 0) {
+          return false;
+        }
+        const auto start = basketEntry[iBasket];
+        const auto nRead =
+            column.branch->GetBulkRead().GetEntriesSerialized(start,
+                                                              *column.buffer);
+        if (nRead <= 0) {
+          return false;
+        }
+        auto serialized = column.buffer->GetCurrent();
+        switch (column.column) {
+          case kMod:
+          case kCh:
+            Decode<UChar_t>(serialized, nRead, column.data);
+            break;
+          case kFineTS:
+            Decode<Double_t>(serialized, nRead, column.data);
+            break;
+          case kTimeStamp:
+            Decode<ULong64_t>(serialized, nRead, column.data);
+            break;
+          case kRecordLength:
+            Decode<UInt_t>(serialized, nRead, column.data);
+            break;
+          default:
+            Decode<UShort_t>(serialized, nRead, column.data);
+            break;
+        }
+        column.basketStart = start;
+        column.basketEnd = start + nRead;
+        if (entry >= column.basketEnd) {
+          return false;
+        }
+      }
+
+      const auto to = std::min(last, column.basketEnd);
+      const auto offset = entry - first;
+      switch (column.column) {
+        case kMod:
+          CopyColumn(column, entry, to, block.mod.data() + offset);
+          break;
+        case kCh:
+          CopyColumn(column, entry, to, block.ch.data() + offset);
+          break;
+        case kFineTS:
+          CopyColumn(column, entry, to, block.fineTS.data() + offset);
+          break;
+        case kChargeLong:
+          CopyColumn(column, entry, to, block.chargeLong.data() + offset);
+          break;
+        case kChargeShort:
+          CopyColumn(column, entry, to, block.chargeShort.data() + offset);
+          break;
+        case kTimeStamp:
+          CopyColumn(column, entry, to, block.timeStamp.data() + offset);
+          break;
+        case kRecordLength:
+          CopyColumn(column, entry, to, block.recordLength.data() + offset);
+          break;
+        default:
+          return false;
+      }
+      entry = to;
+    }
+    return true;
+#else
+    return false;
+#endif
+  };
+
+  void ReadEntryByEntry(const Long64_t first, const Long64_t last,
+                        RawColumns &block)
+  {
+    if (!fAddressSet) {
+      if (fColumns & kMod) fTree->SetBranchAddress("Mod", &fMod);
+      if (fColumns & kCh) fTree->SetBranchAddress("Ch", &fCh);
+      if (fColumns & kFineTS) fTree->SetBranchAddress("FineTS", &fFineTS);
+      if (fColumns & kChargeLong)
+        fTree->SetBranchAddress("ChargeLong", &fChargeLong);
+      if (fColumns & kChargeShort)
+        fTree->SetBranchAddress("ChargeShort", &fChargeShort);
+      if (fColumns & kTimeStamp)
+        fTree->SetBranchAddress("TimeStamp", &fTimeStamp);
+      if (fColumns & kRecordLength)
+        fTree->SetBranchAddress("RecordLength", &fRecordLength);
+      for (auto &column : fColumnInfo) {
+        column.branch = fTree->GetBranch(column.name.c_str());
+      }
+      fAddressSet = true;
+    }
+
+    for (Long64_t entry = first; entry < last; entry++) {
+      const auto i = entry - first;
+      for (const auto &column : fColumnInfo) {
+        if (column.branch) {
+          column.branch->GetEntry(entry);
+        }
+      }
+      if (fColumns & kMod) block.mod[i] = fMod;
+      if (fColumns & kCh) block.ch[i] = fCh;
+      if (fColumns & kFineTS) block.fineTS[i] = fFineTS;
+      if (fColumns & kChargeLong) block.chargeLong[i] = fChargeLong;
+      if (fColumns & kChargeShort) block.chargeShort[i] = fChargeShort;
+      if (fColumns & kTimeStamp) block.timeStamp[i] = fTimeStamp;
+      if (fColumns & kRecordLength) block.recordLength[i] = fRecordLength;
+    }
+  };
+};
+
+}  // namespace DELILA
+
+#endif
@@ -0,0 +1,317 @@
+#ifndef RunCatalog_hpp
+#define RunCatalog_hpp 1
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "TFileRAII.hpp"
+
+namespace DELILA
+{
+
+const std::string kRunCatalogFileName = "runCatalog.json";
+// Backward jump [ns] taken as an acquisition restart, as in L1EventBuilder
+constexpr double_t kRunRestartThreshold = 10e9;
+
+// One raw data file, entries < 0 until the file is inspected
+struct RunFileInfo_t {
+  std::string path;
+  uint32_t run = 0;
+  uint32_t version = 0;
+  int64_t fileSize = 0;
+  int64_t modTime = 0;  // File system clock ticks, cache validation only
+  int64_t entries = -1;
+  double_t firstTS = 0.;  // [ns], earliest of the first entries
+  double_t lastTS = 0.;   // [ns], latest of the last entries
+};
+
+// Index of the raw files of a data directory, made in one directory pass.
+// File names are parsed once into a (run, version) map, so a version range
+// is a map lookup instead of a name scan per version.  Entry counts and
+// the time stamps at both ends of every file are kept in a JSON cache in
+// the working directory (the data directory may be read only).  A cached
+// file is only inspected again when its size or modification time changes.
+class RunCatalog
+{
+ public:
+  RunCatalog() = default;
+  ~RunCatalog() = default;
+
+  // run%04d_%04d_*.root, or the older run%d_%d_*.root
+  static bool ParseFileName(const std::string &fileName, uint32_t &run,
+                            uint32_t &version)
+  {
+    if (fileName.find(".root") == std::string::npos) {
+      return false;
+    }
+    for (auto pos = fileName.find("run"); pos != std::string::npos;
+         pos = fileName.find("run", pos + 1)) {
+      auto cursor = pos + 3;
+      if (ParseNumber(fileName, cursor, run) && cursor < fileName.size() &&
+          fileName[cursor] == '_' && ParseNumber(fileName, ++cursor, version) &&
+          cursor < fileName.size() && fileName[cursor] == '_') {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // key_0.root, key_1.root, ... up to the first missing number
+  static std::vector<std::string> FindNumberedFiles(
+      const std::string &directory, const std::string &key)
+  {
+    std::map<uint32_t, std::string> numbered;
+    std::error_code error;
+    const std::string prefix = key + "_";
+    for (const auto &entry :
+         std::filesystem::directory_iterator(directory, error)) {
+      if (!entry.is_regular_file()) {
+        continue;
+      }
+      const auto name = entry.path().filename().string();
+      if (name.rfind(prefix, 0) != 0 || name.size() <= prefix.size() + 5 ||
+          name.compare(name.size() - 5, 5, ".root") != 0) {
+        continue;
+      }
+      size_t cursor = prefix.size();
+      uint32_t number = 0;
+      if (ParseNumber(name, cursor, number) && cursor == name.size() - 5) {
+        numbered.emplace(number, entry.path().string());
+      }
+    }
+
+    std::vector<std::string> fileList;
+    for (uint32_t i = 0; numbered.count(i) > 0; i++) {
+      fileList.push_back(numbered[i]);
+    }
+    return fileList;
+  };
+
+  // One pass over the directory.  With several files for the same run and
+  // version the lexicographically first path is used.
+  bool Scan(const std::string &directory)
+  {
+    fFiles.clear();
+    if (!std::filesystem::exists(directory)) {
+      std::cerr << "Directory not found: " << directory << std::endl;
+      return false;
+    }
+    std::error_code error;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(directory, error)) {
+      if (!entry.is_regular_file()) {
+        continue;
+      }
+      RunFileInfo_t info;
+      if (!ParseFileName(entry.path().filename().string(), info.run,
+                         info.version)) {
+        continue;
+      }
+      info.path = entry.path().string();
+      info.fileSize = entry.file_size(error);
+      info.modTime = entry.last_write_time(error).time_since_epoch().count();
+      const auto key = std::make_pair(info.run, info.version);
+      auto it = fFiles.find(key);
+      if (it == fFiles.end()) {
+        fFiles.emplace(key, std::move(info));
+      } else if (info.path < it->second.path) {
+        it->second = std::move(info);
+      }
+    }
+    return true;
+  };
+
+  size_t Size() const { return fFiles.size(); };
+
+  // Files of one run, versions [startVersion, endVersion] in version order
+  std::vector<RunFileInfo_t *> GetFiles(const uint32_t run,
+                                        const uint32_t startVersion,
+                                        const uint32_t endVersion)
+  {
+    std::vector<RunFileInfo_t *> files;
+    for (auto it = fFiles.lower_bound({run, startVersion});
+         it != fFiles.end() && it->first.first == run &&
+         it->first.second <= endVersion;
+         ++it) {
+      files.push_back(&it->second);
+    }
+    return files;
+  };
+  // Any file of a run after this one, i.e. the DAQ has moved on
+  bool HasLaterRun(const uint32_t run) const
+  {
+    return fFiles.lower_bound({run + 1, 0}) != fFiles.end();
+  };
+  std::vector<std::string> GetFileList(const uint32_t run,
+                                       const uint32_t startVersion,
+                                       const uint32_t endVersion)
+  {
+    std::vector<std::string> fileList;
+    for (const auto *info : GetFiles(run, startVersion, endVersion)) {
+      fileList.push_back(info->path);
+    }
+    return fileList;
+  };
+
+  // Entries and time stamps from the cache, or from the file if it changed
+  void LoadCache(const std::string &fileName = kRunCatalogFileName)
+  {
+    std::ifstream ifs(fileName);
+    if (!ifs) {
+      return;
+    }
+    try {
+      nlohmann::json j;
+      ifs >> j;
+      for (auto &[key, info] : fFiles) {
+        const auto it = j.find(info.path);
+        if (it == j.end() ||
+            it->at("FileSize").get<int64_t>() != info.fileSize ||
+            it->at("ModTime").get<int64_t>() != info.modTime) {
+          continue;
+        }
+        info.entries = it->at("Entries").get<int64_t>();
+        info.firstTS = it->at("FirstTS").get<double_t>();
+        info.lastTS = it->at("LastTS").get<double_t>();
+      }
+    } catch (const std::exception &e) {
+      std::cerr << "Warning: Ignoring " << fileName << ": " << e.what()
+                << std::endl;
+    }
+  };
+  void SaveCache(const std::string &fileName = kRunCatalogFileName) const
+  {
+    // Other runs of the same cache are kept
+    nlohmann::json j = nlohmann::json::object();
+    std::ifstream ifs(fileName);
+    if (ifs) {
+      try {
+        ifs >> j;
+      } catch (const std::exception &) {
+        j = nlohmann::json::object();
+      }
+    }
+    ifs.close();
+    for (const auto &[key, info] : fFiles) {
+      if (info.entries < 0) {
+        continue;
+      }
+      j[info.path] = {{"FileSize", info.fileSize}, {"ModTime", info.modTime},
+                      {"Entries", info.entries},   {"FirstTS", info.firstTS},
+                      {"LastTS", info.lastTS}};
+    }
+    std::ofstream ofs(fileName);
+    ofs << j.dump() << std::endl;
+  };
+
+  // Opens the files that are not in the cache, false if any is unreadable
+  bool Inspect(const std::vector<RunFileInfo_t *> &files)
+  {
+    auto ok = true;
+    for (auto *info : files) {
+      if (info->entries < 0 && !InspectFile(*info)) {
+        ok = false;
+      }
+    }
+    return ok;
+  };
+
+  // Indices in files where the time stamps jump back by more than the
+  // threshold [ns] compared to every file before, i.e. an acquisition
+  // restart.  Same rule as TimeOrderedMerger.
+  static std::vector<size_t> FindRestarts(
+      const std::vector<RunFileInfo_t *> &files,
+      const double_t threshold = kRunRestartThreshold)
+  {
+    std::vector<size_t> restarts;
+    auto segmentEmpty = true;
+    double_t segmentMaxTS = 0.;
+    for (size_t i = 0; i < files.size(); i++) {
+      const auto &info = *files[i];
+      if (info.entries <= 0) {
+        continue;
+      }
+      if (!segmentEmpty && info.firstTS + threshold < segmentMaxTS) {
+        restarts.push_back(i);
+        segmentMaxTS = info.lastTS;
+      } else {
+        segmentMaxTS =
+            segmentEmpty ? info.lastTS : std::max(segmentMaxTS, info.lastTS);
+      }
+      segmentEmpty = false;
+    }
+    return restarts;
+  };
+
+ private:
+  // Time stamps of this many entries at both ends of a file, the channels
+  // are only interleaved over short distances
+  static constexpr int64_t kProbeEntries = 1000;
+
+  std::map<std::pair<uint32_t, uint32_t>, RunFileInfo_t> fFiles;
+
+  static bool ParseNumber(const std::string &text, size_t &cursor,
+                          uint32_t &number)
+  {
+    const auto begin = cursor;
+    uint64_t value = 0;
+    while (cursor < text.size() && text[cursor] >= '0' &&
+           text[cursor] <= '9' && cursor - begin < 9) {
+      value = value * 10 + (text[cursor] - '0');
+      cursor++;
+    }
+    number = value;
+    return cursor > begin;
+  };
+
+  static bool InspectFile(RunFileInfo_t &info)
+  {
+    auto file = MakeTFile(info.path.c_str(), "READ");
+    if (!file || file->IsZombie()) {
+      std::cerr << "Error: Could not open file: " << info.path << std::endl;
+      return false;
+    }
+    auto tree = static_cast<TTree *>(file->Get("ELIADE_Tree"));
+    if (!tree) {
+      std::cerr << "Error: Could not find tree in file: " << info.path
+                << std::endl;
+      return false;
+    }
+
+    Double_t fineTS = 0.;
+    tree->SetBranchStatus("*", kFALSE);
+    tree->SetBranchStatus("FineTS", kTRUE);
+    tree->SetBranchAddress("FineTS", &fineTS);
+    info.entries = tree->GetEntries();
+    info.firstTS = info.lastTS = 0.;
+    const auto nProbe = std::min(kProbeEntries, info.entries);
+    for (int64_t i = 0; i < nProbe; i++) {
+      tree->GetEntry(i);
+      const auto ts = fineTS / 1000.;  // ps -> ns
+      info.firstTS = (i == 0) ? ts : std::min(info.firstTS, ts);
+    }
+    for (int64_t i = info.entries - nProbe; i < info.entries; i++) {
+      tree->GetEntry(i);
+      const auto ts = fineTS / 1000.;
+      info.lastTS = (i == info.entries - nProbe) ? ts
+                                                 : std::max(info.lastTS, ts);
+    }
+    tree->ResetBranchAddresses();
+    return true;
+  };
+};
+
+}  // namespace DELILA
+
+#endif
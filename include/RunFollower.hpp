@@ -0,0 +1,153 @@
+#ifndef RunFollower_hpp
+#define RunFollower_hpp 1
+
+#include <RtypesCore.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "DELILAExceptions.hpp"
+#include "RunCatalog.hpp"
+
+namespace DELILA
+{
+
+// Follows one run while the DAQ writes it, for the follow mode (-f).
+// The data directory is polled with the run catalog, inotify does not see
+// files written over NFS by the DAQ host.  A version is closed once the
+// DAQ has moved on: a later version of the run or a later run exists.
+// The last version is closed when nothing changed for the idle timeout,
+// which also ends the run.  Closed versions are handed out once, in
+// version order, with unknown entries (the builders open them anyway).
+class RunFollower
+{
+ public:
+  RunFollower(const std::string &directory, const uint32_t run,
+              const uint32_t startVersion, const uint32_t endVersion)
+      : fDirectory(directory),
+        fRun(run),
+        fNextVersion(startVersion),
+        fEndVersion(endVersion) {};
+  ~RunFollower() = default;
+
+  // [s] between two looks at the directory
+  void SetPollInterval(const double_t seconds)
+  {
+    if (!(seconds > 0.)) {
+      throw DELILA::ValidationException(
+          "Follow poll interval must be positive, got: " +
+          std::to_string(seconds));
+    }
+    fPollInterval = seconds;
+  };
+  // [s] without any change after which the run is taken as ended
+  void SetIdleTimeout(const double_t seconds)
+  {
+    if (!(seconds > 0.)) {
+      throw DELILA::ValidationException(
+          "Follow idle timeout must be positive, got: " +
+          std::to_string(seconds));
+    }
+    fIdleTimeout = seconds;
+  };
+
+  // Blocks until versions are closed.  Empty once the run is over, or
+  // when cancelled.
+  std::vector<RunFileInfo_t> Next(const std::atomic<bool> &cancelled)
+  {
+    while (!fFinished && !cancelled.load()) {
+      auto closed = Poll();
+      if (!closed.empty() || fFinished) {
+        return closed;
+      }
+      // Short sleeps, a Ctrl-C does not wait for the whole interval
+      const auto wakeUp =
+          Clock::now() + std::chrono::duration<double_t>(fPollInterval);
+      while (!cancelled.load() && Clock::now() < wakeUp) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(
+            std::min<int64_t>(100, int64_t(fPollInterval * 1000.) + 1)));
+      }
+    }
+    return {};
+  };
+
+  // One look at the directory: the versions closed since the last call
+  std::vector<RunFileInfo_t> Poll()
+  {
+    std::vector<RunFileInfo_t> closed;
+    const auto now = Clock::now();
+    if (!fStarted) {
+      fLastChange = now;
+      fStarted = true;
+    }
+    RunCatalog catalog;
+    if (fFinished || !catalog.Scan(fDirectory)) {
+      return closed;
+    }
+
+    auto files = catalog.GetFiles(fRun, fNextVersion, fEndVersion);
+    // A new version or a growing file restarts the idle timer
+    const auto state =
+        files.empty() ? State_t(0, 0, 0)
+                      : State_t(files.back()->version, files.back()->fileSize,
+                                files.back()->modTime);
+    if (files.size() != fLastCount || state != fLastState) {
+      fLastCount = files.size();
+      fLastState = state;
+      fLastChange = now;
+    }
+    const auto idle =
+        std::chrono::duration<double_t>(now - fLastChange).count() >=
+        fIdleTimeout;
+    const auto runOver = idle || catalog.HasLaterRun(fRun);
+
+    // The newest version may still be written, unless one follows it
+    auto nClosed = files.size();
+    if (!runOver && !files.empty()) {
+      const auto last = files.back()->version;
+      const auto followed =
+          last < UINT32_MAX &&
+          !catalog.GetFiles(fRun, last + 1, UINT32_MAX).empty();
+      nClosed -= followed ? 0 : 1;
+    }
+    for (size_t i = 0; i < nClosed; i++) {
+      closed.push_back(*files[i]);
+    }
+    if (!closed.empty()) {
+      fFinished = closed.back().version >= fEndVersion;
+      fNextVersion = closed.back().version + 1;
+      fLastCount = 0;
+    }
+    fFinished = fFinished || runOver;
+    return closed;
+  };
+
+  bool IsFinished() const { return fFinished; };
+
+ private:
+  using Clock = std::chrono::steady_clock;
+  using State_t = std::tuple<uint32_t, int64_t, int64_t>;
+
+  std::string fDirectory;
+  uint32_t fRun = 0;
+  uint32_t fNextVersion = 0;
+  uint32_t fEndVersion = 0;
+  double_t fPollInterval = 5.;
+  double_t fIdleTimeout = 300.;
+
+  bool fStarted = false;
+  bool fFinished = false;
+  size_t fLastCount = 0;
+  State_t fLastState{0, 0, 0};
+  Clock::time_point fLastChange;
+};
+
+}  // namespace DELILA
+
+#endif
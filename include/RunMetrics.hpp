@@ -0,0 +1,501 @@
+#ifndef RunMetrics_hpp
+#define RunMetrics_hpp 1
+
+#include <RtypesCore.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "DELILAExceptions.hpp"
+
+namespace DELILA
+{
+
+const std::string kMetricsReportFileName = "runMetrics.json";
+
+// Added to by one thread, read by the snapshot thread at any time.
+// Relaxed atomics, an uncontended add costs about as much as a plain one.
+template <typename T>
+class MetricCounter
+{
+ public:
+  void Add(const T value) { fValue.fetch_add(value, std::memory_order_relaxed); };
+  void Set(const T value) { fValue.store(value, std::memory_order_relaxed); };
+  T Get() const { return fValue.load(std::memory_order_relaxed); };
+
+ private:
+  std::atomic<T> fValue{0};
+};
+
+// Counters of one stage (read, build, write, ...) on one thread.  A stage
+// uses the counters that apply to it, the others stay 0.
+struct StageMetrics {
+  MetricCounter<uint64_t> tasks;     // Chunks, slices, files or L2 tasks
+  MetricCounter<uint64_t> entries;   // Input entries (hits or L1 events)
+  MetricCounter<uint64_t> hits;      // Hits kept by the prefilter / built
+  MetricCounter<uint64_t> events;    // Events built or evaluated
+  MetricCounter<uint64_t> accepted;  // Events written
+  MetricCounter<uint64_t> bytesIn;   // Bytes read from the files
+  MetricCounter<uint64_t> bytesOut;  // Bytes written to the files
+  MetricCounter<double_t> readTime;  // [s]
+  MetricCounter<double_t> sortTime;
+  MetricCounter<double_t> buildTime;
+  MetricCounter<double_t> fillTime;
+  MetricCounter<double_t> busyTime;  // All the work of the stage
+  MetricCounter<double_t> wallTime;  // Start to finish of the thread
+
+  // Same keys for every stage, so reports diff line by line
+  template <typename F>
+  void ForEach(F &&f) const
+  {
+    f("tasks", tasks);
+    f("entries", entries);
+    f("hits", hits);
+    f("events", events);
+    f("accepted", accepted);
+    f("bytesIn", bytesIn);
+    f("bytesOut", bytesOut);
+    f("readTime", readTime);
+    f("sortTime", sortTime);
+    f("buildTime", buildTime);
+    f("fillTime", fillTime);
+    f("busyTime", busyTime);
+    f("wallTime", wallTime);
+  };
+
+  nlohmann::json ToJSON() const
+  {
+    auto j = nlohmann::json::object();
+    ForEach([&j](const char *name, const auto &counter) {
+      j[name] = counter.Get();
+    });
+    return j;
+  };
+};
+
+// Elapsed seconds of a scope added to a counter, also on early returns
+class ScopedTimer
+{
+ public:
+  explicit ScopedTimer(MetricCounter<double_t> &counter)
+      : fCounter(counter), fStart(std::chrono::steady_clock::now()) {};
+  ~ScopedTimer()
+  {
+    fCounter.Add(std::chrono::duration<double_t>(
+                     std::chrono::steady_clock::now() - fStart)
+                     .count());
+  };
+
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+ private:
+  MetricCounter<double_t> &fCounter;
+  std::chrono::steady_clock::time_point fStart;
+};
+
+// Metrics of one run (-t, -l1, -l1l2 or -l2): per stage and thread
+// counters, sampled queue depths and L2 acceptance counts.  The builders
+// record, main() starts and stops the run and writes the JSON report.
+// Between Start() and Stop() a sampler thread reads the queue depths every
+// 10 ms and, with a live target, writes a snapshot every interval: one
+// JSON line appended to a file, or one UDP datagram to udp://host:port.
+class RunMetrics
+{
+ public:
+  RunMetrics() = default;
+  ~RunMetrics() { Stop(); };
+
+  RunMetrics(const RunMetrics &) = delete;
+  RunMetrics &operator=(const RunMetrics &) = delete;
+
+  void SetMode(const std::string &mode) { fMode = mode; };
+  // Settings of the run, copied into the report to compare configurations
+  void SetConfig(const nlohmann::json &config) { fConfig = config; };
+  // target: file name or udp://host:port, "" for none.  interval [s]
+  void SetLive(const std::string &target, const double_t interval = 1.)
+  {
+    if (!(interval > 0.)) {
+      throw DELILA::ValidationException(
+          "Metrics interval must be positive: " + std::to_string(interval));
+    }
+    fLiveTarget = target;
+    fLiveInterval = interval;
+  };
+
+  // One thread of a stage, the reference stays valid for the whole run
+  StageMetrics &GetStage(const std::string &stage, const uint32_t thread)
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    auto &threads = FindStage(stage).threads;
+    while (threads.size() <= thread) {
+      threads.emplace_back(std::make_unique<StageMetrics>());
+    }
+    return *threads[thread];
+  };
+  // For threads without an index (the merger's readers): one entry per
+  // calling thread, numbered in the order of their first call
+  StageMetrics &GetStage(const std::string &stage)
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    auto &entry = FindStage(stage);
+    const auto id = std::this_thread::get_id();
+    auto slot = entry.slots.find(id);
+    if (slot == entry.slots.end()) {
+      slot = entry.slots.emplace(id, entry.threads.size()).first;
+      entry.threads.emplace_back(std::make_unique<StageMetrics>());
+    }
+    return *entry.threads[slot->second];
+  };
+
+  // Sampled while the returned watch lives, the statistics stay
+  class QueueWatch
+  {
+   public:
+    QueueWatch(RunMetrics &metrics, const size_t index)
+        : fMetrics(metrics), fIndex(index) {};
+    ~QueueWatch() { fMetrics.Unwatch(fIndex); };
+
+    QueueWatch(const QueueWatch &) = delete;
+    QueueWatch &operator=(const QueueWatch &) = delete;
+
+   private:
+    RunMetrics &fMetrics;
+    size_t fIndex;
+  };
+  [[nodiscard]] std::unique_ptr<QueueWatch> WatchQueue(
+      const std::string &name, std::function<size_t()> depth,
+      const size_t capacity = 0)
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    Queue queue;
+    queue.name = name;
+    queue.depth = std::move(depth);
+    queue.capacity = capacity;
+    fQueues.push_back(std::move(queue));
+    Sample(fQueues.back());
+    return std::make_unique<QueueWatch>(*this, fQueues.size() - 1);
+  };
+
+  // Events evaluated and accepted by an L2 selection, and how often every
+  // flag was set.  Summed over the threads.
+  void AddL2Counts(const uint64_t evaluated, const uint64_t accepted,
+                   const std::vector<std::string> &flagNames,
+                   const std::vector<uint64_t> &flagCounts)
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    fL2Evaluated += evaluated;
+    fL2Accepted += accepted;
+    for (size_t f = 0; f < flagNames.size() && f < flagCounts.size(); f++) {
+      auto flag = std::find_if(
+          fL2Flags.begin(), fL2Flags.end(),
+          [&](const auto &entry) { return entry.first == flagNames[f]; });
+      if (flag == fL2Flags.end()) {
+        fL2Flags.emplace_back(flagNames[f], flagCounts[f]);
+      } else {
+        flag->second += flagCounts[f];
+      }
+    }
+  };
+
+  void Start()
+  {
+    Stop();
+    fStartTime = std::chrono::system_clock::now();
+    fStart = std::chrono::steady_clock::now();
+    fEnd = fStart;
+    if (!fLiveTarget.empty()) {
+      OpenLive();
+    }
+    fRunning = true;
+    fSampler = std::thread(&RunMetrics::SampleLoop, this);
+  };
+  void Stop()
+  {
+    if (!fSampler.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(fMutex);
+      fRunning = false;
+    }
+    fWakeUp.notify_all();
+    fSampler.join();
+    std::lock_guard<std::mutex> lock(fMutex);
+    fEnd = std::chrono::steady_clock::now();
+    for (auto &queue : fQueues) {
+      Sample(queue);
+    }
+    if (!fLiveTarget.empty()) {
+      WriteLive(SnapshotLocked(true));
+    }
+    CloseLive();
+  };
+
+  // Sum over the threads of one stage (longest wall time), zeros if the
+  // stage has no thread
+  nlohmann::json GetTotal(const std::string &stage)
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    const auto entry = fStages.find(stage);
+    if (entry == fStages.end()) {
+      return GetTotal(Stage());
+    }
+    return GetTotal(entry->second);
+  };
+
+  // Totals of every stage, current queue depths
+  nlohmann::json Snapshot()
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    return SnapshotLocked(false);
+  };
+
+  // The full report: totals and threads of every stage, queue statistics,
+  // L2 counts and the settings of the run
+  nlohmann::json ToJSON()
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    auto j = SnapshotLocked(!fRunning);
+    const auto startTime = std::chrono::system_clock::to_time_t(fStartTime);
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ",
+                  std::gmtime(&startTime));
+    j["startTime"] = buffer;
+    j["hardwareThreads"] = std::thread::hardware_concurrency();
+    for (const auto &[name, stage] : fStages) {
+      auto threads = nlohmann::json::array();
+      for (const auto &thread : stage.threads) {
+        threads.push_back(thread->ToJSON());
+      }
+      j["stages"][name]["threads"] = threads;
+    }
+    if (fL2Evaluated > 0 || !fL2Flags.empty()) {
+      j["l2"]["evaluated"] = fL2Evaluated;
+      j["l2"]["accepted"] = fL2Accepted;
+      auto flags = nlohmann::json::object();
+      for (const auto &[name, count] : fL2Flags) {
+        flags[name] = count;
+      }
+      j["l2"]["flags"] = flags;
+    }
+    j["config"] = fConfig;
+    return j;
+  };
+
+  void WriteReport(const std::string &fileName)
+  {
+    std::ofstream file(fileName);
+    if (!file) {
+      throw DELILA::FileException("Could not write metrics report: " +
+                                  fileName);
+    }
+    file << ToJSON().dump(2) << std::endl;
+  };
+
+ private:
+  struct Stage {
+    std::vector<std::unique_ptr<StageMetrics>> threads;
+    std::map<std::thread::id, size_t> slots;  // For GetStage(stage)
+  };
+  struct Queue {
+    std::string name;
+    std::function<size_t()> depth;  // Empty once the watch is gone
+    size_t capacity = 0;
+    size_t last = 0;
+    size_t max = 0;
+    uint64_t sum = 0;
+    uint64_t samples = 0;
+  };
+  static constexpr auto kSamplePeriod = std::chrono::milliseconds(10);
+
+  std::string fMode;
+  nlohmann::json fConfig = nlohmann::json::object();
+  std::string fLiveTarget;
+  double_t fLiveInterval = 1.;
+
+  std::mutex fMutex;
+  std::map<std::string, Stage> fStages;
+  std::vector<Queue> fQueues;
+  uint64_t fL2Evaluated = 0;
+  uint64_t fL2Accepted = 0;
+  std::vector<std::pair<std::string, uint64_t>> fL2Flags;  // Settings order
+
+  std::chrono::system_clock::time_point fStartTime;
+  std::chrono::steady_clock::time_point fStart;
+  std::chrono::steady_clock::time_point fEnd;
+  std::thread fSampler;
+  std::condition_variable fWakeUp;
+  bool fRunning = false;
+
+  // Live target, a file or a UDP socket
+  std::ofstream fLiveFile;
+  int fSocket = -1;
+  sockaddr_storage fAddress{};
+  socklen_t fAddressLength = 0;
+
+  Stage &FindStage(const std::string &stage) { return fStages[stage]; };
+
+  static nlohmann::json GetTotal(const Stage &stage)
+  {
+    const StageMetrics zero;
+    auto total = zero.ToJSON();
+    for (const auto &thread : stage.threads) {
+      thread->ForEach([&total](const char *key, const auto &counter) {
+        using Value_t = decltype(counter.Get());
+        const auto value = counter.Get();
+        const auto sum = total[key].template get<Value_t>();
+        // Threads run side by side, the stage takes as long as the longest
+        total[key] = (std::string(key) == "wallTime") ? std::max(sum, value)
+                                                      : Value_t(sum + value);
+      });
+    }
+    return total;
+  };
+
+  void Unwatch(const size_t index)
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    Sample(fQueues[index]);
+    fQueues[index].depth = nullptr;
+  };
+
+  static void Sample(Queue &queue)
+  {
+    if (!queue.depth) {
+      return;
+    }
+    queue.last = queue.depth();
+    queue.max = std::max(queue.max, queue.last);
+    queue.sum += queue.last;
+    queue.samples++;
+  };
+
+  void SampleLoop()
+  {
+    auto nextLive = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::duration<double_t>(fLiveInterval));
+    std::unique_lock<std::mutex> lock(fMutex);
+    while (fRunning) {
+      fWakeUp.wait_for(lock, kSamplePeriod, [this] { return !fRunning; });
+      for (auto &queue : fQueues) {
+        Sample(queue);
+      }
+      if (!fLiveTarget.empty() && std::chrono::steady_clock::now() >= nextLive) {
+        WriteLive(SnapshotLocked(false));
+        nextLive += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::duration<double_t>(fLiveInterval));
+      }
+    }
+  };
+
+  nlohmann::json SnapshotLocked(const bool final) const
+  {
+    nlohmann::json j;
+    j["mode"] = fMode;
+    j["final"] = final;
+    const auto end = fRunning ? std::chrono::steady_clock::now() : fEnd;
+    j["wallTime"] = std::chrono::duration<double_t>(end - fStart).count();
+    j["stages"] = nlohmann::json::object();
+    for (const auto &[name, stage] : fStages) {
+      j["stages"][name]["threadCount"] = stage.threads.size();
+      j["stages"][name]["total"] = GetTotal(stage);
+    }
+    j["queues"] = nlohmann::json::object();
+    for (const auto &queue : fQueues) {
+      auto &q = j["queues"][queue.name];
+      q["depth"] = queue.last;
+      q["max"] = queue.max;
+      q["mean"] = queue.samples > 0 ? double_t(queue.sum) / queue.samples : 0.;
+      q["capacity"] = queue.capacity;
+    }
+    return j;
+  };
+
+  void OpenLive()
+  {
+    CloseLive();
+    const std::string scheme = "udp://";
+    if (fLiveTarget.rfind(scheme, 0) != 0) {
+      fLiveFile.open(fLiveTarget, std::ios::trunc);
+      if (!fLiveFile) {
+        throw DELILA::FileException("Could not open metrics live file: " +
+                                    fLiveTarget);
+      }
+      return;
+    }
+
+    const auto address = fLiveTarget.substr(scheme.size());
+    const auto colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0 ||
+        colon + 1 == address.size()) {
+      throw DELILA::ConfigException("Metrics live target must be udp://host:port: " +
+                                    fLiveTarget);
+    }
+    const auto host = address.substr(0, colon);
+    const auto port = address.substr(colon + 1);
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0 ||
+        !result) {
+      throw DELILA::ConfigException("Could not resolve metrics live target: " +
+                                    fLiveTarget);
+    }
+    fSocket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    std::copy_n(reinterpret_cast<const char *>(result->ai_addr),
+                result->ai_addrlen, reinterpret_cast<char *>(&fAddress));
+    fAddressLength = result->ai_addrlen;
+    freeaddrinfo(result);
+    if (fSocket < 0) {
+      throw DELILA::ConfigException("Could not open a socket for: " +
+                                    fLiveTarget);
+    }
+  };
+
+  // Snapshots are lost rather than slowing the run down
+  void WriteLive(const nlohmann::json &snapshot)
+  {
+    const auto line = snapshot.dump();
+    if (fLiveFile.is_open()) {
+      fLiveFile << line << std::endl;
+    } else if (fSocket >= 0) {
+      sendto(fSocket, line.data(), line.size(), 0,
+             reinterpret_cast<const sockaddr *>(&fAddress), fAddressLength);
+    }
+  };
+
+  void CloseLive()
+  {
+    if (fLiveFile.is_open()) {
+      fLiveFile.close();
+    }
+    if (fSocket >= 0) {
+      close(fSocket);
+      fSocket = -1;
+    }
+  };
+};
+
+}  // namespace DELILA
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef SPSCQueue_hpp
+#define SPSCQueue_hpp 1
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace DELILA
+{
+
+// Lock-free ring buffer for exactly one producer and one consumer thread.
+// The capacity is rounded up to a power of two.  TryPush / TryPop never
+// block; Push / Pop sleep on an atomic wait while the queue is full /
+// empty instead of spinning.  Close() has the same meaning as for
+// BoundedQueue: pending items can still be popped, after that Pop()
+// returns std::nullopt and Push() returns false.
+template <typename T>
+class SPSCQueue
+{
+ public:
+  explicit SPSCQueue(const size_t capacity)
+      : fBuffer(std::bit_ceil(capacity > 0 ? capacity : 1)),
+        fMask(fBuffer.size() - 1) {};
+  ~SPSCQueue() = default;
+
+  SPSCQueue(const SPSCQueue &) = delete;
+  SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+  // Producer side.  The item is only moved from if it was queued.
+  bool TryPush(T &&item)
+  {
+    const auto tail = fTail.load(std::memory_order_relaxed);
+    if (tail - fHead.load(std::memory_order_acquire) > fMask) {
+      return false;
+    }
+    fBuffer[tail & fMask] = std::move(item);
+    fTail.store(tail + 1, std::memory_order_release);
+    Signal();
+    return true;
+  };
+  bool Push(T &&item)
+  {
+    while (true) {
+      const auto signal = fSignal.load(std::memory_order_acquire);
+      if (fClosed.load(std::memory_order_acquire)) {
+        return false;
+      }
+      if (TryPush(std::move(item))) {
+        return true;
+      }
+      Wait(signal);
+    }
+  };
+
+  // Consumer side
+  std::optional<T> TryPop()
+  {
+    const auto head = fHead.load(std::memory_order_relaxed);
+    if (head == fTail.load(std::memory_order_acquire)) {
+      return std::nullopt;
+    }
+    std::optional<T> item(std::move(fBuffer[head & fMask]));
+    fHead.store(head + 1, std::memory_order_release);
+    Signal();
+    return item;
+  };
+  std::optional<T> Pop()
+  {
+    while (true) {
+      const auto signal = fSignal.load(std::memory_order_acquire);
+      const auto closed = fClosed.load(std::memory_order_acquire);
+      if (auto item = TryPop()) {
+        return item;
+      }
+      if (closed) {
+        return std::nullopt;
+      }
+      Wait(signal);
+    }
+  };
+
+  void Close()
+  {
+    fClosed.store(true, std::memory_order_release);
+    Signal();
+  };
+
+  size_t Size() const
+  {
+    return fTail.load(std::memory_order_acquire) -
+           fHead.load(std::memory_order_acquire);
+  };
+  size_t Capacity() const { return fBuffer.size(); };
+
+ private:
+  // Head and tail on their own cache lines, each is written by one side only
+  static constexpr size_t kCacheLine = 64;
+
+  std::vector<T> fBuffer;
+  const uint64_t fMask;
+  alignas(kCacheLine) std::atomic<uint64_t> fHead{0};
+  alignas(kCacheLine) std::atomic<uint64_t> fTail{0};
+  // Bumped by every push, pop and close, the waiting side sleeps on it.
+  // notify_all is cheap while nobody waits.
+  alignas(kCacheLine) std::atomic<uint32_t> fSignal{0};
+  std::atomic<bool> fClosed{false};
+
+  void Signal()
+  {
+    fSignal.fetch_add(1, std::memory_order_acq_rel);
+    fSignal.notify_all();
+  };
+  void Wait(const uint32_t signal) { fSignal.wait(signal); };
+};
+
+}  // namespace DELILA
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef SettingsCache_hpp
+#define SettingsCache_hpp 1
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "ContentHash.hpp"
+
+namespace DELILA
+{
+
+// Binary copy of a JSON settings file, next to it: chSettings.json ->
+// chSettings.bin.  The cache holds the hash of the JSON content, it is
+// used only while the JSON is byte for byte the one it was made of, so an
+// edited JSON is parsed again and the cache rewritten.  Hashing the file
+// is much faster than parsing it.  Writing is best effort (the settings
+// may be in a read-only directory); a failed or corrupt cache only costs
+// the JSON parse.
+class SettingsCache
+{
+ public:
+  typedef char Magic_t[8];  // Kind and version of the cached content
+
+  static void SetEnabled(const bool enabled) { Enabled() = enabled; };
+  static bool IsEnabled() { return Enabled(); };
+
+  static std::string GetCacheFileName(const std::string &jsonFileName)
+  {
+    return std::filesystem::path(jsonFileName).replace_extension(".bin");
+  };
+
+  // Whole file, false when it can not be read
+  static bool ReadFile(const std::string &fileName, std::string &content)
+  {
+    std::ifstream ifs(fileName, std::ios::binary);
+    if (!ifs) {
+      return false;
+    }
+    std::ostringstream ss;
+    ss << ifs.rdbuf();
+    content = ss.str();
+    return true;
+  };
+
+  static uint64_t Hash(const std::string &content)
+  {
+    return HashBytes(content.data(), content.size());
+  };
+
+  // Opens the cache of jsonFileName, true when it is of this kind and of
+  // the JSON content with this hash.  ifs is then at the cached content.
+  static bool Open(std::ifstream &ifs, const std::string &jsonFileName,
+                   const Magic_t &magic, const uint64_t hash)
+  {
+    if (!IsEnabled()) {
+      return false;
+    }
+    ifs.open(GetCacheFileName(jsonFileName), std::ios::binary);
+    Magic_t fileMagic;
+    ifs.read(fileMagic, sizeof(fileMagic));
+    const auto fileHash = Read<uint64_t>(ifs);
+    return ifs && std::memcmp(fileMagic, magic, sizeof(magic)) == 0 &&
+           fileHash == hash;
+  };
+
+  // write writes the content.  Temporary file of this process and rename,
+  // concurrent jobs (shards) never see a half written cache.
+  static void Save(const std::string &jsonFileName, const Magic_t &magic,
+                   const uint64_t hash,
+                   const std::function<void(std::ostream &)> &write)
+  {
+    if (!IsEnabled()) {
+      return;
+    }
+    const auto fileName = GetCacheFileName(jsonFileName);
+    const auto tmpName = fileName + "." + std::to_string(::getpid()) + ".tmp";
+    std::ofstream ofs(tmpName, std::ios::binary);
+    ofs.write(magic, sizeof(magic));
+    Write(ofs, hash);
+    write(ofs);
+    ofs.close();
+    std::error_code error;
+    if (ofs) {
+      std::filesystem::rename(tmpName, fileName, error);
+    }
+    if (!ofs || error) {
+      std::filesystem::remove(tmpName, error);
+      std::cerr << "Warning: Could not write settings cache " << fileName
+                << std::endl;
+    }
+  };
+
+  template <typename T>
+  static void Write(std::ostream &os, const T value)
+  {
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  };
+  template <typename T>
+  static T Read(std::istream &is)
+  {
+    T value{};
+    is.read(reinterpret_cast<char *>(&value), sizeof(T));
+    return value;
+  };
+  static void WriteString(std::ostream &os, const std::string &value)
+  {
+    Write(os, uint32_t(value.size()));
+    os.write(value.data(), value.size());
+  };
+  // A corrupt length fails the stream instead of allocating it
+  static std::string ReadString(std::istream &is)
+  {
+    const auto size = Read<uint32_t>(is);
+    std::string value;
+    if (size > kMaxStringSize) {
+      is.setstate(std::ios::failbit);
+    } else if (is) {
+      value.resize(size);
+      is.read(value.data(), size);
+    }
+    return value;
+  };
+
+ private:
+  static constexpr uint32_t kMaxStringSize = 1 << 20;
+
+  static bool &Enabled()
+  {
+    static bool enabled = true;
+    return enabled;
+  };
+};
+
+}  // namespace DELILA
+
+#endif
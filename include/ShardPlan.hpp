@@ -0,0 +1,276 @@
+#ifndef ShardPlan_hpp
+#define ShardPlan_hpp 1
+
+#include <RtypesCore.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "DELILAExceptions.hpp"
+#include "EventIndex.hpp"
+#include "RunCatalog.hpp"
+#include "Timestamp.hpp"
+
+namespace DELILA
+{
+
+const std::string kShardPlanFileName = "shardPlan.json";
+// Written into the shard directory when the shard is built completely
+const std::string kShardDoneFileName = "shardDone.json";
+
+// One independent part of a run for the sharded mode
+struct Shard_t {
+  uint32_t index = 0;
+  std::vector<std::string> files;  // Guard and owned files, in run order
+  std::vector<int64_t> entries;
+  size_t firstOwned = 0;  // files[firstOwned, firstOwned + nOwned) are owned
+  size_t nOwned = 0;
+  // [startTS, endTS) [ps]: only triggers in here are built by this shard
+  Timestamp_t startTS = kMinTimestamp;
+  Timestamp_t endTS = kMaxTimestamp;
+};
+
+// Split of a run into shards that are built on separate nodes.
+// Every shard owns a contiguous range of files with about the same number
+// of entries, and a shard never spans an acquisition restart.  Two shards
+// of one acquisition are cut at the first time stamp of the first file of
+// the later shard; each builds only the triggers on its side of the cut.
+// The neighbouring files within the guard (coincidence window and time
+// offsets) of a cut are read too, so the events at the cut are complete
+// and every trigger is built by exactly one shard, as in one process.
+class ShardPlan
+{
+ public:
+  ShardPlan() = default;
+  ~ShardPlan() = default;
+
+  // files: inspected (entries, first and last time stamps), in run order.
+  // guard [ns].  Gives more shards than nShards with more acquisitions.
+  static ShardPlan Make(const std::vector<RunFileInfo_t *> &files,
+                        const uint32_t nShards, const double_t guard)
+  {
+    if (nShards == 0) {
+      throw DELILA::ValidationException("Number of shards must be positive");
+    }
+    std::vector<RunFileInfo_t *> valid;
+    int64_t totalEntries = 0;
+    for (auto *info : files) {
+      if (info->entries > 0) {
+        valid.push_back(info);
+        totalEntries += info->entries;
+      }
+    }
+    ShardPlan plan;
+    if (valid.empty()) {
+      return plan;
+    }
+
+    // Acquisition of every file, shards are cut at every restart
+    std::vector<uint32_t> acquisition(valid.size(), 0);
+    for (const auto i : RunCatalog::FindRestarts(valid)) {
+      for (auto j = i; j < valid.size(); j++) {
+        acquisition[j]++;
+      }
+    }
+    const auto target = (totalEntries + nShards - 1) / nShards;
+    std::vector<size_t> firsts = {0};
+    int64_t shardEntries = 0;
+    for (size_t i = 0; i < valid.size(); i++) {
+      if (i > 0 && (acquisition[i] != acquisition[i - 1] ||
+                    shardEntries >= target)) {
+        firsts.push_back(i);
+        shardEntries = 0;
+      }
+      shardEntries += valid[i]->entries;
+    }
+    firsts.push_back(valid.size());
+
+    auto cutTS = [&](const size_t i) {
+      return (i == 0 || i == valid.size() ||
+              acquisition[i] != acquisition[i - 1])
+                 ? kMinTimestamp
+                 : NsToTimestamp(valid[i]->firstTS);
+    };
+    for (size_t s = 0; s + 1 < firsts.size(); s++) {
+      const auto a = firsts[s];
+      const auto b = firsts[s + 1];
+      Shard_t shard;
+      shard.index = s;
+      shard.startTS = cutTS(a);
+      shard.endTS = cutTS(b) == kMinTimestamp ? kMaxTimestamp : cutTS(b);
+
+      // Guard files of the same acquisition, at least the neighbour
+      auto first = a;
+      if (shard.startTS != kMinTimestamp) {
+        while (first > 0 && acquisition[first - 1] == acquisition[a] &&
+               (first == a ||
+                valid[first - 1]->lastTS >= valid[a]->firstTS - guard)) {
+          first--;
+        }
+      }
+      auto last = b;
+      if (shard.endTS != kMaxTimestamp) {
+        while (last < valid.size() && acquisition[last] == acquisition[a] &&
+               (last == b || valid[last]->firstTS <= valid[b]->firstTS + guard)) {
+          last++;
+        }
+      }
+      // Absolute, the shards are built in their own directories
+      for (auto i = first; i < last; i++) {
+        shard.files.push_back(std::filesystem::absolute(valid[i]->path));
+        shard.entries.push_back(valid[i]->entries);
+      }
+      shard.firstOwned = a - first;
+      shard.nOwned = b - a;
+      plan.fShards.push_back(shard);
+    }
+    return plan;
+  };
+
+  void Save(const std::string &fileName = kShardPlanFileName) const
+  {
+    nlohmann::json j;
+    j["Shards"] = nlohmann::json::array();
+    for (const auto &shard : fShards) {
+      j["Shards"].push_back({{"Index", shard.index},
+                             {"Files", shard.files},
+                             {"Entries", shard.entries},
+                             {"FirstOwned", shard.firstOwned},
+                             {"NumberOfOwned", shard.nOwned},
+                             {"StartTS", shard.startTS},
+                             {"EndTS", shard.endTS}});
+    }
+    std::ofstream ofs(fileName);
+    ofs << j.dump(2) << std::endl;
+    if (!ofs) {
+      throw DELILA::FileException("Could not write shard plan: " + fileName);
+    }
+  };
+
+  static ShardPlan Load(const std::string &fileName = kShardPlanFileName)
+  {
+    std::ifstream ifs(fileName);
+    if (!ifs) {
+      throw DELILA::FileException("Could not open shard plan: " + fileName);
+    }
+    ShardPlan plan;
+    try {
+      nlohmann::json j;
+      ifs >> j;
+      for (const auto &item : j.at("Shards")) {
+        Shard_t shard;
+        shard.index = item.at("Index").get<uint32_t>();
+        shard.files = item.at("Files").get<std::vector<std::string>>();
+        shard.entries = item.at("Entries").get<std::vector<int64_t>>();
+        shard.firstOwned = item.at("FirstOwned").get<size_t>();
+        shard.nOwned = item.at("NumberOfOwned").get<size_t>();
+        shard.startTS = item.at("StartTS").get<Timestamp_t>();
+        shard.endTS = item.at("EndTS").get<Timestamp_t>();
+        if (shard.entries.size() != shard.files.size() ||
+            shard.firstOwned + shard.nOwned > shard.files.size() ||
+            shard.index != plan.fShards.size()) {
+          throw DELILA::ValidationException("Shard " +
+                                            std::to_string(shard.index) +
+                                            " is inconsistent");
+        }
+        plan.fShards.push_back(shard);
+      }
+    } catch (const nlohmann::json::exception &e) {
+      throw DELILA::JSONException("Invalid shard plan " + fileName + ": " +
+                                  e.what());
+    }
+    return plan;
+  };
+
+  // Working directory of a shard, its outputs, checkpoint and report
+  static std::string GetShardDirectory(const uint32_t index)
+  {
+    return "shard_" + std::to_string(index);
+  };
+
+  // In the shard directory, after the shard was built completely
+  static void MarkDone(const uint32_t index, const std::string &level)
+  {
+    std::ofstream ofs(kShardDoneFileName);
+    ofs << nlohmann::json({{"Index", index}, {"Level", level}}).dump()
+        << std::endl;
+  };
+
+  // Merge step: moves the L1_N.root or L2_N.root of every shard (and its
+  // index), in shard order, here and numbers them on, as written by one
+  // process.  Nothing is moved while a shard is not complete (no done
+  // marker).  Returns the number of files, level is the level the shards
+  // were built to.
+  size_t CollectOutputs(std::string &level) const
+  {
+    level.clear();
+    std::vector<std::string> outputs;
+    for (const auto &shard : fShards) {
+      const auto directory = GetShardDirectory(shard.index);
+      std::ifstream ifs(std::filesystem::path(directory) / kShardDoneFileName);
+      if (!ifs) {
+        throw DELILA::FileException("Shard " + std::to_string(shard.index) +
+                                    " is not complete, no " + directory +
+                                    "/" + kShardDoneFileName);
+      }
+      std::string shardLevel;
+      try {
+        nlohmann::json j;
+        ifs >> j;
+        shardLevel = j.at("Level").get<std::string>();
+      } catch (const nlohmann::json::exception &e) {
+        throw DELILA::JSONException("Invalid " + directory + "/" +
+                                    kShardDoneFileName + ": " + e.what());
+      }
+      if (!level.empty() && shardLevel != level) {
+        throw DELILA::ValidationException(
+            "Shard " + std::to_string(shard.index) + " is built to " +
+            shardLevel + ", the shards before to " + level);
+      }
+      level = shardLevel;
+      const auto files = RunCatalog::FindNumberedFiles(directory, level);
+      outputs.insert(outputs.end(), files.begin(), files.end());
+    }
+    if (outputs.empty()) {
+      return 0;
+    }
+
+    for (const auto &file : RunCatalog::FindNumberedFiles(".", level)) {
+      std::filesystem::remove(file);
+      EventIndex::RemoveIndexFile(file);
+    }
+    // The event index of an output goes with it, its entries stay valid
+    for (size_t i = 0; i < outputs.size(); i++) {
+      const auto output = level + "_" + std::to_string(i) + ".root";
+      std::filesystem::rename(outputs[i], output);
+      if (std::filesystem::exists(EventIndex::GetIndexFileName(outputs[i]))) {
+        std::filesystem::rename(EventIndex::GetIndexFileName(outputs[i]),
+                                EventIndex::GetIndexFileName(output));
+      }
+    }
+    return outputs.size();
+  };
+
+  const std::vector<Shard_t> &GetShards() const { return fShards; };
+  const Shard_t &GetShard(const uint32_t index) const
+  {
+    if (index >= fShards.size()) {
+      throw DELILA::RangeException("Shard " + std::to_string(index) +
+                                   " is not in the plan of " +
+                                   std::to_string(fShards.size()) + " shards");
+    }
+    return fShards[index];
+  };
+
+ private:
+  std::vector<Shard_t> fShards;
+};
+
+}  // namespace DELILA
+
+#endif
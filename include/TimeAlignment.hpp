@@ -6,17 +6,25 @@
 #include <TH2.h>
 
 #include <atomic>
+#include <functional>
 #include <mutex>
 #include <string>
 #include <vector>
 
 #include "ChSettings.hpp"
+#include "ChannelTable.hpp"
+#include "CompactHistogram.hpp"
+#include "HitFilter.hpp"
+#include "RunMetrics.hpp"
+#include "WorkerTiming.hpp"
 
 namespace DELILA
 {
 
 const std::string kTimeAlignmentFileName = "timeAlignment.root";
 const std::string kTimeSettingsFileName = "timeSettings.json";
+// Histogram hashes and offsets of the last CalculateTimeAlignment
+const std::string kTimeCacheFileName = "timeSettings.cache.json";
 
 class TimeAlignment
 {
@@ -25,39 +33,85 @@ class TimeAlignment
   ~TimeAlignment();
 
   void LoadChSettings(const std::string &fileName);
-  void LoadFileList(const std::vector<std::string> &fileList);
+  // With the entries per file (-1: unknown) the largest files are taken
+  // first, so no thread starts a big file when the others are done
+  void LoadFileList(const std::vector<std::string> &fileList,
+                    const std::vector<int64_t> &fileEntries = {});
   void SetTimeWindow(double_t timeWindow) { fTimeWindow = timeWindow; }
+  // Fast calibration: stop when every pair of a trigger channel and a
+  // channel with data has minEntries entries in the window, 0: read all
+  void SetMinEntries(const uint64_t minEntries);
+  // Fast calibration: read only this fraction of every chunk, (0, 1]
+  void SetSampleFraction(const double_t fraction);
   void InitHistograms();
+  // Adds the files of the last LoadFileList to the histograms of the calls
+  // since InitHistograms and saves them, so a followed run can be filled
+  // version by version
   void FillHistograms(const int nThreads);
   void CalculateTimeAlignment();
   void Cancel() { fCancelled.store(true); }
+  // Set by Ctrl-C, the follow mode stops waiting for files on it
+  const std::atomic<bool> &GetCancelFlag() const { return fCancelled; }
+  // Stages fill (per thread), merge and fit
+  RunMetrics &GetMetrics() { return fMetrics; }
 
  private:
   std::vector<std::vector<ChSettings_t>> fChSettingsVec;
-  std::vector<std::vector<std::unique_ptr<TH2D>>> fHistoTime;
-  std::vector<std::vector<std::unique_ptr<TH1D>>> fHistoADC;
+  ChannelTable fChannelTable;  // Hot path copy of fChSettingsVec
+  HitFilter fHitFilter;
   double_t fTimeWindow = 0.;
+  size_t fNThreads = 0;  // Of the last FillHistograms, 0: all cores
 
   std::atomic<bool> fDataProcessFlag{false};
   std::vector<std::string> fFileList;
   std::atomic<bool> fCancelled{false};
   std::mutex fFileListMutex;
-  std::mutex fHistogramMutex;  // For mutex-based approach
+  std::vector<WorkerTiming_t> fWorkerTimings;
+  RunMetrics fMetrics;
 
   // Chunked processing configuration to limit memory usage
   static constexpr int64_t CHUNK_SIZE = 10000000;  // 10M entries per chunk
 
-  // Thread-local histograms for parallel filling
+  // Stopping rule and sampling
+  uint64_t fMinEntries = 0;
+  double_t fSampleFraction = 1.;
+  std::atomic<bool> fStatisticsReached{false};
+  std::vector<std::atomic<uint64_t>> fPairEntries;  // [slot * fMaxID + ID]
+  std::vector<std::atomic<bool>> fLiveIDs;          // IDs with hits
+
+  // Only trigger channels have time histograms, the memory scales with
+  // the number of trigger channels and the IDs they actually see
+  static constexpr int32_t kADCBins = 32000;
+  int32_t fMaxID = 0;
+  std::vector<int32_t> fTriggerSlot;       // Flat index -> histoTime, -1: none
+  std::vector<uint32_t> fTriggerChannels;  // histoTime -> flat index
   struct ThreadHistograms {
-    std::vector<std::vector<std::unique_ptr<TH2D>>> histoTime;
-    std::vector<std::vector<std::unique_ptr<TH1D>>> histoADC;
+    std::vector<CompactHistogram> histoTime;  // Per trigger channel
+    std::vector<CompactHistogram> histoADC;   // Per flat channel index
   };
+  ThreadHistograms fHistograms;  // Empty by InitHistograms, merged result
+  ThreadHistograms fEmptyHistograms;  // Copied for every fill thread
+  uint32_t fNFills = 0;               // FillHistograms since InitHistograms
   std::vector<ThreadHistograms> fThreadHistograms;
 
   void DataProcess(int threadID);
+  // Adds the pair counts of one chunk to the shared ones, checks the rule
+  void PublishStatistics(std::vector<uint64_t> &pairCounts,
+                         const std::vector<Timestamp_t> &lastTime);
   void MergeThreadHistograms();
   void SaveHistograms();
 
+  // Offset extraction, one reference histogram per call
+  struct TimeTarget_t {
+    int32_t bin = 0;     // Y bin of the channel ID
+    int32_t nGroup = 1;  // Rebinning of the time axis
+  };
+  std::vector<std::vector<double_t>> FindTimeOffsets(
+      TH2D *hist, const std::vector<std::vector<TimeTarget_t>> &targets) const;
+  static uint64_t HashHistogram(TH2D *hist);
+  static void ParallelFor(const size_t n, size_t nThreads,
+                          const std::function<void(size_t)> &fn);
+
   // For fitting ADC spectrum
   // Have to be a different class
   std::vector<TF1 *> FitHist(TH1D *hist);
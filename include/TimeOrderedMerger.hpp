@@ -0,0 +1,183 @@
+#ifndef TimeOrderedMerger_hpp
+#define TimeOrderedMerger_hpp 1
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <vector>
+
+#include "BoundedQueue.hpp"
+#include "HitBufferPool.hpp"
+#include "Timestamp.hpp"
+
+namespace DELILA
+{
+
+// One contiguous range of entries [firstEntry, lastEntry) of one input file
+struct ChunkTask {
+  size_t fileIndex = 0;
+  Long64_t firstEntry = 0;
+  Long64_t lastEntry = 0;
+};
+
+// Time ordered piece of the merged hit stream handed to the event builders.
+// A slice owns the half-open time range [coreStartTS, coreEndTS): only
+// triggers inside it are built by this slice, so a trigger is emitted by
+// exactly one slice no matter which worker gets which slice.  The hits in
+// [coreStartTS - window, coreStartTS) and [coreEndTS, coreEndTS + window] are
+// copies of the neighbouring slices and only complete the coincidence window
+// of the triggers close to the edges.  hits[coreBegin, coreEnd) is the core.
+struct HitSlice {
+  uint64_t sliceID = 0;
+  HitVec_t hits;
+  size_t coreBegin = 0;
+  size_t coreEnd = 0;
+  Timestamp_t coreStartTS = 0;  // [ps]
+  Timestamp_t coreEndTS = 0;
+
+  bool IsOwner(const Timestamp_t ts) const
+  {
+    return ts >= coreStartTS && ts < coreEndTS;
+  };
+};
+
+// Streaming k-way merge of the chunks of all input files.
+// Chunks are loaded (filtered, time corrected and sorted) by a pool of reader
+// threads in file order, a few chunks ahead of the merge point.  The merger
+// keeps every loaded chunk whose time range is still open in a heap and emits
+// hits in one global time order, cut into slices for the builder workers.
+// Hits are only emitted when they are earlier than the first hits of the next
+// two chunks in file order, so a file boundary never splits a coincidence
+// window.  A chunk starting earlier than those is sorted into the slices not
+// pushed yet, a hit of a slice already pushed makes Run() fail.
+// Slices are cut between two different time stamps and padded by exactly
+// the context window, so they can be built independently and in parallel.
+// Follow mode: tasks can be added between runs.  A run that is not the end
+// of the data keeps the merge state (hits that a later file can still
+// precede, the open slice and the slices waiting for their trailing pad),
+// so a file boundary between two runs is merged like any other.
+// Checkpoints: that state can be saved between two runs and loaded into a
+// merger of the same tasks, which then goes on with the next task.
+class TimeOrderedMerger
+{
+ public:
+  // Fills the given (empty, pooled) buffer with the sorted hits of a chunk
+  using ChunkLoader = std::function<HitVec_t(const ChunkTask &, HitVec_t &&)>;
+
+  TimeOrderedMerger(std::vector<ChunkTask> tasks, ChunkLoader loader,
+                    BoundedQueue<HitSlice> &output);
+  // SetOutput() before SetNumberOfReaders() and Run()
+  TimeOrderedMerger(std::vector<ChunkTask> tasks, ChunkLoader loader);
+  ~TimeOrderedMerger();
+
+  // Queue of the next Run(), its capacity sizes the buffer pool
+  void SetOutput(BoundedQueue<HitSlice> &output) { fOutput = &output; }
+  // Appended behind the tasks given so far
+  void AddTasks(const std::vector<ChunkTask> &tasks)
+  {
+    fTasks.insert(fTasks.end(), tasks.begin(), tasks.end());
+  }
+  void SetNumberOfReaders(const uint32_t nReaders);
+  void SetSliceSize(const size_t sliceSize) { fSliceSize = sliceSize; }
+  // Padding [ps] added on both sides of every slice, the coincidence window
+  void SetContextWindow(const Timestamp_t window) { fContextWindow = window; }
+  // Backward jump of the time stamps [ps] treated as an acquisition restart
+  void SetResetThreshold(const Timestamp_t threshold)
+  {
+    fResetThreshold = threshold;
+  }
+
+  // Blocks until the chunks not merged yet are merged and pushed (or
+  // cancelled).  Does not close the output queue, the caller owns it.
+  // Throws ValidationException after the readers stopped if hits arrived
+  // too late for their slice.
+  // endOfData == false: hits later than the stream horizon of the last
+  // chunk, and the slices they complete, are kept for the next Run()
+  void Run(const std::atomic<bool> &cancelled, const bool endOfData = true);
+
+  uint64_t GetNumberOfSlices() const { return fNextSliceID; }
+  uint64_t GetNumberOfLateHits() const { return fLateHits; }
+  uint32_t GetNumberOfResets() const { return fResets; }
+  // Tasks merged so far, the next Run() starts with this one
+  size_t GetNumberOfMergedTasks() const { return fConsumed; }
+
+  // Between two Run()s only.  LoadState throws FileException on a
+  // truncated or foreign stream.
+  void SaveState(std::ostream &os) const;
+  void LoadState(std::istream &is);
+
+  // Chunk and slice buffers are recycled through this pool, consumers of the
+  // output queue should release the finished slices here.
+  HitBufferPool &GetBufferPool() { return fBufferPool; }
+
+ private:
+  std::vector<ChunkTask> fTasks;
+  ChunkLoader fLoader;
+  BoundedQueue<HitSlice> *fOutput = nullptr;
+  HitBufferPool fBufferPool;
+
+  uint32_t fNReaders = 1;
+  size_t fWindow = 2;  // Number of chunks loaded ahead of the merge point
+  size_t fSliceSize = 1000000;
+  Timestamp_t fContextWindow = 0;
+  Timestamp_t fResetThreshold = Timestamp_t(10e9) * kPsPerNs;  // 10 s
+
+  // Prefetch slots filled by the reader threads
+  std::vector<HitVec_t> fSlots;
+  std::vector<bool> fSlotReady;
+  size_t fConsumed = 0;  // All tasks below this index are taken by the merger
+  std::atomic<size_t> fNextTask{0};
+  std::mutex fSlotMutex;
+  std::condition_variable fSlotReadyCond;
+  std::condition_variable fWindowCond;
+
+  void ReaderLoop(const std::atomic<bool> &cancelled);
+  bool WaitForSlot(const size_t index, const std::atomic<bool> &cancelled);
+
+  // Merge state
+  struct Run_t {
+    HitVec_t hits;
+    size_t pos = 0;
+  };
+  std::vector<Run_t> fRuns;
+  std::vector<std::pair<Timestamp_t, size_t>> fHeap;  // (head time, run)
+  Timestamp_t fSegmentMaxTS = 0;
+  Timestamp_t fLastEmittedTS = 0;
+  Timestamp_t fPushedEndTS = 0;  // End of the trailing pad of the last push
+  bool fSegmentEmpty = true;
+  bool fStop = false;
+  bool fOpen = false;  // State kept from a Run() before the end of the data
+
+  void Activate(HitVec_t &&hits);
+  Timestamp_t GetHorizon() const;
+  void EmitBefore(const Timestamp_t watermark);
+  void EmitAll();
+  void Emit(const RawHit_t &hit);
+
+  // Slice assembly
+  struct PendingSlice_t {
+    HitSlice slice;
+    bool isSorted = true;
+  };
+  HitSlice fCurrent;
+  bool fCurrentSorted = true;
+  bool fCutRequested = false;
+  std::deque<PendingSlice_t> fPending;  // Core closed, waiting for trailing pad
+  uint64_t fNextSliceID = 0;
+  uint64_t fLateHits = 0;
+  uint64_t fLostHits = 0;
+  uint32_t fResets = 0;
+
+  void CloseCurrent(const Timestamp_t cutTS);
+  void EndSegment();
+  void PushSlice(HitSlice &&slice, const bool isSorted);
+  static void SortSlice(HitSlice &slice);
+};
+
+}  // namespace DELILA
+
+#endif
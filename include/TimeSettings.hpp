@@ -0,0 +1,212 @@
+#ifndef TimeSettings_hpp
+#define TimeSettings_hpp 1
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "DELILAExceptions.hpp"
+#include "SettingsCache.hpp"
+
+namespace DELILA
+{
+
+// timeSettings.json: the time offset of every channel [mod][ch] for every
+// reference channel [refMod][refCh], a cube growing with the channels
+// squared.  A build uses one reference row only.  From the binary cache
+// (see SettingsCache) only the header is read at Load() and the row at
+// GetOffsets(), the rows are at fixed positions in the cache.  Without a
+// valid cache the JSON is parsed once and the cache written.
+class TimeSettings
+{
+ public:
+  TimeSettings() = default;
+  ~TimeSettings() = default;
+
+  void Load(const std::string &fileName)
+  {
+    fCube.clear();
+    fNRefChs.clear();
+    fRowPositions.clear();
+    fCache.close();
+
+    std::string content;
+    if (!SettingsCache::ReadFile(fileName, content)) {
+      throw DELILA::FileException("Could not open time settings file: " +
+                                  fileName);
+    }
+    const auto hash = SettingsCache::Hash(content);
+    if (OpenCache(fileName, hash)) {
+      return;
+    }
+
+    nlohmann::json timeJSON;
+    try {
+      timeJSON = nlohmann::json::parse(content);
+      if (timeJSON.empty()) {
+        throw DELILA::ConfigException("No time settings found in file: " +
+                                      fileName);
+      }
+      fCube.resize(timeJSON.size());
+      for (size_t iRefMod = 0; iRefMod < timeJSON.size(); iRefMod++) {
+        fCube[iRefMod].resize(timeJSON[iRefMod].size());
+        for (size_t iRefCh = 0; iRefCh < timeJSON[iRefMod].size(); iRefCh++) {
+          const auto &row = timeJSON[iRefMod][iRefCh];
+          fCube[iRefMod][iRefCh].resize(row.size());
+          for (size_t iMod = 0; iMod < row.size(); iMod++) {
+            fCube[iRefMod][iRefCh][iMod].resize(row[iMod].size());
+            for (size_t iCh = 0; iCh < row[iMod].size(); iCh++) {
+              fCube[iRefMod][iRefCh][iMod][iCh] =
+                  (iRefMod == iMod && iRefCh == iCh)
+                      ? 0.  // Reference channel has no offset
+                      : row[iMod][iCh]["TimeOffset"].get<double_t>();
+            }
+          }
+        }
+      }
+    } catch (const nlohmann::json::exception &e) {
+      fCube.clear();
+      throw DELILA::JSONException("Invalid JSON in time settings file " +
+                                  fileName + ": " + e.what());
+    }
+    for (const auto &refMod : fCube) {
+      fNRefChs.push_back(refMod.size());
+    }
+    WriteCache(fileName, hash);
+  };
+
+  // Reference modules, and reference channels of one of them
+  size_t GetNumberOfModules() const { return fNRefChs.size(); };
+  size_t GetNumberOfChannels(const size_t refMod) const
+  {
+    return refMod < fNRefChs.size() ? fNRefChs[refMod] : 0;
+  };
+
+  // [mod][ch] offsets for the reference channel
+  std::vector<std::vector<double_t>> GetOffsets(const size_t refMod,
+                                                const size_t refCh)
+  {
+    if (refCh >= GetNumberOfChannels(refMod)) {
+      throw DELILA::RangeException(
+          "No time settings for the reference module " +
+          std::to_string(refMod) + ", channel " + std::to_string(refCh));
+    }
+    if (!fCube.empty()) {
+      return fCube[refMod][refCh];
+    }
+
+    size_t row = refCh;
+    for (size_t i = 0; i < refMod; i++) {
+      row += fNRefChs[i];
+    }
+    typedef SettingsCache C;
+    fCache.clear();
+    fCache.seekg(fRowPositions[row]);
+    const auto nMods = C::Read<uint32_t>(fCache);
+    std::vector<std::vector<double_t>> offsets(nMods <= UINT16_MAX ? nMods
+                                                                   : 0);
+    for (auto &mod : offsets) {
+      const auto nChs = C::Read<uint32_t>(fCache);
+      if (!fCache || nChs > UINT16_MAX) {
+        fCache.setstate(std::ios::failbit);
+        break;
+      }
+      mod.resize(nChs);
+      fCache.read(reinterpret_cast<char *>(mod.data()),
+                  nChs * sizeof(double_t));
+    }
+    if (!fCache || nMods > UINT16_MAX) {
+      throw DELILA::FileException(
+          "Could not read the time settings cache of the reference module " +
+          std::to_string(refMod) + ", channel " + std::to_string(refCh));
+    }
+    return offsets;
+  };
+
+ private:
+  static constexpr SettingsCache::Magic_t kCacheMagic = {'E', 'L', 'I', 'F',
+                                                         'T', 'I', 'M', '1'};
+
+  // Filled when parsed from the JSON, empty when read from the cache
+  std::vector<std::vector<std::vector<std::vector<double_t>>>> fCube;
+  std::vector<uint32_t> fNRefChs;
+  // Kept open, a cache rewritten meanwhile is another file
+  std::ifstream fCache;
+  std::vector<uint64_t> fRowPositions;  // Of every row in refMod, refCh order
+
+  // Header: reference modules, their reference channels, row positions
+  bool OpenCache(const std::string &fileName, const uint64_t hash)
+  {
+    typedef SettingsCache C;
+    if (!SettingsCache::Open(fCache, fileName, kCacheMagic, hash)) {
+      fCache.close();
+      return false;
+    }
+    const auto nRefMods = C::Read<uint32_t>(fCache);
+    size_t nRows = 0;
+    for (uint32_t i = 0; fCache && nRefMods <= UINT16_MAX && i < nRefMods;
+         i++) {
+      fNRefChs.push_back(C::Read<uint32_t>(fCache));
+      if (fNRefChs.back() > UINT16_MAX) {
+        fCache.setstate(std::ios::failbit);
+      }
+      nRows += fNRefChs.back();
+    }
+    for (size_t i = 0; fCache && i < nRows; i++) {
+      fRowPositions.push_back(C::Read<uint64_t>(fCache));
+    }
+    if (!fCache || nRefMods == 0 || fNRefChs.size() != nRefMods ||
+        fRowPositions.size() != nRows) {
+      std::cerr << "Warning: Ignoring the corrupt cache of " << fileName
+                << std::endl;
+      fNRefChs.clear();
+      fRowPositions.clear();
+      fCache.close();
+      return false;
+    }
+    return true;
+  };
+
+  void WriteCache(const std::string &fileName, const uint64_t hash) const
+  {
+    SettingsCache::Save(fileName, kCacheMagic, hash, [this](std::ostream &os) {
+      typedef SettingsCache C;
+      C::Write(os, uint32_t(fNRefChs.size()));
+      size_t nRows = 0;
+      for (const auto nRefChs : fNRefChs) {
+        C::Write(os, nRefChs);
+        nRows += nRefChs;
+      }
+      // Rows follow the position table, positions are from the file start
+      uint64_t position = sizeof(SettingsCache::Magic_t) + sizeof(uint64_t) +
+                          (1 + fNRefChs.size()) * sizeof(uint32_t) +
+                          nRows * sizeof(uint64_t);
+      for (const auto &refMod : fCube) {
+        for (const auto &row : refMod) {
+          C::Write(os, position);
+          position += sizeof(uint32_t);
+          for (const auto &mod : row) {
+            position += sizeof(uint32_t) + mod.size() * sizeof(double_t);
+          }
+        }
+      }
+      for (const auto &refMod : fCube) {
+        for (const auto &row : refMod) {
+          C::Write(os, uint32_t(row.size()));
+          for (const auto &mod : row) {
+            C::Write(os, uint32_t(mod.size()));
+            os.write(reinterpret_cast<const char *>(mod.data()),
+                     mod.size() * sizeof(double_t));
+          }
+        }
+      }
+    });
+  };
+};
+
+}  // namespace DELILA
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef Timestamp_hpp
+#define Timestamp_hpp 1
+
+#include <RtypesCore.h>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace DELILA
+{
+
+// Internal time stamp: integer picoseconds.  Sorting, merging and window
+// tests on it are exact at any absolute time, a double in ns can not hold
+// every ps any more after about 70 minutes of run time.
+// The files keep FineTS (ps, double) and TriggerTime / hit times in ns,
+// conversions happen only at the edges.
+typedef int64_t Timestamp_t;
+
+constexpr Timestamp_t kPsPerNs = 1000;
+constexpr Timestamp_t kMinTimestamp = std::numeric_limits<Timestamp_t>::lowest();
+constexpr Timestamp_t kMaxTimestamp = std::numeric_limits<Timestamp_t>::max();
+
+// FineTS [ps] of the raw data, rounded to the nearest ps
+inline Timestamp_t ToTimestamp(const double_t ps)
+{
+  return std::llround(ps);
+}
+// Settings (windows, time offsets) are given in ns
+inline Timestamp_t NsToTimestamp(const double_t ns)
+{
+  return std::llround(ns * kPsPerNs);
+}
+inline double_t ToNs(const Timestamp_t ts)
+{
+  return double_t(ts) / kPsPerNs;
+}
+
+}  // namespace DELILA
+
+#endif
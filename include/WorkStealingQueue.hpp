@@ -0,0 +1,96 @@
+#ifndef WorkStealingQueue_hpp
+#define WorkStealingQueue_hpp 1
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace DELILA
+{
+
+// One task deque per worker, filled before the workers start.
+// A worker takes tasks from the front of its own deque, in the order they
+// were pushed.  When it runs dry it steals from the back of the next
+// non-empty deque, so a worker with slow tasks loses its last tasks first.
+// Tasks are coarse (file entry ranges), a mutex per deque is enough.
+template <typename T>
+class WorkStealingQueue
+{
+ public:
+  explicit WorkStealingQueue(const size_t nWorkers)
+  {
+    for (size_t i = 0; i < (nWorkers > 0 ? nWorkers : 1); i++) {
+      fLanes.emplace_back(std::make_unique<Lane>());
+    }
+  };
+  ~WorkStealingQueue() = default;
+
+  WorkStealingQueue(const WorkStealingQueue &) = delete;
+  WorkStealingQueue &operator=(const WorkStealingQueue &) = delete;
+
+  size_t GetNumberOfWorkers() const { return fLanes.size(); };
+  uint64_t GetNumberOfSteals() const { return fNSteals.load(); };
+
+  // Tasks left in all deques
+  size_t Size()
+  {
+    size_t size = 0;
+    for (auto &lane : fLanes) {
+      std::lock_guard<std::mutex> lock(lane->mutex);
+      size += lane->tasks.size();
+    }
+    return size;
+  };
+
+  void Push(const size_t worker, T &&task)
+  {
+    auto &lane = *fLanes[worker % fLanes.size()];
+    std::lock_guard<std::mutex> lock(lane.mutex);
+    lane.tasks.emplace_back(std::move(task));
+  };
+
+  // std::nullopt when every deque is empty
+  std::optional<T> Pop(const size_t worker)
+  {
+    const auto nLanes = fLanes.size();
+    const auto own = worker % nLanes;
+    {
+      auto &lane = *fLanes[own];
+      std::lock_guard<std::mutex> lock(lane.mutex);
+      if (!lane.tasks.empty()) {
+        std::optional<T> task(std::move(lane.tasks.front()));
+        lane.tasks.pop_front();
+        return task;
+      }
+    }
+
+    for (size_t i = 1; i < nLanes; i++) {
+      auto &lane = *fLanes[(own + i) % nLanes];
+      std::lock_guard<std::mutex> lock(lane.mutex);
+      if (!lane.tasks.empty()) {
+        std::optional<T> task(std::move(lane.tasks.back()));
+        lane.tasks.pop_back();
+        fNSteals++;
+        return task;
+      }
+    }
+    return std::nullopt;
+  };
+
+ private:
+  struct Lane {
+    std::mutex mutex;
+    std::deque<T> tasks;
+  };
+  std::vector<std::unique_ptr<Lane>> fLanes;
+  std::atomic<uint64_t> fNSteals{0};
+};
+
+}  // namespace DELILA
+
+#endif
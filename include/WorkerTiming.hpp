@@ -0,0 +1,49 @@
+#ifndef WorkerTiming_hpp
+#define WorkerTiming_hpp 1
+
+#include <RtypesCore.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace DELILA
+{
+
+// Wall time of one worker thread, from start to finish, and the part of
+// it spent on its own tasks.  Every worker writes only its own entry.
+struct WorkerTiming_t {
+  double_t wallTime = 0.;  // [s]
+  double_t busyTime = 0.;  // [s]
+  uint64_t nTasks = 0;
+};
+
+// Longest wall time over the mean, 1 is a perfect balance
+inline double_t GetImbalance(const std::vector<WorkerTiming_t> &timings)
+{
+  double_t sum = 0.;
+  double_t longest = 0.;
+  for (const auto &timing : timings) {
+    sum += timing.wallTime;
+    longest = std::max(longest, timing.wallTime);
+  }
+  return sum > 0. ? longest * timings.size() / sum : 1.;
+}
+
+inline void PrintWorkerTimings(const std::vector<WorkerTiming_t> &timings,
+                               const std::string &taskName)
+{
+  for (size_t i = 0; i < timings.size(); i++) {
+    std::cout << "Thread " << i << ": " << timings[i].wallTime
+              << " s wall, " << timings[i].busyTime << " s busy, "
+              << timings[i].nTasks << " " << taskName << std::endl;
+  }
+  std::cout << "Thread imbalance (longest / mean wall time): "
+            << GetImbalance(timings) << std::endl;
+}
+
+}  // namespace DELILA
+
+#endif
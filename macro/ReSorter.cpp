@@ -7,6 +7,8 @@
 #include <map>
 #include <vector>
 
+#include "../include/RawTreeReader.hpp"
+
 class TreeData
 {  // no getter setter.  using public member variables.
  public:
@@ -143,19 +145,9 @@ void ReSorter(const UInt_t runNumber)
       file->Close();
       continue;
     }
-    UChar_t Mod, Ch;
-    ULong64_t TimeStamp;
-    Double_t FineTS;
-    UShort_t ChargeLong;
-    UShort_t ChargeShort;
-    UInt_t RecordLength;
-    tree->SetBranchAddress("Mod", &Mod);
-    tree->SetBranchAddress("Ch", &Ch);
-    tree->SetBranchAddress("TimeStamp", &TimeStamp);
-    tree->SetBranchAddress("FineTS", &FineTS);
-    tree->SetBranchAddress("ChargeLong", &ChargeLong);
-    tree->SetBranchAddress("ChargeShort", &ChargeShort);
-    tree->SetBranchAddress("RecordLength", &RecordLength);
+    // Every column but the traces, read cluster by cluster
+    DELILA::RawTreeReader reader(tree, DELILA::RawTreeReader::kAll);
+    reader.SetPrefetch(true);
     // Get number of entries
     Long64_t nEntries = tree->GetEntries();
     if (nEntries == 0) {
@@ -166,10 +158,13 @@ void ReSorter(const UInt_t runNumber)
     // Read entries
     std::cout << "Reading file: " << fileName << " with " << nEntries
               << " entries." << std::endl;
-    for (Long64_t i = 0; i < nEntries; i++) {
-      tree->GetEntry(i);
-      data.emplace_back(Mod, Ch, TimeStamp, FineTS, ChargeLong, ChargeShort,
-                        RecordLength);
+    DELILA::RawColumns block;
+    while (reader.Next(block)) {
+      for (size_t i = 0; i < block.size(); i++) {
+        data.emplace_back(block.mod[i], block.ch[i], block.timeStamp[i],
+                          block.fineTS[i], block.chargeLong[i],
+                          block.chargeShort[i], block.recordLength[i]);
+      }
     }
     file->Close();
     fileCounter++;
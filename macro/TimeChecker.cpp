@@ -8,6 +8,8 @@
 #include <map>
 #include <vector>
 
+#include "../include/RawTreeReader.hpp"
+
 struct RunInfo {
   int runNumber;
   int version;
@@ -56,8 +58,9 @@ void TimeChecker()
         continue;
       }
 
-      Double_t fineTS;
-      tree->SetBranchAddress("FineTS", &fineTS);
+      // Only FineTS is needed, read it cluster by cluster
+      DELILA::RawTreeReader reader(tree, DELILA::RawTreeReader::kFineTS);
+      reader.SetPrefetch(true);
 
       Long64_t nEntries = tree->GetEntries();
       if (nEntries == 0) {
@@ -68,10 +71,12 @@ void TimeChecker()
 
       // Get min and max time
       Double_t minTime = 1e20, maxTime = -1e20;
-      for (Long64_t i = 0; i < nEntries; i++) {
-        tree->GetEntry(i);
-        if (fineTS < minTime) minTime = fineTS;
-        if (fineTS > maxTime) maxTime = fineTS;
+      DELILA::RawColumns block;
+      while (reader.Next(block)) {
+        const auto range =
+            std::minmax_element(block.fineTS.begin(), block.fineTS.end());
+        if (*range.first < minTime) minTime = *range.first;
+        if (*range.second > maxTime) maxTime = *range.second;
       }
 
       RunInfo info;
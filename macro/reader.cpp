@@ -14,27 +14,61 @@
 #include <iostream>
 #include <mutex>
 #include <nlohmann/json.hpp>
+#include <numeric>
 #include <string>
 #include <thread>
 #include <vector>
 
 #include "ChSettings.hpp"
 #include "EventData.hpp"
+#include "EventIndex.hpp"
+#include "EventTreeIO.hpp"
 #include "L2Conditions.hpp"
 #include "L2EventBuilder.hpp"
+#include "RunCatalog.hpp"
 
 std::vector<std::string> GetFileList(const std::string dirName)
 {
-  std::vector<std::string> fileList;
+  // L2_0.root, L2_1.root, ..., not their L2_N.idx
+  return DELILA::RunCatalog::FindNumberedFiles(dirName, "L2");
+}
 
-  auto searchKey = Form("L2_");
-  for (const auto &entry : std::filesystem::directory_iterator(dirName)) {
-    if (entry.path().string().find(searchKey) != std::string::npos) {
-      fileList.push_back(entry.path().string());
+// Events to analyse: TriggerTime in [startNs, endNs) with the L2 flag set.
+// Found in the event index (L2_N.idx) of every file, no other event is
+// read.  endNs <= startNs: any time, empty flag: any event.
+Double_t selectStartNs = 0.;
+Double_t selectEndNs = 0.;
+std::string selectFlag;
+bool GetSelectedEntries(const TString &fileName, const Long64_t nEntries,
+                        std::vector<Long64_t> &entries)
+{
+  if (selectEndNs <= selectStartNs && selectFlag.empty()) {
+    entries.resize(nEntries);
+    std::iota(entries.begin(), entries.end(), 0);
+    return true;
+  }
+  try {
+    const auto index = DELILA::EventIndex::Load(
+        DELILA::EventIndex::GetIndexFileName(fileName.Data()));
+    if (Long64_t(index.GetEntries()) != nEntries) {
+      std::cerr << "Event index does not match: " << fileName << std::endl;
+      return false;
     }
+    const auto startTS = selectEndNs > selectStartNs
+                             ? DELILA::NsToTimestamp(selectStartNs)
+                             : DELILA::kMinTimestamp;
+    const auto endTS = selectEndNs > selectStartNs
+                           ? DELILA::NsToTimestamp(selectEndNs)
+                           : DELILA::kMaxTimestamp;
+    entries = index.Select(startTS, endTS,
+                           selectFlag.empty()
+                               ? std::vector<std::string>()
+                               : std::vector<std::string>{selectFlag});
+  } catch (const DELILA::DELILAException &e) {
+    std::cerr << e.what() << std::endl;
+    return false;
   }
-
-  return fileList;
+  return true;
 }
 
 Double_t GetCalibratedEnergy(const DELILA::ChSettings_t &chSetting,
@@ -195,8 +229,12 @@ void AnalysisThread(TString fileName, uint32_t threadID)
   }
 
   DELILA::EventData eventData;
-  tree->SetBranchAddress("TriggerTime", &eventData.triggerTime);
-  tree->SetBranchAddress("EventDataVec", &eventData.eventDataVec);
+  // Only the columns used below are read from flat files
+  DELILA::EventTreeReader reader(tree, eventData,
+                                 DELILA::EventTreeReader::kIsWithAC |
+                                     DELILA::EventTreeReader::kMod |
+                                     DELILA::EventTreeReader::kCh |
+                                     DELILA::EventTreeReader::kChargeLong);
 
   ULong64_t ESectorCounter = 0;
   tree->SetBranchAddress("E_Sector_Counter", &ESectorCounter);
@@ -210,15 +248,20 @@ void AnalysisThread(TString fileName, uint32_t threadID)
   UInt_t ringE = 0;
   UInt_t ringDE = 0;
 
-  auto const nEntries = tree->GetEntries();
+  std::vector<Long64_t> entries;
+  if (!GetSelectedEntries(fileName, tree->GetEntries(), entries)) {
+    IsFinished.at(threadID) = true;
+    return;
+  }
+  auto const nEntries = Long64_t(entries.size());
   {
     std::lock_guard<std::mutex> lock(counterMutex);
     totalEvents += nEntries;
   }
 
   //   for (auto iEve = 0; iEve < 10000; iEve++) {
-  for (auto iEve = 0; iEve < nEntries; iEve++) {
-    tree->GetEntry(iEve);
+  for (Long64_t iEve = 0; iEve < nEntries; iEve++) {
+    reader.GetEntry(entries[iEve]);
     constexpr auto nProcess = 1000;
     if (iEve % nProcess == 0) {
       std::lock_guard<std::mutex> lock(counterMutex);
@@ -297,8 +340,15 @@ void AnalysisThread(TString fileName, uint32_t threadID)
   file->Close();
 }
 
-void reader()
+// e.g. reader(1.e9, 2.e9, "E_More_Than_0"): only the events from 1 s
+// to 2 s with the flag set, found through the event index
+void reader(const Double_t startNs = 0., const Double_t endNs = 0.,
+            const std::string flag = "")
 {
+  selectStartNs = startNs;
+  selectEndNs = endNs;
+  selectFlag = flag;
+
   // Load library with OS-specific extension
 #ifdef __APPLE__
   gSystem->Load("libEveBuilder.dylib");
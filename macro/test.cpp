@@ -7,6 +7,7 @@
 #include <iostream>
 
 #include "EventData.hpp"
+#include "EventTreeIO.hpp"
 
 TH2D *hist;
 
@@ -36,8 +37,11 @@ void test()
             << std::endl;
 
   DELILA::EventData eventData;
-  chain->SetBranchAddress("TriggerTime", &eventData.triggerTime);
-  chain->SetBranchAddress("EventDataVec", &eventData.eventDataVec);
+  // Only the columns used below are read from flat files
+  DELILA::EventTreeReader reader(chain, eventData,
+                                 DELILA::EventTreeReader::kMod |
+                                     DELILA::EventTreeReader::kCh |
+                                     DELILA::EventTreeReader::kChargeLong);
 
   ULong64_t E_Sector_Counter = 0;
   chain->SetBranchAddress("E_Sector_Counter", &E_Sector_Counter);
@@ -47,7 +51,7 @@ void test()
 
   const auto nEntries = chain->GetEntries();
   for (auto i = 0; i < nEntries; i++) {
-    chain->GetEntry(i);
+    reader.GetEntry(i);
     if (i % 1000000 == 0) {
       std::cout << "Processing event " << i << " / " << nEntries << std::endl;
     }
@@ -1,9 +1,11 @@
 #include <TROOT.h>
 #include <TString.h>
 
+#include <atomic>
 #include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <nlohmann/json.hpp>
@@ -13,48 +15,104 @@
 
 #include "ChSettings.hpp"
 #include "DELILAExceptions.hpp"
+#include "EventTreeIO.hpp"
 #include "L1EventBuilder.hpp"
 #include "L2EventBuilder.hpp"
+#include "OutputSettings.hpp"
+#include "RunCatalog.hpp"
+#include "RunFollower.hpp"
+#include "RunMetrics.hpp"
+#include "SettingsCache.hpp"
+#include "ShardPlan.hpp"
 #include "TimeAlignment.hpp"
 
 std::vector<std::string> GetFileList(const std::string &directory,
                                      const uint32_t runNumber,
                                      const uint32_t startVersion,
-                                     const uint32_t endVersion)
+                                     const uint32_t endVersion,
+                                     std::vector<int64_t> &fileEntries)
 {
+  // One directory pass, entries and time stamps from the catalog cache
+  DELILA::RunCatalog catalog;
+  if (!catalog.Scan(directory)) {
+    return {};
+  }
+  auto files = catalog.GetFiles(runNumber, startVersion, endVersion);
+  catalog.LoadCache();
+  catalog.Inspect(files);
+  catalog.SaveCache();
+
   std::vector<std::string> fileList = {};
-  // Check if the directory exists
-  if (!std::filesystem::exists(directory)) {
-    std::cerr << "Directory not found: " << directory << std::endl;
-    return fileList;
+  fileEntries.clear();
+  int64_t totalEntries = 0;
+  for (const auto *info : files) {
+    fileList.push_back(info->path);
+    fileEntries.push_back(info->entries);
+    totalEntries += std::max<int64_t>(0, info->entries);
+  }
+  if (!files.empty()) {
+    std::cout << "Run catalog: " << totalEntries << " entries in "
+              << files.size() << " files" << std::endl;
+  }
+  for (const auto i : DELILA::RunCatalog::FindRestarts(files)) {
+    std::cout << "Acquisition restart expected at " << files[i]->path
+              << std::endl;
   }
 
-  // Make all file list
-  std::vector<std::string> allFileList;
-  for (const auto &entry : std::filesystem::directory_iterator(directory)) {
-    if (entry.is_regular_file()) {
-      allFileList.push_back(entry.path().string());
-    }
+  return fileList;
+}
+
+struct MetricsSettings_t {
+  std::string report = DELILA::kMetricsReportFileName;  // "": no report
+  std::string live = "";  // File or udp://host:port, "": no snapshots
+  double interval = 1.;   // [s] between live snapshots
+};
+
+void StartMetrics(DELILA::RunMetrics &metrics, const std::string &mode,
+                  const nlohmann::json &config,
+                  const MetricsSettings_t &settings)
+{
+  metrics.SetMode(mode);
+  metrics.SetConfig(config);
+  metrics.SetLive(settings.live, settings.interval);
+  metrics.Start();
+}
+
+void FinishMetrics(DELILA::RunMetrics &metrics,
+                   const MetricsSettings_t &settings)
+{
+  metrics.Stop();
+  if (!settings.report.empty()) {
+    metrics.WriteReport(settings.report);
+    std::cout << "Run metrics written to " << settings.report << std::endl;
   }
+}
 
-  // Filter the file list based on the run number and version
-  for (auto i = startVersion; i <= endVersion; i++) {
-    std::string searchKey = Form("run%04d_%04d_", runNumber, i);
-    std::string searchKeyOld = Form("run%d_%d_", runNumber, i);
-    for (const auto &file : allFileList) {
-      if ((file.find(searchKey) != std::string::npos) ||
-          (file.find(searchKeyOld) != std::string::npos)) {
-        // Check if the file is a ROOT file
-        if (file.find(".root") == std::string::npos) {
-          continue;
-        }
-        fileList.push_back(file);
-        break;
-      }
+// Follow mode: builds the closed versions of the run as the DAQ writes them
+void FollowRun(
+    DELILA::RunFollower &follower, const std::atomic<bool> &cancelled,
+    const std::function<void(const std::vector<std::string> &,
+                             const std::vector<int64_t> &)> &build)
+{
+  std::cout << "Following the run, Ctrl-C to stop..." << std::endl;
+  size_t nFiles = 0;
+  while (true) {
+    const auto files = follower.Next(cancelled);
+    if (files.empty()) {
+      break;
     }
+    std::vector<std::string> fileList;
+    std::vector<int64_t> fileEntries;
+    for (const auto &info : files) {
+      std::cout << "Closed: " << info.path << std::endl;
+      fileList.push_back(info.path);
+      fileEntries.push_back(info.entries);
+    }
+    build(fileList, fileEntries);
+    nFiles += files.size();
   }
-
-  return fileList;
+  std::cout << (cancelled.load() ? "Follow mode stopped" : "Run finished")
+            << ", " << nFiles << " files built." << std::endl;
 }
 
 enum class BuildType {
@@ -62,6 +120,9 @@ enum class BuildType {
   Time,
   L1,
   L2,
+  L1L2,
+  Plan,
+  Merge,
 };
 
 void PrintHelp()
@@ -73,11 +134,26 @@ void PrintHelp()
   std::cout << "  -t         Generating time allignment file." << std::endl;
   std::cout << "  -l1        Making files by L1 trigger settings" << std::endl;
   std::cout << "  -l2        Making files by L2 trigger settings" << std::endl;
+  std::cout << "  -l1l2      Making L2 files directly, without L1 files"
+            << std::endl;
+  std::cout << "  -f         Follow the run while it is written (with -t, -l1,"
+            << " -l1l2)" << std::endl;
+  std::cout << "  -plan      Split the run into NumberOfShards shards" << std::endl;
+  std::cout << "  -shard N   Build only shard N of the plan (with -l1, -l1l2)"
+            << std::endl;
+  std::cout << "  -merge     Collect the outputs of all shards" << std::endl;
+  std::cout << "  -q         Quiet, no dump of the L2 conditions" << std::endl;
+  std::cout << "  -v         Verbose, a line for every raw file chunk read"
+            << std::endl;
 }
 
 int main(int argc, char *argv[])
 {
   BuildType buildType = BuildType::Init;
+  auto follow = false;
+  auto quiet = false;
+  auto verbose = false;
+  auto shardIndex = -1;  // -1: the whole run
   if (argc < 2) {
     std::cout << "No options provided. Initialize mode." << std::endl;
   } else {
@@ -93,6 +169,38 @@ int main(int argc, char *argv[])
         buildType = BuildType::L1;
       } else if (std::string(argv[i]) == "-l2") {
         buildType = BuildType::L2;
+      } else if (std::string(argv[i]) == "-l1l2") {
+        buildType = BuildType::L1L2;
+      } else if (std::string(argv[i]) == "-f") {
+        follow = true;
+      } else if (std::string(argv[i]) == "-q") {
+        quiet = true;
+      } else if (std::string(argv[i]) == "-v") {
+        verbose = true;
+      } else if (std::string(argv[i]) == "-plan") {
+        buildType = BuildType::Plan;
+      } else if (std::string(argv[i]) == "-merge") {
+        buildType = BuildType::Merge;
+      } else if (std::string(argv[i]) == "-shard") {
+        if (i + 1 >= argc) {
+          std::cerr << "-shard needs the shard number" << std::endl;
+          return 1;
+        }
+        const std::string value = argv[++i];
+        try {
+          size_t end = 0;
+          shardIndex = std::stoi(value, &end);
+          if (end != value.size()) {
+            shardIndex = -1;
+          }
+        } catch (const std::exception &) {
+          shardIndex = -1;
+        }
+        if (shardIndex < 0) {
+          std::cerr << "-shard needs a shard number of 0 or more, got: "
+                    << value << std::endl;
+          return 1;
+        }
       }
     }
   }
@@ -108,6 +216,21 @@ int main(int argc, char *argv[])
   auto nThread = 0;
   auto refMod = 9;
   auto refCh = 0;
+  std::string outputFormat = "Object";
+  auto l1Output = nlohmann::json::object();
+  auto l2Output = nlohmann::json::object();
+  auto l2MergeOutput = false;
+  auto l2MergeSorted = false;
+  uint64_t timeAlignmentMinEntries = 0;
+  auto timeAlignmentFraction = 1.;
+  MetricsSettings_t metricsSettings;
+  auto followPollInterval = 5.;   // [s]
+  auto followIdleTimeout = 300.;  // [s]
+  uint32_t checkpointTasks = 0;   // 0: no checkpoints
+  auto writeEventIndex = true;
+  auto settingsCache = true;  // Binary copies of the JSON settings
+  uint32_t nShards = 1;
+  auto config = nlohmann::json::object();
 
   auto settings = std::ifstream("settings.json");
   if (!settings) {
@@ -127,10 +250,32 @@ int main(int argc, char *argv[])
     nThread = j["NumberOfThread"];
     refMod = j["TimeReferenceMod"];
     refCh = j["TimeReferenceCh"];
+    // Optional, older settings files do not have it
+    outputFormat = j.value("OutputFormat", outputFormat);
+    l1Output = j.value("L1Output", l1Output);
+    l2Output = j.value("L2Output", l2Output);
+    l2MergeOutput = j.value("L2MergeOutput", l2MergeOutput);
+    l2MergeSorted = j.value("L2MergeSorted", l2MergeSorted);
+    timeAlignmentMinEntries =
+        j.value("TimeAlignmentMinEntries", timeAlignmentMinEntries);
+    timeAlignmentFraction =
+        j.value("TimeAlignmentFraction", timeAlignmentFraction);
+    metricsSettings.report = j.value("MetricsReport", metricsSettings.report);
+    metricsSettings.live = j.value("MetricsLive", metricsSettings.live);
+    metricsSettings.interval =
+        j.value("MetricsInterval", metricsSettings.interval);
+    followPollInterval = j.value("FollowPollInterval", followPollInterval);
+    followIdleTimeout = j.value("FollowIdleTimeout", followIdleTimeout);
+    checkpointTasks = j.value("CheckpointTasks", checkpointTasks);
+    writeEventIndex = j.value("WriteEventIndex", writeEventIndex);
+    settingsCache = j.value("SettingsCache", settingsCache);
+    nShards = j.value("NumberOfShards", nShards);
+    config["Settings"] = j;
   }
   if (nThread == 0) {
     nThread = std::thread::hardware_concurrency();
   }
+  DELILA::SettingsCache::SetEnabled(settingsCache);
 
   if (buildType == BuildType::Init) {
     std::cout << "Initializing the event builder..." << std::endl;
@@ -235,6 +380,27 @@ int main(int argc, char *argv[])
     settings["TimeReferenceCh"] = refCh;
     settings["CoincidenceWindow"] = coincidenceWindow;
     settings["L2Settings"] = l2SettingsFileName;
+    settings["OutputFormat"] = outputFormat;
+    // L1 files are intermediate, L2 files are kept
+    DELILA::OutputSettings l1Template;
+    l1Template.compression = DELILA::CompressionType::None;
+    settings["L1Output"] = l1Template.ToJSON();
+    DELILA::OutputSettings l2Template;
+    l2Template.compression = DELILA::CompressionType::ZSTD;
+    settings["L2Output"] = l2Template.ToJSON();
+    settings["L2MergeOutput"] = l2MergeOutput;
+    settings["L2MergeSorted"] = l2MergeSorted;
+    settings["TimeAlignmentMinEntries"] = timeAlignmentMinEntries;
+    settings["TimeAlignmentFraction"] = timeAlignmentFraction;
+    settings["MetricsReport"] = metricsSettings.report;
+    settings["MetricsLive"] = metricsSettings.live;
+    settings["MetricsInterval"] = metricsSettings.interval;
+    settings["FollowPollInterval"] = followPollInterval;
+    settings["FollowIdleTimeout"] = followIdleTimeout;
+    settings["CheckpointTasks"] = checkpointTasks;
+    settings["WriteEventIndex"] = writeEventIndex;
+    settings["SettingsCache"] = settingsCache;
+    settings["NumberOfShards"] = nShards;
 
     std::ofstream ofs("settings.json");
     ofs << settings.dump(4) << std::endl;
@@ -250,33 +416,140 @@ int main(int argc, char *argv[])
     return 0;
   }
 
-  auto fileList = GetFileList(fileDir, runNumber, startVersion, endVersion);
-  if (fileList.empty()) {
-    std::cerr << "No files found." << std::endl;
+  if (buildType == BuildType::Plan) {
+    // Time offsets are within the TimeWindow of the alignment, so the
+    // guard of a cut is both windows
+    DELILA::RunCatalog catalog;
+    if (!catalog.Scan(fileDir)) {
+      return 1;
+    }
+    auto files = catalog.GetFiles(runNumber, startVersion, endVersion);
+    catalog.LoadCache();
+    catalog.Inspect(files);
+    catalog.SaveCache();
+    try {
+      const auto plan = DELILA::ShardPlan::Make(files, nShards,
+                                                coincidenceWindow + timeWindow);
+      if (plan.GetShards().empty()) {
+        std::cerr << "No files found." << std::endl;
+        return 1;
+      }
+      plan.Save();
+      for (const auto &shard : plan.GetShards()) {
+        std::cout << "Shard " << shard.index << ": " << shard.nOwned
+                  << " files (+" << shard.files.size() - shard.nOwned
+                  << " guard)" << std::endl;
+      }
+      std::cout << DELILA::kShardPlanFileName << " generated, build every "
+                << "shard with -l1 -shard N or -l1l2 -shard N, then -merge."
+                << std::endl;
+    } catch (const DELILA::DELILAException &e) {
+      std::cerr << "\n❌ Shard plan Error: " << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  } else if (buildType == BuildType::Merge) {
+    try {
+      const auto plan = DELILA::ShardPlan::Load();
+      std::string level;
+      const auto nFiles = plan.CollectOutputs(level);
+      std::cout << nFiles << " " << level << " files of "
+                << plan.GetShards().size() << " shards collected."
+                << std::endl;
+    } catch (const DELILA::DELILAException &e) {
+      std::cerr << "\n❌ Merge Error: " << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  const auto sharded = (shardIndex >= 0);
+  if (sharded && buildType != BuildType::L1 && buildType != BuildType::L1L2) {
+    std::cerr << "-shard works with -l1 and -l1l2." << std::endl;
+    return 1;
+  }
+  if (sharded && follow) {
+    std::cerr << "-shard and -f can not be combined." << std::endl;
     return 1;
   }
-  // std::cout << "Found files:" << std::endl;
-  // for (const auto &file : fileList) {
-  //   std::cout << file << std::endl;
-  // }
-  std::cout << "Total files: " << fileList.size() << std::endl;
-
-  if (fileList.size() < nThread) {
-    nThread = fileList.size();
+  DELILA::Shard_t shard;
+  if (sharded) {
+    try {
+      shard = DELILA::ShardPlan::Load().GetShard(shardIndex);
+    } catch (const DELILA::DELILAException &e) {
+      std::cerr << "\n❌ Shard plan Error: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  if (follow && buildType == BuildType::L2) {
+    // L1 files of an open run are not complete, -l1l2 selects on the fly
+    std::cerr << "Follow mode works with -t, -l1 and -l1l2, use -l1l2 -f for "
+                 "L2 events of a run in progress."
+              << std::endl;
+    return 1;
   }
 
+  // Follow mode: the files come from the follower, one version at a time
+  std::vector<int64_t> fileEntries;
+  std::vector<std::string> fileList;
+  if (sharded) {
+    std::cout << "Shard " << shard.index << " of " << DELILA::kShardPlanFileName
+              << std::endl;
+    fileList = shard.files;
+    fileEntries = shard.entries;
+    config["Shard"] = shard.index;
+  } else if (!follow) {
+    fileList =
+        GetFileList(fileDir, runNumber, startVersion, endVersion, fileEntries);
+  }
+  if (!follow) {
+    if (fileList.empty()) {
+      std::cerr << "No files found." << std::endl;
+      return 1;
+    }
+    // std::cout << "Found files:" << std::endl;
+    // for (const auto &file : fileList) {
+    //   std::cout << file << std::endl;
+    // }
+    std::cout << "Total files: " << fileList.size() << std::endl;
+    config["NumberOfFiles"] = fileList.size();
+  }
+  config["NumberOfThread"] = nThread;
+  config["Follow"] = follow;
+  DELILA::RunFollower follower(fileDir, runNumber, startVersion, endVersion);
+
   auto start = std::chrono::high_resolution_clock::now();
 
   try {
+    follower.SetPollInterval(followPollInterval);
+    follower.SetIdleTimeout(followIdleTimeout);
+
     if (buildType == BuildType::Time) {
       std::cout << "Generating time alignment information..." << std::endl;
       auto timeAlign = std::make_unique<DELILA::TimeAlignment>();
       timeAlign->LoadChSettings(chSettingsFileName);
-      timeAlign->LoadFileList(fileList);
+      if (!follow) {
+        timeAlign->LoadFileList(fileList, fileEntries);
+      }
       timeAlign->SetTimeWindow(timeWindow);
+      timeAlign->SetMinEntries(timeAlignmentMinEntries);
+      timeAlign->SetSampleFraction(timeAlignmentFraction);
       timeAlign->InitHistograms();
-      timeAlign->FillHistograms(nThread);
+      StartMetrics(timeAlign->GetMetrics(), "Time", config, metricsSettings);
+      if (follow) {
+        // Every version adds to the histograms, the fit is done at the end
+        FollowRun(follower, timeAlign->GetCancelFlag(),
+                  [&](const std::vector<std::string> &files,
+                      const std::vector<int64_t> &entries) {
+                    timeAlign->LoadFileList(files, entries);
+                    timeAlign->FillHistograms(nThread);
+                  });
+      } else {
+        timeAlign->FillHistograms(nThread);
+      }
       timeAlign->CalculateTimeAlignment();
+      FinishMetrics(timeAlign->GetMetrics(), metricsSettings);
       std::cout << "Time alignment information generated." << std::endl;
 
       auto end = std::chrono::high_resolution_clock::now();
@@ -286,25 +559,81 @@ int main(int argc, char *argv[])
                 << std::endl;
 
       return 0;
-    } else if (buildType == BuildType::L1) {
+    } else if (buildType == BuildType::L1 || buildType == BuildType::L1L2) {
+      const auto fused = (buildType == BuildType::L1L2);
       std::cout << "Generating L1 trigger information..." << std::endl;
       auto l1EventBuilder = std::make_unique<DELILA::L1EventBuilder>();
       l1EventBuilder->LoadChSettings(chSettingsFileName);
-      l1EventBuilder->LoadFileList(fileList);
+      if (!follow) {
+        l1EventBuilder->LoadFileList(fileList, fileEntries);
+      }
       l1EventBuilder->LoadTimeSettings(DELILA::kTimeSettingsFileName);
       l1EventBuilder->SetRefMod(refMod);
       l1EventBuilder->SetRefCh(refCh);
       l1EventBuilder->SetTimeWindow(timeWindow);
       l1EventBuilder->SetCoincidenceWindow(coincidenceWindow);
-      l1EventBuilder->BuildEvent(nThread);
-      std::cout << "L1 trigger event file generated." << std::endl;
+      l1EventBuilder->SetOutputFormat(DELILA::GetEventFormat(outputFormat));
+      l1EventBuilder->SetOutputSettings(
+          DELILA::OutputSettings::FromJSON(fused ? l2Output : l1Output));
+      l1EventBuilder->SetCheckpointTasks(checkpointTasks);
+      l1EventBuilder->SetWriteEventIndex(writeEventIndex);
+      l1EventBuilder->SetVerbose(verbose);
+      if (fused) {
+        // Only the selection of the L2 builder is used
+        std::cout << "Applying L2 trigger settings to L1 events..."
+                  << std::endl;
+        DELILA::L2EventBuilder l2Conditions;
+        l2Conditions.SetVerbose(!quiet);
+        l2Conditions.LoadChSettings(chSettingsFileName);
+        l2Conditions.LoadL2Settings(l2SettingsFileName);
+        l1EventBuilder->SetL2Selector(l2Conditions.MakeSelector());
+      }
+      if (sharded) {
+        // Outputs, checkpoint and report of the shard in its own directory,
+        // the settings are loaded already
+        l1EventBuilder->SetOwnedRange(shard.startTS, shard.endTS);
+        const auto directory = DELILA::ShardPlan::GetShardDirectory(shard.index);
+        std::filesystem::create_directories(directory);
+        std::filesystem::current_path(directory);
+        std::filesystem::remove(DELILA::kShardDoneFileName);
+      }
+      StartMetrics(l1EventBuilder->GetMetrics(), fused ? "L1L2" : "L1", config,
+                   metricsSettings);
+      if (follow) {
+        FollowRun(follower, l1EventBuilder->GetCancelFlag(),
+                  [&](const std::vector<std::string> &files,
+                      const std::vector<int64_t> &entries) {
+                    l1EventBuilder->BuildIncrement(files, entries, nThread);
+                  });
+        // Also after Ctrl-C, the held back slices are built
+        l1EventBuilder->FinishIncrements(nThread);
+      } else {
+        l1EventBuilder->BuildEvent(nThread);
+      }
+      FinishMetrics(l1EventBuilder->GetMetrics(), metricsSettings);
+      if (sharded && !l1EventBuilder->GetCancelFlag().load()) {
+        DELILA::ShardPlan::MarkDone(shard.index, fused ? "L2" : "L1");
+      }
+      std::cout << (fused ? "L2" : "L1") << " trigger event file generated."
+                << std::endl;
     } else if (buildType == BuildType::L2) {
       std::cout << "Generating L2 trigger information..." << std::endl;
       auto l2EventBuilder = std::make_unique<DELILA::L2EventBuilder>();
       l2EventBuilder->LoadChSettings(chSettingsFileName);
       l2EventBuilder->SetCoincidenceWindow(coincidenceWindow);
+      l2EventBuilder->SetOutputFormat(DELILA::GetEventFormat(outputFormat));
+      l2EventBuilder->SetOutputSettings(
+          DELILA::OutputSettings::FromJSON(l2Output));
+      l2EventBuilder->SetMergeOutput(l2MergeOutput);
+      l2EventBuilder->SetMergeSorted(l2MergeSorted);
+      l2EventBuilder->SetCheckpointTasks(checkpointTasks);
+      l2EventBuilder->SetWriteEventIndex(writeEventIndex);
+      l2EventBuilder->SetVerbose(!quiet);
       l2EventBuilder->LoadL2Settings(l2SettingsFileName);
+      StartMetrics(l2EventBuilder->GetMetrics(), "L2", config,
+                   metricsSettings);
       l2EventBuilder->BuildEvent(nThread);
+      FinishMetrics(l2EventBuilder->GetMetrics(), metricsSettings);
       std::cout << "L2 trigger event file generated." << std::endl;
     }
 
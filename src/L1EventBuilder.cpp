@@ -5,14 +5,24 @@
 #include <TROOT.h>
 #include <TTree.h>
 
+#include <Checkpoint.hpp>
+#include <CoincidenceEngine.hpp>
 #include <DELILAExceptions.hpp>
 #include <EventData.hpp>
+#include <EventIndex.hpp>
+#include <EventTreeIO.hpp>
+#include <HitSorter.hpp>
+#include <RawTreeReader.hpp>
+#include <RunCatalog.hpp>
 #include <algorithm>
 #include <csignal>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <nlohmann/json.hpp>
 
+#include <sys/resource.h>
+
 // Global pointer for signal handler access
 static DELILA::L1EventBuilder* g_eventBuilder = nullptr;
 
@@ -45,77 +55,142 @@ void DELILA::L1EventBuilder::LoadChSettings(const std::string &fileName)
 }
 
 void DELILA::L1EventBuilder::LoadFileList(
-    const std::vector<std::string> &fileList)
+    const std::vector<std::string> &fileList,
+    const std::vector<int64_t> &fileEntries)
 {
   if (fileList.empty()) {
     throw DELILA::ValidationException("File list is empty");
   }
+  if (!fileEntries.empty() && fileEntries.size() != fileList.size()) {
+    throw DELILA::ValidationException(
+        "Entries given for " + std::to_string(fileEntries.size()) +
+        " of " + std::to_string(fileList.size()) + " files");
+  }
   fFileList = fileList;
+  fFileEntries = fileEntries;
+  fFileEntries.resize(fFileList.size(), -1);
 }
 
 void DELILA::L1EventBuilder::LoadTimeSettings(const std::string &fileName)
 {
-  auto jsonFile = std::ifstream(fileName);
-  if (!jsonFile) {
-    throw DELILA::FileException("Could not open time settings file: " + fileName);
+  // Only the dimensions, the reference row is read by BuildEvent
+  fTimeSettings.Load(fileName);
+
+  // Print loaded dimensions for debugging
+  std::cout << "Time settings loaded: [" << fTimeSettings.GetNumberOfModules()
+            << "][" << fTimeSettings.GetNumberOfChannels(0) << "][...]"
+            << std::endl;
+}
+
+void DELILA::L1EventBuilder::BuildEvent(const uint32_t nThreads)
+{
+  if (fFileList.empty()) {
+    throw DELILA::ValidationException("File list is empty. Call LoadFileList first.");
   }
+  Prepare(nThreads);
 
-  nlohmann::json timeJSON;
-  try {
-    jsonFile >> timeJSON;
-  } catch (const nlohmann::json::exception &e) {
-    throw DELILA::JSONException("Invalid JSON in time settings file " + fileName +
-                                ": " + e.what());
-  }
-
-  if (timeJSON.empty()) {
-    throw DELILA::ConfigException("No time settings found in file: " + fileName);
-  }
-
-  fTimeSettingsVec.clear();
-  fTimeSettingsVec.resize(timeJSON.size());
-  for (size_t iRefMod = 0; iRefMod < timeJSON.size(); iRefMod++) {
-    fTimeSettingsVec[iRefMod].resize(timeJSON[iRefMod].size());
-    for (size_t iRefCh = 0; iRefCh < timeJSON[iRefMod].size(); iRefCh++) {
-      fTimeSettingsVec[iRefMod][iRefCh].resize(
-          timeJSON[iRefMod][iRefCh].size());
-      for (size_t iMod = 0; iMod < timeJSON[iRefMod][iRefCh].size(); iMod++) {
-        fTimeSettingsVec[iRefMod][iRefCh][iMod].resize(
-            timeJSON[iRefMod][iRefCh][iMod].size());
-        for (size_t iCh = 0; iCh < timeJSON[iRefMod][iRefCh][iMod].size();
-             iCh++) {
-          fTimeSettingsVec[iRefMod][iRefCh][iMod][iCh] =
-              timeJSON[iRefMod][iRefCh][iMod][iCh]["TimeOffset"];
-          if (iRefMod == iMod && iRefCh == iCh) {
-            fTimeSettingsVec[iRefMod][iRefCh][iMod][iCh] =
-                0.;  // Reference channel has no offset
-          }
-        }
-      }
-    }
+  // One k-way merge over all files feeds time slices to the builder workers.
+  // File boundaries and the split between threads do not matter any more.
+  auto tasks = MakeChunkTasks();
+  if (tasks.empty()) {
+    throw DELILA::ValidationException("No readable entries in the input files.");
+  }
+  const auto nTasks = tasks.size();
+  fOutputIndex = 0;
+  std::unique_ptr<TimeOrderedMerger> merger;
+  if (fCheckpointTasks > 0) {
+    merger = RunCheckpointed(tasks, nThreads);
+  } else {
+    merger = MakeMerger(std::move(tasks));
+    RunSlices(*merger, nThreads, true);
   }
 
-  // Print loaded dimensions for debugging
-  std::cout << "Time settings loaded: [" << fTimeSettingsVec.size() << "][";
-  if (!fTimeSettingsVec.empty()) {
-    std::cout << fTimeSettingsVec[0].size() << "][";
-    if (!fTimeSettingsVec[0].empty()) {
-      std::cout << fTimeSettingsVec[0][0].size() << "][...]";
-    }
+  std::cout << "Merged " << nTasks << " chunks into "
+            << merger->GetNumberOfSlices() << " slices, "
+            << merger->GetNumberOfResets() << " acquisition restart(s)"
+            << std::endl;
+  if (merger->GetNumberOfLateHits() > 0) {
+    std::cout << "Warning: " << merger->GetNumberOfLateHits()
+              << " hits arrived out of time order between chunks, sorted "
+                 "into their slices"
+              << std::endl;
+  }
+  const auto read = fMetrics.GetTotal("read");
+  std::cout << "Total read time: " << read["busyTime"].get<double_t>()
+            << " s (sort " << read["sortTime"].get<double_t>() << " s)"
+            << std::endl;
+  PrintWorkerTimings(fWorkerTimings, "slices");
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    // ru_maxrss is in kB on Linux and in bytes on macOS
+#ifdef __APPLE__
+    const auto peakMB = usage.ru_maxrss / (1024. * 1024.);
+#else
+    const auto peakMB = usage.ru_maxrss / 1024.;
+#endif
+    std::cout << "Peak memory (RSS): " << peakMB << " MB" << std::endl;
   }
-  std::cout << std::endl;
 }
 
-void DELILA::L1EventBuilder::BuildEvent(const uint32_t nThreads)
+void DELILA::L1EventBuilder::BuildIncrement(
+    const std::vector<std::string> &fileList,
+    const std::vector<int64_t> &fileEntries, const uint32_t nThreads)
 {
-  // Validate inputs
-  if (nThreads == 0 || nThreads > 128) {
-    throw DELILA::ValidationException("Thread count must be between 1 and 128, got: " +
-                                      std::to_string(nThreads));
+  if (!fileEntries.empty() && fileEntries.size() != fileList.size()) {
+    throw DELILA::ValidationException(
+        "Entries given for " + std::to_string(fileEntries.size()) +
+        " of " + std::to_string(fileList.size()) + " files");
   }
+  if (!fMerger) {
+    Prepare(nThreads);
+    fFileList.clear();
+    fFileEntries.clear();
+    fMerger = MakeMerger({});
+    fOutputIndex = 0;
+  }
+  fCancelled.store(false);
 
-  if (fFileList.empty()) {
-    throw DELILA::ValidationException("File list is empty. Call LoadFileList first.");
+  const auto firstFile = fFileList.size();
+  fFileList.insert(fFileList.end(), fileList.begin(), fileList.end());
+  fFileEntries.insert(fFileEntries.end(), fileEntries.begin(),
+                      fileEntries.end());
+  fFileEntries.resize(fFileList.size(), -1);
+  fMerger->AddTasks(MakeChunkTasks(firstFile));
+  RunSlices(*fMerger, nThreads, false);
+
+  std::cout << "Increment of " << fileList.size() << " file(s) done, "
+            << fMerger->GetNumberOfSlices() << " slices so far" << std::endl;
+}
+
+void DELILA::L1EventBuilder::FinishIncrements(const uint32_t nThreads)
+{
+  if (!fMerger) {
+    return;
+  }
+  fCancelled.store(false);
+  RunSlices(*fMerger, nThreads, true);
+
+  std::cout << "Merged " << fFileList.size() << " files into "
+            << fMerger->GetNumberOfSlices() << " slices, "
+            << fMerger->GetNumberOfResets() << " acquisition restart(s)"
+            << std::endl;
+  if (fMerger->GetNumberOfLateHits() > 0) {
+    std::cout << "Warning: " << fMerger->GetNumberOfLateHits()
+              << " hits arrived out of time order between chunks, sorted "
+                 "into their slices"
+              << std::endl;
+  }
+  fMerger.reset();
+}
+
+void DELILA::L1EventBuilder::Prepare(const uint32_t nThreads)
+{
+  // Validate inputs
+  // Workers take slices, not files, any number of them is fine
+  if (nThreads == 0) {
+    throw DELILA::ValidationException("Thread count must be at least 1, got: " +
+                                      std::to_string(nThreads));
   }
 
   if (fChSettingsVec.empty()) {
@@ -134,24 +209,24 @@ void DELILA::L1EventBuilder::BuildEvent(const uint32_t nThreads)
   ::signal(SIGINT, signalHandler);
 
   // Validate reference channel configuration
-  if (fTimeSettingsVec.empty()) {
+  if (fTimeSettings.GetNumberOfModules() == 0) {
     throw DELILA::ConfigException("Time settings not loaded. Call LoadTimeSettings first.");
   }
 
-  if (fRefMod >= fTimeSettingsVec.size()) {
+  if (fRefMod >= fTimeSettings.GetNumberOfModules()) {
     throw DELILA::RangeException(
         "TimeReferenceMod (" + std::to_string(fRefMod) +
         ") is out of bounds! Time settings has " +
-        std::to_string(fTimeSettingsVec.size()) +
+        std::to_string(fTimeSettings.GetNumberOfModules()) +
         " modules. Please check your settings.json and timeSettings.json files.");
   }
 
-  if (fRefCh >= fTimeSettingsVec[fRefMod].size()) {
+  if (fRefCh >= fTimeSettings.GetNumberOfChannels(fRefMod)) {
     throw DELILA::RangeException(
         "TimeReferenceCh (" + std::to_string(fRefCh) +
         ") is out of bounds! Time settings for module " +
         std::to_string(fRefMod) + " has " +
-        std::to_string(fTimeSettingsVec[fRefMod].size()) +
+        std::to_string(fTimeSettings.GetNumberOfChannels(fRefMod)) +
         " channels. Either regenerate timeSettings.json with './eve-builder -t' " +
         "or set TimeReferenceCh to 0 in settings.json.");
   }
@@ -159,67 +234,169 @@ void DELILA::L1EventBuilder::BuildEvent(const uint32_t nThreads)
   std::cout << "Using reference: Module " << static_cast<int>(fRefMod)
             << ", Channel " << static_cast<int>(fRefCh) << std::endl;
 
-  // make local file list
-  std::vector<std::vector<std::string>> localFileList;
-  localFileList.resize(nThreads);
-  for (auto iThread = 0, iFile = 0; iThread < nThreads; iThread++) {
-    auto nFiles = fFileList.size() / nThreads;
-    auto nFilesMod = fFileList.size() % nThreads;
-    auto nFilesPerThread = nFiles + (iThread < nFilesMod ? 1 : 0);
-    for (auto iFilePerThread = 0; iFilePerThread < nFilesPerThread;
-         iFilePerThread++) {
-      localFileList[iThread].emplace_back(fFileList[iFile]);
-      iFile++;
-    }
-  }
+  fChannelTable.Build(fChSettingsVec);
+  fTimeOffsets = fTimeSettings.GetOffsets(fRefMod, fRefCh);
+  fChannelTable.SetTimeOffsets(fTimeOffsets);
+  fHitFilter.Build(fChannelTable);
+  std::cout << "Hit filter kernel: "
+            << HitFilter::GetKernelName(fHitFilter.GetKernel()) << std::endl;
+}
 
-  std::vector<std::thread> readerThreads;
+std::unique_ptr<DELILA::TimeOrderedMerger> DELILA::L1EventBuilder::MakeMerger(
+    std::vector<ChunkTask> tasks)
+{
+  // The output queue is set per run
+  auto merger = std::make_unique<TimeOrderedMerger>(
+      std::move(tasks), [this](const ChunkTask &task, HitVec_t &&buffer) {
+        return DataReader(task, std::move(buffer));
+      });
+  merger->SetSliceSize(SLICE_SIZE);
+  merger->SetContextWindow(NsToTimestamp(fCoincidenceWindow));
+  merger->SetResetThreshold(TIMESTAMP_RESET_THRESHOLD);
+  return merger;
+}
+
+void DELILA::L1EventBuilder::RunSlices(TimeOrderedMerger &merger,
+                                       const uint32_t nThreads,
+                                       const bool endOfData)
+{
+  BoundedQueue<HitSlice> sliceQueue(2 * nThreads);
+  merger.SetOutput(sliceQueue);
+  merger.SetNumberOfReaders(nThreads);
+
+  auto sliceWatch = fMetrics.WatchQueue(
+      "slices", [&sliceQueue] { return sliceQueue.Size(); }, 2 * nThreads);
+  auto bufferWatch = fMetrics.WatchQueue(
+      "freeHitBuffers",
+      [&merger] { return merger.GetBufferPool().Size(); });
+
+  fWorkerTimings.assign(nThreads, WorkerTiming_t());
+  std::vector<std::thread> workerThreads;
   for (uint32_t i = 0; i < nThreads; i++) {
-    readerThreads.emplace_back(&DELILA::L1EventBuilder::DataReader, this, i,
-                               localFileList[i]);
+    workerThreads.emplace_back(&DELILA::L1EventBuilder::EventWorker, this, i,
+                               fOutputIndex + i, std::ref(sliceQueue),
+                               std::ref(merger.GetBufferPool()));
   }
 
-  for (auto &thread : readerThreads) {
-    thread.join();
+  // The workers finish the slices pushed so far before a failure is thrown
+  auto stopWorkers = [&sliceQueue, &workerThreads] {
+    sliceQueue.Close();
+    for (auto &thread : workerThreads) {
+      thread.join();
+    }
+  };
+  try {
+    merger.Run(fCancelled, endOfData);
+  } catch (...) {
+    stopWorkers();
+    throw;
   }
+  stopWorkers();
+  fOutputIndex += nThreads;
 }
 
-void DELILA::L1EventBuilder::DataReader(int threadID,
-                                        std::vector<std::string> fileList)
+std::unique_ptr<DELILA::TimeOrderedMerger>
+DELILA::L1EventBuilder::RunCheckpointed(const std::vector<ChunkTask> &tasks,
+                                        const uint32_t nThreads)
 {
-  TString outputName = TString::Format("L1_%d.root", threadID);
-  auto outputFile = DELILA::MakeTFile(outputName, "RECREATE");
-  auto outputTree = new TTree("L1EventData", "L1EventData");
-  DELILA::EventData eventData;
-  outputTree->Branch("TriggerTime", &eventData.triggerTime, "TriggerTime/D");
-  outputTree->Branch("EventDataVec", &eventData.eventDataVec);
-  outputTree->SetDirectory(outputFile.get());
-
-  // Overlap buffer for cross-file continuity
-  // Maintains events from end of previous chunk/file for coincidence detection
-  std::vector<std::unique_ptr<RawData_t>> overlapBuffer;
-
-  // Track last timestamp to detect acquisition restarts (timestamp resets)
-  // If first event of new file has earlier timestamp than last event of previous file,
-  // it indicates a new acquisition and we should clear the overlap buffer
-  Double_t lastFileLastTimestamp = -1.0;
+  const std::string level = fL2Selector ? "L2" : "L1";
+  Checkpoint checkpoint(fL2Selector ? "L1L2Checkpoint.json"
+                                    : "L1Checkpoint.json");
+  checkpoint.SetFingerprint(MakeFingerprint(tasks.size()));
+  checkpoint.SetRoundOutputs(nThreads);
+
+  auto merger = MakeMerger({});
+  uint32_t interrupted = 0;
+  if (checkpoint.Load() && checkpoint.GetTasksDone() <= tasks.size()) {
+    const auto done = checkpoint.GetTasksDone();
+    try {
+      std::ifstream state(checkpoint.GetStateFileName(), std::ios::binary);
+      merger->AddTasks({tasks.begin(), tasks.begin() + done});
+      merger->LoadState(state);
+      fOutputIndex = checkpoint.GetOutputIndex();
+      interrupted = checkpoint.GetInterruptedOutputs();
+      std::cout << "Resuming from checkpoint: " << done << " of "
+                << tasks.size() << " chunks done, " << fOutputIndex
+                << " output files kept" << std::endl;
+    } catch (const DELILA::FileException &e) {
+      std::cerr << "Warning: Starting over, " << e.what() << std::endl;
+      merger = MakeMerger({});
+    }
+  }
+  Checkpoint::RemoveInterruptedOutputs(level, fOutputIndex, interrupted);
 
-  for (auto iFile = 0; iFile < fileList.size(); iFile++) {
-    // Check if cancelled
+  auto done = merger->GetNumberOfMergedTasks();
+  while (done < tasks.size() && !fCancelled.load()) {
+    const auto next = std::min<size_t>(tasks.size(), done + fCheckpointTasks);
+    merger->AddTasks({tasks.begin() + done, tasks.begin() + next});
+    RunSlices(*merger, nThreads, next == tasks.size());
     if (fCancelled.load()) {
-      std::lock_guard<std::mutex> lock(fFileListMutex);
-      std::cout << "Thread " << threadID << " cancelled by user." << std::endl;
-      break;
+      // The outputs of this round are incomplete, the last checkpoint holds
+      std::cout << "Stopped, run again to resume from chunk " << done
+                << std::endl;
+      return merger;
     }
+    done = next;
+    if (done < tasks.size()) {
+      checkpoint.Save(done, fOutputIndex, [&merger](std::ostream &os) {
+        merger->SaveState(os);
+      });
+    }
+  }
+  if (done < tasks.size()) {
+    return merger;
+  }
+  checkpoint.Remove();
+
+  // One output per thread again
+  auto roundOutputs = RunCatalog::FindNumberedFiles(".", level);
+  roundOutputs.resize(std::min<size_t>(roundOutputs.size(), fOutputIndex));
+  if (Checkpoint::MergeRoundOutputs(roundOutputs, nThreads,
+                                    fOutputSettings.GetCompressionSettings(),
+                                    fWriteEventIndex)) {
+    fOutputIndex = roundOutputs.size();
+  }
+  return merger;
+}
 
-    std::string fileName = fileList[iFile];
-    {
-      std::lock_guard<std::mutex> lock(fFileListMutex);
-      std::cout << "Thread " << threadID << " reading file: " << fileName
-                << " (" << iFile + 1 << "/" << fileList.size() << ")"
-                << std::endl;
+nlohmann::json DELILA::L1EventBuilder::MakeFingerprint(
+    const size_t nTasks) const
+{
+  // Everything that changes the events of a chunk
+  nlohmann::json j;
+  j["Files"] = Checkpoint::FileFingerprint(fFileList);
+  j["Tasks"] = nTasks;
+  j["TimeWindow"] = fTimeWindow;
+  j["CoincidenceWindow"] = fCoincidenceWindow;
+  j["Reference"] = {fRefMod, fRefCh};
+  j["OwnedRange"] = {fOwnedStartTS, fOwnedEndTS};
+  j["TimeOffsets"] = fTimeOffsets;
+  auto channels = nlohmann::json::array();
+  for (const auto &module : fChSettingsVec) {
+    for (const auto &ch : module) {
+      channels.push_back({ch.isEventTrigger, ch.ID, ch.thresholdADC, ch.hasAC,
+                          ch.ACMod, ch.ACCh, ch.p0, ch.p1, ch.p2, ch.p3});
     }
+  }
+  j["Channels"] = channels;
+  j["OutputFormat"] = int(fOutputFormat);
+  j["Output"] = fOutputSettings.ToJSON();
+  j["L2Selection"] = fL2Selector ? fL2Selector->ToJSON() : nlohmann::json();
+  return j;
+}
 
+std::vector<DELILA::ChunkTask> DELILA::L1EventBuilder::MakeChunkTasks(
+    const size_t firstFile)
+{
+  std::vector<ChunkTask> tasks;
+  for (size_t iFile = firstFile; iFile < fFileList.size(); iFile++) {
+    const auto &fileName = fFileList[iFile];
+    auto nEntries = fFileEntries[iFile];
+    if (nEntries >= 0) {
+      // Known from the run catalog, the reader opens the file later
+      AddChunkTasks(tasks, iFile, nEntries);
+      continue;
+    }
     auto file = DELILA::MakeTFile(fileName.c_str(), "READ");
     if (!file || file->IsZombie()) {
       std::cerr << "Error: Could not open file: " << fileName << std::endl;
@@ -229,268 +406,296 @@ void DELILA::L1EventBuilder::DataReader(int threadID,
     if (!tree) {
       std::cerr << "Error: Could not find tree in file: " << fileName
                 << std::endl;
-      file->Close();
       continue;
     }
-    tree->SetBranchStatus("*", kFALSE);
-
-    UChar_t mod;
-    tree->SetBranchStatus("Mod", kTRUE);
-    tree->SetBranchAddress("Mod", &mod);
-
-    UChar_t ch;
-    tree->SetBranchStatus("Ch", kTRUE);
-    tree->SetBranchAddress("Ch", &ch);
-
-    Double_t fineTS;
-    tree->SetBranchStatus("FineTS", kTRUE);
-    tree->SetBranchAddress("FineTS", &fineTS);
-
-    UShort_t chargeLong;
-    tree->SetBranchStatus("ChargeLong", kTRUE);
-    tree->SetBranchAddress("ChargeLong", &chargeLong);
-
-    UShort_t chargeShort;
-    tree->SetBranchStatus("ChargeShort", kTRUE);
-    tree->SetBranchAddress("ChargeShort", &chargeShort);
-
-    const auto nEntries = tree->GetEntries();
-
-    // Check first event timestamp to detect acquisition restart
-    if (nEntries > 0 && lastFileLastTimestamp > 0) {
-      tree->GetEntry(0);
-      Double_t firstTimestamp = fineTS / 1000.;  // ps to ns
-
-      // Timestamp reset detection with 10-second threshold
-      // Electronics/DAQ can have small timing variations, so only consider it a reset
-      // if timestamp jumped backwards by more than 10 seconds
-      constexpr Double_t TIMESTAMP_RESET_THRESHOLD = 10e9;  // 10 seconds in ns
-
-      if ((firstTimestamp + TIMESTAMP_RESET_THRESHOLD) < lastFileLastTimestamp) {
-        // Significant timestamp jump backwards - new acquisition detected
-        overlapBuffer.clear();
-        std::lock_guard<std::mutex> lock(fFileListMutex);
-        std::cout << "Thread " << threadID
-                  << ": Timestamp reset detected (new acquisition), clearing overlap buffer"
-                  << std::endl;
-        std::cout << "         Previous file last timestamp: " << lastFileLastTimestamp / 1e9 << " s"
-                  << std::endl;
-        std::cout << "         Current file first timestamp: " << firstTimestamp / 1e9 << " s"
-                  << std::endl;
-      }
-    }
 
     // CHUNKED PROCESSING: Process file in chunks to limit memory usage
     // Instead of loading all 174M entries (6.9 GB), process 10M at a time (350 MB)
+    AddChunkTasks(tasks, iFile, tree->GetEntries());
+  }
 
-    // Performance profiling: measure read vs process time
-    Double_t totalReadTime = 0.0;
-    Double_t totalProcessTime = 0.0;
-
-    for (Long64_t chunkStart = 0; chunkStart < nEntries; chunkStart += CHUNK_SIZE) {
-      // Check if cancelled
-      if (fCancelled.load()) {
-        std::lock_guard<std::mutex> lock(fFileListMutex);
-        std::cout << "Thread " << threadID << " cancelled during chunked processing." << std::endl;
-        break;
-      }
-
-      // Calculate chunk boundaries with overlap for coincidence window
-      Long64_t readStart = (chunkStart > OVERLAP_SIZE) ? (chunkStart - OVERLAP_SIZE) : 0;
-      Long64_t readEnd = std::min(nEntries, chunkStart + CHUNK_SIZE + OVERLAP_SIZE);
-
-      // === Timing: Start Read Phase ===
-      auto readPhaseStart = std::chrono::high_resolution_clock::now();
-
-      // Load this chunk from file
-      std::vector<std::unique_ptr<RawData_t>> rawDataVec;
-
-      // Merge overlap from previous chunk/file for cross-file continuity
-      if (!overlapBuffer.empty()) {
-        rawDataVec.reserve((readEnd - readStart) + overlapBuffer.size());
-        rawDataVec.insert(rawDataVec.end(),
-                         std::make_move_iterator(overlapBuffer.begin()),
-                         std::make_move_iterator(overlapBuffer.end()));
-        overlapBuffer.clear();
-      } else {
-        rawDataVec.reserve(readEnd - readStart);
-      }
-
-      for (Long64_t iEve = readStart; iEve < readEnd; iEve++) {
-        tree->GetEntry(iEve);
-
-        // Bounds checking to prevent segmentation fault
-        if (mod >= fChSettingsVec.size() || ch >= fChSettingsVec[mod].size()) {
-          continue;
-        }
-
-        // Check if mod/ch are within bounds for time settings array
-        if (mod >= fTimeSettingsVec[fRefMod][fRefCh].size() ||
-            ch >= fTimeSettingsVec[fRefMod][fRefCh][mod].size()) {
-          continue;
-        }
+  return tasks;
+}
 
-        if (chargeLong > fChSettingsVec[mod][ch].thresholdADC) {
-          auto ts = fineTS / 1000.;  // ps to ns
-          ts -= fTimeSettingsVec[fRefMod][fRefCh][mod][ch];
-          auto rawData =
-              new RawData_t(false, mod, ch, chargeLong, chargeShort, ts);
-          rawDataVec.emplace_back(rawData);
-        }
-      }
+void DELILA::L1EventBuilder::AddChunkTasks(std::vector<ChunkTask> &tasks,
+                                           const size_t fileIndex,
+                                           const Long64_t nEntries)
+{
+  // Equal entry ranges, so the reader threads get equal work whatever the
+  // file sizes are
+  for (Long64_t chunkStart = 0; chunkStart < nEntries;
+       chunkStart += CHUNK_SIZE) {
+    ChunkTask task;
+    task.fileIndex = fileIndex;
+    task.firstEntry = chunkStart;
+    task.lastEntry = std::min(nEntries, chunkStart + CHUNK_SIZE);
+    tasks.push_back(task);
+  }
+}
 
-      // Sort merged data (overlap from previous chunk/file + new chunk)
-      std::sort(rawDataVec.begin(), rawDataVec.end(),
-                [](const std::unique_ptr<RawData_t> &a,
-                   const std::unique_ptr<RawData_t> &b) {
-                  return a->fineTS < b->fineTS;
-                });
+DELILA::HitVec_t DELILA::L1EventBuilder::DataReader(const ChunkTask &task,
+                                                    HitVec_t &&rawDataVec)
+{
+  if (fCancelled.load()) {
+    rawDataVec.clear();
+    return std::move(rawDataVec);
+  }
 
-      // === Timing: End Read Phase, Start Process Phase ===
-      auto readPhaseEnd = std::chrono::high_resolution_clock::now();
-      totalReadTime += std::chrono::duration<double>(readPhaseEnd - readPhaseStart).count();
+  const auto &fileName = fFileList[task.fileIndex];
+  if (fVerbose) {
+    std::lock_guard<std::mutex> lock(fFileListMutex);
+    std::cout << "Reading file: " << fileName << " entries " << task.firstEntry
+              << " - " << task.lastEntry << " (" << task.fileIndex + 1 << "/"
+              << fFileList.size() << ")" << std::endl;
+  }
 
-    const auto nRawData = rawDataVec.size();
+  // === Timing: Start Read Phase ===
+  auto &metrics = fMetrics.GetStage("read");
+  auto readPhaseStart = std::chrono::high_resolution_clock::now();
 
-    for (auto iEve = 0; iEve < nRawData; iEve++) {
-      auto &rawData = rawDataVec[iEve];
-      auto trgMod = rawData->mod;
-      auto trgCh = rawData->ch;
+  auto file = DELILA::MakeTFile(fileName.c_str(), "READ");
+  rawDataVec.clear();
+  if (!file || file->IsZombie()) {
+    std::cerr << "Error: Could not open file: " << fileName << std::endl;
+    return std::move(rawDataVec);
+  }
+  auto tree = static_cast<TTree *>(file->Get("ELIADE_Tree"));
+  if (!tree) {
+    std::cerr << "Error: Could not find tree in file: " << fileName
+              << std::endl;
+    return std::move(rawDataVec);
+  }
+  // Whole clusters are decoded into columns, the next one in the background
+  DELILA::RawTreeReader reader(tree);
+  reader.SetRange(task.firstEntry, task.lastEntry);
+  reader.SetPrefetch(true);
+
+  // The buffer comes from the pool and keeps its capacity across chunks and
+  // files, hits are stored by value
+  rawDataVec.reserve(task.lastEntry - task.firstEntry);
+  // Unknown channels, channels without time offset and hits below the
+  // threshold are dropped block wise, times are integer ps with the offset
+  DELILA::RawColumns block;
+  thread_local DELILA::FilteredHits selected;
+  while (reader.Next(block)) {
+    fHitFilter.Filter(block, selected);
+    for (size_t k = 0; k < selected.size(); k++) {
+      const auto i = selected.entry[k];
+      rawDataVec.emplace_back(false, block.mod[i], block.ch[i],
+                              block.chargeLong[i], block.chargeShort[i],
+                              selected.time[k]);
+    }
+  }
 
-      if (fChSettingsVec[trgMod][trgCh].isEventTrigger) {
-        auto triggerID = fChSettingsVec[trgMod][trgCh].ID;
-        eventData.Clear();
-        eventData.triggerTime = rawData->fineTS;
-        eventData.eventDataVec->emplace_back(
-            rawData->isWithAC, trgMod, trgCh, rawData->chargeLong,
-            rawData->chargeShort, rawData->fineTS - eventData.triggerTime);
-        bool fillFlag = true;
-
-        for (auto jEve = iEve + 1; (jEve < nRawData) && fillFlag; jEve++) {
-          auto &rawData2 = rawDataVec[jEve];
-          auto ts = rawData2->fineTS - eventData.triggerTime;
-          if (ts > fCoincidenceWindow) {
-            break;
-          }
-          auto mod = rawData2->mod;
-          auto ch = rawData2->ch;
-          auto id = fChSettingsVec[mod][ch].ID;
-          auto isEventTrigger = fChSettingsVec[mod][ch].isEventTrigger;
-          if (isEventTrigger && id >= triggerID && ts < fCoincidenceWindow) {
-            // skip this event
-            fillFlag = false;
-            break;
-          }
-          auto hit = *rawData2;
-          hit.fineTS -= eventData.triggerTime;
-          eventData.eventDataVec->emplace_back(hit.isWithAC, mod, ch,
-                                               hit.chargeLong, hit.chargeShort,
-                                               hit.fineTS);
-        }
-        for (auto jEve = iEve - 1; (jEve >= 0) && fillFlag; jEve--) {
-          auto &rawData2 = rawDataVec[jEve];
-          auto ts = rawData2->fineTS - eventData.triggerTime;
-          if (ts < -fCoincidenceWindow) {
-            break;
-          }
-          auto mod = rawData2->mod;
-          auto ch = rawData2->ch;
-          auto id = fChSettingsVec[mod][ch].ID;
-          auto isEventTrigger = fChSettingsVec[mod][ch].isEventTrigger;
-          if (isEventTrigger && id >= triggerID && ts > -fCoincidenceWindow) {
-            // skip this event
-            fillFlag = false;
-            break;
-          }
-          auto hit = *rawData2;
-          hit.fineTS -= eventData.triggerTime;
-          eventData.eventDataVec->emplace_back(hit.isWithAC, mod, ch,
-                                               hit.chargeLong, hit.chargeShort,
-                                               hit.fineTS);
-        }
+  // The merger expects every chunk in time order.  Each channel is already
+  // in order, so this is mostly a merge of the channel streams.
+  // One sorter per reader thread keeps its scratch buffers between chunks.
+  auto sortStart = std::chrono::high_resolution_clock::now();
+  metrics.readTime.Add(
+      std::chrono::duration<double>(sortStart - readPhaseStart).count());
+  thread_local HitSorter<RawHit_t> sorter;
+  sorter.Sort(
+      rawDataVec,
+      [](const RawHit_t &hit) {
+        return HitSorter<RawHit_t>::OrderedKey(hit.ts);
+      },
+      [](const RawHit_t &hit) { return uint16_t((hit.mod << 8) | hit.ch); });
+
+  // === Timing: End Read Phase ===
+  auto readPhaseEnd = std::chrono::high_resolution_clock::now();
+  metrics.sortTime.Add(
+      std::chrono::duration<double>(readPhaseEnd - sortStart).count());
+  metrics.busyTime.Add(
+      std::chrono::duration<double>(readPhaseEnd - readPhaseStart).count());
+  metrics.tasks.Add(1);
+  metrics.entries.Add(task.lastEntry - task.firstEntry);
+  metrics.hits.Add(rawDataVec.size());
+  metrics.bytesIn.Add(file->GetBytesRead());
+
+  return std::move(rawDataVec);
+}
 
-        if (fillFlag) {
-          std::sort(eventData.eventDataVec->begin() + 1,
-                    eventData.eventDataVec->end(),
-                    [](const RawData_t &a, const RawData_t &b) {
-                      return a.fineTS < b.fineTS;
-                    });
-
-          // Check AC
-          for (auto &hit : *(eventData.eventDataVec)) {
-            auto mod = hit.mod;
-            auto ch = hit.ch;
-
-            // Bounds checking to prevent segmentation fault
-            if (mod >= fChSettingsVec.size() || ch >= fChSettingsVec[mod].size()) {
-              continue;
-            }
-
-            if (fChSettingsVec[mod][ch].hasAC) {
-              auto acMod = fChSettingsVec[mod][ch].ACMod;
-              auto acCh = fChSettingsVec[mod][ch].ACCh;
-              for (auto &ac : *(eventData.eventDataVec)) {
-                if (ac.mod == acMod && ac.ch == acCh &&
-                    fabs(ac.fineTS) < fCoincidenceWindow) {
-                  hit.isWithAC = true;
-                  break;
-                }
-              }
-            }
-          }
+void DELILA::L1EventBuilder::EventWorker(int threadID, uint32_t outputIndex,
+                                         BoundedQueue<HitSlice> &sliceQueue,
+                                         HitBufferPool &bufferPool)
+{
+  // Fused mode: L2 selection of every built event, only accepted events
+  // are written, as L2_N.root in the layout of -l2
+  std::unique_ptr<L2Selector> selector;
+  if (fL2Selector) {
+    selector = std::make_unique<L2Selector>(*fL2Selector);
+  }
+  const auto level = selector ? "L2" : "L1";
+  TString outputName = TString::Format("%s_%u.root", level, outputIndex);
+  TString treeName = TString::Format("%sEventData", level);
+  auto outputFile = DELILA::MakeTFile(outputName, "RECREATE");
+  fOutputSettings.Apply(outputFile.get());
+  auto outputTree = new TTree(treeName, treeName);
+  auto &buildMetrics = fMetrics.GetStage("build", threadID);
+  auto &writeMetrics = fMetrics.GetStage("write", threadID);
+  std::unique_ptr<EventIndex> index;
+  if (fWriteEventIndex) {
+    index = std::make_unique<EventIndex>(
+        selector ? selector->GetFlagNames() : std::vector<std::string>());
+  }
+  // The tree is filled on the writer's own thread from pooled events
+  DELILA::AsyncEventWriter writer(
+      outputTree, fOutputFormat,
+      selector ? std::make_unique<L2Selector>(*selector) : nullptr,
+      AsyncEventWriter::kDefaultPoolSize, &writeMetrics, index.get());
+  auto writerWatch = fMetrics.WatchQueue(
+      TString::Format("writer%d", threadID).Data(),
+      [&writer] { return writer.GetQueueDepth(); },
+      AsyncEventWriter::kDefaultPoolSize);
+  fOutputSettings.Apply(outputTree);
+  outputTree->SetDirectory(outputFile.get());
 
-          outputTree->Fill();
-        }
-        eventData.Clear();
-      }
-    }
+  DELILA::ACTagger acTagger(fChannelTable, fCoincidenceWindow);
 
-      // Save last OVERLAP_SIZE events for next chunk/file (cross-file continuity)
-      overlapBuffer.clear();
-      Long64_t overlapStart = (rawDataVec.size() > OVERLAP_SIZE) ?
-                              (rawDataVec.size() - OVERLAP_SIZE) : 0;
-
-      for (Long64_t i = overlapStart; i < rawDataVec.size(); i++) {
-        // Deep copy for overlap buffer
-        overlapBuffer.emplace_back(
-          std::make_unique<RawData_t>(*rawDataVec[i])
-        );
-      }
-
-      // Clear this chunk's data and release memory
-      rawDataVec.clear();
-      rawDataVec.shrink_to_fit();
-
-      // === Timing: End Process Phase ===
-      auto processPhaseEnd = std::chrono::high_resolution_clock::now();
-      totalProcessTime += std::chrono::duration<double>(processPhaseEnd - readPhaseEnd).count();
-    }  // End chunk loop
-    // Note: overlapBuffer is NOT cleared here to maintain cross-file continuity
-
-    // Update last timestamp from this file for next file's acquisition restart detection
-    if (!overlapBuffer.empty()) {
-      lastFileLastTimestamp = overlapBuffer.back()->fineTS;
-    }
+  // Performance profiling: measure process time of this worker
+  const auto workerStart = std::chrono::high_resolution_clock::now();
+  Double_t totalProcessTime = 0.0;
+  uint64_t nSlices = 0;
 
-    {
+  while (auto slice = sliceQueue.Pop()) {
+    // Check if cancelled
+    if (fCancelled.load()) {
       std::lock_guard<std::mutex> lock(fFileListMutex);
-      std::cout << "Thread " << threadID << ": Finished processing "
-                << fileName << std::endl;
-      std::cout << "         Read time:    " << totalReadTime << " s ("
-                << (totalReadTime / (totalReadTime + totalProcessTime) * 100) << "%)" << std::endl;
-      std::cout << "         Process time: " << totalProcessTime << " s ("
-                << (totalProcessTime / (totalReadTime + totalProcessTime) * 100) << "%)" << std::endl;
-      std::cout << "         Total time:   " << (totalReadTime + totalProcessTime) << " s" << std::endl;
+      std::cout << "Thread " << threadID << " cancelled by user." << std::endl;
+      sliceQueue.Close();  // Unblock the merger
+      break;
     }
+
+    // === Timing: Start Process Phase ===
+    auto processPhaseStart = std::chrono::high_resolution_clock::now();
+
+    buildMetrics.hits.Add(slice->hits.size());
+    BuildSlice(*slice, acTagger, selector.get(), writer, buildMetrics);
+    bufferPool.Release(std::move(slice->hits));
+    nSlices++;
+
+    // === Timing: End Process Phase ===
+    auto processPhaseEnd = std::chrono::high_resolution_clock::now();
+    const auto processTime =
+        std::chrono::duration<double>(processPhaseEnd - processPhaseStart)
+            .count();
+    totalProcessTime += processTime;
+    buildMetrics.tasks.Add(1);
+    buildMetrics.buildTime.Add(processTime);
+    buildMetrics.busyTime.Add(processTime);
   }
 
+  writer.Close();
   outputFile->cd();
   outputTree->Write();
+  writeMetrics.bytesOut.Add(outputFile->GetBytesWritten());
+  if (index) {
+    try {
+      index->Save(EventIndex::GetIndexFileName(outputName.Data()));
+    } catch (const DELILA::FileException &e) {
+      std::lock_guard<std::mutex> lock(fFileListMutex);
+      std::cerr << "Warning: " << e.what() << std::endl;
+    }
+  }
+  writeMetrics.busyTime.Add(writer.GetFillTime());
+  if (selector) {
+    fMetrics.AddL2Counts(selector->GetNumberOfEvaluated(),
+                         selector->GetNumberOfAccepted(),
+                         selector->GetFlagNames(), selector->GetFlagCounts());
+  }
   // outputFile will be automatically closed and deleted
+  auto &timing = fWorkerTimings[threadID];
+  timing.wallTime = std::chrono::duration<double>(
+                        std::chrono::high_resolution_clock::now() - workerStart)
+                        .count();
+  timing.busyTime = totalProcessTime;
+  timing.nTasks = nSlices;
+  buildMetrics.wallTime.Set(timing.wallTime);
+  writeMetrics.wallTime.Set(timing.wallTime);
   {
     std::lock_guard<std::mutex> lock(fFileListMutex);
     std::cout << "Thread " << threadID << " finished writing data."
               << std::endl;
+    std::cout << "         Slices:       " << nSlices << std::endl;
+    std::cout << "         Events:       " << outputTree->GetEntries()
+              << std::endl;
+    std::cout << "         Process time: " << totalProcessTime << " s"
+              << std::endl;
+    std::cout << "         Fill time:    " << writer.GetFillTime() << " s"
+              << std::endl;
     std::cout << "Thread " << threadID << " finished." << std::endl;
   }
-}
\ No newline at end of file
+}
+
+void DELILA::L1EventBuilder::BuildSlice(const HitSlice &slice,
+                                        ACTagger &acTagger,
+                                        L2Selector *selector,
+                                        AsyncEventWriter &writer,
+                                        StageMetrics &metrics)
+{
+  uint64_t nEvents = 0;
+  uint64_t nAccepted = 0;
+  const auto &rawDataVec = slice.hits;
+
+  // Owner rule: only triggers in [coreStartTS, coreEndTS) are built here.
+  // The +-fCoincidenceWindow pads around the core complete the window of the
+  // edge triggers and are built by the neighbouring slices.
+  // A shard owns only a time range, the core is cut to it (hits are sorted).
+  auto coreBegin = slice.coreBegin;
+  auto coreEnd = slice.coreEnd;
+  if (fOwnedStartTS != kMinTimestamp || fOwnedEndTS != kMaxTimestamp) {
+    auto lower = [&rawDataVec, coreBegin, coreEnd](const Timestamp_t ts) {
+      return size_t(std::lower_bound(rawDataVec.begin() + coreBegin,
+                                     rawDataVec.begin() + coreEnd, ts,
+                                     [](const RawHit_t &hit,
+                                        const Timestamp_t value) {
+                                       return hit.ts < value;
+                                     }) -
+                    rawDataVec.begin());
+    };
+    coreBegin = lower(fOwnedStartTS);
+    coreEnd = std::max(coreBegin, lower(fOwnedEndTS));
+  }
+
+  // Window tests on integer ps are exact at any run time
+  CoincidenceEngine engine(double_t(NsToTimestamp(fCoincidenceWindow)));
+  engine.Run(
+      rawDataVec.size(), coreBegin, coreEnd,
+      [&rawDataVec](size_t i) { return rawDataVec[i].ts; },
+      [this, &rawDataVec](size_t i) -> int64_t {
+        const auto &info =
+            fChannelTable.Get(rawDataVec[i].mod, rawDataVec[i].ch);
+        return info.isEventTrigger ? info.ID : CoincidenceEngine::kNoTrigger;
+      },
+      [&](size_t iTrg, size_t lo, size_t hi) {
+        // Trigger first, then the rest of the window already in time order
+        const auto &trigger = rawDataVec[iTrg];
+        auto &eventData = writer.Current();
+        eventData.Clear();
+        eventData.triggerTime = ToNs(trigger.ts);
+        eventData.triggerTimePs = trigger.ts;
+        eventData.eventDataVec->emplace_back(trigger.isWithAC, trigger.mod,
+                                             trigger.ch, trigger.chargeLong,
+                                             trigger.chargeShort, 0.);
+        for (auto j = lo; j < hi; j++) {
+          if (j == iTrg) {
+            continue;
+          }
+          const auto &hit = rawDataVec[j];
+          eventData.eventDataVec->emplace_back(
+              hit.isWithAC, hit.mod, hit.ch, hit.chargeLong, hit.chargeShort,
+              ToNs(hit.ts - trigger.ts));
+        }
+
+        // Check AC
+        acTagger.Tag(*(eventData.eventDataVec));
+
+        nEvents++;
+        if (!selector || selector->Accept(*(eventData.eventDataVec))) {
+          writer.Commit(selector);
+          nAccepted++;
+        }
+      });
+  metrics.events.Add(nEvents);
+  metrics.accepted.Add(nAccepted);
+}
@@ -1,14 +1,21 @@
 #include "L2EventBuilder.hpp"
 
-#include <TChain.h>
 #include <TFile.h>
+#include <TFileMerger.h>
 #include <TFileRAII.hpp>
 #include <TROOT.h>
 #include <TTree.h>
 
+#include <Checkpoint.hpp>
 #include <DELILAExceptions.hpp>
+#include <EventIndex.hpp>
+#include <EventTreeIO.hpp>
+#include <RunCatalog.hpp>
+#include <algorithm>
 #include <csignal>
 #include <filesystem>
+#include <functional>
+#include <queue>
 
 // Global pointer for signal handler access
 static DELILA::L2EventBuilder* g_l2EventBuilder = nullptr;
@@ -33,6 +40,7 @@ void DELILA::L2EventBuilder::LoadChSettings(const std::string &fileName)
     if (fChSettingsVec.empty()) {
       throw DELILA::ConfigException("No channel settings found in file: " + fileName);
     }
+    fChannelTable.Build(fChSettingsVec);
   } catch (const DELILA::ConfigException &e) {
     throw;  // Re-throw DELILA exceptions as-is
   } catch (const std::exception &e) {
@@ -70,12 +78,14 @@ void DELILA::L2EventBuilder::LoadL2Settings(const std::string &fileName)
     auto type = condition["Type"];
     if (type == "Counter") {
       std::vector<std::string> tags = condition["Tags"];
-      std::cout << "Counter setting: " << name << std::endl;
-      std::cout << "Tags: ";
-      for (auto &tag : tags) {
-        std::cout << tag << " ";
+      if (fVerbose) {
+        std::cout << "Counter setting: " << name << std::endl;
+        std::cout << "Tags: ";
+        for (auto &tag : tags) {
+          std::cout << tag << " ";
+        }
+        std::cout << std::endl;
       }
-      std::cout << std::endl;
 
       std::vector<std::vector<bool>> conditionTable;
       conditionTable.resize(fChSettingsVec.size());
@@ -98,42 +108,58 @@ void DELILA::L2EventBuilder::LoadL2Settings(const std::string &fileName)
       counter.SetConditionTable(conditionTable);
       fCounterVec.push_back(counter);
 
-      std::cout << name << " condition table: " << std::endl;
-      for (auto i = 0; i < conditionTable.size(); i++) {
-        std::cout << "Mod " << i << ": ";
-        for (auto j = 0; j < conditionTable[i].size(); j++) {
-          std::cout << conditionTable[i][j] << " ";
+      if (fVerbose) {
+        std::cout << name << " condition table: " << std::endl;
+        for (auto i = 0; i < conditionTable.size(); i++) {
+          std::cout << "Mod " << i << ": ";
+          for (auto j = 0; j < conditionTable[i].size(); j++) {
+            std::cout << conditionTable[i][j] << " ";
+          }
+          std::cout << std::endl;
         }
         std::cout << std::endl;
       }
-      std::cout << std::endl;
     } else if (type == "Flag") {
       auto monitorName = condition["Monitor"];
       auto conditionOp = condition["Operator"];
       auto value = condition["Value"];
-      std::cout << "Flag setting: " << name << std::endl;
-      std::cout << "Monitor: " << monitorName << std::endl;
-      std::cout << "Operator: " << conditionOp << std::endl;
-      std::cout << "Value: " << value << std::endl;
+      if (fVerbose) {
+        std::cout << "Flag setting: " << name << std::endl;
+        std::cout << "Monitor: " << monitorName << std::endl;
+        std::cout << "Operator: " << conditionOp << std::endl;
+        std::cout << "Value: " << value << std::endl;
+        std::cout << std::endl;
+      }
       L2Flag flag(name, monitorName, conditionOp, value);
       fFlagVec.push_back(flag);
-      std::cout << std::endl;
     } else if (type == "Accept") {
       std::vector<std::string> monitors = condition["Monitor"];
       auto logic = condition["Operator"];
-      std::cout << "Accept setting: " << name << std::endl;
-      std::cout << "Monitors: ";
-      for (auto &monitor : monitors) {
-        std::cout << monitor << " ";
+      if (fVerbose) {
+        std::cout << "Accept setting: " << name << std::endl;
+        std::cout << "Monitors: ";
+        for (auto &monitor : monitors) {
+          std::cout << monitor << " ";
+        }
+        std::cout << std::endl;
+        std::cout << "Operator: " << logic << std::endl;
       }
-      std::cout << std::endl;
-      std::cout << "Operator: " << logic << std::endl;
       auto tmp = L2DataAcceptance(monitors, logic);
       fDataAcceptanceVec.push_back(tmp);
     } else {
       std::cerr << "Error: Unknown type: " << type << std::endl;
     }
   }
+
+  if (!fVerbose) {
+    std::cout << fCounterVec.size() << " counters, " << fFlagVec.size()
+              << " flags, " << fDataAcceptanceVec.size() << " acceptances"
+              << std::endl;
+  }
+
+  // Resolve names and operators once, threads copy the compiled program
+  fSelector = L2Selector(fChannelTable, fCounterVec, fFlagVec,
+                         fDataAcceptanceVec);
 }
 
 void DELILA::L2EventBuilder::BuildEvent(uint32_t nThreads)
@@ -149,258 +175,547 @@ void DELILA::L2EventBuilder::BuildEvent(uint32_t nThreads)
   ::signal(SIGINT, l2SignalHandler);
 
   GetFileList("L1");
+  auto tasks = MakeTasks();
+  if (tasks.empty()) {
+    std::cerr << "Error: No L1 events found." << std::endl;
+    return;
+  }
+  if (nThreads == 0) {
+    nThreads = 1;
+  }
 
-  if (nThreads < fFileList.size()) {
-    std::cout << "Number of threads is less than the number of files. "
-                 "Using the same number of files: "
-              << fFileList.size() << std::endl;
+  fTotalEntries = 0;
+  for (const auto &task : tasks) {
+    fTotalEntries += task.lastEntry - task.firstEntry;
+  }
+  std::cout << fTotalEntries << " L1 events in " << tasks.size()
+            << " tasks from " << fFileList.size() << " files, "
+            << std::min<size_t>(nThreads, tasks.size()) << " threads"
+            << std::endl;
+
+  fProcessedEntries.store(0);
+  fOutputFileList.clear();
+  if (fCheckpointTasks > 0) {
+    RunCheckpointed(tasks, nThreads);
+  } else {
+    RunTasks({tasks.begin(), tasks.end()}, nThreads);
   }
-  nThreads = fFileList.size();
 
+  if (fMergeOutput && !fCancelled.load() && MergeFiles()) {
+    for (const auto &file : fOutputFileList) {
+      std::filesystem::remove(file);
+      EventIndex::RemoveIndexFile(file);
+    }
+  }
+}
+
+void DELILA::L2EventBuilder::RunTasks(std::vector<L2Task> tasks,
+                                      uint32_t nThreads)
+{
+  if (nThreads > tasks.size()) {
+    nThreads = tasks.size();
+  }
+
+  // Contiguous runs of tasks with about the same number of entries per
+  // worker, so every worker starts with its own part of the files in order
+  Long64_t nEntries = 0;
+  for (const auto &task : tasks) {
+    nEntries += task.lastEntry - task.firstEntry;
+  }
+  WorkStealingQueue<L2Task> taskQueue(nThreads);
+  Long64_t entriesBefore = 0;
+  for (auto &task : tasks) {
+    const auto worker = entriesBefore * nThreads / std::max<Long64_t>(1, nEntries);
+    entriesBefore += task.lastEntry - task.firstEntry;
+    taskQueue.Push(worker, std::move(task));
+  }
+
+  // Numbered on from the outputs of the rounds before
+  const auto firstOutput = fOutputFileList.size();
+  for (uint32_t i = 0; i < nThreads; i++) {
+    fOutputFileList.push_back(Form("L2_%zu.root", firstOutput + i));
+  }
+  auto taskWatch = fMetrics.WatchQueue(
+      "tasks", [&taskQueue] { return taskQueue.Size(); }, tasks.size());
   std::vector<std::thread> threads;
   for (uint32_t i = 0; i < nThreads; i++) {
-    auto localCounterVec = fCounterVec;
-    auto localFlagVec = fFlagVec;
-    auto localDataAcceptanceVec = fDataAcceptanceVec;
     threads.emplace_back(&DELILA::L2EventBuilder::ProcessData, this, i,
-                         fFileList[i], localCounterVec, localFlagVec,
-                         localDataAcceptanceVec);
+                         firstOutput + i, std::ref(taskQueue));
   }
 
   for (auto &thread : threads) {
     thread.join();
   }
+  taskWatch.reset();
+  std::cout << "Processing event " << fProcessedEntries.load() << " / "
+            << fTotalEntries << ", finished (" << taskQueue.GetNumberOfSteals()
+            << " tasks stolen)." << std::endl;
+}
 
-  // MergeFiles();
+void DELILA::L2EventBuilder::RunCheckpointed(const std::vector<L2Task> &tasks,
+                                             const uint32_t nThreads)
+{
+  // Everything that changes the accepted events of a task
+  nlohmann::json fingerprint;
+  fingerprint["Files"] = Checkpoint::FileFingerprint(fFileList);
+  fingerprint["Tasks"] = tasks.size();
+  fingerprint["CoincidenceWindow"] = fCoincidenceWindow;
+  fingerprint["OutputFormat"] = int(fOutputFormat);
+  fingerprint["Output"] = fOutputSettings.ToJSON();
+  // Compiled with the channel tags: the counter membership of every channel
+  fingerprint["L2Selection"] = fSelector.ToJSON();
+  Checkpoint checkpoint("L2Checkpoint.json");
+  checkpoint.SetFingerprint(fingerprint);
+  checkpoint.SetRoundOutputs(nThreads);
+
+  size_t done = 0;
+  uint32_t interrupted = 0;
+  if (checkpoint.Load() && checkpoint.GetTasksDone() <= tasks.size()) {
+    done = checkpoint.GetTasksDone();
+    interrupted = checkpoint.GetInterruptedOutputs();
+    for (uint32_t i = 0; i < checkpoint.GetOutputIndex(); i++) {
+      fOutputFileList.push_back(Form("L2_%u.root", i));
+    }
+    for (size_t i = 0; i < done; i++) {
+      fProcessedEntries += tasks[i].lastEntry - tasks[i].firstEntry;
+    }
+    std::cout << "Resuming from checkpoint: " << done << " of "
+              << tasks.size() << " tasks done, " << fOutputFileList.size()
+              << " output files kept" << std::endl;
+  }
+  Checkpoint::RemoveInterruptedOutputs("L2", fOutputFileList.size(),
+                                       interrupted);
 
-  // // delete files
-  // GetFileList("L2");
-  // for (const auto &file : fFileList) {
-  //   std::cout << "Deleting file: " << file << std::endl;
-  //   std::filesystem::remove(file);
-  // }
+  while (done < tasks.size() && !fCancelled.load()) {
+    const auto next = std::min<size_t>(tasks.size(), done + fCheckpointTasks);
+    RunTasks({tasks.begin() + done, tasks.begin() + next}, nThreads);
+    if (fCancelled.load()) {
+      // The outputs of this round are incomplete, the last checkpoint holds
+      std::cout << "Stopped, run again to resume from task " << done
+                << std::endl;
+      return;
+    }
+    done = next;
+    checkpoint.Save(done, fOutputFileList.size());
+  }
+  if (done < tasks.size()) {
+    return;
+  }
+  checkpoint.Remove();
+
+  // One output per thread again, unless merged into one file anyway
+  if (!fMergeOutput) {
+    Checkpoint::MergeRoundOutputs(
+        fOutputFileList, std::min<size_t>(nThreads, fCheckpointTasks),
+        fOutputSettings.GetCompressionSettings(), fWriteEventIndex);
+  }
 }
 
-void DELILA::L2EventBuilder::MergeFiles()
+std::vector<DELILA::L2Task> DELILA::L2EventBuilder::MakeTasks()
 {
-  std::cout << "Merging files..." << std::endl;
-  //   ROOT::EnableImplicitMT();
+  std::vector<L2Task> tasks;
+  for (size_t iFile = 0; iFile < fFileList.size(); iFile++) {
+    const auto &fileName = fFileList[iFile];
+    auto file = DELILA::MakeTFile(fileName.c_str(), "READ");
+    if (!file || file->IsZombie()) {
+      std::cerr << "Error: Could not open file: " << fileName << std::endl;
+      continue;
+    }
+    auto tree = static_cast<TTree *>(file->Get("L1EventData"));
+    if (!tree) {
+      std::cerr << "Error: Could not find tree in file: " << fileName
+                << std::endl;
+      continue;
+    }
 
-  auto chain = new TChain("L2EventData");
-  GetFileList("L2");
-  if (fFileList.size() == 0) {
+    // Whole clusters only, so no two tasks read the same baskets
+    const auto nEntries = tree->GetEntries();
+    auto clusters = tree->GetClusterIterator(0);
+    L2Task task;
+    task.fileIndex = iFile;
+    while (task.lastEntry < nEntries) {
+      const auto start = clusters.Next();
+      auto next = clusters.GetNextEntry();
+      if (next <= start) {
+        next = nEntries;  // No cluster information
+      }
+      task.lastEntry = std::min(nEntries, next);
+      if (task.lastEntry - task.firstEntry >= TASK_SIZE) {
+        tasks.push_back(task);
+        task.firstEntry = task.lastEntry;
+      }
+    }
+    if (task.lastEntry > task.firstEntry) {
+      tasks.push_back(task);
+    }
+  }
+
+  return tasks;
+}
+
+bool DELILA::L2EventBuilder::MergeFiles()
+{
+  if (fOutputFileList.size() == 0) {
     std::cerr << "Error: No L2 files found." << std::endl;
-    return;
+    return false;
   }
-  for (const auto &file : fFileList) {
-    chain->Add(file.c_str());
+  std::cout << "Merging " << fOutputFileList.size() << " files into "
+            << kL2MergedFileName
+            << (fMergeSorted ? " in TriggerTime order..." : "...") << std::endl;
+  auto startTime = std::chrono::high_resolution_clock::now();
+
+  // Not of the merged file any more, also when the new one is not indexed
+  EventIndex::RemoveIndexFile(kL2MergedFileName);
+  auto result = fMergeSorted ? MergeSorted() : FastMerge();
+  // The baskets keep the file order, so do the entries of the indices
+  if (result && !fMergeSorted && fWriteEventIndex) {
+    try {
+      EventIndex::Load(fOutputFileList)
+          .Save(EventIndex::GetIndexFileName(kL2MergedFileName));
+    } catch (const DELILA::DELILAException &e) {
+      std::cerr << "Warning: No index of " << kL2MergedFileName << ": "
+                << e.what() << std::endl;
+    }
   }
-  //   DELILA::EventData originalData;
-  DELILA::EventData eventData;
-  chain->SetBranchAddress("TriggerTime", &eventData.triggerTime);
-  chain->SetBranchAddress("EventDataVec", &eventData.eventDataVec);
 
-  auto outputFile = DELILA::MakeTFile("L2Event.root", "RECREATE");
-  auto outputTree = new TTree("L2EventData", "L2EventData");
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::high_resolution_clock::now() - startTime)
+                     .count();
+  auto &metrics = fMetrics.GetStage("merge", 0);
+  metrics.tasks.Add(fOutputFileList.size());
+  metrics.busyTime.Add(elapsed);
+  metrics.wallTime.Add(elapsed);
+  if (result) {
+    std::error_code error;
+    const auto size = std::filesystem::file_size(kL2MergedFileName, error);
+    metrics.bytesOut.Add(error ? 0 : size);
+  }
+  std::lock_guard<std::mutex> lock(fMutex);
+  if (result) {
+    std::cout << "Merging files finished (" << elapsed << " s)." << std::endl;
+  } else {
+    std::cerr << "Error: Merging files failed." << std::endl;
+  }
+  return result;
+}
 
-  //   DELILA::EventData eventData;
-  outputTree->Branch("TriggerTime", &eventData.triggerTime, "TriggerTime/D");
-  outputTree->Branch("EventDataVec", &eventData.eventDataVec);
-  outputTree->SetDirectory(outputFile.get());
+bool DELILA::L2EventBuilder::FastMerge()
+{
+  // Baskets are copied as they are, no event is deserialized
+  TFileMerger merger(kFALSE, kFALSE);
+  merger.SetFastMethod(kTRUE);
+  merger.SetPrintLevel(0);
+  const auto compression = fOutputSettings.GetCompressionSettings();
+  const auto opened =
+      compression >= 0
+          ? merger.OutputFile(kL2MergedFileName.c_str(), "RECREATE",
+                              compression)
+          : merger.OutputFile(kL2MergedFileName.c_str(), "RECREATE");
+  if (!opened) {
+    return false;
+  }
+  for (const auto &file : fOutputFileList) {
+    if (!merger.AddFile(file.c_str(), kFALSE)) {
+      return false;
+    }
+  }
+  return merger.Merge();
+}
 
-  auto startTime = std::chrono::high_resolution_clock::now();
-  auto lastTime = startTime;
-  const auto nEntries = chain->GetEntries();
-  for (Long64_t iEve = 0; iEve < nEntries; iEve++) {
-    chain->GetEntry(iEve);
-    if (iEve % 1000 == 0) {
-      auto now = std::chrono::high_resolution_clock::now();
-      auto duration =
-          std::chrono::duration_cast<std::chrono::milliseconds>(now - lastTime);
-      if (duration.count() > 1000) {
-        auto finishedEvents = iEve;
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                           now - startTime)
-                           .count();
-        auto remainingTime =
-            (nEntries - finishedEvents) * elapsed / finishedEvents / 1.e3;
-        lastTime = now;
-        std::cout << "\b\r" << "Processing event " << finishedEvents << " / "
-                  << nEntries << ", " << int(remainingTime) << "s  \b\b"
-                  << std::flush;
+bool DELILA::L2EventBuilder::MergeSorted()
+{
+  // Every input reads into the same buffers, which are also the buffers of
+  // the output tree, so an event is copied by GetEntry + Fill
+  DELILA::EventData eventData;
+  std::vector<ULong64_t> counters(fCounterVec.size(), 0);
+  auto flags = std::make_unique<Bool_t[]>(fFlagVec.size() + 1);
+
+  struct Input {
+    DELILA::TFilePtr file;
+    TTree *tree = nullptr;
+    std::unique_ptr<DELILA::EventTreeReader> reader;
+  };
+  std::vector<Input> inputs;
+  // Time ordered runs [first, last) of one input, cut where the time goes
+  // back: own tasks of a worker follow each other, stolen ones do not
+  struct Run {
+    size_t input;
+    Long64_t entry;
+    Long64_t last;
+  };
+  std::vector<Run> runs;
+  std::vector<std::vector<Long64_t>> times;  // TriggerTimePs
+  Long64_t nEntries = 0;
+
+  for (const auto &fileName : fOutputFileList) {
+    Input input;
+    input.file = DELILA::MakeTFile(fileName.c_str(), "READ");
+    if (!input.file || input.file->IsZombie()) {
+      std::cerr << "Error: Could not open file: " << fileName << std::endl;
+      return false;
+    }
+    input.tree = static_cast<TTree *>(input.file->Get("L2EventData"));
+    if (!input.tree) {
+      std::cerr << "Error: Could not find tree in file: " << fileName
+                << std::endl;
+      return false;
+    }
+
+    // TriggerTimePs only, exact at any run time
+    std::vector<Long64_t> inputTimes(input.tree->GetEntries());
+    Long64_t triggerTime = 0;
+    input.tree->SetBranchStatus("*", kFALSE);
+    input.tree->SetBranchStatus("TriggerTimePs", kTRUE);
+    input.tree->SetBranchAddress("TriggerTimePs", &triggerTime);
+    Long64_t runStart = 0;
+    for (Long64_t i = 0; i < Long64_t(inputTimes.size()); i++) {
+      input.tree->GetEntry(i);
+      inputTimes[i] = triggerTime;
+      if (i > 0 && triggerTime < inputTimes[i - 1]) {
+        runs.push_back({inputs.size(), runStart, i});
+        runStart = i;
       }
     }
-    // eventData = originalData;
-    outputTree->Fill();
+    if (runStart < Long64_t(inputTimes.size())) {
+      runs.push_back({inputs.size(), runStart, Long64_t(inputTimes.size())});
+    }
+    nEntries += inputTimes.size();
+    times.push_back(std::move(inputTimes));
+
+    input.tree->ResetBranchAddresses();
+    input.tree->SetBranchStatus("*", kTRUE);
+    for (size_t i = 0; i < fFlagVec.size(); i++) {
+      input.tree->SetBranchAddress(fFlagVec[i].name.c_str(), &flags[i]);
+    }
+    for (size_t i = 0; i < fCounterVec.size(); i++) {
+      input.tree->SetBranchAddress(fCounterVec[i].name.c_str(), &counters[i]);
+    }
+    input.reader =
+        std::make_unique<DELILA::EventTreeReader>(input.tree, eventData);
+    inputs.push_back(std::move(input));
   }
-  std::cout << "\b\r" << "Processing event " << nEntries << " / " << nEntries
-            << ", finished." << std::endl;
 
-  {
-    std::lock_guard<std::mutex> lock(fMutex);
-    std::cout << "Merging files finished." << std::endl;
+  auto outputFile = DELILA::MakeTFile(kL2MergedFileName.c_str(), "RECREATE");
+  fOutputSettings.Apply(outputFile.get());
+  auto outputTree = new TTree("L2EventData", "L2EventData");
+  outputTree->SetDirectory(outputFile.get());
+  // Same branch order as the per thread files
+  for (size_t i = 0; i < fFlagVec.size(); i++) {
+    outputTree->Branch(fFlagVec[i].name.c_str(), &flags[i],
+                       (fFlagVec[i].name + "/O").c_str());
+  }
+  for (size_t i = 0; i < fCounterVec.size(); i++) {
+    outputTree->Branch(fCounterVec[i].name.c_str(), &counters[i],
+                       (fCounterVec[i].name + "/l").c_str());
+  }
+  DELILA::EventTreeWriter writer(outputTree, eventData, fOutputFormat);
+  fOutputSettings.Apply(outputTree);
+  EventIndex index(fSelector.GetFlagNames());
+
+  // k-way merge of the runs, equal times keep the input order
+  typedef std::pair<Long64_t, size_t> Head_t;  // (time, run)
+  std::priority_queue<Head_t, std::vector<Head_t>, std::greater<Head_t>> heap;
+  for (size_t i = 0; i < runs.size(); i++) {
+    heap.emplace(times[runs[i].input][runs[i].entry], i);
+  }
+  Long64_t nMerged = 0;
+  while (!heap.empty()) {
+    if (fCancelled.load()) {
+      return false;
+    }
+    auto &run = runs[heap.top().second];
+    heap.pop();
+    inputs[run.input].reader->GetEntry(run.entry);
+    writer.Fill();
+    if (fWriteEventIndex) {
+      index.Add(times[run.input][run.entry], flags.get());
+    }
+    if (++run.entry < run.last) {
+      heap.emplace(times[run.input][run.entry], &run - runs.data());
+    }
+    if (++nMerged % 1000000 == 0) {
+      std::cout << "\b\r" << "Merging event " << nMerged << " / " << nEntries
+                << std::flush;
+    }
   }
+  std::cout << "\b\r" << "Merging event " << nEntries << " / " << nEntries
+            << ", " << runs.size() << " time ordered runs." << std::endl;
 
   outputFile->cd();
   outputTree->Write();
+  if (fWriteEventIndex) {
+    try {
+      index.Save(EventIndex::GetIndexFileName(kL2MergedFileName));
+    } catch (const DELILA::FileException &e) {
+      std::cerr << "Warning: " << e.what() << std::endl;
+    }
+  }
   // outputFile will be automatically closed and deleted
+  return true;
 }
 
-void DELILA::L2EventBuilder::ProcessData(
-    const uint32_t threadID, const std::string &fileName,
-    std::vector<L2Counter> localCounterVec, std::vector<L2Flag> localFlagVec,
-    std::vector<L2DataAcceptance> localDataAcceptanceVec)
+DELILA::L2Selector DELILA::L2EventBuilder::MakeSelector() const
 {
-  // Process the data in the file here
-  {
-    std::lock_guard<std::mutex> lock(fMutex);
-    std::cout << "Thread " << threadID << " processing file: " << fileName
-              << std::endl;
-  }
-
-  auto inputFile = DELILA::MakeTFile(fileName.c_str(), "READ");
-  auto inputTree = static_cast<TTree *>(inputFile->Get("L1EventData"));
-  if (!inputTree) {
-    std::cerr << "Error: Could not find tree in file: " << fileName
-              << std::endl;
-    // inputFile will be automatically closed and deleted
-    return;
-  }
-  DELILA::EventData eventData;
-  inputTree->SetBranchAddress("TriggerTime", &eventData.triggerTime);
-  inputTree->SetBranchAddress("EventDataVec", &eventData.eventDataVec);
+  return fSelector;
+}
 
-  auto outputName = Form("L2_%d.root", threadID);
-  auto outputFile = DELILA::MakeTFile(outputName, "RECREATE");
+void DELILA::L2EventBuilder::ProcessData(const uint32_t threadID,
+                                         const size_t outputIndex,
+                                         WorkStealingQueue<L2Task> &taskQueue)
+{
+  auto outputFile =
+      DELILA::MakeTFile(fOutputFileList[outputIndex].c_str(), "RECREATE");
+  fOutputSettings.Apply(outputFile.get());
   auto outputTree = new TTree("L2EventData", "L2EventData");
   outputTree->SetDirectory(outputFile.get());
 
-  for (auto &flag : localFlagVec) {
-    outputTree->Branch(flag.name.c_str(), &flag.flag,
-                       (flag.name + "/O").c_str());
-  }
-  for (auto &counter : localCounterVec) {
-    outputTree->Branch(counter.name.c_str(), &counter.counter,
-                       (counter.name + "/l").c_str());
-  }
-  outputTree->Branch("TriggerTime", &eventData.triggerTime, "TriggerTime/D");
-  outputTree->Branch("EventDataVec", &eventData.eventDataVec);
-
+  DELILA::EventData eventData;
+  auto selector = MakeSelector();
+  selector.Branch(outputTree);
+  DELILA::EventTreeWriter writer(outputTree, eventData, fOutputFormat);
+  fOutputSettings.Apply(outputTree);
+  EventIndex index(selector.GetFlagNames());
+  L2Result_t result;
+
+  // The input stays open while the tasks come from the same file
+  DELILA::TFilePtr inputFile;
+  TTree *inputTree = nullptr;
+  std::unique_ptr<DELILA::EventTreeReader> reader;
+  size_t currentFile = fFileList.size();
+
+  auto &metrics = fMetrics.GetStage("l2", threadID);
   auto startTime = std::chrono::high_resolution_clock::now();
   auto lastTime = startTime;
-  const auto nEntries = inputTree->GetEntries();
-  for (Long64_t iEve = 0; iEve < nEntries; iEve++) {
-    // Check if cancelled
+  uint32_t nTasks = 0;
+  while (auto task = taskQueue.Pop(threadID)) {
     if (fCancelled.load()) {
       std::lock_guard<std::mutex> lock(fMutex);
-      std::cout << "Thread " << threadID << " cancelled by user after processing "
-                << iEve << "/" << nEntries << " events." << std::endl;
+      std::cout << "Thread " << threadID << " cancelled by user." << std::endl;
       break;
     }
 
-    inputTree->GetEntry(iEve);
-    if ((threadID == 0) && (iEve % 1000 == 0)) {
-      auto now = std::chrono::high_resolution_clock::now();
-      auto duration =
-          std::chrono::duration_cast<std::chrono::milliseconds>(now - lastTime);
-      if (duration.count() > 1000) {
-        auto finishedEvents = iEve;
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                           now - startTime)
-                           .count();
-        auto remainingTime =
-            (nEntries - finishedEvents) * elapsed / finishedEvents / 1.e3;
-        lastTime = now;
-        std::lock_guard<std::mutex> lock(fMutex);
-        std::cout << "\b\rThread " << threadID << ": Processing event "
-                  << finishedEvents << " / " << nEntries << ", "
-                  << int(remainingTime) << "s  \b\b" << std::flush;
+    if (task->fileIndex != currentFile) {
+      reader.reset();
+      if (inputFile) {
+        metrics.bytesIn.Add(inputFile->GetBytesRead());
       }
+      inputFile = DELILA::MakeTFile(fFileList[task->fileIndex].c_str(), "READ");
+      if (!inputFile || inputFile->IsZombie()) {
+        std::cerr << "Error: Could not open file: "
+                  << fFileList[task->fileIndex] << std::endl;
+        currentFile = fFileList.size();
+        continue;
+      }
+      inputTree = static_cast<TTree *>(inputFile->Get("L1EventData"));
+      if (!inputTree) {
+        std::cerr << "Error: Could not find tree in file: "
+                  << fFileList[task->fileIndex] << std::endl;
+        currentFile = fFileList.size();
+        continue;
+      }
+      reader = std::make_unique<DELILA::EventTreeReader>(inputTree, eventData);
+      currentFile = task->fileIndex;
     }
-
-    if (eventData.eventDataVec->size() == 0) {
-      continue;
-    }
-
-    for (auto &counter : localCounterVec) {
-      counter.ResetCounter();
-      for (auto &rawData : *eventData.eventDataVec) {
-        // Bounds checking to prevent segmentation fault
-        if (rawData.mod >= fChSettingsVec.size() ||
-            rawData.ch >= fChSettingsVec[rawData.mod].size()) {
-          continue;
+    inputTree->SetCacheEntryRange(task->firstEntry, task->lastEntry);
+    nTasks++;
+
+    // Read and fill are timed per event, the selection is the rest
+    const auto taskStart = std::chrono::steady_clock::now();
+    double_t readTime = 0.;
+    double_t fillTime = 0.;
+    uint64_t nAccepted = 0;
+    for (auto iEve = task->firstEntry; iEve < task->lastEntry; iEve++) {
+      const auto readStart = std::chrono::steady_clock::now();
+      reader->GetEntry(iEve);
+      const auto readEnd = std::chrono::steady_clock::now();
+      readTime += std::chrono::duration<double_t>(readEnd - readStart).count();
+      if (selector.Accept(*eventData.eventDataVec)) {
+        const auto fillStart = std::chrono::steady_clock::now();
+        writer.Fill();
+        if (fWriteEventIndex) {
+          selector.GetResult(result);
+          index.Add(eventData.triggerTimePs, result.flags.data());
         }
-        counter.Check(rawData.mod, rawData.ch);
+        fillTime += std::chrono::duration<double_t>(
+                        std::chrono::steady_clock::now() - fillStart)
+                        .count();
+        nAccepted++;
       }
     }
-
-    for (auto &flag : localFlagVec) {
-      flag.Check(localCounterVec);
-    }
-
-    auto fillFlag = false;
-    for (auto &accept : localDataAcceptanceVec) {
-      fillFlag |= accept.Check(localFlagVec);
-    }
-
-    // if (localDataAcceptanceVec.size() == 0) {
-    //   fillFlag = true;  // If no acceptance is defined, fill the tree
-    // }
-    if (fillFlag) {
-      outputTree->Fill();
+    const auto taskTime = std::chrono::duration<double_t>(
+                              std::chrono::steady_clock::now() - taskStart)
+                              .count();
+    metrics.tasks.Add(1);
+    metrics.entries.Add(task->lastEntry - task->firstEntry);
+    metrics.events.Add(task->lastEntry - task->firstEntry);
+    metrics.accepted.Add(nAccepted);
+    metrics.readTime.Add(readTime);
+    metrics.fillTime.Add(fillTime);
+    metrics.buildTime.Add(taskTime - readTime - fillTime);
+    metrics.busyTime.Add(taskTime);
+
+    const auto finishedEvents =
+        fProcessedEntries.fetch_add(task->lastEntry - task->firstEntry) +
+        task->lastEntry - task->firstEntry;
+    auto now = std::chrono::high_resolution_clock::now();
+    if (threadID == 0 &&
+        std::chrono::duration_cast<std::chrono::milliseconds>(now - lastTime)
+                .count() > 1000) {
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         now - startTime)
+                         .count();
+      auto remainingTime =
+          (fTotalEntries - finishedEvents) * elapsed / finishedEvents / 1.e3;
+      lastTime = now;
+      std::lock_guard<std::mutex> lock(fMutex);
+      std::cout << "\b\rProcessing event " << finishedEvents << " / "
+                << fTotalEntries << ", " << int(remainingTime) << "s  \b\b"
+                << std::flush;
     }
   }
+  reader.reset();
+  if (inputFile) {
+    metrics.bytesIn.Add(inputFile->GetBytesRead());
+  }
+  inputFile.reset();
 
   {
     std::lock_guard<std::mutex> lock(fMutex);
-    std::cout << "\b\rThread " << threadID << ": Processing event " << nEntries
-              << " / " << nEntries << ", finished." << std::endl;
+    std::cout << "\b\rThread " << threadID << ": " << nTasks << " tasks, "
+              << outputTree->GetEntries() << " events accepted." << std::endl;
   }
 
   outputFile->cd();
   outputTree->Write();
-  // outputFile and inputFile will be automatically closed and deleted
-
-  {
-    std::lock_guard<std::mutex> lock(fMutex);
-    std::cout << "Thread " << threadID << " finished writing data."
-              << std::endl;
+  metrics.bytesOut.Add(outputFile->GetBytesWritten());
+  if (fWriteEventIndex) {
+    try {
+      index.Save(EventIndex::GetIndexFileName(fOutputFileList[outputIndex]));
+    } catch (const DELILA::FileException &e) {
+      std::lock_guard<std::mutex> lock(fMutex);
+      std::cerr << "Warning: " << e.what() << std::endl;
+    }
   }
+  metrics.wallTime.Set(std::chrono::duration<double_t>(
+                           std::chrono::high_resolution_clock::now() -
+                           startTime)
+                           .count());
+  fMetrics.AddL2Counts(selector.GetNumberOfEvaluated(),
+                       selector.GetNumberOfAccepted(), selector.GetFlagNames(),
+                       selector.GetFlagCounts());
+  // outputFile will be automatically closed and deleted
 }
 
 void DELILA::L2EventBuilder::GetFileList(const std::string &key)
 {
   std::string directory = "./";
 
-  std::vector<std::string> fileList = {};
   // Check if the directory exists
   if (!std::filesystem::exists(directory)) {
     std::cerr << "Directory not found: " << directory << std::endl;
   }
 
-  // Make all file list
-  std::vector<std::string> allFileList;
-  for (const auto &entry : std::filesystem::directory_iterator(directory)) {
-    if (entry.is_regular_file()) {
-      allFileList.push_back(entry.path().string());
-    }
-  }
-
-  for (auto i = 0; i < 1024; i++) {
-    std::string searchKey = key + Form("_%d.root", i);
-    auto keyFound = false;
-    for (const auto &file : allFileList) {
-      if (file.find(searchKey) != std::string::npos) {
-        fileList.push_back(file);
-        keyFound = true;
-        break;
-      }
-    }
-
-    if (keyFound == false) {
-      break;
-    }
-  }
-
+  // key_0.root, key_1.root, ... in one directory pass
+  auto fileList = RunCatalog::FindNumberedFiles(directory, key);
   fFileList = fileList;
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "TimeAlignment.hpp"
 
+#include <Math/MinimizerOptions.h>
 #include <TF1.h>
 #include <TFile.h>
 #include <TFileRAII.hpp>
@@ -7,18 +8,25 @@
 #include <TSpectrum.h>
 #include <TTree.h>
 
+#include <CoincidenceEngine.hpp>
+#include <ContentHash.hpp>
 #include <DELILAExceptions.hpp>
+#include <HitSorter.hpp>
+#include <RawTreeReader.hpp>
 #include <algorithm>
+#include <chrono>
 #include <csignal>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <mutex>
 #include <nlohmann/json.hpp>
 #include <thread>
 #include <tuple>
 
-// Define USE_MUTEX_APPROACH to compare performance
-// #define USE_MUTEX_APPROACH
-
 // Global pointer for signal handler access
 static DELILA::TimeAlignment* g_timeAlignment = nullptr;
 
@@ -42,7 +50,6 @@ DELILA::TimeAlignment::~TimeAlignment()
   fDataProcessFlag.store(false);
   fFileList.clear();
   fChSettingsVec.clear();
-  fHistoTime.clear();
 }
 
 void DELILA::TimeAlignment::LoadChSettings(const std::string &fileName)
@@ -52,6 +59,8 @@ void DELILA::TimeAlignment::LoadChSettings(const std::string &fileName)
     if (fChSettingsVec.empty()) {
       throw DELILA::ConfigException("No channel settings found in file: " + fileName);
     }
+    fChannelTable.Build(fChSettingsVec);
+    fHitFilter.Build(fChannelTable, false);  // Offsets are the result here
   } catch (const DELILA::ConfigException &e) {
     throw;  // Re-throw DELILA exceptions as-is
   } catch (const std::exception &e) {
@@ -61,12 +70,32 @@ void DELILA::TimeAlignment::LoadChSettings(const std::string &fileName)
 }
 
 void DELILA::TimeAlignment::LoadFileList(
-    const std::vector<std::string> &fileList)
+    const std::vector<std::string> &fileList,
+    const std::vector<int64_t> &fileEntries)
 {
   if (fileList.empty()) {
     throw DELILA::ValidationException("File list is empty");
   }
+  if (!fileEntries.empty() && fileEntries.size() != fileList.size()) {
+    throw DELILA::ValidationException(
+        "Entries given for " + std::to_string(fileEntries.size()) +
+        " of " + std::to_string(fileList.size()) + " files");
+  }
   fFileList = fileList;
+  if (fileEntries.empty()) {
+    return;
+  }
+
+  // Files are independent here, longest processing time first.
+  // Unknown sizes (-1) go last, equal sizes keep the run order.
+  std::vector<size_t> order(fileList.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return fileEntries[a] > fileEntries[b];
+  });
+  for (size_t i = 0; i < order.size(); i++) {
+    fFileList[i] = fileList[order[i]];
+  }
 }
 
 void DELILA::TimeAlignment::InitHistograms()
@@ -78,26 +107,30 @@ void DELILA::TimeAlignment::InitHistograms()
     }
   }
   maxID += 1;  // Adjust for zero-based indexing
-
-  fHistoTime.resize(fChSettingsVec.size());
-  fHistoADC.resize(fChSettingsVec.size());
+  fMaxID = maxID;
+
+  // No bin is allocated here, rows are allocated by the first fill
+  fTriggerSlot.assign(fChannelTable.Size(), -1);
+  fTriggerChannels.clear();
+  fHistograms.histoTime.clear();
+  fHistograms.histoADC.assign(fChannelTable.Size(),
+                              CompactHistogram(kADCBins, 0, kADCBins));
   for (size_t i = 0; i < fChSettingsVec.size(); i++) {
-    fHistoTime[i].resize(fChSettingsVec[i].size());
-    fHistoADC[i].resize(fChSettingsVec[i].size());
     for (size_t j = 0; j < fChSettingsVec[i].size(); j++) {
+      if (!fChannelTable.IsValid(i, j) ||
+          !fChSettingsVec[i][j].isEventTrigger) {
+        continue;
+      }
+      const auto index = fChannelTable.Index(i, j);
+      fTriggerSlot[index] = fTriggerChannels.size();
+      fTriggerChannels.push_back(index);
       int nBins = fTimeWindow;
-      TString histName = Form("hTime_%02zu_%02zu", i, j);
-      fHistoTime[i][j] =
-          std::make_unique<TH2D>(histName, histName, nBins, -fTimeWindow,
-                                 fTimeWindow, maxID, 0, maxID);
-
-      histName = Form("hADC_%02zu_%02zu", i, j);
-      fHistoADC[i][j] =
-          std::make_unique<TH1D>(histName, histName, 32000, 0, 32000);
-      fHistoADC[i][j]->SetDirectory(0);
-      fHistoTime[i][j]->SetDirectory(0);
+      fHistograms.histoTime.emplace_back(nBins, -fTimeWindow, fTimeWindow,
+                                         maxID);
     }
   }
+  fEmptyHistograms = fHistograms;
+  fNFills = 0;
 }
 
 void DELILA::TimeAlignment::SaveHistograms()
@@ -109,33 +142,57 @@ void DELILA::TimeAlignment::SaveHistograms()
     return;
   }
 
-  for (size_t i = 0; i < fHistoTime.size(); i++) {
-    for (size_t j = 0; j < fHistoTime[i].size(); j++) {
-      if (!fHistoTime[i][j]) {
-        std::cerr << "Error: Histogram not initialized for module " << i
-                  << ", channel " << j << std::endl;
-        continue;
-      }
-      if (fHistoTime[i][j]->GetEntries() > 0) {
-        fHistoTime[i][j]->Write();
-      }
+  // One ROOT histogram at a time, only for writing
+  const auto nChannels = fChannelTable.GetNChannels();
+  for (size_t slot = 0; slot < fHistograms.histoTime.size(); slot++) {
+    const auto &accumulator = fHistograms.histoTime[slot];
+    if (accumulator.GetEntries() > 0) {
+      const auto index = fTriggerChannels[slot];
+      TString histName =
+          Form("hTime_%02u_%02u", index / nChannels, index % nChannels);
+      accumulator.ToTH2D(histName.Data())->Write();
     }
   }
 
-  for (size_t i = 0; i < fHistoADC.size(); i++) {
-    for (size_t j = 0; j < fHistoADC[i].size(); j++) {
-      if (!fHistoADC[i][j]) {
+  // The ADC peak fits run in parallel, the file is written by this thread.
+  // TMinuit is not thread safe, Minuit2 is.  Fits and peak searches do
+  // not draw (N0 / goff nodraw), the threads share no graphics state.
+  std::vector<std::pair<uint32_t, uint32_t>> adcChannels;
+  for (size_t i = 0; i < fChSettingsVec.size(); i++) {
+    for (size_t j = 0; j < fChSettingsVec[i].size(); j++) {
+      const auto index = fChannelTable.Index(i, j);
+      if (!fChannelTable.IsValid(i, j) ||
+          index >= fHistograms.histoADC.size()) {
         std::cerr << "Error: Histogram not initialized for module " << i
                   << ", channel " << j << std::endl;
         continue;
       }
-      auto hist = fHistoADC[i][j].get();  // crazy!
-      auto fitVec = FitHist(hist);
-      fHistoADC[i][j]->Write();
-      for (auto fit : fitVec) {
-        if (fit) {
-          fit->Write();
-        }
+      adcChannels.emplace_back(i, j);
+    }
+  }
+  // The default minimizer is process wide, restored after the fits
+  const auto defaultMinimizer =
+      ROOT::Math::MinimizerOptions::DefaultMinimizerType();
+  const auto defaultAlgorithm =
+      ROOT::Math::MinimizerOptions::DefaultMinimizerAlgo();
+  ROOT::Math::MinimizerOptions::SetDefaultMinimizer("Minuit2");
+  std::vector<std::unique_ptr<TH1D>> adcHists(adcChannels.size());
+  std::vector<std::vector<TF1 *>> adcFits(adcChannels.size());
+  ParallelFor(adcChannels.size(), fNThreads, [&](size_t k) {
+    const auto [i, j] = adcChannels[k];
+    TString histName = Form("hADC_%02u_%02u", i, j);
+    adcHists[k] = fHistograms.histoADC[fChannelTable.Index(i, j)].ToTH1D(
+        histName.Data());
+    adcFits[k] = FitHist(adcHists[k].get());
+  });
+  ROOT::Math::MinimizerOptions::SetDefaultMinimizer(defaultMinimizer.c_str(),
+                                                    defaultAlgorithm.c_str());
+
+  for (size_t k = 0; k < adcHists.size(); k++) {
+    adcHists[k]->Write();
+    for (auto fit : adcFits[k]) {
+      if (fit) {
+        fit->Write();
       }
     }
   }
@@ -156,43 +213,30 @@ void DELILA::TimeAlignment::FillHistograms(const int nThreads)
   fCancelled.store(false);
   ::signal(SIGINT, timeAlignmentSignalHandler);
 
-  // Initialize thread-local histograms
-  auto maxID = 0;
-  for (size_t i = 0; i < fChSettingsVec.size(); i++) {
-    for (size_t j = 0; j < fChSettingsVec[i].size(); j++) {
-      maxID = std::max(maxID, static_cast<int>(fChSettingsVec[i][j].ID));
-    }
+  // The fits use all threads, the readers take a file each
+  fNThreads = nThreads;
+  const int nReaders =
+      std::max<int>(1, std::min<size_t>(nThreads, fFileList.size()));
+
+  // Thread-local histograms, copies of the empty ones
+  fThreadHistograms.assign(nReaders, fEmptyHistograms);
+
+  // Shared statistics for the stopping rule
+  fStatisticsReached.store(false);
+  if (fMinEntries > 0) {
+    fPairEntries = std::vector<std::atomic<uint64_t>>(
+        fTriggerChannels.size() * fMaxID);
+    fLiveIDs = std::vector<std::atomic<bool>>(fMaxID);
   }
-  maxID += 1;
-
-#ifndef USE_MUTEX_APPROACH
-  fThreadHistograms.resize(nThreads);
-  for (int t = 0; t < nThreads; ++t) {
-    fThreadHistograms[t].histoTime.resize(fChSettingsVec.size());
-    fThreadHistograms[t].histoADC.resize(fChSettingsVec.size());
-    for (size_t i = 0; i < fChSettingsVec.size(); i++) {
-      fThreadHistograms[t].histoTime[i].resize(fChSettingsVec[i].size());
-      fThreadHistograms[t].histoADC[i].resize(fChSettingsVec[i].size());
-      for (size_t j = 0; j < fChSettingsVec[i].size(); j++) {
-        int nBins = fTimeWindow;
-        TString histName = Form("hTime_%02zu_%02zu_thread%d", i, j, t);
-        fThreadHistograms[t].histoTime[i][j] =
-            std::make_unique<TH2D>(histName, histName, nBins, -fTimeWindow,
-                                   fTimeWindow, maxID, 0, maxID);
-        fThreadHistograms[t].histoTime[i][j]->SetDirectory(0);
-
-        histName = Form("hADC_%02zu_%02zu_thread%d", i, j, t);
-        fThreadHistograms[t].histoADC[i][j] =
-            std::make_unique<TH1D>(histName, histName, 32000, 0, 32000);
-        fThreadHistograms[t].histoADC[i][j]->SetDirectory(0);
-      }
-    }
+  if (fSampleFraction < 1.) {
+    std::cout << "Sampling " << fSampleFraction * 100.
+              << "% of every chunk." << std::endl;
   }
-#endif
 
+  fWorkerTimings.assign(nReaders, WorkerTiming_t());
   std::vector<std::thread> threads;
   fDataProcessFlag.store(true);
-  for (int i = 0; i < nThreads; ++i) {
+  for (int i = 0; i < nReaders; ++i) {
     threads.emplace_back(&DELILA::TimeAlignment::DataProcess, this, i);
   }
 
@@ -202,14 +246,40 @@ void DELILA::TimeAlignment::FillHistograms(const int nThreads)
     }
   }
 
-#ifndef USE_MUTEX_APPROACH
+  PrintWorkerTimings(fWorkerTimings, "files");
+  ScopedTimer mergeTime(fMetrics.GetStage("merge", 0).busyTime);
   MergeThreadHistograms();
-#endif
   SaveHistograms();
 }
 
 void DELILA::TimeAlignment::DataProcess(int threadID)
 {
+  typedef std::tuple<UChar_t, UChar_t, Timestamp_t> Hit_t;
+  HitSorter<Hit_t> sorter;  // Scratch buffers are reused for every chunk
+  std::vector<Hit_t> dataVec;
+  auto &histograms = fThreadHistograms[threadID];
+  std::vector<Timestamp_t> lastTime(fChannelTable.Size());  // Per flat index
+  FilteredHits selected;
+  const bool countPairs = (fMinEntries > 0);
+  std::vector<uint64_t> pairCounts(
+      countPairs ? fTriggerChannels.size() * fMaxID : 0);
+  // The wall time is taken at every return
+  const auto workerStart = std::chrono::high_resolution_clock::now();
+  auto &timing = fWorkerTimings[threadID];
+  auto &metrics = fMetrics.GetStage("fill", threadID);
+  struct WallTime {
+    WorkerTiming_t &timing;
+    StageMetrics &metrics;
+    std::chrono::high_resolution_clock::time_point start;
+    ~WallTime()
+    {
+      timing.wallTime = std::chrono::duration<double>(
+                            std::chrono::high_resolution_clock::now() - start)
+                            .count();
+      metrics.wallTime.Set(timing.wallTime);
+    }
+  } wallTime{timing, metrics, workerStart};
+
   while (fDataProcessFlag.load()) {
     // Check if cancelled
     if (fCancelled.load()) {
@@ -217,6 +287,9 @@ void DELILA::TimeAlignment::DataProcess(int threadID)
       std::cout << "Thread " << threadID << " cancelled by user." << std::endl;
       break;
     }
+    if (fStatisticsReached.load()) {
+      break;
+    }
 
     auto fileName = std::string();
     {
@@ -229,35 +302,34 @@ void DELILA::TimeAlignment::DataProcess(int threadID)
       fFileList.erase(fFileList.begin());
       std::cout << "Processing file: " << fileName << std::endl;
     }
+    const auto fileStart = std::chrono::high_resolution_clock::now();
     auto file = DELILA::MakeTFile(fileName.c_str(), "READ");
     if (!file || file->IsZombie()) {
       std::cerr << "Error: Could not open file: " << fileName << std::endl;
       continue;  // Now safe - file will be automatically closed and deleted
     }
     auto tree = static_cast<TTree *>(file->Get("ELIADE_Tree"));
-    tree->SetBranchStatus("*", kFALSE);
-
-    UChar_t mod;
-    tree->SetBranchStatus("Mod", kTRUE);
-    tree->SetBranchAddress("Mod", &mod);
-    UChar_t ch;
-    tree->SetBranchStatus("Ch", kTRUE);
-    tree->SetBranchAddress("Ch", &ch);
-
-    UShort_t chargeLong;
-    tree->SetBranchStatus("ChargeLong", kTRUE);
-    tree->SetBranchAddress("ChargeLong", &chargeLong);
-
-    Double_t fineTS;
-    tree->SetBranchStatus("FineTS", kTRUE);
-    tree->SetBranchAddress("FineTS", &fineTS);
+    if (!tree) {
+      std::cerr << "Error: Could not find tree in file: " << fileName
+                << std::endl;
+      continue;
+    }
+    constexpr uint32_t columns = RawTreeReader::kMod | RawTreeReader::kCh |
+                                 RawTreeReader::kChargeLong |
+                                 RawTreeReader::kFineTS;
 
     const int64_t nEvents = tree->GetEntries();
 
     // CHUNKED PROCESSING: Process file in chunks to limit memory usage
-    // Instead of loading all entries at once, process 10M at a time
-    const int64_t numChunks = (nEvents + CHUNK_SIZE - 1) / CHUNK_SIZE;
-
+    // Instead of loading all entries at once, process 10M at a time.
+    // A chunk owns the triggers in [coreStart, coreEnd).  Triggers whose
+    // window can still get hits from the next chunk are left to it, together
+    // with the hits that complete their windows, so no pair is lost or
+    // counted twice at a chunk edge.
+    // Integer ps, the chunk edges are exact at any run time
+    const auto window = NsToTimestamp(fTimeWindow);
+    auto coreStart = kMinTimestamp;
+    dataVec.clear();
     for (int64_t chunkStart = 0; chunkStart < nEvents; chunkStart += CHUNK_SIZE) {
       // Check if cancelled
       if (fCancelled.load()) {
@@ -265,98 +337,150 @@ void DELILA::TimeAlignment::DataProcess(int threadID)
         std::cout << "Thread " << threadID << " cancelled during chunked processing." << std::endl;
         return;
       }
+      if (fStatisticsReached.load()) {
+        break;
+      }
 
-      int64_t chunkEnd = std::min(nEvents, chunkStart + CHUNK_SIZE);
-
-      // Load this chunk from file
-      std::vector<std::tuple<UChar_t, UChar_t, Double_t>> dataVec;
-      dataVec.reserve(chunkEnd - chunkStart);
-
-      for (int64_t iEve = chunkStart; iEve < chunkEnd; iEve++) {
-        tree->GetEntry(iEve);
-
-        // Bounds checking to prevent segmentation fault
-        if (mod >= fChSettingsVec.size() || ch >= fChSettingsVec[mod].size()) {
-          continue;
-        }
-
-        auto threshold = fChSettingsVec[mod][ch].thresholdADC;
-        if (chargeLong > threshold) {
-#ifdef USE_MUTEX_APPROACH
-          {
-            std::lock_guard<std::mutex> lock(fHistogramMutex);
-            fHistoADC[mod][ch]->Fill(chargeLong);
-          }
-#else
-          fThreadHistograms[threadID].histoADC[mod][ch]->Fill(chargeLong);
-#endif
-          dataVec.emplace_back(mod, ch, fineTS / 1000.);  // ps -> ns
+      const int64_t chunkEnd = std::min(nEvents, chunkStart + CHUNK_SIZE);
+      // Sampling reads the first part of every chunk, spread over the file
+      int64_t readEnd = chunkEnd;
+      if (fSampleFraction < 1.) {
+        readEnd = std::min<int64_t>(
+            chunkEnd, chunkStart + std::max<int64_t>(
+                                       1, std::llround((chunkEnd - chunkStart) *
+                                                       fSampleFraction)));
+      }
+      const bool isFileEnd = (readEnd == nEvents);
+      const bool isContiguous = (readEnd == chunkEnd) && !isFileEnd;
+
+      // Load this chunk from file, behind the hits carried over
+      dataVec.reserve(dataVec.size() + (readEnd - chunkStart));
+      std::fill(lastTime.begin(), lastTime.end(), kMinTimestamp);
+
+      // Cluster wise column reads, the next cluster is decoded meanwhile
+      RawTreeReader reader(tree, columns);
+      reader.SetRange(chunkStart, readEnd);
+      reader.SetPrefetch(true);
+      // Unknown channels and hits below the threshold are dropped, times
+      // are only rounded to integer ps
+      RawColumns block;
+      const auto readStart = std::chrono::steady_clock::now();
+      const auto nBefore = dataVec.size();
+      while (reader.Next(block)) {
+        fHitFilter.Filter(block, selected);
+        for (size_t k = 0; k < selected.size(); k++) {
+          const auto i = selected.entry[k];
+          const auto index = selected.index[k];
+          const auto time = selected.time[k];
+          histograms.histoADC[index].Fill(block.chargeLong[i]);
+          dataVec.emplace_back(block.mod[i], block.ch[i], time);
+          lastTime[index] = time;
         }
       }
 
-      // Sort this chunk
-      std::sort(dataVec.begin(), dataVec.end(), [](const auto &a, const auto &b) {
-        return std::get<2>(a) < std::get<2>(b);
-      });
-
-      const auto nGoodEvents = dataVec.size();
-    for (int64_t iEve = 0; iEve < nGoodEvents; iEve++) {
-      auto mod = std::get<0>(dataVec[iEve]);
-      auto ch = std::get<1>(dataVec[iEve]);
-      auto fineTS = std::get<2>(dataVec[iEve]);
-
-      if (fChSettingsVec[mod][ch].isEventTrigger) {
-        auto time0 = fineTS;
-        int origMod = mod;
-        int origCh = ch;
-
-        for (auto i = iEve + 1; i < nGoodEvents; i++) {
-          auto mod = std::get<0>(dataVec[i]);
-          auto ch = std::get<1>(dataVec[i]);
-          auto fineTS = std::get<2>(dataVec[i]);
-
-          auto timeDiff = fineTS - time0;
-          if (timeDiff > fTimeWindow) {
-            break;
-          }
-#ifdef USE_MUTEX_APPROACH
-          {
-            std::lock_guard<std::mutex> lock(fHistogramMutex);
-            fHistoTime[origMod][origCh]->Fill(timeDiff,
-                                              fChSettingsVec[mod][ch].ID);
+      const auto sortStart = std::chrono::steady_clock::now();
+      metrics.readTime.Add(
+          std::chrono::duration<double>(sortStart - readStart).count());
+      metrics.entries.Add(readEnd - chunkStart);
+      metrics.hits.Add(dataVec.size() - nBefore);
+
+      // Sort this chunk, every channel is already in time order
+      sorter.Sort(
+          dataVec,
+          [](const Hit_t &hit) {
+            return HitSorter<Hit_t>::OrderedKey(std::get<2>(hit));
+          },
+          [](const Hit_t &hit) {
+            return uint16_t((std::get<0>(hit) << 8) | std::get<1>(hit));
+          });
+
+      const auto buildStart = std::chrono::steady_clock::now();
+      metrics.sortTime.Add(
+          std::chrono::duration<double>(buildStart - sortStart).count());
+
+      // Channels are in time order, so the next chunk has no hit earlier
+      // than the last hit of any channel of this one.  A channel without any
+      // hit in a chunk is assumed to be no later than the others.
+      auto coreEnd = kMaxTimestamp;
+      if (!isFileEnd) {
+        auto horizon = kMaxTimestamp;
+        for (const auto time : lastTime) {
+          if (time > kMinTimestamp) {
+            horizon = std::min(horizon, time);
           }
-#else
-          fThreadHistograms[threadID].histoTime[origMod][origCh]->Fill(
-              timeDiff, fChSettingsVec[mod][ch].ID);
-#endif
-        }
-        for (auto i = iEve - 1; i >= 0; i--) {
-          auto mod = std::get<0>(dataVec[i]);
-          auto ch = std::get<1>(dataVec[i]);
-          auto fineTS = std::get<2>(dataVec[i]);
-
-          auto timeDiff = fineTS - time0;
-          if (timeDiff < -fTimeWindow) {
-            break;
-          }
-#ifdef USE_MUTEX_APPROACH
-          {
-            std::lock_guard<std::mutex> lock(fHistogramMutex);
-            fHistoTime[origMod][origCh]->Fill(timeDiff,
-                                              fChSettingsVec[mod][ch].ID);
-          }
-#else
-          fThreadHistograms[threadID].histoTime[origMod][origCh]->Fill(
-              timeDiff, fChSettingsVec[mod][ch].ID);
-#endif
         }
+        coreEnd = std::max(coreStart, horizon - window);
+      }
+      const auto firstHitAt = [&dataVec](const Timestamp_t time) {
+        const auto before = [time](const Hit_t &hit) {
+          return std::get<2>(hit) < time;
+        };
+        return std::partition_point(dataVec.begin(), dataVec.end(), before) -
+               dataVec.begin();
+      };
+      const size_t triggerBegin = firstHitAt(coreStart);
+      const size_t triggerEnd = firstHitAt(coreEnd);
+
+      // Every hit within +-fTimeWindow of a trigger, no veto
+      CoincidenceEngine engine(double_t(window), false);
+      engine.Run(
+          dataVec.size(), triggerBegin, triggerEnd,
+          [&dataVec](size_t i) { return std::get<2>(dataVec[i]); },
+          [this, &dataVec](size_t i) -> int64_t {
+            const auto &info = fChannelTable.Get(std::get<0>(dataVec[i]),
+                                                 std::get<1>(dataVec[i]));
+            return info.isEventTrigger ? info.ID
+                                       : CoincidenceEngine::kNoTrigger;
+          },
+          [&](size_t iTrg, size_t lo, size_t hi) {
+            // Only trigger channels open an event, they all have a slot
+            const auto slot = fTriggerSlot[fChannelTable.Index(
+                std::get<0>(dataVec[iTrg]), std::get<1>(dataVec[iTrg]))];
+            auto &histoTime = histograms.histoTime[slot];
+            const auto time0 = std::get<2>(dataVec[iTrg]);
+            for (auto i = lo; i < hi; i++) {
+              if (i == iTrg) {
+                continue;
+              }
+              auto mod = std::get<0>(dataVec[i]);
+              auto ch = std::get<1>(dataVec[i]);
+              auto timeDiff = ToNs(std::get<2>(dataVec[i]) - time0);
+              const auto id = fChannelTable.Get(mod, ch).ID;
+              histoTime.Fill(timeDiff, id);
+              if (countPairs && id >= 0 && id < fMaxID) {
+                pairCounts[slot * fMaxID + id]++;
+              }
+            }
+          });
+
+      metrics.buildTime.Add(std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - buildStart)
+                                .count());
+
+      if (isContiguous) {
+        // Keep the context of the triggers left to the next chunk
+        dataVec.erase(dataVec.begin(),
+                      dataVec.begin() + firstHitAt(coreEnd - window));
+        coreStart = coreEnd;
+      } else {
+        // Keep the capacity for the next chunk
+        dataVec.clear();
+        coreStart = kMinTimestamp;
       }
-    }
 
-      // Clear this chunk's data and release memory
-      dataVec.clear();
-      dataVec.shrink_to_fit();
+      if (countPairs) {
+        PublishStatistics(pairCounts, lastTime);
+      }
     }  // End chunk loop
+    timing.nTasks++;
+    const auto busyTime = std::chrono::duration<double>(
+                              std::chrono::high_resolution_clock::now() -
+                              fileStart)
+                              .count();
+    timing.busyTime += busyTime;
+    metrics.tasks.Add(1);
+    metrics.busyTime.Add(busyTime);
+    metrics.bytesIn.Add(file->GetBytesRead());
     // file will be automatically closed and deleted at end of scope
   }
 
@@ -366,48 +490,102 @@ void DELILA::TimeAlignment::DataProcess(int threadID)
   }
 }
 
-void DELILA::TimeAlignment::MergeThreadHistograms()
+void DELILA::TimeAlignment::SetMinEntries(const uint64_t minEntries)
 {
-  std::cout << "Merging thread histograms..." << std::endl;
+  fMinEntries = minEntries;
+}
 
-  // Merge all thread-local histograms into the main histograms
-  for (size_t i = 0; i < fChSettingsVec.size(); i++) {
-    for (size_t j = 0; j < fChSettingsVec[i].size(); j++) {
-      // Move first thread's histogram as base
-      if (fThreadHistograms.size() > 0 &&
-          fThreadHistograms[0].histoTime[i][j]) {
-        fHistoTime[i][j] = std::move(fThreadHistograms[0].histoTime[i][j]);
-        fHistoADC[i][j] = std::move(fThreadHistograms[0].histoADC[i][j]);
-
-        // Add all other threads' histograms
-        for (size_t t = 1; t < fThreadHistograms.size(); t++) {
-          if (fThreadHistograms[t].histoTime[i][j]) {
-            fHistoTime[i][j]->Add(fThreadHistograms[t].histoTime[i][j].get());
-          }
-          if (fThreadHistograms[t].histoADC[i][j]) {
-            fHistoADC[i][j]->Add(fThreadHistograms[t].histoADC[i][j].get());
-          }
-        }
+void DELILA::TimeAlignment::SetSampleFraction(const double_t fraction)
+{
+  if (!(fraction > 0. && fraction <= 1.)) {
+    throw DELILA::ValidationException(
+        "Time alignment sample fraction must be in (0, 1]: " +
+        std::to_string(fraction));
+  }
+  fSampleFraction = fraction;
+}
 
-        // Rename to final names
-        TString histName = Form("hTime_%02zu_%02zu", i, j);
-        fHistoTime[i][j]->SetName(histName);
-        fHistoTime[i][j]->SetTitle(histName);
+void DELILA::TimeAlignment::PublishStatistics(
+    std::vector<uint64_t> &pairCounts, const std::vector<Timestamp_t> &lastTime)
+{
+  for (size_t index = 0; index < lastTime.size(); index++) {
+    const auto id = fChannelTable[index].ID;
+    if (lastTime[index] > kMinTimestamp &&
+        id >= 0 && id < fMaxID) {
+      fLiveIDs[id].store(true);
+    }
+  }
+  for (size_t i = 0; i < pairCounts.size(); i++) {
+    if (pairCounts[i] > 0) {
+      fPairEntries[i] += pairCounts[i];
+      pairCounts[i] = 0;
+    }
+  }
 
-        histName = Form("hADC_%02zu_%02zu", i, j);
-        fHistoADC[i][j]->SetName(histName);
-        fHistoADC[i][j]->SetTitle(histName);
+  // Every pair of a trigger channel and a channel that has data, except
+  // the trigger channel itself
+  for (size_t slot = 0; slot < fTriggerChannels.size(); slot++) {
+    const auto ownID = fChannelTable[fTriggerChannels[slot]].ID;
+    for (int32_t id = 0; id < fMaxID; id++) {
+      if (id != ownID && fLiveIDs[id].load() &&
+          fPairEntries[slot * fMaxID + id].load() < fMinEntries) {
+        return;
       }
     }
   }
+  if (!fStatisticsReached.exchange(true)) {
+    std::lock_guard<std::mutex> lock(fFileListMutex);
+    std::cout << "Every channel pair has " << fMinEntries
+              << " entries, stopping." << std::endl;
+  }
+}
+
+void DELILA::TimeAlignment::MergeThreadHistograms()
+{
+  std::cout << "Merging thread histograms..." << std::endl;
+  if (fThreadHistograms.empty()) {
+    return;
+  }
+
+  // Every merging thread owns a disjoint set of histograms, no lock needed.
+  // The first fill takes over thread 0, later ones add to the earlier ones.
+  size_t firstThread = 0;
+  if (fNFills == 0) {
+    fHistograms = std::move(fThreadHistograms[0]);
+    firstThread = 1;
+  }
+  fNFills++;
+  const auto nTime = fHistograms.histoTime.size();
+  const auto nHistograms = nTime + fHistograms.histoADC.size();
+  ParallelFor(nHistograms, fNThreads, [&](size_t h) {
+    for (size_t t = firstThread; t < fThreadHistograms.size(); t++) {
+      if (h < nTime) {
+        fHistograms.histoTime[h].Add(fThreadHistograms[t].histoTime[h]);
+      } else {
+        fHistograms.histoADC[h - nTime].Add(
+            fThreadHistograms[t].histoADC[h - nTime]);
+      }
+    }
+  });
 
   // Clear thread histograms to free memory
   fThreadHistograms.clear();
-  std::cout << "Histogram merging completed." << std::endl;
+
+  size_t memory = 0;
+  for (const auto &hist : fHistograms.histoTime) {
+    memory += hist.GetMemoryBytes();
+  }
+  for (const auto &hist : fHistograms.histoADC) {
+    memory += hist.GetMemoryBytes();
+  }
+  std::cout << "Histogram merging completed, " << fHistograms.histoTime.size()
+            << " trigger channels, " << memory / (1024 * 1024) << " MB."
+            << std::endl;
 }
 
 void DELILA::TimeAlignment::CalculateTimeAlignment()
 {
+  ScopedTimer fitTime(fMetrics.GetStage("fit", 0).busyTime);
   TString fileName = kTimeAlignmentFileName;
   auto file = DELILA::MakeTFile(fileName, "READ");
   if (!file || file->IsZombie()) {
@@ -415,63 +593,103 @@ void DELILA::TimeAlignment::CalculateTimeAlignment()
     return;
   }
 
-  std::vector<std::vector<std::vector<std::vector<double_t>>>> timeSettingsVec;
+  // Projection bin and rebinning of every channel, part of the cache key
+  std::vector<std::vector<TimeTarget_t>> targets(fChSettingsVec.size());
+  uint64_t layoutHash = kHashSeed;
+  for (size_t i = 0; i < fChSettingsVec.size(); i++) {
+    targets[i].resize(fChSettingsVec[i].size());
+    for (size_t j = 0; j < fChSettingsVec[i].size(); j++) {
+      auto &target = targets[i][j];
+      target.bin = fChSettingsVec[i][j].ID + 1;
+      auto detectorType =
+          ChSettings::GetDetectorType(fChSettingsVec[i][j].detectorType);
+      if (detectorType == DetectorType::AC) {
+        target.nGroup = 10;
+      } else if (detectorType == DetectorType::HPGe) {
+        target.nGroup = 100;
+      } else if (detectorType == DetectorType::PMT) {
+        // target.nGroup = 2;
+      }
+      layoutHash = HashWord(layoutHash, (uint64_t(i) << 48) |
+                                            (uint64_t(j) << 32) |
+                                            uint32_t(target.bin));
+      layoutHash = HashWord(layoutHash, target.nGroup);
+    }
+  }
 
-  timeSettingsVec.resize(fChSettingsVec.size());
-  for (auto iMod = 0; iMod < fChSettingsVec.size(); iMod++) {
-    timeSettingsVec[iMod].resize(fChSettingsVec[iMod].size());
-    for (auto iCh = 0; iCh < fChSettingsVec[iMod].size(); iCh++) {
+  // The histograms are read by this thread, the offsets are found in
+  // parallel straight from the bin arrays
+  struct Reference {
+    uint32_t mod;
+    uint32_t ch;
+    std::string name;
+    TH2D *hist;
+    uint64_t hash = 0;
+    std::vector<std::vector<double_t>> offsets;
+  };
+  std::vector<Reference> references;
+  for (uint32_t iMod = 0; iMod < fChSettingsVec.size(); iMod++) {
+    for (uint32_t iCh = 0; iCh < fChSettingsVec[iMod].size(); iCh++) {
       // Read the histogram from the file
-      auto histName = Form("hTime_%02d_%02d", iMod, iCh);
-      auto hist2D = static_cast<TH2D *>(file->Get(histName));
+      std::string histName = Form("hTime_%02u_%02u", iMod, iCh);
+      auto hist2D = static_cast<TH2D *>(file->Get(histName.c_str()));
       if (!hist2D) {
         std::cerr << "Error: Could not find histogram: " << histName
                   << std::endl;
-        // file->Close();
-        // delete file;
         continue;
       }
-      auto histVec = std::vector<std::vector<TH1D *>>();
-      histVec.resize(fChSettingsVec.size());
-      for (size_t i = 0; i < fChSettingsVec.size(); i++) {
-        histVec[i].resize(fChSettingsVec[i].size());
-        for (size_t j = 0; j < fChSettingsVec[i].size(); j++) {
-          auto id = fChSettingsVec[i][j].ID;
-          auto bin = id + 1;
-          histVec[i][j] = hist2D->ProjectionX(Form("hpx_%04d", id), bin, bin);
-          auto detectorType =
-              ChSettings::GetDetectorType(fChSettingsVec[i][j].detectorType);
-          if (detectorType == DetectorType::AC) {
-            histVec[i][j]->Rebin(10);
-          } else if (detectorType == DetectorType::HPGe) {
-            histVec[i][j]->Rebin(100);
-          } else if (detectorType == DetectorType::PMT) {
-            // histVec[i][j]->Rebin(2);
-          }
-        }
-      }
+      references.push_back({iMod, iCh, histName, hist2D});
+    }
+  }
 
-      std::vector<std::vector<double_t>> localVec;
-      localVec.resize(fChSettingsVec.size());
-      for (size_t i = 0; i < fChSettingsVec.size(); i++) {
-        localVec[i].resize(fChSettingsVec[i].size());
-        for (size_t j = 0; j < fChSettingsVec[i].size(); j++) {
-          auto hist = histVec[i][j];
-          auto timeOffset = 0.;
-          auto leftEdge = 0.;
-          auto rightEdge = 0.;
-          if (hist->GetEntries() > 0) {
-            const auto maxBin = hist->GetMaximumBin();
-            const auto maxBinCenter = hist->GetBinCenter(maxBin);
-            timeOffset = maxBinCenter;
-
-            localVec[i][j] = timeOffset;
-          }
+  // Offsets of the last run for histograms with the same content
+  std::map<std::string, std::pair<uint64_t, nlohmann::json>> cache;
+  std::ifstream cacheFile(kTimeCacheFileName);
+  if (cacheFile) {
+    try {
+      nlohmann::json j;
+      cacheFile >> j;
+      if (j.at("Layout").get<uint64_t>() == layoutHash) {
+        for (const auto &[name, entry] : j.at("References").items()) {
+          cache[name] = {entry.at("Hash").get<uint64_t>(),
+                         entry.at("Offsets")};
         }
+      }
+    } catch (const std::exception &e) {
+      std::cerr << "Warning: Ignoring " << kTimeCacheFileName << ": "
+                << e.what() << std::endl;
+      cache.clear();
+    }
+  }
 
-        timeSettingsVec[iMod][iCh] = localVec;
+  std::atomic<uint32_t> nCached{0};
+  ParallelFor(references.size(), fNThreads, [&](size_t r) {
+    auto &reference = references[r];
+    reference.hash = HashHistogram(reference.hist);
+    const auto it = cache.find(reference.name);
+    if (it != cache.end() && it->second.first == reference.hash) {
+      try {
+        reference.offsets =
+            it->second.second.get<std::vector<std::vector<double_t>>>();
+        nCached++;
+        return;
+      } catch (const std::exception &) {
+        // Recalculated below
       }
     }
+    reference.offsets = FindTimeOffsets(reference.hist, targets);
+  });
+  std::cout << nCached.load() << " of " << references.size()
+            << " reference channels unchanged since the last "
+            << kTimeSettingsFileName << "." << std::endl;
+
+  std::vector<std::vector<std::vector<std::vector<double_t>>>> timeSettingsVec;
+  timeSettingsVec.resize(fChSettingsVec.size());
+  for (size_t iMod = 0; iMod < fChSettingsVec.size(); iMod++) {
+    timeSettingsVec[iMod].resize(fChSettingsVec[iMod].size());
+  }
+  for (auto &reference : references) {
+    timeSettingsVec[reference.mod][reference.ch] = reference.offsets;
   }
   // file will be automatically closed and deleted
 
@@ -509,6 +727,109 @@ void DELILA::TimeAlignment::CalculateTimeAlignment()
   ofs << jsonData.dump(4) << std::endl;
   ofs.close();
   std::cout << kTimeSettingsFileName << " generated." << std::endl;
+
+  nlohmann::json cacheData;
+  cacheData["Layout"] = layoutHash;
+  cacheData["References"] = nlohmann::json::object();
+  for (const auto &reference : references) {
+    cacheData["References"][reference.name] = {
+        {"Hash", reference.hash}, {"Offsets", reference.offsets}};
+  }
+  std::ofstream cacheOfs(kTimeCacheFileName);
+  cacheOfs << cacheData.dump() << std::endl;
+}
+
+std::vector<std::vector<double_t>> DELILA::TimeAlignment::FindTimeOffsets(
+    TH2D *hist, const std::vector<std::vector<TimeTarget_t>> &targets) const
+{
+  // Same result as ProjectionX of the ID bin, Rebin(nGroup) and the center
+  // of GetMaximumBin, without creating the projections
+  std::vector<std::vector<double_t>> offsets(targets.size());
+  const auto nX = hist->GetNbinsX();
+  const auto nY = hist->GetNbinsY();
+  const Double_t *bins = hist->GetArray();
+  for (size_t i = 0; i < targets.size(); i++) {
+    offsets[i].assign(targets[i].size(), 0.);
+    for (size_t j = 0; j < targets[i].size(); j++) {
+      const auto &target = targets[i][j];
+      if (!bins || target.bin < 0 || target.bin > nY + 1) {
+        continue;
+      }
+      const auto *row = bins + size_t(nX + 2) * target.bin;
+      auto entries = 0.;
+      for (Int_t x = 0; x <= nX + 1; x++) {
+        entries += row[x];
+      }
+      if (entries <= 0.) {
+        continue;
+      }
+
+      // TH1::Rebin refuses a group wider than the axis
+      const auto nGroup = target.nGroup > nX ? 1 : target.nGroup;
+      auto maxContent = std::numeric_limits<double_t>::lowest();
+      Int_t maxBin = 1;
+      for (Int_t bin = 1; bin <= nX / nGroup; bin++) {
+        auto content = 0.;
+        for (Int_t x = (bin - 1) * nGroup + 1; x <= bin * nGroup; x++) {
+          content += row[x];
+        }
+        if (content > maxContent) {
+          maxContent = content;
+          maxBin = bin;
+        }
+      }
+      offsets[i][j] = 0.5 * (hist->GetBinCenter((maxBin - 1) * nGroup + 1) +
+                             hist->GetBinCenter(maxBin * nGroup));
+    }
+  }
+  return offsets;
+}
+
+uint64_t DELILA::TimeAlignment::HashHistogram(TH2D *hist)
+{
+  auto hash = kHashSeed;
+  const auto nX = hist->GetNbinsX();
+  const auto nY = hist->GetNbinsY();
+  hash = HashWord(hash, (uint64_t(nX) << 32) | uint32_t(nY));
+  const double_t edges[2] = {hist->GetBinCenter(1), hist->GetBinCenter(nX)};
+  for (const auto edge : edges) {
+    uint64_t word;
+    std::memcpy(&word, &edge, sizeof(word));
+    hash = HashWord(hash, word);
+  }
+  const Double_t *bins = hist->GetArray();
+  if (bins) {
+    const size_t nBins = size_t(nX + 2) * (nY + 2);
+    for (size_t b = 0; b < nBins; b++) {
+      uint64_t word;
+      std::memcpy(&word, &bins[b], sizeof(word));
+      hash = HashWord(hash, word);
+    }
+  }
+  return hash;
+}
+
+void DELILA::TimeAlignment::ParallelFor(
+    const size_t n, size_t nThreads, const std::function<void(size_t)> &fn)
+{
+  if (nThreads == 0) {
+    nThreads = std::thread::hardware_concurrency();
+  }
+  nThreads = std::min(nThreads, n);
+  if (nThreads <= 1) {
+    for (size_t i = 0; i < n; i++) fn(i);
+    return;
+  }
+  // Strided, every index is handled by exactly one thread
+  std::vector<std::thread> threads;
+  for (size_t w = 0; w < nThreads; w++) {
+    threads.emplace_back([w, n, nThreads, &fn]() {
+      for (auto i = w; i < n; i += nThreads) fn(i);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
 }
 
 std::vector<TF1 *> DELILA::TimeAlignment::FitHist(TH1D *hist)
@@ -517,15 +838,16 @@ std::vector<TF1 *> DELILA::TimeAlignment::FitHist(TH1D *hist)
 
   std::vector<TF1 *> fitVec;
   auto peaks = GetPeaks(hist, 50, 0.2);
-  TF1 *simpleGaus = new TF1("simpleGaus", "gaus");
   auto histName = hist->GetName();
+  // Functions of the same name replace each other, one per histogram
+  auto simpleGaus = std::make_unique<TF1>(TString(histName) + "_seed", "gaus");
   for (int i = 0; i < peaks.size(); i++) {
     // Get peak information
     auto peakPos = peaks[i];
     auto peakHeight = hist->GetBinContent(hist->FindBin(peakPos));
     simpleGaus->SetRange(peakPos - 10, peakPos + 10);
     simpleGaus->SetParameters(peakHeight, peakPos, 1);
-    hist->Fit(simpleGaus, "RQ");
+    hist->Fit(simpleGaus.get(), "RQN0");
     auto peakSigma = simpleGaus->GetParameter(2);
 
     // Get BG information
@@ -539,8 +861,8 @@ std::vector<TF1 *> DELILA::TimeAlignment::FitHist(TH1D *hist)
                        peakPos + 2 * peakSigma);
     fit->SetParNames("height", "mean", "sigma", "bgIntercept", "bgSlope");
     fit->SetParameters(peakHeight, peakPos, peakSigma, bgIntercept, bgSlope);
-    hist->Fit(fit, "RQ");
-    hist->Fit(fit, "RQ");
+    hist->Fit(fit, "RQN0");
+    hist->Fit(fit, "RQN0");
     fitVec.push_back(fit);
   }
 
@@ -550,8 +872,8 @@ std::vector<TF1 *> DELILA::TimeAlignment::FitHist(TH1D *hist)
 std::vector<double> DELILA::TimeAlignment::GetPeaks(TH1D *hist, double sigma,
                                                     double threshold)
 {
-  TSpectrum *s = new TSpectrum(20);
-  int n = s->Search(hist, sigma, "", threshold);
+  auto s = std::make_unique<TSpectrum>(20);
+  int n = s->Search(hist, sigma, "goff nodraw", threshold);
   std::vector<double> peaks;
 
   double *p = s->GetPositionX();
@@ -0,0 +1,554 @@
+#include "TimeOrderedMerger.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <type_traits>
+
+#include "DELILAExceptions.hpp"
+
+namespace
+{
+// Checkpoint stream: fixed size values and hit vectors as they are in memory
+constexpr char kStateMagic[8] = {'E', 'L', 'I', 'F', 'M', 'R', 'G', '2'};
+static_assert(std::is_trivially_copyable_v<DELILA::RawHit_t>);
+
+template <typename T>
+void WriteValue(std::ostream &os, const T value)
+{
+  os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+T ReadValue(std::istream &is)
+{
+  T value{};
+  if (!is.read(reinterpret_cast<char *>(&value), sizeof(T))) {
+    throw DELILA::FileException("Merger state is truncated");
+  }
+  return value;
+}
+
+void WriteHits(std::ostream &os, const DELILA::HitVec_t &hits,
+               const size_t first = 0)
+{
+  WriteValue<uint64_t>(os, hits.size() - first);
+  os.write(reinterpret_cast<const char *>(hits.data() + first),
+           (hits.size() - first) * sizeof(DELILA::RawHit_t));
+}
+
+DELILA::HitVec_t ReadHits(std::istream &is)
+{
+  DELILA::HitVec_t hits(ReadValue<uint64_t>(is));
+  if (!is.read(reinterpret_cast<char *>(hits.data()),
+               hits.size() * sizeof(DELILA::RawHit_t))) {
+    throw DELILA::FileException("Merger state is truncated");
+  }
+  return hits;
+}
+
+void WriteSlice(std::ostream &os, const DELILA::HitSlice &slice)
+{
+  WriteHits(os, slice.hits);
+  WriteValue<uint64_t>(os, slice.coreBegin);
+  WriteValue<uint64_t>(os, slice.coreEnd);
+  WriteValue(os, slice.coreStartTS);
+  WriteValue(os, slice.coreEndTS);
+}
+
+DELILA::HitSlice ReadSlice(std::istream &is)
+{
+  DELILA::HitSlice slice;
+  slice.hits = ReadHits(is);
+  slice.coreBegin = ReadValue<uint64_t>(is);
+  slice.coreEnd = ReadValue<uint64_t>(is);
+  slice.coreStartTS = ReadValue<DELILA::Timestamp_t>(is);
+  slice.coreEndTS = ReadValue<DELILA::Timestamp_t>(is);
+  if (slice.coreBegin > slice.hits.size() ||
+      slice.coreEnd > slice.hits.size()) {
+    throw DELILA::FileException("Merger state has an invalid slice");
+  }
+  return slice;
+}
+}  // namespace
+
+DELILA::TimeOrderedMerger::TimeOrderedMerger(std::vector<ChunkTask> tasks,
+                                             ChunkLoader loader,
+                                             BoundedQueue<HitSlice> &output)
+    : fTasks(std::move(tasks)), fLoader(std::move(loader)), fOutput(&output)
+{
+}
+
+DELILA::TimeOrderedMerger::TimeOrderedMerger(std::vector<ChunkTask> tasks,
+                                             ChunkLoader loader)
+    : fTasks(std::move(tasks)), fLoader(std::move(loader))
+{
+}
+
+DELILA::TimeOrderedMerger::~TimeOrderedMerger() {}
+
+void DELILA::TimeOrderedMerger::SetNumberOfReaders(const uint32_t nReaders)
+{
+  fNReaders = std::max<uint32_t>(1, nReaders);
+  fWindow = fNReaders + 1;
+  // Chunks in flight, active runs and slices in the output queue
+  fBufferPool.SetMaxBuffers(2 * fWindow + fOutput->Capacity() + 4);
+}
+
+void DELILA::TimeOrderedMerger::Run(const std::atomic<bool> &cancelled,
+                                     const bool endOfData)
+{
+  const auto firstTask = fConsumed;
+  const auto nTasks = fTasks.size();
+  fSlots.resize(nTasks);
+  fSlotReady.resize(nTasks, false);
+  fNextTask.store(firstTask);
+  fStop = false;
+
+  if (!fOpen) {
+    fCurrent = HitSlice();
+    fCurrent.coreStartTS = kMinTimestamp;
+    fPending.clear();
+    fCurrentSorted = true;
+    fCutRequested = false;
+    fSegmentEmpty = true;
+    fLastEmittedTS = kMinTimestamp;
+    fPushedEndTS = kMinTimestamp;
+  }
+  fLostHits = 0;
+
+  std::vector<std::thread> readers;
+  for (uint32_t i = 0; i < std::min<size_t>(fNReaders, nTasks - firstTask);
+       i++) {
+    readers.emplace_back(&DELILA::TimeOrderedMerger::ReaderLoop, this,
+                         std::cref(cancelled));
+  }
+
+  for (size_t iTask = firstTask; iTask < nTasks; iTask++) {
+    if (!WaitForSlot(iTask, cancelled)) {
+      break;
+    }
+    // A channel without hits in this chunk can start the next chunk earlier
+    // than this one, so its first hit bounds the emission too
+    auto nextTS = kMaxTimestamp;
+    if (iTask + 1 < nTasks) {
+      if (!WaitForSlot(iTask + 1, cancelled)) {
+        break;
+      }
+      std::lock_guard<std::mutex> lock(fSlotMutex);
+      if (!fSlots[iTask + 1].empty()) {
+        nextTS = fSlots[iTask + 1].front().ts;
+      }
+    }
+
+    HitVec_t hits;
+    {
+      std::lock_guard<std::mutex> lock(fSlotMutex);
+      hits = std::move(fSlots[iTask]);
+      fConsumed = iTask + 1;
+    }
+    fWindowCond.notify_all();
+
+    if (hits.empty()) {
+      continue;
+    }
+
+    // Chunks are sorted, the first hit is the earliest one of the chunk.
+    // Everything already loaded and earlier than it and the next chunk can
+    // not be preceded by any later chunk any more.
+    const auto firstTS = hits.front().ts;
+    if (!fSegmentEmpty && (firstTS + fResetThreshold) < fSegmentMaxTS) {
+      // Significant time stamp jump backwards - new acquisition detected.
+      // Close the current acquisition so no coincidence spans the restart.
+      std::cout << "Timestamp reset detected (new acquisition) at file index "
+                << fTasks[iTask].fileIndex << std::endl;
+      std::cout << "         Previous acquisition last timestamp: "
+                << ToNs(fSegmentMaxTS) / 1e9 << " s" << std::endl;
+      std::cout << "         Current chunk first timestamp: "
+                << ToNs(firstTS) / 1e9 << " s" << std::endl;
+      EmitAll();
+      EndSegment();
+      fResets++;
+    } else {
+      // The first chunk of a new acquisition does not bound this one
+      const auto segmentMaxTS = fSegmentEmpty
+                                    ? hits.back().ts
+                                    : std::max(fSegmentMaxTS, hits.back().ts);
+      const bool nextIsReset = nextTS < kMaxTimestamp &&
+                               nextTS + fResetThreshold < segmentMaxTS;
+      EmitBefore(nextIsReset ? firstTS : std::min(firstTS, nextTS));
+    }
+    Activate(std::move(hits));
+    if (fLostHits > 0) {
+      break;
+    }
+  }
+
+  const bool failed = fLostHits > 0;
+  fOpen = !endOfData && !cancelled.load() && !failed;
+  if (fOpen) {
+    // A later file can still precede the hits after the horizon
+    EmitBefore(GetHorizon());
+  } else if (!cancelled.load() && !failed) {
+    EmitAll();
+    EndSegment();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(fSlotMutex);
+    fStop = true;
+  }
+  fWindowCond.notify_all();
+  for (auto &reader : readers) {
+    reader.join();
+  }
+
+  if (!fOpen) {
+    fRuns.clear();
+    fHeap.clear();
+  }
+  fSlots.clear();
+
+  if (fLostHits > 0) {
+    throw DELILA::ValidationException(
+        std::to_string(fLostHits) +
+        " hits are earlier than slices already built, a chunk starts earlier "
+        "than the two chunks before it.  Use larger chunks.");
+  }
+}
+
+void DELILA::TimeOrderedMerger::SaveState(std::ostream &os) const
+{
+  os.write(kStateMagic, sizeof(kStateMagic));
+  WriteValue<uint64_t>(os, fConsumed);
+  WriteValue<uint8_t>(os, fOpen);
+  WriteValue(os, fSegmentMaxTS);
+  WriteValue(os, fLastEmittedTS);
+  WriteValue(os, fPushedEndTS);
+  WriteValue<uint8_t>(os, fSegmentEmpty);
+
+  // Only the hits not emitted yet, the heap is made again from them
+  uint64_t nRuns = 0;
+  for (const auto &run : fRuns) {
+    nRuns += run.pos < run.hits.size();
+  }
+  WriteValue(os, nRuns);
+  for (const auto &run : fRuns) {
+    if (run.pos < run.hits.size()) {
+      WriteHits(os, run.hits, run.pos);
+    }
+  }
+
+  WriteSlice(os, fCurrent);
+  WriteValue<uint8_t>(os, fCurrentSorted);
+  WriteValue<uint8_t>(os, fCutRequested);
+  WriteValue<uint64_t>(os, fPending.size());
+  for (const auto &pending : fPending) {
+    WriteSlice(os, pending.slice);
+    WriteValue<uint8_t>(os, pending.isSorted);
+  }
+  WriteValue(os, fNextSliceID);
+  WriteValue(os, fLateHits);
+  WriteValue(os, fResets);
+}
+
+void DELILA::TimeOrderedMerger::LoadState(std::istream &is)
+{
+  char magic[sizeof(kStateMagic)] = {};
+  if (!is.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, kStateMagic, sizeof(magic)) != 0) {
+    throw DELILA::FileException("Not a merger state");
+  }
+  const auto consumed = ReadValue<uint64_t>(is);
+  if (consumed > fTasks.size()) {
+    throw DELILA::FileException(
+        "Merger state is of " + std::to_string(consumed) + " tasks, only " +
+        std::to_string(fTasks.size()) + " given");
+  }
+  // Read into locals first, a bad stream leaves the merger as it was
+  const bool open = ReadValue<uint8_t>(is);
+  const auto segmentMaxTS = ReadValue<Timestamp_t>(is);
+  const auto lastEmittedTS = ReadValue<Timestamp_t>(is);
+  const auto pushedEndTS = ReadValue<Timestamp_t>(is);
+  const bool segmentEmpty = ReadValue<uint8_t>(is);
+  std::vector<Run_t> runs(ReadValue<uint64_t>(is));
+  for (auto &run : runs) {
+    run.hits = ReadHits(is);
+  }
+  auto current = ReadSlice(is);
+  const bool currentSorted = ReadValue<uint8_t>(is);
+  const bool cutRequested = ReadValue<uint8_t>(is);
+  std::deque<PendingSlice_t> pending(ReadValue<uint64_t>(is));
+  for (auto &slice : pending) {
+    slice.slice = ReadSlice(is);
+    slice.isSorted = ReadValue<uint8_t>(is);
+  }
+  const auto nextSliceID = ReadValue<uint64_t>(is);
+  const auto lateHits = ReadValue<uint64_t>(is);
+  const auto resets = ReadValue<uint32_t>(is);
+
+  fConsumed = consumed;
+  fOpen = open;
+  fSegmentMaxTS = segmentMaxTS;
+  fLastEmittedTS = lastEmittedTS;
+  fPushedEndTS = pushedEndTS;
+  fSegmentEmpty = segmentEmpty;
+  fRuns = std::move(runs);
+  fHeap.clear();
+  for (size_t i = 0; i < fRuns.size(); i++) {
+    if (!fRuns[i].hits.empty()) {
+      fHeap.emplace_back(fRuns[i].hits.front().ts, i);
+    }
+  }
+  std::make_heap(fHeap.begin(), fHeap.end(), std::greater<>());
+  fCurrent = std::move(current);
+  fCurrentSorted = currentSorted;
+  fCutRequested = cutRequested;
+  fPending = std::move(pending);
+  fNextSliceID = nextSliceID;
+  fLateHits = lateHits;
+  fResets = resets;
+}
+
+void DELILA::TimeOrderedMerger::ReaderLoop(const std::atomic<bool> &cancelled)
+{
+  while (true) {
+    const auto index = fNextTask.fetch_add(1);
+    if (index >= fTasks.size()) {
+      break;
+    }
+
+    {
+      // Do not run too far ahead of the merger, this bounds the memory
+      std::unique_lock<std::mutex> lock(fSlotMutex);
+      while (!fStop && !cancelled.load() && index >= fConsumed + fWindow) {
+        fWindowCond.wait_for(lock, std::chrono::milliseconds(100));
+      }
+      if (fStop || cancelled.load()) {
+        break;
+      }
+    }
+
+    const auto &task = fTasks[index];
+    auto hits = fLoader(task, fBufferPool.Acquire(task.lastEntry - task.firstEntry));
+
+    {
+      std::lock_guard<std::mutex> lock(fSlotMutex);
+      fSlots[index] = std::move(hits);
+      fSlotReady[index] = true;
+    }
+    fSlotReadyCond.notify_all();
+  }
+}
+
+bool DELILA::TimeOrderedMerger::WaitForSlot(const size_t index,
+                                            const std::atomic<bool> &cancelled)
+{
+  std::unique_lock<std::mutex> lock(fSlotMutex);
+  while (!fSlotReady[index]) {
+    if (cancelled.load()) {
+      return false;
+    }
+    fSlotReadyCond.wait_for(lock, std::chrono::milliseconds(100));
+  }
+  return true;
+}
+
+void DELILA::TimeOrderedMerger::Activate(HitVec_t &&hits)
+{
+  fSegmentMaxTS = fSegmentEmpty ? hits.back().ts
+                                : std::max(fSegmentMaxTS, hits.back().ts);
+  fSegmentEmpty = false;
+
+  const auto runIndex = fRuns.size();
+  const auto headTS = hits.front().ts;
+  fRuns.push_back(Run_t{std::move(hits), 0});
+  fHeap.emplace_back(headTS, runIndex);
+  std::push_heap(fHeap.begin(), fHeap.end(), std::greater<>());
+}
+
+DELILA::Timestamp_t DELILA::TimeOrderedMerger::GetHorizon() const
+{
+  // Every channel is in time order over the files, so the next file has no
+  // hit earlier than the last hit of any channel of the last chunk.  A
+  // channel without a hit in that chunk is assumed to be no later.
+  if (fRuns.empty() || fRuns.back().hits.empty()) {
+    return kMaxTimestamp;
+  }
+  std::vector<Timestamp_t> lastTS(1 << 16, kMinTimestamp);
+  for (const auto &hit : fRuns.back().hits) {
+    auto &last = lastTS[(uint32_t(hit.mod) << 8) | hit.ch];
+    last = std::max(last, hit.ts);
+  }
+  auto horizon = kMaxTimestamp;
+  for (const auto ts : lastTS) {
+    if (ts > kMinTimestamp) {
+      horizon = std::min(horizon, ts);
+    }
+  }
+  return horizon;
+}
+
+void DELILA::TimeOrderedMerger::EmitBefore(const Timestamp_t watermark)
+{
+  while (!fHeap.empty() && fHeap.front().first < watermark) {
+    std::pop_heap(fHeap.begin(), fHeap.end(), std::greater<>());
+    const auto runIndex = fHeap.back().second;
+    fHeap.pop_back();
+
+    // Take as many hits from this run as possible before touching the heap
+    auto &run = fRuns[runIndex];
+    const auto nextTS = fHeap.empty() ? watermark
+                                      : std::min(watermark, fHeap.front().first);
+    do {
+      Emit(run.hits[run.pos]);
+      run.pos++;
+    } while (run.pos < run.hits.size() && run.hits[run.pos].ts < nextTS);
+
+    if (run.pos < run.hits.size()) {
+      fHeap.emplace_back(run.hits[run.pos].ts, runIndex);
+      std::push_heap(fHeap.begin(), fHeap.end(), std::greater<>());
+    } else {
+      fBufferPool.Release(std::move(run.hits));  // Reuse the finished chunk
+    }
+  }
+}
+
+void DELILA::TimeOrderedMerger::EmitAll()
+{
+  EmitBefore(kMaxTimestamp);
+  fRuns.clear();
+}
+
+void DELILA::TimeOrderedMerger::Emit(const RawHit_t &hit)
+{
+  const auto ts = hit.ts;
+  const auto isLate = ts < fLastEmittedTS;
+  if (isLate) {
+    // Only possible if a chunk starts earlier than the two before it.  A hit
+    // of a slice already pushed, core or trailing pad, can not be added any
+    // more: Run() stops and fails.
+    if (ts <= fPushedEndTS) {
+      fLostHits++;
+      return;
+    }
+    fLateHits++;
+    fCurrentSorted = false;
+  } else {
+    // Cut only between two different time stamps, hits with the same time
+    // always end up in the same core
+    if (fCutRequested && ts > fLastEmittedTS) {
+      CloseCurrent(ts);
+    }
+    fLastEmittedTS = ts;
+  }
+
+  // Trailing pad of the slices closed recently
+  while (!fPending.empty() &&
+         ts > fPending.front().slice.coreEndTS + fContextWindow) {
+    fPushedEndTS = fPending.front().slice.coreEndTS + fContextWindow;
+    PushSlice(std::move(fPending.front().slice), fPending.front().isSorted);
+    fPending.pop_front();
+  }
+  for (auto &pending : fPending) {
+    // A late hit can be earlier than the leading pad
+    if (!isLate || pending.slice.coreStartTS == kMinTimestamp ||
+        ts >= pending.slice.coreStartTS - fContextWindow) {
+      pending.slice.hits.push_back(hit);
+      pending.isSorted &= !isLate;
+    }
+  }
+
+  if (fCurrent.hits.capacity() == 0) {
+    fCurrent.hits = fBufferPool.Acquire(fSliceSize);
+  }
+  fCurrent.hits.push_back(hit);
+  if (fCurrent.hits.size() - fCurrent.coreBegin >= fSliceSize) {
+    fCutRequested = true;
+  }
+}
+
+void DELILA::TimeOrderedMerger::CloseCurrent(const Timestamp_t cutTS)
+{
+  fCutRequested = false;
+  fCurrent.coreEnd = fCurrent.hits.size();
+  fCurrent.coreEndTS = cutTS;
+  if (!fCurrentSorted) {
+    // The pad is found by walking back from the end
+    SortSlice(fCurrent);
+    fCurrentSorted = true;
+  }
+
+  // Leading pad of the next slice: hits in [cutTS - window, cutTS)
+  HitSlice next;
+  next.coreStartTS = cutTS;
+  const auto padStartTS = cutTS - fContextWindow;
+  auto padBegin = fCurrent.hits.size();
+  while (padBegin > 0 && fCurrent.hits[padBegin - 1].ts >= padStartTS) {
+    padBegin--;
+  }
+  next.hits = fBufferPool.Acquire(fSliceSize +
+                                  2 * (fCurrent.hits.size() - padBegin));
+  next.hits.insert(next.hits.end(), fCurrent.hits.begin() + padBegin,
+                   fCurrent.hits.end());
+  next.coreBegin = next.hits.size();
+
+  fPending.push_back(PendingSlice_t{std::move(fCurrent), fCurrentSorted});
+  fCurrent = std::move(next);
+  fCurrentSorted = true;
+}
+
+void DELILA::TimeOrderedMerger::EndSegment()
+{
+  for (auto &pending : fPending) {
+    PushSlice(std::move(pending.slice), pending.isSorted);
+  }
+  fPending.clear();
+  if (fCurrent.hits.size() > fCurrent.coreBegin) {
+    fCurrent.coreEnd = fCurrent.hits.size();
+    fCurrent.coreEndTS = kMaxTimestamp;
+    PushSlice(std::move(fCurrent), fCurrentSorted);
+  }
+
+  // Nothing of the previous acquisition is carried over
+  fCurrent = HitSlice();
+  fCurrent.coreStartTS = kMinTimestamp;
+  fCurrentSorted = true;
+  fCutRequested = false;
+  fSegmentEmpty = true;
+  fSegmentMaxTS = 0;
+  fLastEmittedTS = kMinTimestamp;
+  fPushedEndTS = kMinTimestamp;
+}
+
+void DELILA::TimeOrderedMerger::PushSlice(HitSlice &&slice,
+                                          const bool isSorted)
+{
+  if (!isSorted) {
+    SortSlice(slice);
+  }
+  slice.sliceID = fNextSliceID++;
+  fOutput->Push(std::move(slice));
+}
+
+void DELILA::TimeOrderedMerger::SortSlice(HitSlice &slice)
+{
+  // Ownership is defined by time, so the core can be found again after
+  // sorting the late hits into place
+  auto byTime = [](const RawHit_t &a, const RawHit_t &b) {
+    return a.ts < b.ts;
+  };
+  std::stable_sort(slice.hits.begin(), slice.hits.end(), byTime);
+  auto lower = [&slice](const Timestamp_t ts) -> size_t {
+    return std::lower_bound(slice.hits.begin(), slice.hits.end(), ts,
+                            [](const RawHit_t &hit, const Timestamp_t value) {
+                              return hit.ts < value;
+                            }) -
+           slice.hits.begin();
+  };
+  slice.coreBegin = lower(slice.coreStartTS);
+  slice.coreEnd = lower(slice.coreEndTS);
+}
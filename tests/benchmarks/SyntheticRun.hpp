@@ -0,0 +1,345 @@
+#ifndef SyntheticRun_hpp
+#define SyntheticRun_hpp 1
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "DELILAExceptions.hpp"
+
+namespace DELILA
+{
+
+struct SyntheticRunConfig_t {
+  uint32_t nModules = 8;
+  uint32_t nChannels = 16;
+  // Detector type of module i is moduleTypes[i % size]
+  std::vector<std::string> moduleTypes = {"HPGe", "HPGe", "HPGe", "HPGe",
+                                          "PMT",  "PMT",  "Si",   "AC"};
+  // Singles rate per channel [Hz]
+  std::map<std::string, double> rates = {
+      {"HPGe", 2.e3}, {"PMT", 1.e4}, {"Si", 5.e3}, {"AC", 3.e3}};
+  // Fraction of the channels of triggerType flagged IsEventTrigger
+  std::string triggerType = "HPGe";
+  double triggerFraction = 0.5;
+  // Trigger hits with coincident hits, and their mean number (Poisson)
+  double correlatedFraction = 0.5;
+  double multiplicity = 3.;
+  double spread = 20.;  // [ns] sigma of the coincident hit times
+  // HPGe channels have the same channel of the first AC module as veto
+  double acFraction = 0.1;
+  double belowThresholdFraction = 0.05;  // Hits at or below ThresholdADC
+  uint32_t thresholdADC = 50;
+  double moduleOffset = 12.5;  // [ns] cable delay of module i is i * this
+  uint32_t runNumber = 1;
+  uint32_t nFiles = 4;
+  uint64_t hitsPerFile = 200000;
+  uint64_t seed = 20240101;
+};
+
+// Writes a run the way the DAQ does: run%04d_%04d_synthetic.root files with
+// an ELIADE_Tree (FineTS continues over the files), plus the chSettings,
+// timeSettings and L2 settings JSON files that match the detector layout.
+// The hit stream is a Poisson process per channel.  Trigger hits come with
+// coincident hits on the other detectors, HPGe hits sometimes with an AC
+// hit, so every stage of the pipeline has real work to do.  The same seed
+// gives the same files.
+class SyntheticRun
+{
+ public:
+  explicit SyntheticRun(const SyntheticRunConfig_t &config) : fConfig(config)
+  {
+    if (fConfig.nModules == 0 || fConfig.nChannels == 0 ||
+        fConfig.nModules > 256 || fConfig.nChannels > 256 ||
+        fConfig.moduleTypes.empty() || fConfig.nFiles == 0) {
+      throw DELILA::ValidationException("Invalid synthetic run layout");
+    }
+    MakeChannels();
+  };
+
+  static constexpr const char *kChSettingsFileName = "chSettings.json";
+  static constexpr const char *kTimeSettingsFileName = "timeSettings.json";
+  static constexpr const char *kL2SettingsFileName = "L2Settings.json";
+
+  // Writes the raw files and the settings into directory, returns the files
+  std::vector<std::string> Generate(const std::string &directory)
+  {
+    std::filesystem::create_directories(directory);
+    WriteChSettings(directory + "/" + kChSettingsFileName);
+    WriteTimeSettings(directory + "/" + kTimeSettingsFileName);
+    WriteL2Settings(directory + "/" + kL2SettingsFileName);
+
+    std::mt19937_64 rng(fConfig.seed);
+    std::vector<double> weights;
+    std::vector<double> followerWeights;
+    auto totalRate = 0.;
+    for (const auto &channel : fChannels) {
+      weights.push_back(channel.rate);
+      followerWeights.push_back(channel.isTrigger ? 0. : channel.rate);
+      totalRate += channel.rate;
+    }
+    if (!(totalRate > 0.)) {
+      throw DELILA::ValidationException("Synthetic run without any rate");
+    }
+    std::discrete_distribution<size_t> pickChannel(weights.begin(),
+                                                   weights.end());
+    std::discrete_distribution<size_t> pickFollower(followerWeights.begin(),
+                                                    followerWeights.end());
+    std::exponential_distribution<double> interval(totalRate * 1.e-12);  // ps
+    std::normal_distribution<double> jitter(0., fConfig.spread * 1.e3);
+    std::poisson_distribution<uint32_t> followers(fConfig.multiplicity);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+
+    std::vector<std::string> fileList;
+    fNHits = 0;
+    auto time = 1.e6;  // [ps]
+    for (uint32_t version = 0; version < fConfig.nFiles; version++) {
+      const auto fileName =
+          directory + "/" + GetFileName(fConfig.runNumber, version);
+      TFile file(fileName.c_str(), "RECREATE");
+      if (file.IsZombie()) {
+        throw DELILA::FileException("Could not create file: " + fileName);
+      }
+      TTree tree("ELIADE_Tree", "Synthetic raw data");
+      tree.Branch("Mod", &fMod, "Mod/b");
+      tree.Branch("Ch", &fCh, "Ch/b");
+      tree.Branch("FineTS", &fFineTS, "FineTS/D");
+      tree.Branch("ChargeLong", &fChargeLong, "ChargeLong/s");
+      tree.Branch("ChargeShort", &fChargeShort, "ChargeShort/s");
+
+      uint64_t nHits = 0;
+      while (nHits < fConfig.hitsPerFile) {
+        time += interval(rng);
+        const auto &channel = fChannels[pickChannel(rng)];
+        Fill(tree, channel, time, rng, nHits);
+        if (channel.isTrigger && fFollowers &&
+            uniform(rng) < fConfig.correlatedFraction) {
+          for (auto n = followers(rng); n > 0; n--) {
+            Fill(tree, fChannels[pickFollower(rng)],
+                 time + std::abs(jitter(rng)), rng, nHits);
+          }
+        }
+        if (channel.acIndex >= 0 && uniform(rng) < fConfig.acFraction) {
+          Fill(tree, fChannels[channel.acIndex], time + 5.e3, rng, nHits);
+        }
+      }
+      tree.Write();
+      file.Close();
+      fNHits += nHits;
+      fileList.push_back(fileName);
+    }
+    return fileList;
+  };
+
+  static std::string GetFileName(const uint32_t run, const uint32_t version)
+  {
+    char name[64];
+    snprintf(name, sizeof(name), "run%04u_%04u_synthetic.root", run, version);
+    return name;
+  };
+
+  // Hits written by the last Generate()
+  uint64_t GetNumberOfHits() const { return fNHits; };
+  uint32_t GetNumberOfTriggerChannels() const
+  {
+    uint32_t n = 0;
+    for (const auto &channel : fChannels) {
+      n += channel.isTrigger;
+    }
+    return n;
+  };
+
+ private:
+  struct Channel {
+    uint8_t mod = 0;
+    uint8_t ch = 0;
+    std::string type;
+    double rate = 0.;
+    bool isTrigger = false;
+    int32_t acIndex = -1;  // Veto channel in fChannels
+  };
+
+  SyntheticRunConfig_t fConfig;
+  std::vector<Channel> fChannels;
+  bool fFollowers = false;
+  uint64_t fNHits = 0;
+
+  // Branch buffers
+  UChar_t fMod = 0;
+  UChar_t fCh = 0;
+  Double_t fFineTS = 0.;
+  UShort_t fChargeLong = 0;
+  UShort_t fChargeShort = 0;
+
+  const std::string &GetType(const uint32_t mod) const
+  {
+    return fConfig.moduleTypes[mod % fConfig.moduleTypes.size()];
+  };
+
+  void MakeChannels()
+  {
+    int32_t firstAC = -1;
+    for (uint32_t mod = 0; mod < fConfig.nModules; mod++) {
+      if (firstAC < 0 && GetType(mod) == "AC") {
+        firstAC = mod;
+      }
+    }
+
+    // Trigger channels spread evenly over the channels of triggerType
+    uint32_t nOfType = 0;
+    for (uint32_t mod = 0; mod < fConfig.nModules; mod++) {
+      const auto &type = GetType(mod);
+      const auto rate = fConfig.rates.count(type) ? fConfig.rates.at(type) : 0.;
+      for (uint32_t ch = 0; ch < fConfig.nChannels; ch++) {
+        Channel channel;
+        channel.mod = mod;
+        channel.ch = ch;
+        channel.type = type;
+        channel.rate = rate;
+        if (type == fConfig.triggerType) {
+          channel.isTrigger =
+              std::floor((nOfType + 1) * fConfig.triggerFraction) >
+              std::floor(nOfType * fConfig.triggerFraction);
+          nOfType++;
+        }
+        if (type == "HPGe" && firstAC >= 0) {
+          channel.acIndex = firstAC * fConfig.nChannels + ch;
+        }
+        fFollowers = fFollowers || (!channel.isTrigger && rate > 0.);
+        fChannels.push_back(channel);
+      }
+    }
+  };
+
+  template <typename RNG>
+  void Fill(TTree &tree, const Channel &channel, const double time, RNG &rng,
+            uint64_t &nHits)
+  {
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    fMod = channel.mod;
+    fCh = channel.ch;
+    fFineTS = time + channel.mod * fConfig.moduleOffset * 1.e3;
+    fChargeLong =
+        uniform(rng) < fConfig.belowThresholdFraction
+            ? UShort_t(uniform(rng) * fConfig.thresholdADC)
+            : UShort_t(fConfig.thresholdADC + 1 + uniform(rng) * 16000.);
+    fChargeShort = fChargeLong * 4 / 5;
+    tree.Fill();
+    nHits++;
+  };
+
+  void WriteChSettings(const std::string &fileName) const
+  {
+    nlohmann::json result;
+    for (uint32_t mod = 0; mod < fConfig.nModules; mod++) {
+      nlohmann::json module = nlohmann::json::array();
+      for (uint32_t ch = 0; ch < fConfig.nChannels; ch++) {
+        const auto &channel = fChannels[mod * fConfig.nChannels + ch];
+        const auto hasAC = channel.acIndex >= 0;
+        nlohmann::json j;
+        j["IsEventTrigger"] = channel.isTrigger;
+        j["ID"] = mod * fConfig.nChannels + ch;
+        j["Module"] = mod;
+        j["Channel"] = ch;
+        j["HasAC"] = hasAC;
+        j["ACModule"] = hasAC ? fChannels[channel.acIndex].mod : 128;
+        j["ACChannel"] = hasAC ? fChannels[channel.acIndex].ch : 128;
+        j["Phi"] = 0.;
+        j["Theta"] = 0.;
+        j["Distance"] = 0.;
+        j["ThresholdADC"] = fConfig.thresholdADC;
+        j["x"] = 0.;
+        j["y"] = 0.;
+        j["z"] = 0.;
+        j["p0"] = 0.;
+        j["p1"] = 1.;
+        j["p2"] = 0.;
+        j["p3"] = 0.;
+        j["DetectorType"] = channel.type;
+        j["Tags"] = nlohmann::json::array({channel.type});
+        module.push_back(j);
+      }
+      result.push_back(module);
+    }
+    Write(fileName, result);
+  };
+
+  // Offsets relative to every reference channel, [refMod][refCh][mod][ch]
+  void WriteTimeSettings(const std::string &fileName) const
+  {
+    nlohmann::json result;
+    for (uint32_t refMod = 0; refMod < fConfig.nModules; refMod++) {
+      nlohmann::json ref;
+      for (uint32_t mod = 0; mod < fConfig.nModules; mod++) {
+        nlohmann::json module;
+        const auto offset = (double(mod) - refMod) * fConfig.moduleOffset;
+        for (uint32_t ch = 0; ch < fConfig.nChannels; ch++) {
+          module.push_back({{"TimeOffset", offset}});
+        }
+        ref.push_back(module);
+      }
+      nlohmann::json refModule;
+      for (uint32_t refCh = 0; refCh < fConfig.nChannels; refCh++) {
+        refModule.push_back(ref);
+      }
+      result.push_back(refModule);
+    }
+    Write(fileName, result);
+  };
+
+  // One counter and flag per detector type, events with any detector
+  // besides the trigger type are accepted
+  void WriteL2Settings(const std::string &fileName) const
+  {
+    nlohmann::json result = nlohmann::json::array();
+    std::vector<std::string> monitors;
+    std::vector<std::string> types;
+    for (const auto &channel : fChannels) {
+      if (std::find(types.begin(), types.end(), channel.type) == types.end()) {
+        types.push_back(channel.type);
+      }
+    }
+    for (const auto &type : types) {
+      result.push_back({{"Name", type + "_Counter"},
+                        {"Type", "Counter"},
+                        {"Tags", nlohmann::json::array({type})}});
+      result.push_back({{"Name", type + "_Flag"},
+                        {"Type", "Flag"},
+                        {"Monitor", type + "_Counter"},
+                        {"Operator", ">"},
+                        {"Value", 0}});
+      if (type != fConfig.triggerType) {
+        monitors.push_back(type + "_Flag");
+      }
+    }
+    result.push_back({{"Name", "Accept"},
+                      {"Type", "Accept"},
+                      {"Monitor", monitors},
+                      {"Operator", "OR"}});
+    Write(fileName, result);
+  };
+
+  static void Write(const std::string &fileName, const nlohmann::json &j)
+  {
+    std::ofstream ofs(fileName);
+    if (!ofs) {
+      throw DELILA::FileException("Could not write file: " + fileName);
+    }
+    ofs << j.dump(4) << std::endl;
+  };
+};
+
+}  // namespace DELILA
+
+#endif
@@ -1,8 +1,11 @@
 #include <gtest/gtest.h>
 
+#include "ACTagger.hpp"
 #include "EventData.hpp"
+#include "HitFilter.hpp"
 #include "L1EventBuilder.hpp"
 #include "L2EventBuilder.hpp"
+#include "L2Selector.hpp"
 #include "TimeAlignment.hpp"
 
 #include <algorithm>
@@ -552,3 +555,332 @@ TEST_F(ThroughputBenchmark, DataCopyOverhead_Large) {
   std::cout << "  → Data copied: " << std::fixed << std::setprecision(2) << dataMB
             << " MB | Bandwidth: " << bandwidth << " MB/s" << std::endl;
 }
+
+//=============================================================================
+// AC Tagging Benchmarks
+//=============================================================================
+
+class ACTaggingBenchmark : public ::testing::Test {
+ protected:
+  static constexpr double_t window = 500.;
+  std::vector<std::vector<ChSettings_t>> settings;
+  ChannelTable table;
+
+  void SetUp() override
+  {
+    std::cout << "\n=== AC Tagging Benchmarks ===" << std::endl;
+    // 16 modules x 16 channels, every even channel has the next one as AC
+    settings.resize(16);
+    for (uint32_t mod = 0; mod < 16; mod++) {
+      settings[mod].resize(16);
+      for (uint32_t ch = 0; ch < 16; ch++) {
+        settings[mod][ch].hasAC = (ch % 2 == 0);
+        settings[mod][ch].ACMod = mod;
+        settings[mod][ch].ACCh = ch + 1;
+      }
+    }
+    table.Build(settings);
+  }
+
+  std::vector<std::vector<RawData_t>> MakeEvents(int nEvents, int hitsPerEvent)
+  {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> chDist(0, 255);
+    std::uniform_real_distribution<double> tsDist(-window, window);
+    std::vector<std::vector<RawData_t>> events(nEvents);
+    for (auto &event : events) {
+      for (int i = 0; i < hitsPerEvent; i++) {
+        auto c = chDist(rng);
+        event.emplace_back(false, c / 16, c % 16, 100, 50, tsDist(rng));
+      }
+    }
+    return events;
+  }
+
+  // The former nested loop of L1EventBuilder
+  void NestedLoopTag(std::vector<RawData_t> &hits)
+  {
+    for (auto &hit : hits) {
+      const auto &s = settings[hit.mod][hit.ch];
+      if (s.hasAC) {
+        for (auto &ac : hits) {
+          if (ac.mod == s.ACMod && ac.ch == s.ACCh &&
+              fabs(ac.fineTS) < window) {
+            hit.isWithAC = true;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  void Compare(int hitsPerEvent, int nEvents)
+  {
+    auto nested = MakeEvents(nEvents, hitsPerEvent);
+    auto bitmap = nested;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto &event : nested) {
+      NestedLoopTag(event);
+    }
+    auto mid = std::chrono::high_resolution_clock::now();
+    ACTagger tagger(table, window);
+    for (auto &event : bitmap) {
+      tagger.Tag(event);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    auto nestedMs = std::chrono::duration<double, std::milli>(mid - start).count();
+    auto bitmapMs = std::chrono::duration<double, std::milli>(end - mid).count();
+    const auto label = std::to_string(hitsPerEvent) + " hits/evt";
+    PrintBenchmark("Nested loop AC tagging (" + label + ")", nestedMs, nEvents,
+                   "evt");
+    PrintBenchmark("Bitmap AC tagging (" + label + ")", bitmapMs, nEvents,
+                   "evt");
+    std::cout << "  → Speedup: " << std::fixed << std::setprecision(1)
+              << nestedMs / std::max(bitmapMs, 1e-6) << "x" << std::endl;
+
+    for (int i = 0; i < nEvents; i++) {
+      for (int j = 0; j < hitsPerEvent; j++) {
+        ASSERT_EQ(nested[i][j].isWithAC, bitmap[i][j].isWithAC);
+      }
+    }
+  }
+};
+
+TEST_F(ACTaggingBenchmark, HitsPerEvent_10) { Compare(10, 100000); }
+
+TEST_F(ACTaggingBenchmark, HitsPerEvent_100) { Compare(100, 10000); }
+
+TEST_F(ACTaggingBenchmark, HitsPerEvent_1000) { Compare(1000, 1000); }
+
+//=============================================================================
+// L2 Selection Benchmarks
+//=============================================================================
+
+class L2SelectionBenchmark : public ::testing::Test {
+ protected:
+  static constexpr int nCounters = 24;
+  ChannelTable table;
+  std::vector<L2Counter> counters;
+  std::vector<L2Flag> flags;
+  std::vector<L2DataAcceptance> accepts;
+
+  void SetUp() override
+  {
+    std::cout << "\n=== L2 Selection Benchmarks ===" << std::endl;
+    // 16 modules x 16 channels, every counter watches one module, every
+    // flag asks for one hit in it and the events need two of them
+    std::vector<std::vector<ChSettings_t>> settings(16);
+    for (uint32_t mod = 0; mod < 16; mod++) {
+      settings[mod].resize(16);
+      for (uint32_t ch = 0; ch < 16; ch++) {
+        settings[mod][ch].mod = mod;
+        settings[mod][ch].ch = ch;
+      }
+    }
+    table.Build(settings);
+
+    for (int i = 0; i < nCounters; i++) {
+      std::vector<std::vector<bool>> conditionTable(
+          16, std::vector<bool>(16, false));
+      for (uint32_t ch = 0; ch < 16; ch++) {
+        conditionTable[i % 16][ch] = (ch % 2 == uint32_t(i / 16));
+      }
+      const auto name = "Counter_" + std::to_string(i);
+      L2Counter counter(name);
+      counter.SetConditionTable(conditionTable);
+      counters.push_back(counter);
+      flags.emplace_back("Flag_" + std::to_string(i), name, ">=", 1);
+    }
+    for (int i = 0; i + 1 < nCounters; i += 2) {
+      accepts.emplace_back(
+          std::vector<std::string>{flags[i].name, flags[i + 1].name}, "AND");
+    }
+  }
+
+  std::vector<std::vector<RawData_t>> MakeEvents(int nEvents, int hitsPerEvent)
+  {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> chDist(0, 255);
+    std::vector<std::vector<RawData_t>> events(nEvents);
+    for (auto &event : events) {
+      for (int i = 0; i < hitsPerEvent; i++) {
+        auto c = chDist(rng);
+        event.emplace_back(false, c / 16, c % 16, 100, 50, 0.);
+      }
+    }
+    return events;
+  }
+
+  // The former per event evaluation of L2EventBuilder::ProcessData
+  bool ConditionClasses(const std::vector<RawData_t> &hits)
+  {
+    for (auto &counter : counters) {
+      counter.ResetCounter();
+      for (auto &rawData : hits) {
+        if (!table.IsValid(rawData.mod, rawData.ch)) {
+          continue;
+        }
+        counter.Check(rawData.mod, rawData.ch);
+      }
+    }
+    for (auto &flag : flags) {
+      flag.Check(counters);
+    }
+    auto fillFlag = false;
+    for (auto &accept : accepts) {
+      fillFlag |= accept.Check(flags);
+    }
+    return fillFlag;
+  }
+
+  void Compare(int hitsPerEvent, int nEvents)
+  {
+    auto events = MakeEvents(nEvents, hitsPerEvent);
+    L2Selector selector(table, counters, flags, accepts);
+
+    uint64_t nClasses = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const auto &event : events) {
+      nClasses += ConditionClasses(event);
+    }
+    auto mid = std::chrono::high_resolution_clock::now();
+    uint64_t nCompiled = 0;
+    for (const auto &event : events) {
+      nCompiled += selector.Accept(event);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    auto classesMs = std::chrono::duration<double, std::milli>(mid - start).count();
+    auto compiledMs = std::chrono::duration<double, std::milli>(end - mid).count();
+    const auto label = std::to_string(hitsPerEvent) + " hits/evt";
+    PrintBenchmark("L2 condition classes (" + label + ")", classesMs, nEvents,
+                   "evt");
+    PrintBenchmark("Compiled L2 selector (" + label + ")", compiledMs, nEvents,
+                   "evt");
+    std::cout << "  → Speedup: " << std::fixed << std::setprecision(1)
+              << classesMs / std::max(compiledMs, 1e-6) << "x" << std::endl;
+
+    EXPECT_EQ(nClasses, nCompiled);
+  }
+};
+
+TEST_F(L2SelectionBenchmark, HitsPerEvent_4) { Compare(4, 100000); }
+
+TEST_F(L2SelectionBenchmark, HitsPerEvent_32) { Compare(32, 20000); }
+
+//=============================================================================
+// Raw Hit Ingestion Benchmarks
+//=============================================================================
+
+class IngestionBenchmark : public ::testing::Test {
+ protected:
+  ChannelTable table;
+
+  void SetUp() override
+  {
+    std::cout << "\n=== Raw Hit Ingestion Benchmarks ===" << std::endl;
+    // 16 modules x 16 channels with offsets, module 15 is not aligned
+    std::vector<std::vector<ChSettings_t>> settings(16);
+    std::vector<std::vector<double_t>> offsets(15);
+    for (uint32_t mod = 0; mod < 16; mod++) {
+      settings[mod].resize(16);
+      for (uint32_t ch = 0; ch < 16; ch++) {
+        settings[mod][ch].mod = mod;
+        settings[mod][ch].ch = ch;
+        settings[mod][ch].thresholdADC = 100;
+        if (mod < 15) offsets[mod].push_back(0.1 * ch);
+      }
+    }
+    table.Build(settings);
+    table.SetTimeOffsets(offsets);
+  }
+
+  // About 70 % of the hits pass
+  RawColumns MakeBlock(size_t n)
+  {
+    std::mt19937 rng(42);
+    RawColumns block;
+    block.nEntries = n;
+    for (size_t i = 0; i < n; i++) {
+      block.mod.push_back(rng() % 17);
+      block.ch.push_back(rng() % 16);
+      block.chargeLong.push_back(rng() % 400);
+      block.chargeShort.push_back(50);
+      block.fineTS.push_back(1000. * i);
+    }
+    return block;
+  }
+
+  // The former per hit loop of L1EventBuilder::DataReader
+  size_t Branchy(const RawColumns &block, std::vector<RawHit_t> &hits)
+  {
+    hits.clear();
+    for (size_t i = 0; i < block.size(); i++) {
+      const auto mod = block.mod[i];
+      const auto ch = block.ch[i];
+      if (!table.IsValid(mod, ch)) {
+        continue;
+      }
+      const auto &info = table.Get(mod, ch);
+      const auto chargeLong = block.chargeLong[i];
+      if (chargeLong > info.thresholdADC) {
+        const auto ts = ToTimestamp(block.fineTS[i]) - info.timeOffset;
+        hits.emplace_back(false, mod, ch, chargeLong, block.chargeShort[i], ts);
+      }
+    }
+    return hits.size();
+  }
+
+  size_t Filtered(const HitFilter &filter, const RawColumns &block,
+                  FilteredHits &selected, std::vector<RawHit_t> &hits)
+  {
+    hits.clear();
+    filter.Filter(block, selected);
+    for (size_t k = 0; k < selected.size(); k++) {
+      const auto i = selected.entry[k];
+      hits.emplace_back(false, block.mod[i], block.ch[i], block.chargeLong[i],
+                        block.chargeShort[i], selected.time[k]);
+    }
+    return hits.size();
+  }
+};
+
+TEST_F(IngestionBenchmark, PrefilterKernels_1M) {
+  constexpr int nHits = 1 << 20;
+  constexpr int nRepeat = 20;
+  auto block = MakeBlock(nHits);
+  std::vector<RawHit_t> hits;
+  hits.reserve(nHits);
+  FilteredHits selected;
+  HitFilter scalar(table);
+  scalar.SetKernel(HitFilter::Kernel::Scalar);
+  HitFilter best(table);
+
+  // One thread, so the rates are per core
+  const auto measure = [&](const auto &fn) {
+    size_t n = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < nRepeat; r++) n = fn();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::make_pair(
+        n, std::chrono::duration<double, std::milli>(end - start).count());
+  };
+  auto [nBranchy, branchyMs] = measure([&] { return Branchy(block, hits); });
+  auto [nScalar, scalarMs] =
+      measure([&] { return Filtered(scalar, block, selected, hits); });
+  auto [nBest, bestMs] =
+      measure([&] { return Filtered(best, block, selected, hits); });
+
+  PrintBenchmark("Per hit branches (1M hits)", branchyMs, nHits * nRepeat,
+                 "hit");
+  PrintBenchmark("Scalar kernel (1M hits)", scalarMs, nHits * nRepeat, "hit");
+  PrintBenchmark(HitFilter::GetKernelName(best.GetKernel()) + " kernel (1M hits)",
+                 bestMs, nHits * nRepeat, "hit");
+  std::cout << "  → Speedup: " << std::fixed << std::setprecision(1)
+            << branchyMs / std::max(bestMs, 1e-6) << "x" << std::endl;
+
+  EXPECT_EQ(nBranchy, nScalar);
+  EXPECT_EQ(nBranchy, nBest);
+}
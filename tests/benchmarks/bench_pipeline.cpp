@@ -0,0 +1,400 @@
+#include <gtest/gtest.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "L1EventBuilder.hpp"
+#include "L2EventBuilder.hpp"
+#include "RunCatalog.hpp"
+#include "SyntheticRun.hpp"
+#include "TimeAlignment.hpp"
+
+using namespace DELILA;
+
+//=============================================================================
+// End-to-end pipeline benchmarks on a synthetic run
+//
+// Environment (all optional):
+//   ELIFANT_BENCH_HITS       hits per file (100000)
+//   ELIFANT_BENCH_FILES      number of files (4)
+//   ELIFANT_BENCH_THREADS    largest thread count (hardware, at most 8)
+//   ELIFANT_BENCH_REPEATS    timed runs per thread count, median kept (3)
+//   ELIFANT_BENCH_OUTPUT     result file (benchPipeline.json)
+//   ELIFANT_BENCH_BASELINE   result file of an earlier run to compare with
+//   ELIFANT_BENCH_TOLERANCE  allowed throughput loss against it (0.2)
+//=============================================================================
+
+namespace
+{
+
+struct BenchSettings_t {
+  uint64_t hitsPerFile = 100000;
+  uint32_t nFiles = 4;
+  uint32_t maxThreads = 8;
+  uint32_t repeats = 3;
+  std::string output = "benchPipeline.json";
+  std::string baseline = "";
+  double tolerance = 0.2;
+};
+
+template <typename T>
+T GetEnv(const char *name, const T defaultValue)
+{
+  const char *value = std::getenv(name);
+  if (value == nullptr || *value == '\0') {
+    return defaultValue;
+  }
+  std::istringstream stream(value);
+  T result;
+  return (stream >> result) ? result : defaultValue;
+}
+
+// Paths may have spaces
+template <>
+std::string GetEnv(const char *name, const std::string defaultValue)
+{
+  const char *value = std::getenv(name);
+  return (value == nullptr || *value == '\0') ? defaultValue : value;
+}
+
+BenchSettings_t GetBenchSettings()
+{
+  BenchSettings_t settings;
+  const auto hardware = std::max(1u, std::thread::hardware_concurrency());
+  settings.maxThreads = std::min(hardware, settings.maxThreads);
+  settings.hitsPerFile = GetEnv("ELIFANT_BENCH_HITS", settings.hitsPerFile);
+  settings.nFiles = GetEnv("ELIFANT_BENCH_FILES", settings.nFiles);
+  settings.maxThreads =
+      std::max(1u, GetEnv("ELIFANT_BENCH_THREADS", settings.maxThreads));
+  settings.repeats =
+      std::max(1u, GetEnv("ELIFANT_BENCH_REPEATS", settings.repeats));
+  settings.output = GetEnv("ELIFANT_BENCH_OUTPUT", settings.output);
+  settings.baseline = GetEnv("ELIFANT_BENCH_BASELINE", settings.baseline);
+  settings.tolerance = GetEnv("ELIFANT_BENCH_TOLERANCE", settings.tolerance);
+  return settings;
+}
+
+// 1, 2, 4, ... and the largest count
+std::vector<uint32_t> GetThreadCounts(const uint32_t maxThreads)
+{
+  std::vector<uint32_t> counts;
+  for (uint32_t n = 1; n < maxThreads; n *= 2) {
+    counts.push_back(n);
+  }
+  counts.push_back(maxThreads);
+  return counts;
+}
+
+// Linux resets the peak RSS (VmHWM) on writing 5 to clear_refs.  Elsewhere
+// the peak stays the one of the whole process.
+void ResetPeakRSS()
+{
+  std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+// [MB]
+double GetPeakRSS()
+{
+  std::ifstream status("/proc/self/status");
+  for (std::string line; std::getline(status, line);) {
+    if (line.rfind("VmHWM:", 0) == 0) {
+      return std::stod(line.substr(6)) / 1024.;
+    }
+  }
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.;
+}
+
+void RemoveFiles(const std::string &key)
+{
+  for (const auto &file : RunCatalog::FindNumberedFiles(".", key)) {
+    std::filesystem::remove(file);
+  }
+}
+
+// One run of a stage: input entries (hits, or L1 events for L2) and events
+struct RunCounts_t {
+  uint64_t entries = 0;
+  uint64_t events = 0;
+};
+
+struct Sample_t {
+  uint32_t threads = 0;
+  double wallTime = 0.;  // [s], median of the repeats
+  double spread = 0.;    // (max - min) / median of the repeats
+  uint64_t entries = 0;
+  uint64_t events = 0;
+  double peakRSS = 0.;  // [MB]
+
+  double EntriesPerSecond() const { return entries / wallTime; };
+  double EventsPerSecond() const { return events / wallTime; };
+};
+
+}  // namespace
+
+class PipelineBenchmark : public ::testing::Test
+{
+ protected:
+  static inline BenchSettings_t settings;
+  static inline std::filesystem::path workDirectory;
+  static inline std::filesystem::path startDirectory;
+  static inline std::vector<std::string> fileList;
+  static inline uint64_t nHits = 0;
+
+  // The builders read and write in the working directory
+  static void SetUpTestSuite()
+  {
+    settings = GetBenchSettings();
+    startDirectory = std::filesystem::current_path();
+    workDirectory = std::filesystem::temp_directory_path() /
+                    ("elifant_bench_" + std::to_string(getpid()));
+
+    SyntheticRunConfig_t config;
+    config.nFiles = settings.nFiles;
+    config.hitsPerFile = settings.hitsPerFile;
+    SyntheticRun run(config);
+    fileList = run.Generate(workDirectory.string());
+    nHits = run.GetNumberOfHits();
+    std::filesystem::current_path(workDirectory);
+
+    std::cout << "\n=== Pipeline Benchmarks: " << nHits << " hits in "
+              << fileList.size() << " files, " << settings.repeats
+              << " repeats ===" << std::endl;
+  }
+
+  static void TearDownTestSuite()
+  {
+    std::filesystem::current_path(startDirectory);
+    std::error_code error;
+    std::filesystem::remove_all(workDirectory, error);
+  }
+
+  static std::filesystem::path GetOutputPath(const std::string &name)
+  {
+    const std::filesystem::path path(name);
+    return path.is_absolute() ? path : startDirectory / path;
+  }
+
+  // run(nThreads) sets up untimed and returns the counts of the timed part
+  // in wallTime.  A warm-up run at the largest thread count comes first.
+  static std::vector<Sample_t> Measure(
+      const std::function<RunCounts_t(uint32_t, double &)> &run)
+  {
+    std::vector<Sample_t> samples;
+    double wallTime = 0.;
+    run(settings.maxThreads, wallTime);
+    for (const auto nThreads : GetThreadCounts(settings.maxThreads)) {
+      Sample_t sample;
+      sample.threads = nThreads;
+      std::vector<double> times;
+      ResetPeakRSS();
+      for (uint32_t i = 0; i < settings.repeats; i++) {
+        const auto counts = run(nThreads, wallTime);
+        times.push_back(wallTime);
+        sample.entries = counts.entries;
+        sample.events = counts.events;
+      }
+      sample.peakRSS = GetPeakRSS();
+      std::sort(times.begin(), times.end());
+      sample.wallTime = times[times.size() / 2];
+      sample.spread = (times.back() - times.front()) / sample.wallTime;
+      samples.push_back(sample);
+    }
+    return samples;
+  }
+
+  // Prints the scaling curve, adds it to the result file and compares it
+  // with the baseline
+  static void Report(const std::string &stage,
+                     const std::vector<Sample_t> &samples)
+  {
+    std::cout << "\n--- " << stage << " ---" << std::endl;
+    std::cout << std::setw(8) << "Threads" << std::setw(12) << "Wall [s]"
+              << std::setw(10) << "Spread" << std::setw(16) << "Entries/s"
+              << std::setw(16) << "Events/s" << std::setw(10) << "Speedup"
+              << std::setw(12) << "RSS [MB]" << std::endl;
+    nlohmann::json curve = nlohmann::json::array();
+    for (const auto &sample : samples) {
+      const auto speedup = samples.front().wallTime / sample.wallTime;
+      std::cout << std::setw(8) << sample.threads << std::setw(12)
+                << std::fixed << std::setprecision(3) << sample.wallTime
+                << std::setw(10) << std::setprecision(2) << sample.spread
+                << std::setw(16) << std::setprecision(0)
+                << sample.EntriesPerSecond() << std::setw(16)
+                << sample.EventsPerSecond() << std::setw(10)
+                << std::setprecision(2) << speedup << std::setw(12)
+                << std::setprecision(1) << sample.peakRSS << std::endl;
+      curve.push_back({{"threads", sample.threads},
+                       {"wallTime", sample.wallTime},
+                       {"spread", sample.spread},
+                       {"entries", sample.entries},
+                       {"events", sample.events},
+                       {"entriesPerSecond", sample.EntriesPerSecond()},
+                       {"eventsPerSecond", sample.EventsPerSecond()},
+                       {"speedup", speedup},
+                       {"peakRSS", sample.peakRSS}});
+    }
+    std::cout.unsetf(std::ios::floatfield);
+
+    // Each test may run in its own process, so the file is updated in place
+    const auto outputPath = GetOutputPath(settings.output);
+    nlohmann::json result = nlohmann::json::object();
+    if (std::ifstream input(outputPath); input) {
+      result = nlohmann::json::parse(input, nullptr, false);
+      if (result.is_discarded() || !result.is_object()) {
+        result = nlohmann::json::object();
+      }
+    }
+    result["run"] = {{"hits", nHits},
+                     {"files", fileList.size()},
+                     {"repeats", settings.repeats}};
+    result["stages"][stage] = curve;
+    std::ofstream(outputPath) << result.dump(2) << std::endl;
+
+    if (!settings.baseline.empty()) {
+      CompareWithBaseline(stage, samples);
+    }
+  }
+
+  // Fails if a thread count lost more than the tolerance in throughput
+  static void CompareWithBaseline(const std::string &stage,
+                                  const std::vector<Sample_t> &samples)
+  {
+    std::ifstream input(GetOutputPath(settings.baseline));
+    ASSERT_TRUE(input) << "Could not open baseline: " << settings.baseline;
+    const auto baseline = nlohmann::json::parse(input, nullptr, false);
+    ASSERT_FALSE(baseline.is_discarded()) << "Invalid baseline JSON";
+    if (!baseline.contains("stages") || !baseline["stages"].contains(stage)) {
+      std::cout << "No " << stage << " results in the baseline" << std::endl;
+      return;
+    }
+    for (const auto &reference : baseline["stages"][stage]) {
+      const auto threads = reference["threads"].get<uint32_t>();
+      auto sample = std::find_if(
+          samples.begin(), samples.end(),
+          [threads](const Sample_t &s) { return s.threads == threads; });
+      if (sample == samples.end()) {
+        continue;
+      }
+      const auto expected = reference["entriesPerSecond"].get<double>();
+      EXPECT_GE(sample->EntriesPerSecond(),
+                expected * (1. - settings.tolerance))
+          << stage << " with " << threads << " threads is slower than the "
+          << "baseline";
+    }
+  }
+
+  static double Elapsed(const std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  }
+
+  static RunCounts_t RunL1(const uint32_t nThreads, double &wallTime)
+  {
+    RemoveFiles("L1");
+    L1EventBuilder builder;
+    builder.LoadChSettings(SyntheticRun::kChSettingsFileName);
+    builder.LoadFileList(fileList);
+    builder.LoadTimeSettings(SyntheticRun::kTimeSettingsFileName);
+    builder.SetRefMod(0);
+    builder.SetRefCh(0);
+    builder.SetTimeWindow(1000.);
+    builder.SetCoincidenceWindow(1000.);
+
+    const auto start = std::chrono::steady_clock::now();
+    builder.BuildEvent(nThreads);
+    wallTime = Elapsed(start);
+
+    RunCounts_t counts;
+    auto &metrics = builder.GetMetrics();
+    counts.entries = metrics.GetTotal("read")["entries"].get<uint64_t>();
+    counts.events = metrics.GetTotal("build")["events"].get<uint64_t>();
+    return counts;
+  }
+};
+
+TEST_F(PipelineBenchmark, TimeAlignmentFillHistograms) {
+  const auto samples = Measure([](const uint32_t nThreads, double &wallTime) {
+    TimeAlignment alignment;
+    alignment.LoadChSettings(SyntheticRun::kChSettingsFileName);
+    alignment.LoadFileList(fileList);
+    alignment.SetTimeWindow(1000.);
+    alignment.InitHistograms();
+
+    const auto start = std::chrono::steady_clock::now();
+    alignment.FillHistograms(nThreads);
+    wallTime = Elapsed(start);
+
+    RunCounts_t counts;
+    const auto total = alignment.GetMetrics().GetTotal("fill");
+    counts.entries = total["entries"].get<uint64_t>();
+    counts.events = total["hits"].get<uint64_t>();
+    return counts;
+  });
+  Report("TimeAlignment", samples);
+
+  for (const auto &sample : samples) {
+    EXPECT_EQ(sample.entries, nHits);
+  }
+}
+
+TEST_F(PipelineBenchmark, L1BuildEvent) {
+  const auto samples = Measure(RunL1);
+  Report("L1", samples);
+
+  for (const auto &sample : samples) {
+    EXPECT_EQ(sample.entries, nHits);
+    EXPECT_GT(sample.events, 0);
+    // The events do not depend on the number of threads
+    EXPECT_EQ(sample.events, samples.front().events);
+  }
+}
+
+TEST_F(PipelineBenchmark, L2BuildEvent) {
+  // L2 input from one L1 run, the L1 events are the L2 entries
+  double l1Time = 0.;
+  RunL1(settings.maxThreads, l1Time);
+
+  const auto samples = Measure([](const uint32_t nThreads, double &wallTime) {
+    RemoveFiles("L2");
+    L2EventBuilder builder;
+    builder.LoadChSettings(SyntheticRun::kChSettingsFileName);
+    builder.SetCoincidenceWindow(1000.);
+    builder.SetMergeOutput(false);
+    builder.LoadL2Settings(SyntheticRun::kL2SettingsFileName);
+
+    const auto start = std::chrono::steady_clock::now();
+    builder.BuildEvent(nThreads);
+    wallTime = Elapsed(start);
+
+    RunCounts_t counts;
+    const auto total = builder.GetMetrics().GetTotal("l2");
+    counts.entries = total["entries"].get<uint64_t>();
+    counts.events = total["accepted"].get<uint64_t>();
+    return counts;
+  });
+  Report("L2", samples);
+
+  for (const auto &sample : samples) {
+    EXPECT_GT(sample.entries, 0);
+    EXPECT_EQ(sample.entries, samples.front().entries);
+    EXPECT_GT(sample.events, 0);
+    EXPECT_LE(sample.events, sample.entries);
+  }
+}
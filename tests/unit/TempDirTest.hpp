@@ -0,0 +1,47 @@
+#ifndef TempDirTest_hpp
+#define TempDirTest_hpp 1
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <string>
+
+// Base fixture of the tests that write files: an empty directory of this
+// process and test suite, removed after every test.  Fixtures that change
+// to it call EnterDir(), the working directory is restored at TearDown.
+// Derived SetUp / TearDown call the ones of this class.
+class TempDirTest : public ::testing::Test {
+ protected:
+  std::filesystem::path dir;
+
+  void SetUp() override
+  {
+    const auto *info = ::testing::UnitTest::GetInstance()->current_test_info();
+    dir = std::filesystem::temp_directory_path() /
+          (std::string(info->test_suite_name()) + "_" +
+           std::to_string(::getpid()));
+    std::filesystem::create_directories(dir);
+  }
+  void TearDown() override
+  {
+    if (!oldPath.empty()) {
+      std::filesystem::current_path(oldPath);
+      oldPath.clear();
+    }
+    std::filesystem::remove_all(dir);
+  }
+
+  void EnterDir()
+  {
+    if (oldPath.empty()) {
+      oldPath = std::filesystem::current_path();
+    }
+    std::filesystem::current_path(dir);
+  }
+
+ private:
+  std::filesystem::path oldPath;
+};
+
+#endif
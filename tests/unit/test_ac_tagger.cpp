@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include "ACTagger.hpp"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DELILA;
+
+//=============================================================================
+// ACTagger Tests
+//=============================================================================
+
+class ACTaggerTest : public ::testing::Test {
+ protected:
+  static constexpr double_t window = 100.;
+  std::vector<std::vector<ChSettings_t>> settings;
+  ChannelTable table;
+
+  void SetUp() override
+  {
+    // 4 modules x 16 channels, channel 15 of every module is the AC of
+    // channels 0 - 7 of the same module
+    settings.resize(4);
+    for (uint32_t mod = 0; mod < 4; mod++) {
+      settings[mod].resize(16);
+      for (uint32_t ch = 0; ch < 16; ch++) {
+        auto &s = settings[mod][ch];
+        s.mod = mod;
+        s.ch = ch;
+        s.ID = mod * 16 + ch;
+        if (ch < 8) {
+          s.hasAC = true;
+          s.ACMod = mod;
+          s.ACCh = 15;
+        }
+      }
+    }
+    table.Build(settings);
+  }
+
+  // The nested loop of the original L1 builder
+  void ReferenceTag(std::vector<RawData_t> &hits)
+  {
+    for (auto &hit : hits) {
+      const auto &s = settings[hit.mod][hit.ch];
+      if (s.hasAC) {
+        for (auto &ac : hits) {
+          if (ac.mod == s.ACMod && ac.ch == s.ACCh &&
+              std::fabs(ac.fineTS) < window) {
+            hit.isWithAC = true;
+            break;
+          }
+        }
+      }
+    }
+  }
+};
+
+TEST_F(ACTaggerTest, PartnerInWindowTags) {
+  std::vector<RawData_t> hits;
+  hits.emplace_back(false, 0, 0, 100, 50, 0.);
+  hits.emplace_back(false, 0, 1, 100, 50, 10.);
+  hits.emplace_back(false, 0, 15, 100, 50, -20.);
+
+  ACTagger tagger(table, window);
+  tagger.Tag(hits);
+
+  EXPECT_TRUE(hits[0].isWithAC);
+  EXPECT_TRUE(hits[1].isWithAC);
+  EXPECT_FALSE(hits[2].isWithAC);  // The AC itself has no AC
+}
+
+TEST_F(ACTaggerTest, PartnerOutsideWindowDoesNotTag) {
+  std::vector<RawData_t> hits;
+  hits.emplace_back(false, 0, 0, 100, 50, 0.);
+  hits.emplace_back(false, 0, 15, 100, 50, window);  // Open interval
+
+  ACTagger tagger(table, window);
+  tagger.Tag(hits);
+
+  EXPECT_FALSE(hits[0].isWithAC);
+}
+
+TEST_F(ACTaggerTest, OtherModuleACDoesNotTag) {
+  std::vector<RawData_t> hits;
+  hits.emplace_back(false, 0, 0, 100, 50, 0.);
+  hits.emplace_back(false, 1, 15, 100, 50, 5.);
+
+  ACTagger tagger(table, window);
+  tagger.Tag(hits);
+
+  EXPECT_FALSE(hits[0].isWithAC);
+}
+
+TEST_F(ACTaggerTest, StateIsClearedBetweenEvents) {
+  ACTagger tagger(table, window);
+
+  std::vector<RawData_t> first;
+  first.emplace_back(false, 2, 15, 100, 50, 0.);
+  tagger.Tag(first);
+
+  std::vector<RawData_t> second;
+  second.emplace_back(false, 2, 3, 100, 50, 0.);
+  tagger.Tag(second);
+
+  EXPECT_FALSE(second[0].isWithAC);
+}
+
+TEST_F(ACTaggerTest, IdenticalToNestedLoop) {
+  std::mt19937 rng(2024);
+  std::uniform_int_distribution<int> modDist(0, 3);
+  std::uniform_int_distribution<int> chDist(0, 15);
+  std::uniform_real_distribution<double> tsDist(-1.5 * window, 1.5 * window);
+  ACTagger tagger(table, window);
+
+  for (int nHits : {1, 2, 10, 100, 1000}) {
+    for (int iEvent = 0; iEvent < 20; iEvent++) {
+      std::vector<RawData_t> hits;
+      for (int i = 0; i < nHits; i++) {
+        hits.emplace_back(false, modDist(rng), chDist(rng), 100, 50,
+                          tsDist(rng));
+      }
+      auto reference = hits;
+      ReferenceTag(reference);
+      tagger.Tag(hits);
+
+      for (int i = 0; i < nHits; i++) {
+        ASSERT_EQ(hits[i].isWithAC, reference[i].isWithAC)
+            << "nHits = " << nHits << ", hit " << i;
+      }
+    }
+  }
+}
@@ -66,6 +66,13 @@ TEST_F(L1EventBuilderTest, LoadFileListWithMultipleFiles) {
   EXPECT_NO_THROW(builder.LoadFileList(fileList));
 }
 
+TEST_F(L1EventBuilderTest, LoadFileListWithEntries) {
+  L1EventBuilder builder;
+  std::vector<std::string> fileList = {"file1.root", "file2.root"};
+  EXPECT_NO_THROW(builder.LoadFileList(fileList, {100, -1}));
+  EXPECT_THROW(builder.LoadFileList(fileList, {1, 2, 3}), ValidationException);
+}
+
 TEST_F(L1EventBuilderTest, CancelOperation) {
   L1EventBuilder builder;
   EXPECT_NO_THROW(builder.Cancel());
@@ -92,6 +99,16 @@ TEST_F(L1EventBuilderTest, SetNegativeTimeWindow) {
   EXPECT_NO_THROW(builder.SetTimeWindow(-100.0));
 }
 
+TEST_F(L1EventBuilderTest, ThreadCountIsNotCapped) {
+  L1EventBuilder builder;
+  EXPECT_THROW(builder.BuildIncrement({"file1.root"}, {}, 0),
+               ValidationException);
+  // More threads than files or than 128 cores: only the missing channel
+  // settings stop the build
+  EXPECT_THROW(builder.BuildIncrement({"file1.root"}, {}, 256),
+               ConfigException);
+}
+
 TEST_F(L1EventBuilderTest, LoadFileListMultipleTimes) {
   L1EventBuilder builder;
   std::vector<std::string> list1 = {"f1.root"};
@@ -131,6 +148,13 @@ TEST_F(L2EventBuilderTest, SetCoincidenceWindow) {
   EXPECT_NO_THROW(builder.SetCoincidenceWindow(1000.0));
 }
 
+TEST_F(L2EventBuilderTest, SetMergeOptions) {
+  L2EventBuilder builder;
+  EXPECT_NO_THROW(builder.SetMergeOutput(true));
+  EXPECT_NO_THROW(builder.SetMergeSorted(true));
+  EXPECT_NO_THROW(builder.SetMergeSorted(false));
+}
+
 TEST_F(L2EventBuilderTest, CancelOperation) {
   L2EventBuilder builder;
   EXPECT_NO_THROW(builder.Cancel());
@@ -184,11 +208,27 @@ TEST_F(TimeAlignmentTest, LoadFileListWithFiles) {
   EXPECT_NO_THROW(alignment.LoadFileList(fileList));
 }
 
+TEST_F(TimeAlignmentTest, LoadFileListWithEntries) {
+  TimeAlignment alignment;
+  std::vector<std::string> files = {"small.root", "large.root"};
+  EXPECT_NO_THROW(alignment.LoadFileList(files, {10, -1}));
+  EXPECT_THROW(alignment.LoadFileList(files, {10}), ValidationException);
+}
+
 TEST_F(TimeAlignmentTest, CancelOperation) {
   TimeAlignment alignment;
   EXPECT_NO_THROW(alignment.Cancel());
 }
 
+TEST_F(TimeAlignmentTest, FastCalibrationSettings) {
+  TimeAlignment alignment;
+  EXPECT_NO_THROW(alignment.SetMinEntries(1000));
+  EXPECT_NO_THROW(alignment.SetSampleFraction(0.05));
+  EXPECT_NO_THROW(alignment.SetSampleFraction(1.0));
+  EXPECT_THROW(alignment.SetSampleFraction(0.), ValidationException);
+  EXPECT_THROW(alignment.SetSampleFraction(1.5), ValidationException);
+}
+
 TEST_F(TimeAlignmentTest, InitHistograms) {
   TimeAlignment alignment;
   // InitHistograms needs LoadChSettings first, so it might throw
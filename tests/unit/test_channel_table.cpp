@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+
+#include "ChannelTable.hpp"
+
+#include <vector>
+
+using namespace DELILA;
+
+//=============================================================================
+// ChannelTable Tests
+//=============================================================================
+
+class ChannelTableTest : public ::testing::Test {
+ protected:
+  // Module 0 with 4 channels, module 1 with 2 channels
+  std::vector<std::vector<ChSettings_t>> MakeSettings()
+  {
+    std::vector<std::vector<ChSettings_t>> settings(2);
+    int id = 0;
+    for (uint32_t mod = 0; mod < 2; mod++) {
+      settings[mod].resize(mod == 0 ? 4 : 2);
+      for (uint32_t ch = 0; ch < settings[mod].size(); ch++) {
+        auto &s = settings[mod][ch];
+        s.mod = mod;
+        s.ch = ch;
+        s.ID = id++;
+        s.thresholdADC = 10 * (id);
+        s.detectorType = "HPGe";
+        s.tags = {"tag"};
+      }
+    }
+    settings[0][0].isEventTrigger = true;
+    settings[0][1].hasAC = true;
+    settings[0][1].ACMod = 1;
+    settings[0][1].ACCh = 1;
+    return settings;
+  }
+};
+
+TEST_F(ChannelTableTest, EmptyByDefault) {
+  ChannelTable table;
+  EXPECT_TRUE(table.Empty());
+  EXPECT_FALSE(table.IsValid(0, 0));
+}
+
+TEST_F(ChannelTableTest, DimensionsFollowLongestModule) {
+  ChannelTable table;
+  table.Build(MakeSettings());
+
+  EXPECT_EQ(table.GetNModules(), 2);
+  EXPECT_EQ(table.GetNChannels(), 4);
+  EXPECT_EQ(table.Size(), 8);
+  EXPECT_EQ(table.Index(1, 1), 5);
+}
+
+TEST_F(ChannelTableTest, HotFieldsAreCopied) {
+  auto settings = MakeSettings();
+  ChannelTable table;
+  table.Build(settings);
+
+  for (uint32_t mod = 0; mod < settings.size(); mod++) {
+    for (uint32_t ch = 0; ch < settings[mod].size(); ch++) {
+      const auto &info = table.Get(mod, ch);
+      EXPECT_EQ(info.ID, settings[mod][ch].ID);
+      EXPECT_EQ(info.thresholdADC, settings[mod][ch].thresholdADC);
+      EXPECT_EQ(info.isEventTrigger, settings[mod][ch].isEventTrigger);
+    }
+  }
+}
+
+TEST_F(ChannelTableTest, ValidMaskCoversRaggedModules) {
+  ChannelTable table;
+  table.Build(MakeSettings());
+
+  EXPECT_TRUE(table.IsValid(0, 3));
+  EXPECT_TRUE(table.IsValid(1, 1));
+  EXPECT_FALSE(table.IsValid(1, 2));  // Module 1 has only 2 channels
+  EXPECT_FALSE(table.IsValid(2, 0));
+  EXPECT_FALSE(table.IsValid(255, 255));
+  EXPECT_FALSE(table.IsValid(256, 0));
+}
+
+TEST_F(ChannelTableTest, ACPartnerIsFlatIndex) {
+  ChannelTable table;
+  table.Build(MakeSettings());
+
+  EXPECT_TRUE(table.Get(0, 1).hasAC);
+  EXPECT_EQ(table.Get(0, 1).acIndex, table.Index(1, 1));
+  EXPECT_FALSE(table.Get(0, 2).hasAC);
+}
+
+TEST_F(ChannelTableTest, ACPartnerOutsideTableIsDropped) {
+  auto settings = MakeSettings();
+  settings[0][1].ACMod = 128;  // Template default
+  settings[0][1].ACCh = 128;
+  ChannelTable table;
+  table.Build(settings);
+
+  EXPECT_FALSE(table.Get(0, 1).hasAC);
+}
+
+TEST_F(ChannelTableTest, TimeOffsetsAndMissingOffsets) {
+  ChannelTable table;
+  table.Build(MakeSettings());
+
+  // No offset for (0, 3) and for module 1
+  std::vector<std::vector<double_t>> offsets = {{0., 1.5, -2.5}};
+  table.SetTimeOffsets(offsets);
+
+  EXPECT_EQ(table.Get(0, 1).timeOffset, 1500);  // ps
+  EXPECT_EQ(table.Get(0, 2).timeOffset, -2500);
+  EXPECT_TRUE(table.IsValid(0, 2));
+  EXPECT_FALSE(table.IsValid(0, 3));
+  EXPECT_FALSE(table.IsValid(1, 0));
+  // The AC partner (1, 1) lost its offset
+  EXPECT_FALSE(table.Get(0, 1).hasAC);
+}
+
+TEST_F(ChannelTableTest, RebuildResetsState) {
+  ChannelTable table;
+  table.Build(MakeSettings());
+  table.SetTimeOffsets({});
+  EXPECT_FALSE(table.IsValid(0, 0));
+
+  table.Build(MakeSettings());
+  EXPECT_TRUE(table.IsValid(0, 0));
+}
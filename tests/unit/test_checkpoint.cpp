@@ -0,0 +1,190 @@
+#include <gtest/gtest.h>
+
+#include "Checkpoint.hpp"
+#include "L2Selector.hpp"
+#include "TempDirTest.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+using namespace DELILA;
+
+//=============================================================================
+// Checkpoint Tests
+//=============================================================================
+
+class CheckpointTest : public TempDirTest {
+ protected:
+  std::string fileName;
+
+  void SetUp() override
+  {
+    TempDirTest::SetUp();
+    fileName = (dir / "L1Checkpoint.json").string();
+  }
+
+  // "E" counts the tagged channels of 1 module x 2 channels, one flag
+  static L2Selector MakeSelector(const std::string &op, const int32_t value,
+                                 const bool tagCh1 = false)
+  {
+    std::vector<std::vector<ChSettings_t>> settings(1);
+    settings[0].resize(2);
+    settings[0][1].ch = 1;
+    ChannelTable table;
+    table.Build(settings);
+    L2Counter e("E");
+    e.SetConditionTable({{true, tagCh1}});
+    return L2Selector(table, {e}, {L2Flag("E_Flag", "E", op, value)},
+                      {L2DataAcceptance({"E_Flag"}, "AND")});
+  }
+
+  static std::string ReadState(const std::string &name)
+  {
+    std::ifstream ifs(name, std::ios::binary);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+  }
+};
+
+TEST_F(CheckpointTest, NothingToResume) {
+  Checkpoint checkpoint(fileName);
+  EXPECT_FALSE(checkpoint.Load());
+  EXPECT_EQ(checkpoint.GetTasksDone(), 0);
+  EXPECT_EQ(checkpoint.GetOutputIndex(), 0);
+}
+
+TEST_F(CheckpointTest, SaveAndResume) {
+  {
+    Checkpoint checkpoint(fileName);
+    checkpoint.SetFingerprint({{"Tasks", 10}});
+    checkpoint.Save(4, 8, [](std::ostream &os) { os << "first"; });
+    checkpoint.Save(6, 12, [](std::ostream &os) { os << "second"; });
+  }
+
+  Checkpoint checkpoint(fileName);
+  checkpoint.SetFingerprint({{"Tasks", 10}});
+  ASSERT_TRUE(checkpoint.Load());
+  EXPECT_EQ(checkpoint.GetTasksDone(), 6);
+  EXPECT_EQ(checkpoint.GetOutputIndex(), 12);
+  EXPECT_EQ(ReadState(checkpoint.GetStateFileName()), "second");
+
+  // Only the state of the last checkpoint is kept
+  size_t nFiles = 0;
+  for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+    (void)entry;
+    nFiles++;
+  }
+  EXPECT_EQ(nFiles, 2);
+
+  checkpoint.Remove();
+  EXPECT_TRUE(std::filesystem::is_empty(dir));
+}
+
+TEST_F(CheckpointTest, WithoutState) {
+  Checkpoint saved(fileName);
+  saved.Save(3, 2);
+
+  Checkpoint checkpoint(fileName);
+  ASSERT_TRUE(checkpoint.Load());
+  EXPECT_EQ(checkpoint.GetTasksDone(), 3);
+  EXPECT_TRUE(checkpoint.GetStateFileName().empty());
+}
+
+TEST_F(CheckpointTest, OtherFingerprintIsNotResumed) {
+  Checkpoint saved(fileName);
+  saved.SetFingerprint({{"CoincidenceWindow", 500.}});
+  saved.Save(4, 8);
+
+  Checkpoint checkpoint(fileName);
+  checkpoint.SetFingerprint({{"CoincidenceWindow", 1000.}});
+  EXPECT_FALSE(checkpoint.Load());
+  EXPECT_EQ(checkpoint.GetTasksDone(), 0);
+}
+
+TEST_F(CheckpointTest, MissingOrBrokenFilesAreNotResumed) {
+  Checkpoint saved(fileName);
+  saved.Save(4, 8, [](std::ostream &os) { os << "state"; });
+  std::filesystem::remove(saved.GetStateFileName());
+
+  Checkpoint checkpoint(fileName);
+  EXPECT_FALSE(checkpoint.Load());
+
+  std::ofstream(fileName) << "{ not json";
+  EXPECT_FALSE(checkpoint.Load());
+}
+
+TEST_F(CheckpointTest, RewrittenInputChangesTheFingerprint) {
+  const auto input = (dir / "run0001_0000_a.root").string();
+  std::ofstream(input) << "x";
+  const auto before = Checkpoint::FileFingerprint({input});
+  EXPECT_EQ(Checkpoint::FileFingerprint({input}), before);
+
+  std::ofstream(input) << "longer";
+  EXPECT_NE(Checkpoint::FileFingerprint({input}), before);
+  EXPECT_EQ(Checkpoint::FileFingerprint({input + ".missing"})[0][1], -1);
+}
+
+TEST_F(CheckpointTest, OtherL2SelectionIsNotResumed) {
+  Checkpoint saved(fileName);
+  saved.SetFingerprint({{"L2Selection", MakeSelector(">=", 1).ToJSON()}});
+  saved.Save(4, 8);
+
+  Checkpoint checkpoint(fileName);
+  checkpoint.SetFingerprint({{"L2Selection", MakeSelector(">=", 1).ToJSON()}});
+  EXPECT_TRUE(checkpoint.Load());
+
+  // Same flag names, other value, operator or channel tags
+  checkpoint.SetFingerprint({{"L2Selection", MakeSelector(">=", 2).ToJSON()}});
+  EXPECT_FALSE(checkpoint.Load());
+  checkpoint.SetFingerprint({{"L2Selection", MakeSelector(">", 1).ToJSON()}});
+  EXPECT_FALSE(checkpoint.Load());
+  checkpoint.SetFingerprint(
+      {{"L2Selection", MakeSelector(">=", 1, true).ToJSON()}});
+  EXPECT_FALSE(checkpoint.Load());
+}
+
+TEST_F(CheckpointTest, RoundOutputsAreGroupedPerWorker) {
+  // 3 rounds of 2 workers, the last round with one task only
+  const std::vector<std::string> outputs = {"L1_0.root", "L1_1.root",
+                                            "L1_2.root", "L1_3.root",
+                                            "L1_4.root"};
+  const auto groups = Checkpoint::GroupRoundOutputs(outputs, 2);
+  ASSERT_EQ(groups.size(), 2);
+  EXPECT_EQ(groups[0], (std::vector<std::string>{"L1_0.root", "L1_2.root",
+                                                 "L1_4.root"}));
+  EXPECT_EQ(groups[1], (std::vector<std::string>{"L1_1.root", "L1_3.root"}));
+
+  // One round: nothing to merge
+  EXPECT_EQ(Checkpoint::GroupRoundOutputs({"L2_0.root"}, 4).size(), 1);
+  EXPECT_TRUE(Checkpoint::GroupRoundOutputs({}, 4).empty());
+}
+
+TEST_F(CheckpointTest, OnlyTheInterruptedRoundIsRemoved) {
+  EnterDir();
+  for (int i = 0; i < 5; i++) {
+    std::ofstream("L1_" + std::to_string(i) + ".root") << "x";
+  }
+  std::ofstream("L1_2.idx") << "x";
+
+  Checkpoint saved(fileName);
+  saved.SetRoundOutputs(2);
+  saved.Save(4, 2);
+  Checkpoint checkpoint(fileName);
+  ASSERT_TRUE(checkpoint.Load());
+  EXPECT_EQ(checkpoint.GetInterruptedOutputs(), 2);
+
+  // The outputs 2 and 3 of the interrupted round, not L1_4 of an older run
+  Checkpoint::RemoveInterruptedOutputs("L1", checkpoint.GetOutputIndex(),
+                                       checkpoint.GetInterruptedOutputs());
+  EXPECT_TRUE(std::filesystem::exists("L1_1.root"));
+  EXPECT_FALSE(std::filesystem::exists("L1_2.root"));
+  EXPECT_FALSE(std::filesystem::exists("L1_2.idx"));
+  EXPECT_FALSE(std::filesystem::exists("L1_3.root"));
+  EXPECT_TRUE(std::filesystem::exists("L1_4.root"));
+
+  // Without a checkpoint nothing is removed
+  Checkpoint::RemoveInterruptedOutputs("L1", 0, 0);
+  EXPECT_TRUE(std::filesystem::exists("L1_0.root"));
+}
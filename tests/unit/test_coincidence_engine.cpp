@@ -0,0 +1,190 @@
+#include <gtest/gtest.h>
+
+#include "CoincidenceEngine.hpp"
+
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace DELILA;
+
+//=============================================================================
+// CoincidenceEngine Tests
+//=============================================================================
+
+class CoincidenceEngineTest : public ::testing::Test {
+ protected:
+  struct Hit {
+    double ts;
+    int64_t id;  // kNoTrigger for non trigger hits
+  };
+  typedef std::pair<size_t, std::vector<size_t>> Event_t;  // trigger, hits
+
+  std::vector<Event_t> RunEngine(const std::vector<Hit> &hits, double window,
+                                 bool veto = true, size_t begin = 0,
+                                 size_t end = SIZE_MAX)
+  {
+    std::vector<Event_t> events;
+    CoincidenceEngine engine(window, veto);
+    engine.Run(
+        hits.size(), begin, std::min(end, hits.size()),
+        [&hits](size_t i) { return hits[i].ts; },
+        [&hits](size_t i) { return hits[i].id; },
+        [&](size_t iTrg, size_t lo, size_t hi) {
+          std::vector<size_t> members;
+          for (auto j = lo; j < hi; j++) {
+            if (j != iTrg) members.push_back(j);
+          }
+          events.emplace_back(iTrg, members);
+        });
+    return events;
+  }
+
+  // Forward and backward scans of the original L1 builder
+  static std::vector<Event_t> Reference(const std::vector<Hit> &hits,
+                                        double window)
+  {
+    std::vector<Event_t> events;
+    const int64_t n = hits.size();
+    for (int64_t i = 0; i < n; i++) {
+      if (hits[i].id == CoincidenceEngine::kNoTrigger) continue;
+      const auto t = hits[i].ts;
+      std::set<size_t> members;
+      bool fill = true;
+      for (auto j = i + 1; j < n && fill; j++) {
+        auto ts = hits[j].ts - t;
+        if (ts > window) break;
+        if (hits[j].id != CoincidenceEngine::kNoTrigger &&
+            hits[j].id >= hits[i].id && ts < window) {
+          fill = false;
+          break;
+        }
+        members.insert(j);
+      }
+      for (auto j = i - 1; j >= 0 && fill; j--) {
+        auto ts = hits[j].ts - t;
+        if (ts < -window) break;
+        if (hits[j].id != CoincidenceEngine::kNoTrigger &&
+            hits[j].id >= hits[i].id && ts > -window) {
+          fill = false;
+          break;
+        }
+        members.insert(j);
+      }
+      if (fill) {
+        events.emplace_back(i,
+                            std::vector<size_t>(members.begin(), members.end()));
+      }
+    }
+    return events;
+  }
+
+  static constexpr int64_t kNo = CoincidenceEngine::kNoTrigger;
+};
+
+TEST_F(CoincidenceEngineTest, SingleTriggerCollectsClosedWindow) {
+  std::vector<Hit> hits = {{0., kNo}, {5., kNo}, {10., 1}, {15., kNo},
+                           {20., kNo}, {21., kNo}};
+
+  auto events = RunEngine(hits, 10.);
+
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].first, 2);
+  EXPECT_EQ(events[0].second, (std::vector<size_t>{0, 1, 3, 4}));
+}
+
+TEST_F(CoincidenceEngineTest, HigherIDVetoes) {
+  std::vector<Hit> hits = {{0., 1}, {5., 2}};
+
+  auto events = RunEngine(hits, 10.);
+
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].first, 1);  // ID 2 survives, ID 1 is vetoed
+}
+
+TEST_F(CoincidenceEngineTest, EqualIDsVetoEachOther) {
+  std::vector<Hit> hits = {{0., 3}, {5., 3}};
+
+  EXPECT_TRUE(RunEngine(hits, 10.).empty());
+}
+
+TEST_F(CoincidenceEngineTest, VetoWindowIsOpen) {
+  // Exactly at the window edge: part of the event, but no veto
+  std::vector<Hit> hits = {{0., 1}, {10., 5}};
+
+  auto events = RunEngine(hits, 10.);
+
+  ASSERT_EQ(events.size(), 2);
+  EXPECT_EQ(events[0].second, (std::vector<size_t>{1}));
+  EXPECT_EQ(events[1].second, (std::vector<size_t>{0}));
+}
+
+TEST_F(CoincidenceEngineTest, VetoDisabled) {
+  std::vector<Hit> hits = {{0., 3}, {1., 3}, {2., 7}};
+
+  auto events = RunEngine(hits, 10., false);
+
+  EXPECT_EQ(events.size(), 3);
+}
+
+TEST_F(CoincidenceEngineTest, ZeroWindow) {
+  std::vector<Hit> hits = {{0., 3}, {0., 3}, {1., kNo}};
+
+  auto events = RunEngine(hits, 0.);
+
+  // Nothing can veto, hits with the same time stamp belong to the event
+  ASSERT_EQ(events.size(), 2);
+  EXPECT_EQ(events[0].second, (std::vector<size_t>{1}));
+}
+
+TEST_F(CoincidenceEngineTest, OnlyTriggersInRangeAreBuilt) {
+  std::vector<Hit> hits;
+  for (int i = 0; i < 10; i++) hits.push_back({i * 100., i});
+
+  auto events = RunEngine(hits, 10., true, 3, 6);
+
+  ASSERT_EQ(events.size(), 3);
+  EXPECT_EQ(events[0].first, 3);
+  EXPECT_EQ(events[2].first, 5);
+}
+
+TEST_F(CoincidenceEngineTest, IdenticalToPerTriggerScans) {
+  std::mt19937 rng(7);
+  for (double density : {0.1, 0.5, 0.9}) {
+    std::uniform_real_distribution<double> gap(0., 4.);
+    std::bernoulli_distribution isTrigger(density);
+    std::uniform_int_distribution<int> idDist(0, 5);
+    std::vector<Hit> hits;
+    double ts = 0.;
+    for (int i = 0; i < 5000; i++) {
+      // Some identical time stamps as well
+      if (i % 7 != 0) ts += gap(rng);
+      hits.push_back({ts, isTrigger(rng) ? idDist(rng) : kNo});
+    }
+
+    for (double window : {0.5, 3., 20.}) {
+      EXPECT_EQ(RunEngine(hits, window), Reference(hits, window))
+          << "density " << density << ", window " << window;
+    }
+  }
+}
+
+TEST_F(CoincidenceEngineTest, IntegerTimestampsHaveExactEdges) {
+  // 3 hours in ps, a double could not tell t + 500 from t + 501 here
+  const int64_t t0 = 10800000000000000;
+  const std::vector<int64_t> ts = {t0 - 501, t0 - 500, t0, t0 + 500, t0 + 501};
+  const std::vector<int64_t> ids = {kNo, kNo, 1, kNo, kNo};
+
+  std::vector<size_t> members;
+  CoincidenceEngine engine(500.);
+  engine.Run(
+      ts.size(), 0, ts.size(), [&ts](size_t i) { return ts[i]; },
+      [&ids](size_t i) { return ids[i]; },
+      [&](size_t iTrg, size_t lo, size_t hi) {
+        for (auto j = lo; j < hi; j++) {
+          if (j != iTrg) members.push_back(j);
+        }
+      });
+
+  EXPECT_EQ(members, (std::vector<size_t>{1, 3}));
+}
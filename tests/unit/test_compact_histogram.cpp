@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include "CompactHistogram.hpp"
+
+using namespace DELILA;
+
+//=============================================================================
+// CompactHistogram Tests
+//=============================================================================
+
+TEST(CompactHistogramTest, BinningLikeTAxis) {
+  // 10 bins of 2 ns in [-10, 10)
+  CompactHistogram hist(10, -10., 10.);
+
+  hist.Fill(-10.);
+  hist.Fill(-9.9);
+  hist.Fill(0.);
+  hist.Fill(9.99);
+
+  EXPECT_EQ(hist.GetBinContent(1), 2);
+  EXPECT_EQ(hist.GetBinContent(6), 1);
+  EXPECT_EQ(hist.GetBinContent(10), 1);
+  EXPECT_EQ(hist.GetEntries(), 4);
+}
+
+TEST(CompactHistogramTest, UnderAndOverflow) {
+  CompactHistogram hist(10, -10., 10.);
+
+  hist.Fill(-10.1);
+  hist.Fill(10.);  // The upper edge is overflow
+  hist.Fill(1e9);
+
+  EXPECT_EQ(hist.GetBinContent(0), 1);
+  EXPECT_EQ(hist.GetBinContent(11), 2);
+  EXPECT_EQ(hist.GetEntries(), 3);
+}
+
+TEST(CompactHistogramTest, RowsAreAllocatedByFill) {
+  CompactHistogram hist(1000, -500., 500., 350);
+  EXPECT_EQ(hist.GetNAllocatedRows(), 0);
+
+  hist.Fill(1.5, 7);
+  hist.Fill(-2.5, 7);
+  hist.Fill(0., 42);
+
+  EXPECT_EQ(hist.GetNAllocatedRows(), 2);
+  EXPECT_EQ(hist.GetBinContent(502, 8), 1);  // Row 7 is y bin 8
+  EXPECT_EQ(hist.GetBinContent(498, 8), 1);
+  EXPECT_EQ(hist.GetBinContent(501, 43), 1);
+  EXPECT_EQ(hist.GetBinContent(501, 1), 0);
+  EXPECT_LT(hist.GetMemoryBytes(), 3 * 1002 * sizeof(uint32_t) +
+                                       352 * sizeof(std::vector<uint32_t>));
+}
+
+TEST(CompactHistogramTest, OutOfRangeRows) {
+  CompactHistogram hist(4, 0., 4., 3);
+
+  hist.Fill(1., -1);
+  hist.Fill(1., 3);
+
+  EXPECT_EQ(hist.GetBinContent(2, 0), 1);
+  EXPECT_EQ(hist.GetBinContent(2, 4), 1);
+}
+
+TEST(CompactHistogramTest, AddMergesCopies) {
+  const CompactHistogram empty(100, 0., 100., 5);
+  auto first = empty;
+  auto second = empty;
+
+  first.Fill(10., 1);
+  second.Fill(10., 1);
+  second.Fill(20., 4);
+  first.Add(second);
+
+  EXPECT_EQ(first.GetBinContent(11, 2), 2);
+  EXPECT_EQ(first.GetBinContent(21, 5), 1);
+  EXPECT_EQ(first.GetEntries(), 3);
+  EXPECT_EQ(empty.GetNAllocatedRows(), 0);
+  EXPECT_EQ(second.GetEntries(), 2);
+}
+
+TEST(CompactHistogramTest, OneDimensional) {
+  CompactHistogram hist(32000, 0., 32000.);
+
+  hist.Fill(0.);
+  hist.Fill(1234.);
+  hist.Fill(1234., 99);  // The row is ignored
+
+  EXPECT_EQ(hist.GetNRows(), 0);
+  EXPECT_EQ(hist.GetBinContent(1), 1);
+  EXPECT_EQ(hist.GetBinContent(1235), 2);
+  EXPECT_EQ(hist.GetNAllocatedRows(), 1);
+}
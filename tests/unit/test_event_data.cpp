@@ -287,3 +287,66 @@ TEST_F(EventDataTest, EdgeCaseTriggerTimes) {
   event.triggerTime = 0.0;
   EXPECT_DOUBLE_EQ(event.triggerTime, 0.0);
 }
+
+TEST_F(EventDataTest, CopyIsIndependent) {
+  EventData original;
+  original.eventDataVec->push_back(RawData_t(true, 1, 2, 100, 50, 10.0));
+
+  EventData copy(original);
+  copy.eventDataVec->push_back(RawData_t(true, 1, 3, 100, 50, 20.0));
+
+  EXPECT_NE(copy.eventDataVec, original.eventDataVec);
+  EXPECT_EQ(original.eventDataVec->size(), 1);
+  EXPECT_EQ(copy.eventDataVec->size(), 2);
+}
+
+TEST_F(EventDataTest, AssignmentKeepsVectorAddress) {
+  // The address is what a branch is bound to
+  EventData target;
+  auto *address = target.eventDataVec;
+  EventData source;
+  source.eventDataVec->push_back(RawData_t(true, 1, 2, 100, 50, 10.0));
+
+  target = source;
+  EXPECT_EQ(target.eventDataVec, address);
+  target = std::move(source);
+  EXPECT_EQ(target.eventDataVec, address);
+  EXPECT_EQ(target.eventDataVec->size(), 1);
+}
+
+TEST_F(EventDataTest, TriggerTimePsIsCopiedAndCleared) {
+  EventData original;
+  original.triggerTime = 123.456;
+  original.triggerTimePs = 123456789012345678LL;
+
+  EventData copy(original);
+  EXPECT_EQ(copy.triggerTimePs, original.triggerTimePs);
+  EventData assigned;
+  assigned = original;
+  EXPECT_EQ(assigned.triggerTimePs, original.triggerTimePs);
+  EventData moved(std::move(original));
+  EXPECT_EQ(moved.triggerTimePs, 123456789012345678LL);
+
+  moved.Clear();
+  EXPECT_EQ(moved.triggerTimePs, 0);
+}
+
+TEST_F(EventDataTest, SwapExchangesHits) {
+  EventData first;
+  first.triggerTime = 1.;
+  first.triggerTimePs = 1000;
+  first.eventDataVec->push_back(RawData_t(true, 1, 2, 100, 50, 10.0));
+  auto *firstAddress = first.eventDataVec;
+  EventData second;
+  second.triggerTime = 2.;
+
+  first.Swap(second);
+
+  EXPECT_EQ(first.eventDataVec, firstAddress);
+  EXPECT_TRUE(first.eventDataVec->empty());
+  EXPECT_DOUBLE_EQ(first.triggerTime, 2.);
+  EXPECT_EQ(first.triggerTimePs, 0);
+  EXPECT_EQ(second.eventDataVec->size(), 1);
+  EXPECT_DOUBLE_EQ(second.triggerTime, 1.);
+  EXPECT_EQ(second.triggerTimePs, 1000);
+}
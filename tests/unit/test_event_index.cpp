@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include "EventIndex.hpp"
+#include "TempDirTest.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+using namespace DELILA;
+
+//=============================================================================
+// EventIndex Tests
+//=============================================================================
+
+class EventIndexTest : public TempDirTest {
+ protected:
+  // Two time ordered runs, as two tasks of one thread: 1000..1099 ns and
+  // 500..599 ns.  "Even" is set for even entries, "Tens" every tenth entry.
+  static EventIndex MakeIndex()
+  {
+    EventIndex index({"Even", "Tens"});
+    for (int run = 0; run < 2; run++) {
+      for (int i = 0; i < 100; i++) {
+        const auto entry = index.GetEntries();
+        const uint8_t flags[] = {entry % 2 == 0, entry % 10 == 0};
+        index.Add(NsToTimestamp((run == 0 ? 1000 : 500) + i), flags);
+      }
+    }
+    return index;
+  }
+};
+
+TEST_F(EventIndexTest, IndexFileNameReplacesExtension) {
+  EXPECT_EQ(EventIndex::GetIndexFileName("L2_3.root"), "L2_3.idx");
+  EXPECT_EQ(EventIndex::GetIndexFileName("shard_0/L1_12.root"),
+            "shard_0/L1_12.idx");
+}
+
+TEST_F(EventIndexTest, TimeRangeInEveryRun) {
+  const auto index = MakeIndex();
+  EXPECT_EQ(index.GetEntries(), 200);
+  EXPECT_EQ(index.GetNumberOfRuns(), 2);
+  EXPECT_EQ(index.Select().size(), 200);
+
+  // [1090, 1110) ns: the last 10 of the first run
+  auto entries = index.Select(NsToTimestamp(1090), NsToTimestamp(1110));
+  ASSERT_EQ(entries.size(), 10);
+  EXPECT_EQ(entries.front(), 90);
+  EXPECT_EQ(entries.back(), 99);
+
+  // [590, 1005) ns: the end of the second and the start of the first run,
+  // in entry order
+  entries = index.Select(NsToTimestamp(590), NsToTimestamp(1005));
+  ASSERT_EQ(entries.size(), 15);
+  EXPECT_EQ(entries[0], 0);
+  EXPECT_EQ(entries[4], 4);
+  EXPECT_EQ(entries[5], 190);
+  EXPECT_EQ(entries[14], 199);
+
+  EXPECT_TRUE(index.Select(NsToTimestamp(2000), kMaxTimestamp).empty());
+}
+
+TEST_F(EventIndexTest, FlagsAreCombined) {
+  const auto index = MakeIndex();
+  EXPECT_EQ(index.Select(kMinTimestamp, kMaxTimestamp, {"Even"}).size(), 100);
+  EXPECT_EQ(index.Select(kMinTimestamp, kMaxTimestamp, {"Tens"}).size(), 20);
+
+  // Word boundaries inside the range: entries 63..99 of the first run
+  const auto entries = index.Select(NsToTimestamp(1063), NsToTimestamp(1131),
+                                    {"Even", "Tens"});
+  const std::vector<Long64_t> expected = {70, 80, 90};
+  EXPECT_EQ(entries, expected);
+  for (const auto entry : index.Select(NsToTimestamp(500), NsToTimestamp(600),
+                                       {"Tens"})) {
+    EXPECT_TRUE(index.IsSet(1, entry));
+    EXPECT_GE(entry, 100);
+  }
+
+  EXPECT_THROW(index.Select(kMinTimestamp, kMaxTimestamp, {"Odd"}),
+               ValidationException);
+}
+
+TEST_F(EventIndexTest, SaveAndLoad) {
+  const auto index = MakeIndex();
+  const auto fileName = (dir / "L2_0.idx").string();
+  index.Save(fileName);
+  EXPECT_FALSE(std::filesystem::exists(fileName + ".tmp"));
+
+  const auto loaded = EventIndex::Load(fileName);
+  EXPECT_EQ(loaded.GetFlagNames(), index.GetFlagNames());
+  EXPECT_EQ(loaded.GetEntries(), index.GetEntries());
+  EXPECT_EQ(loaded.GetNumberOfRuns(), 2);
+  EXPECT_EQ(loaded.GetTriggerTime(150), NsToTimestamp(550));
+  EXPECT_EQ(loaded.Select(NsToTimestamp(550), NsToTimestamp(1050), {"Tens"}),
+            index.Select(NsToTimestamp(550), NsToTimestamp(1050), {"Tens"}));
+}
+
+TEST_F(EventIndexTest, ChainNumbersEntriesOn) {
+  EventIndex first({"Flag"});
+  EventIndex second({"Flag"});
+  const uint8_t set[] = {1};
+  const uint8_t unset[] = {0};
+  for (int i = 0; i < 70; i++) {
+    first.Add(NsToTimestamp(i), i == 69 ? set : unset);
+  }
+  for (int i = 0; i < 5; i++) {
+    second.Add(NsToTimestamp(100 + i), i == 2 ? set : unset);
+  }
+  first.Save((dir / "L2_0.idx").string());
+  second.Save((dir / "L2_1.idx").string());
+
+  const auto chain = EventIndex::Load(std::vector<std::string>{
+      (dir / "L2_0.root").string(), (dir / "L2_1.root").string()});
+  EXPECT_EQ(chain.GetEntries(), 75);
+  const std::vector<Long64_t> expected = {69, 72};
+  EXPECT_EQ(chain.Select(kMinTimestamp, kMaxTimestamp, {"Flag"}), expected);
+
+  EventIndex other({"Other"});
+  EXPECT_THROW(other.Append(first), ValidationException);
+}
+
+TEST_F(EventIndexTest, InvalidFilesAreRejected) {
+  const auto fileName = (dir / "L2_0.idx").string();
+  EXPECT_THROW(EventIndex::Load(fileName), FileException);
+
+  {
+    std::ofstream ofs(fileName, std::ios::binary);
+    ofs << "not an index";
+  }
+  EXPECT_THROW(EventIndex::Load(fileName), FileException);
+
+  MakeIndex().Save(fileName);
+  std::filesystem::resize_file(fileName,
+                               std::filesystem::file_size(fileName) - 8);
+  EXPECT_THROW(EventIndex::Load(fileName), FileException);
+}
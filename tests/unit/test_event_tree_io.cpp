@@ -0,0 +1,212 @@
+#include <gtest/gtest.h>
+
+#include "AsyncEventWriter.hpp"
+#include "EventTreeIO.hpp"
+#include "TFileRAII.hpp"
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace DELILA;
+
+//=============================================================================
+// EventTreeWriter / EventTreeReader Tests
+//=============================================================================
+
+class EventTreeIOTest : public ::testing::Test {
+ protected:
+  std::string testFileName = "test_event_tree_io.root";
+  std::vector<std::vector<RawData_t>> events;
+
+  void SetUp() override
+  {
+    // Variable sizes, one empty event and one larger than the initial buffer
+    for (size_t n : {3, 0, 1, 300, 7}) {
+      std::vector<RawData_t> hits;
+      for (size_t i = 0; i < n; i++) {
+        hits.emplace_back(i % 3 == 0, i % 16, i % 32, 1000 + i, 500 + i,
+                          -50. + 0.25 * i);
+      }
+      events.push_back(hits);
+    }
+  }
+
+  void TearDown() override
+  {
+    if (std::filesystem::exists(testFileName)) {
+      std::filesystem::remove(testFileName);
+    }
+  }
+
+  void Write(const EventFormat format)
+  {
+    auto file = MakeTFile(testFileName.c_str(), "RECREATE");
+    auto tree = new TTree("L1EventData", "L1EventData");
+    tree->SetDirectory(file.get());
+    EventData eventData;
+    ULong64_t counter = 0;
+    tree->Branch("Counter", &counter, "Counter/l");
+    EventTreeWriter writer(tree, eventData, format);
+    for (size_t i = 0; i < events.size(); i++) {
+      eventData.triggerTime = 1000. * i;
+      eventData.triggerTimePs = TriggerTimePs(i);
+      *eventData.eventDataVec = events[i];
+      counter = i;
+      writer.Fill();
+    }
+    file->cd();
+    tree->Write();
+  }
+
+  // Same events through the writer thread, a pool of 2 wraps around.
+  // No Counter branch, it would be filled from another thread.
+  void WriteAsync(const EventFormat format)
+  {
+    auto file = MakeTFile(testFileName.c_str(), "RECREATE");
+    auto tree = new TTree("L1EventData", "L1EventData");
+    tree->SetDirectory(file.get());
+    AsyncEventWriter writer(tree, format, nullptr, 2);
+    for (size_t i = 0; i < events.size(); i++) {
+      auto &eventData = writer.Current();
+      eventData.triggerTime = 1000. * i;
+      eventData.triggerTimePs = TriggerTimePs(i);
+      *eventData.eventDataVec = events[i];
+      writer.Commit();
+    }
+    writer.Close();
+    EXPECT_EQ(writer.GetNumberOfEvents(), events.size());
+    file->cd();
+    tree->Write();
+  }
+
+  // Far beyond the ps resolution of a double in ns
+  static Long64_t TriggerTimePs(const size_t i)
+  {
+    return 5000000000000000001LL + Long64_t(i) * 1000000;
+  }
+
+  static void ExpectEqual(const RawData_t &a, const RawData_t &b)
+  {
+    EXPECT_EQ(a.isWithAC, b.isWithAC);
+    EXPECT_EQ(a.mod, b.mod);
+    EXPECT_EQ(a.ch, b.ch);
+    EXPECT_EQ(a.chargeLong, b.chargeLong);
+    EXPECT_EQ(a.chargeShort, b.chargeShort);
+    EXPECT_DOUBLE_EQ(a.fineTS, b.fineTS);
+  }
+
+  void ReadAndCompare(const EventFormat expected, const bool counter = true)
+  {
+    auto file = MakeTFile(testFileName.c_str(), "READ");
+    auto tree = static_cast<TTree *>(file->Get("L1EventData"));
+    ASSERT_NE(tree, nullptr);
+    EventData eventData;
+    ULong64_t counterValue = 0;
+    if (counter) {
+      tree->SetBranchAddress("Counter", &counterValue);
+    }
+    EventTreeReader reader(tree, eventData);
+    EXPECT_EQ(reader.GetFormat(), expected);
+    ASSERT_EQ(tree->GetEntries(), events.size());
+
+    for (size_t i = 0; i < events.size(); i++) {
+      reader.GetEntry(i);
+      EXPECT_DOUBLE_EQ(eventData.triggerTime, 1000. * i);
+      EXPECT_EQ(eventData.triggerTimePs, TriggerTimePs(i));
+      if (counter) {
+        EXPECT_EQ(counterValue, i);
+      }
+      ASSERT_EQ(eventData.eventDataVec->size(), events[i].size());
+      for (size_t j = 0; j < events[i].size(); j++) {
+        ExpectEqual(eventData.eventDataVec->at(j), events[i][j]);
+      }
+    }
+  }
+};
+
+TEST_F(EventTreeIOTest, ParseFormatName) {
+  EXPECT_EQ(GetEventFormat("Object"), EventFormat::Object);
+  EXPECT_EQ(GetEventFormat("flat"), EventFormat::Flat);
+  EXPECT_EQ(GetEventFormatName(EventFormat::Flat), "Flat");
+  EXPECT_THROW(GetEventFormat("RNTuple"), ConfigException);
+}
+
+TEST_F(EventTreeIOTest, ObjectRoundTrip) {
+  Write(EventFormat::Object);
+  ReadAndCompare(EventFormat::Object);
+}
+
+TEST_F(EventTreeIOTest, FlatRoundTrip) {
+  Write(EventFormat::Flat);
+  ReadAndCompare(EventFormat::Flat);
+}
+
+TEST_F(EventTreeIOTest, AsyncObjectRoundTrip) {
+  WriteAsync(EventFormat::Object);
+  ReadAndCompare(EventFormat::Object, false);
+}
+
+TEST_F(EventTreeIOTest, AsyncFlatRoundTrip) {
+  WriteAsync(EventFormat::Flat);
+  ReadAndCompare(EventFormat::Flat, false);
+}
+
+TEST_F(EventTreeIOTest, FlatHasNoObjectBranch) {
+  Write(EventFormat::Flat);
+
+  auto file = MakeTFile(testFileName.c_str(), "READ");
+  auto tree = static_cast<TTree *>(file->Get("L1EventData"));
+  ASSERT_NE(tree, nullptr);
+  EXPECT_EQ(tree->GetBranch("EventDataVec"), nullptr);
+  EXPECT_NE(tree->GetBranch("nHits"), nullptr);
+  EXPECT_NE(tree->GetBranch("FineTS"), nullptr);
+}
+
+TEST_F(EventTreeIOTest, WithoutTriggerTimePs) {
+  // Layout of the files written before the TriggerTimePs branch
+  {
+    auto file = MakeTFile(testFileName.c_str(), "RECREATE");
+    auto tree = new TTree("L1EventData", "L1EventData");
+    tree->SetDirectory(file.get());
+    EventData eventData;
+    tree->Branch("TriggerTime", &eventData.triggerTime, "TriggerTime/D");
+    tree->Branch("EventDataVec", &eventData.eventDataVec);
+    eventData.triggerTime = 1234.5674;
+    tree->Fill();
+    file->cd();
+    tree->Write();
+  }
+
+  auto file = MakeTFile(testFileName.c_str(), "READ");
+  auto tree = static_cast<TTree *>(file->Get("L1EventData"));
+  ASSERT_NE(tree, nullptr);
+  EventData eventData;
+  EventTreeReader reader(tree, eventData);
+  reader.GetEntry(0);
+  EXPECT_EQ(eventData.triggerTimePs, 1234567);
+}
+
+TEST_F(EventTreeIOTest, FlatColumnSelection) {
+  Write(EventFormat::Flat);
+
+  auto file = MakeTFile(testFileName.c_str(), "READ");
+  auto tree = static_cast<TTree *>(file->Get("L1EventData"));
+  ASSERT_NE(tree, nullptr);
+  EventData eventData;
+  EventTreeReader reader(tree, eventData,
+                         EventTreeReader::kMod | EventTreeReader::kCh);
+
+  reader.GetEntry(3);
+  ASSERT_EQ(eventData.eventDataVec->size(), events[3].size());
+  for (size_t j = 0; j < events[3].size(); j++) {
+    const auto &hit = eventData.eventDataVec->at(j);
+    EXPECT_EQ(hit.mod, events[3][j].mod);
+    EXPECT_EQ(hit.ch, events[3][j].ch);
+    EXPECT_EQ(hit.chargeLong, 0);  // Not read
+    EXPECT_EQ(hit.fineTS, 0.);
+  }
+}
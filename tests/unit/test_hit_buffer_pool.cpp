@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include "HitBufferPool.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace DELILA;
+
+//=============================================================================
+// HitBufferPool Tests
+//=============================================================================
+
+TEST(HitBufferPoolTest, AcquireFromEmptyPool) {
+  HitBufferPool pool;
+  auto buffer = pool.Acquire(100);
+
+  EXPECT_TRUE(buffer.empty());
+  EXPECT_GE(buffer.capacity(), 100);
+}
+
+TEST(HitBufferPoolTest, ReleasedBufferKeepsCapacity) {
+  HitBufferPool pool;
+  auto buffer = pool.Acquire(1000);
+  buffer.resize(500);
+  const auto *data = buffer.data();
+
+  pool.Release(std::move(buffer));
+  EXPECT_EQ(pool.Size(), 1);
+
+  auto reused = pool.Acquire(1000);
+  EXPECT_TRUE(reused.empty());
+  EXPECT_GE(reused.capacity(), 1000);
+  EXPECT_EQ(reused.data(), data);  // Same storage, no new allocation
+  EXPECT_EQ(pool.Size(), 0);
+}
+
+TEST(HitBufferPoolTest, PrefersLargeEnoughBuffer) {
+  HitBufferPool pool;
+  auto small = pool.Acquire(10);
+  auto large = pool.Acquire(10000);
+  const auto *largeData = large.data();
+  pool.Release(std::move(large));
+  pool.Release(std::move(small));
+
+  auto buffer = pool.Acquire(5000);
+  EXPECT_EQ(buffer.data(), largeData);
+}
+
+TEST(HitBufferPoolTest, PoolSizeIsBounded) {
+  HitBufferPool pool(2);
+  for (int i = 0; i < 5; i++) {
+    pool.Release(HitVec_t(10));
+  }
+  EXPECT_EQ(pool.Size(), 2);
+}
+
+TEST(HitBufferPoolTest, EmptyBuffersAreNotPooled) {
+  HitBufferPool pool;
+  pool.Release(HitVec_t());
+  EXPECT_EQ(pool.Size(), 0);
+}
+
+TEST(HitBufferPoolTest, ConcurrentAcquireRelease) {
+  HitBufferPool pool(8);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&pool]() {
+      for (int i = 0; i < 1000; i++) {
+        auto buffer = pool.Acquire(64);
+        buffer.emplace_back(false, 1, 2, 3, 4, 5.0);
+        pool.Release(std::move(buffer));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(pool.Size(), 8);
+}
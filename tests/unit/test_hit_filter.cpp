@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+
+#include "HitFilter.hpp"
+
+#include <random>
+#include <vector>
+
+using namespace DELILA;
+
+//=============================================================================
+// HitFilter Tests
+//=============================================================================
+
+class HitFilterTest : public ::testing::Test {
+ protected:
+  ChannelTable table;
+
+  void SetUp() override
+  {
+    // 3 modules x 16 channels, threshold 10 * ch, offset mod + 0.5 * ch.
+    // Module 2 channel 15 has no time offset and becomes invalid.
+    std::vector<std::vector<ChSettings_t>> settings(3);
+    std::vector<std::vector<double_t>> offsets(3);
+    for (uint32_t mod = 0; mod < 3; mod++) {
+      settings[mod].resize(16);
+      for (uint32_t ch = 0; ch < 16; ch++) {
+        settings[mod][ch].mod = mod;
+        settings[mod][ch].ch = ch;
+        settings[mod][ch].thresholdADC = 10 * ch;
+        if (mod < 2 || ch < 15) {
+          offsets[mod].push_back(mod + 0.5 * ch);
+        }
+      }
+    }
+    table.Build(settings);
+    table.SetTimeOffsets(offsets);
+  }
+
+  // Unknown modules, every charge and odd sizes for the scalar tail
+  static RawColumns MakeBlock(const size_t n, const uint32_t seed)
+  {
+    std::mt19937 rng(seed);
+    RawColumns block;
+    block.nEntries = n;
+    for (size_t i = 0; i < n; i++) {
+      block.mod.push_back(rng() % 4);
+      block.ch.push_back(rng() % 20);
+      block.chargeLong.push_back(rng() % 200);
+      block.chargeShort.push_back(0);
+      block.fineTS.push_back(1e6 * i + (rng() % 100000) * 0.001);
+    }
+    return block;
+  }
+
+  // The loop the filter replaces
+  FilteredHits Reference(const RawColumns &block)
+  {
+    FilteredHits hits;
+    for (size_t i = 0; i < block.size(); i++) {
+      const auto mod = block.mod[i];
+      const auto ch = block.ch[i];
+      if (!table.IsValid(mod, ch)) {
+        continue;
+      }
+      const auto &info = table.Get(mod, ch);
+      if (block.chargeLong[i] > info.thresholdADC) {
+        hits.entry.push_back(i);
+        hits.index.push_back(table.Index(mod, ch));
+        hits.time.push_back(ToTimestamp(block.fineTS[i]) - info.timeOffset);
+        hits.nHits++;
+      }
+    }
+    return hits;
+  }
+
+  static void ExpectEqual(const FilteredHits &a, const FilteredHits &b)
+  {
+    ASSERT_EQ(a.size(), b.size());
+    for (size_t k = 0; k < a.size(); k++) {
+      EXPECT_EQ(a.entry[k], b.entry[k]);
+      EXPECT_EQ(a.index[k], b.index[k]);
+      EXPECT_EQ(a.time[k], b.time[k]);
+    }
+  }
+};
+
+TEST_F(HitFilterTest, ScalarMatchesReference) {
+  HitFilter filter(table);
+  filter.SetKernel(HitFilter::Kernel::Scalar);
+
+  for (const size_t n : {0, 1, 7, 8, 9, 1001}) {
+    const auto block = MakeBlock(n, n);
+    FilteredHits hits;
+    filter.Filter(block, hits);
+    ExpectEqual(hits, Reference(block));
+  }
+}
+
+TEST_F(HitFilterTest, BestKernelMatchesScalar) {
+  HitFilter vector(table);
+  HitFilter scalar(table);
+  scalar.SetKernel(HitFilter::Kernel::Scalar);
+  std::cout << "Kernel: " << HitFilter::GetKernelName(vector.GetKernel())
+            << std::endl;
+
+  for (const size_t n : {5, 16, 17, 4099}) {
+    const auto block = MakeBlock(n, 100 + n);
+    FilteredHits a;
+    FilteredHits b;
+    vector.Filter(block, a);
+    scalar.Filter(block, b);
+    ExpectEqual(a, b);
+  }
+}
+
+TEST_F(HitFilterTest, ThresholdIsExclusive) {
+  HitFilter filter(table);
+  RawColumns block;
+  block.nEntries = 2;
+  block.mod = {0, 0};
+  block.ch = {3, 3};
+  block.chargeLong = {30, 31};
+  block.chargeShort = {0, 0};
+  block.fineTS = {1000., 2000.};
+
+  FilteredHits hits;
+  ASSERT_EQ(filter.Filter(block, hits), 1);
+  EXPECT_EQ(hits.entry[0], 1);
+  EXPECT_EQ(hits.time[0], 2000 - 1500);  // ps
+}
+
+TEST_F(HitFilterTest, WithoutTimeOffset) {
+  HitFilter filter(table, false);
+  RawColumns block;
+  block.nEntries = 1;
+  block.mod = {1};
+  block.ch = {2};
+  block.chargeLong = {100};
+  block.chargeShort = {0};
+  block.fineTS = {12345.4};
+
+  FilteredHits hits;
+  ASSERT_EQ(filter.Filter(block, hits), 1);
+  EXPECT_EQ(hits.time[0], 12345);  // Rounded to ps
+}
+
+TEST_F(HitFilterTest, OutputIsReused) {
+  HitFilter filter(table);
+  FilteredHits hits;
+  filter.Filter(MakeBlock(1000, 1), hits);
+  const auto first = hits.size();
+  filter.Filter(MakeBlock(10, 2), hits);
+
+  EXPECT_GT(first, hits.size());
+  ExpectEqual(hits, Reference(MakeBlock(10, 2)));
+}
@@ -0,0 +1,209 @@
+#include <gtest/gtest.h>
+
+#include "EventData.hpp"
+#include "HitSorter.hpp"
+#include "RawHit.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <tuple>
+#include <vector>
+
+using namespace DELILA;
+
+//=============================================================================
+// HitSorter Tests
+//=============================================================================
+
+class HitSorterTest : public ::testing::Test {
+ protected:
+  typedef HitSorter<RawData_t> Sorter_t;
+
+  HitSorter<RawData_t> sorter;
+
+  Sorter_t::Method Sort(std::vector<RawData_t> &hits)
+  {
+    return sorter.Sort(
+        hits,
+        [](const RawData_t &hit) { return Sorter_t::OrderedKey(hit.fineTS); },
+        [](const RawData_t &hit) { return uint16_t((hit.mod << 8) | hit.ch); });
+  }
+
+  // Interleaves nChannels monotone streams the way the DAQ writes blocks
+  static std::vector<RawData_t> MakeInterleaved(int nChannels, int nBlocks,
+                                                int blockSize)
+  {
+    std::vector<RawData_t> hits;
+    for (int b = 0; b < nBlocks; b++) {
+      for (int c = 0; c < nChannels; c++) {
+        for (int i = 0; i < blockSize; i++) {
+          auto ts = (b * blockSize + i) * 10. + c * 0.37;
+          hits.emplace_back(false, c / 16, c % 16, 100, 50, ts);
+        }
+      }
+    }
+    return hits;
+  }
+
+  static bool IsSorted(const std::vector<RawData_t> &hits)
+  {
+    return std::is_sorted(hits.begin(), hits.end(),
+                          [](const RawData_t &a, const RawData_t &b) {
+                            return a.fineTS < b.fineTS;
+                          });
+  }
+
+  static std::vector<double> Times(const std::vector<RawData_t> &hits)
+  {
+    std::vector<double> times;
+    for (const auto &hit : hits) times.push_back(hit.fineTS);
+    return times;
+  }
+};
+
+TEST_F(HitSorterTest, OrderedKeyPreservesOrder) {
+  std::vector<double> values = {-1e12, -3.5, -0., 0., 1e-300, 2.5, 1e15};
+  for (size_t i = 1; i < values.size(); i++) {
+    EXPECT_LE(Sorter_t::OrderedKey(values[i - 1]),
+              Sorter_t::OrderedKey(values[i]));
+  }
+  EXPECT_LT(Sorter_t::OrderedKey(-3.5), Sorter_t::OrderedKey(2.5));
+}
+
+TEST_F(HitSorterTest, EmptyAndSingle) {
+  std::vector<RawData_t> hits;
+  EXPECT_EQ(Sort(hits), Sorter_t::Method::Sorted);
+  hits.emplace_back(false, 0, 0, 1, 1, 5.);
+  EXPECT_EQ(Sort(hits), Sorter_t::Method::Sorted);
+  EXPECT_EQ(hits.size(), 1);
+}
+
+TEST_F(HitSorterTest, AlreadySortedIsUntouched) {
+  auto hits = MakeInterleaved(1, 10, 100);
+  auto reference = Times(hits);
+
+  EXPECT_EQ(Sort(hits), Sorter_t::Method::Sorted);
+  EXPECT_EQ(Times(hits), reference);
+}
+
+TEST_F(HitSorterTest, SmallInputUsesComparisonSort) {
+  std::vector<RawData_t> hits;
+  for (int i = 0; i < 50; i++) {
+    hits.emplace_back(false, 0, 0, 1, 1, 50. - i);
+  }
+
+  EXPECT_EQ(Sort(hits), Sorter_t::Method::Comparison);
+  EXPECT_TRUE(IsSorted(hits));
+}
+
+TEST_F(HitSorterTest, MonotoneChannelsAreMerged) {
+  auto hits = MakeInterleaved(48, 20, 30);
+  auto reference = Times(hits);
+  std::sort(reference.begin(), reference.end());
+
+  EXPECT_EQ(Sort(hits), Sorter_t::Method::ChannelMerge);
+  EXPECT_EQ(Times(hits), reference);
+}
+
+TEST_F(HitSorterTest, ChannelMergeKeepsHitContents) {
+  auto hits = MakeInterleaved(4, 100, 5);
+  Sort(hits);
+
+  for (const auto &hit : hits) {
+    // Time stamp encodes the channel, see MakeInterleaved
+    auto c = hit.mod * 16 + hit.ch;
+    auto frac = hit.fineTS - 10. * std::floor(hit.fineTS / 10.);
+    EXPECT_NEAR(frac, c * 0.37, 1e-6);
+  }
+}
+
+TEST_F(HitSorterTest, DisorderedChannelUsesRadix) {
+  std::mt19937_64 rng(12345);
+  std::uniform_real_distribution<double> dist(0., 1e9);
+  std::vector<RawData_t> hits;
+  for (int i = 0; i < 10000; i++) {
+    hits.emplace_back(false, i % 3, i % 5, 1, 1, dist(rng));
+  }
+  auto reference = Times(hits);
+  std::sort(reference.begin(), reference.end());
+
+  EXPECT_EQ(Sort(hits), Sorter_t::Method::Radix);
+  EXPECT_EQ(Times(hits), reference);
+}
+
+TEST_F(HitSorterTest, RadixHandlesNegativeTimes) {
+  // L1 applies time offsets, so the first hits can be earlier than 0
+  std::vector<RawData_t> hits;
+  for (int i = 0; i < 1000; i++) {
+    hits.emplace_back(false, 0, 0, 1, 1, ((i * 7919) % 1000) - 500.25);
+  }
+  auto reference = Times(hits);
+  std::sort(reference.begin(), reference.end());
+
+  EXPECT_EQ(Sort(hits), Sorter_t::Method::Radix);
+  EXPECT_EQ(Times(hits), reference);
+}
+
+TEST_F(HitSorterTest, ScratchReusedAcrossChunks) {
+  for (int chunk = 0; chunk < 3; chunk++) {
+    auto hits = MakeInterleaved(8, 10 + chunk * 5, 10);
+    Sort(hits);
+    EXPECT_TRUE(IsSorted(hits));
+  }
+  EXPECT_EQ(sorter.GetNumberOfSorts(Sorter_t::Method::ChannelMerge), 3);
+}
+
+TEST_F(HitSorterTest, TupleHits) {
+  // TimeAlignment keeps (mod, ch, fineTS) tuples
+  typedef std::tuple<UChar_t, UChar_t, Double_t> Hit_t;
+  std::vector<Hit_t> hits;
+  for (int b = 0; b < 50; b++) {
+    for (int c = 0; c < 10; c++) {
+      hits.emplace_back(c, 0, b * 10. + c);
+    }
+  }
+  std::reverse(hits.begin(), hits.end());
+
+  HitSorter<Hit_t> tupleSorter;
+  tupleSorter.Sort(
+      hits,
+      [](const Hit_t &hit) {
+        return HitSorter<Hit_t>::OrderedKey(std::get<2>(hit));
+      },
+      [](const Hit_t &hit) {
+        return uint16_t((std::get<0>(hit) << 8) | std::get<1>(hit));
+      });
+
+  for (size_t i = 0; i < hits.size(); i++) {
+    EXPECT_DOUBLE_EQ(std::get<2>(hits[i]), double(i));
+  }
+}
+
+TEST_F(HitSorterTest, IntegerTimestamps) {
+  // The L1 pipeline sorts RawHit_t by integer ps, negative after offsets
+  EXPECT_LT(Sorter_t::OrderedKey(int64_t(-1)),
+            Sorter_t::OrderedKey(int64_t(0)));
+  EXPECT_LT(Sorter_t::OrderedKey(kMinTimestamp),
+            Sorter_t::OrderedKey(kMaxTimestamp));
+
+  std::mt19937 rng(7);
+  std::vector<RawHit_t> hits;
+  for (int i = 0; i < 5000; i++) {
+    hits.emplace_back(false, rng() % 4, rng() % 16, 100, 50,
+                      Timestamp_t(rng() % 1000000) - 500000);
+  }
+  HitSorter<RawHit_t> hitSorter;
+  const auto method = hitSorter.Sort(
+      hits,
+      [](const RawHit_t &hit) {
+        return HitSorter<RawHit_t>::OrderedKey(hit.ts);
+      },
+      [](const RawHit_t &hit) { return uint16_t((hit.mod << 8) | hit.ch); });
+
+  EXPECT_EQ(method, HitSorter<RawHit_t>::Method::Radix);
+  EXPECT_TRUE(std::is_sorted(hits.begin(), hits.end(),
+                             [](const RawHit_t &a, const RawHit_t &b) {
+                               return a.ts < b.ts;
+                             }));
+}
@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+
+#include "L2Selector.hpp"
+
+#include <random>
+#include <vector>
+
+using namespace DELILA;
+
+//=============================================================================
+// L2Selector Tests
+//=============================================================================
+
+class L2SelectorTest : public ::testing::Test {
+ protected:
+  ChannelTable table;
+
+  void SetUp() override
+  {
+    // 2 modules x 4 channels
+    std::vector<std::vector<ChSettings_t>> settings(2);
+    for (uint32_t mod = 0; mod < 2; mod++) {
+      settings[mod].resize(4);
+      for (uint32_t ch = 0; ch < 4; ch++) {
+        settings[mod][ch].mod = mod;
+        settings[mod][ch].ch = ch;
+      }
+    }
+    table.Build(settings);
+  }
+
+  // "E" counts module 0, "dE" counts module 1, accept E >= 1 AND dE >= 1
+  L2Selector MakeSelector()
+  {
+    std::vector<std::vector<bool>> eTable = {{true, true, true, true},
+                                             {false, false, false, false}};
+    std::vector<std::vector<bool>> dETable = {{false, false, false, false},
+                                              {true, true, true, true}};
+    L2Counter e("E");
+    e.SetConditionTable(eTable);
+    L2Counter dE("dE");
+    dE.SetConditionTable(dETable);
+
+    std::vector<L2Flag> flags = {L2Flag("E_Flag", "E", ">=", 1),
+                                 L2Flag("dE_Flag", "dE", ">=", 1)};
+    std::vector<L2DataAcceptance> accept = {
+        L2DataAcceptance({"E_Flag", "dE_Flag"}, "AND")};
+    return L2Selector(table, {e, dE}, flags, accept);
+  }
+
+  static RawData_t Hit(uint8_t mod, uint8_t ch)
+  {
+    return RawData_t(false, mod, ch, 100, 50, 0.);
+  }
+};
+
+TEST_F(L2SelectorTest, AcceptsCoincidence) {
+  auto selector = MakeSelector();
+
+  EXPECT_TRUE(selector.Accept({Hit(0, 1), Hit(1, 2)}));
+}
+
+TEST_F(L2SelectorTest, RejectsSingleSide) {
+  auto selector = MakeSelector();
+
+  EXPECT_FALSE(selector.Accept({Hit(0, 1), Hit(0, 2)}));
+  EXPECT_FALSE(selector.Accept({Hit(1, 3)}));
+}
+
+TEST_F(L2SelectorTest, RejectsEmptyEvent) {
+  auto selector = MakeSelector();
+
+  EXPECT_FALSE(selector.Accept({}));
+}
+
+TEST_F(L2SelectorTest, UnknownChannelsAreIgnored) {
+  auto selector = MakeSelector();
+
+  // Module 5 is not in the channel table
+  EXPECT_FALSE(selector.Accept({Hit(0, 1), Hit(5, 0)}));
+}
+
+TEST_F(L2SelectorTest, CountersAreResetPerEvent) {
+  auto selector = MakeSelector();
+
+  EXPECT_TRUE(selector.Accept({Hit(0, 0), Hit(1, 0)}));
+  EXPECT_FALSE(selector.Accept({Hit(0, 0)}));
+}
+
+TEST_F(L2SelectorTest, CopiesAreIndependent) {
+  auto first = MakeSelector();
+  auto second = first;
+
+  EXPECT_TRUE(first.Accept({Hit(0, 0), Hit(1, 0)}));
+  EXPECT_FALSE(second.Accept({Hit(0, 0)}));
+  EXPECT_TRUE(first.Accept({Hit(0, 3), Hit(1, 3)}));
+}
+
+TEST_F(L2SelectorTest, IdenticalToConditionClasses) {
+  std::mt19937 rng(11);
+  std::bernoulli_distribution member(0.3);
+  std::uniform_int_distribution<int> modDist(0, 2);  // Module 2 is unknown
+  std::uniform_int_distribution<int> chDist(0, 3);
+  std::uniform_int_distribution<int> nHitsDist(0, 12);
+
+  std::vector<L2Counter> counters;
+  for (const auto &name : {"A", "B", "C", "A"}) {  // Duplicated name
+    std::vector<std::vector<bool>> conditionTable(2, std::vector<bool>(4));
+    for (auto &row : conditionTable) {
+      for (size_t ch = 0; ch < row.size(); ch++) row[ch] = member(rng);
+    }
+    L2Counter counter(name);
+    counter.SetConditionTable(conditionTable);
+    counters.push_back(counter);
+  }
+  std::vector<L2Flag> flags = {
+      L2Flag("F0", "A", ">=", 2),  L2Flag("F1", "B", "==", 0),
+      L2Flag("F2", "C", "<", 3),   L2Flag("F3", "B", "!=", 1),
+      L2Flag("F4", "C", "<=", -1), L2Flag("F5", "A", ">", 1),
+      L2Flag("F6", "None", ">=", 0), L2Flag("F7", "B", "=>", 1),
+      L2Flag("F1", "C", ">", 0)};  // Duplicated name
+  std::vector<L2DataAcceptance> accepts = {
+      L2DataAcceptance({"F0", "F1"}, "AND"),
+      L2DataAcceptance({"F2", "F3", "F4"}, "OR"),
+      L2DataAcceptance({"F5", "F6", "F7"}, "OR"),
+      L2DataAcceptance({"Unknown"}, "AND"),
+      L2DataAcceptance({"F0"}, "XOR")};
+
+  L2Selector selector(table, counters, flags, accepts);
+  for (int iEvent = 0; iEvent < 2000; iEvent++) {
+    std::vector<RawData_t> hits;
+    const auto nHits = nHitsDist(rng);
+    for (int i = 0; i < nHits; i++) {
+      hits.push_back(Hit(modDist(rng), chDist(rng)));
+    }
+
+    // The former per event evaluation of L2EventBuilder::ProcessData
+    auto expected = false;
+    if (!hits.empty()) {
+      for (auto &counter : counters) {
+        counter.ResetCounter();
+        for (auto &hit : hits) {
+          if (table.IsValid(hit.mod, hit.ch)) counter.Check(hit.mod, hit.ch);
+        }
+      }
+      for (auto &flag : flags) flag.Check(counters);
+      for (auto &accept : accepts) expected |= accept.Check(flags);
+    }
+
+    ASSERT_EQ(selector.Accept(hits), expected) << "event " << iEvent;
+  }
+}
+
+TEST_F(L2SelectorTest, MoreThan64Counters) {
+  // Counter i counts channel (i % 8), flags need two hits in the last one
+  std::vector<L2Counter> counters;
+  for (int i = 0; i < 130; i++) {
+    std::vector<std::vector<bool>> conditionTable(2, std::vector<bool>(4));
+    conditionTable[(i % 8) / 4][i % 4] = true;
+    L2Counter counter("C" + std::to_string(i));
+    counter.SetConditionTable(conditionTable);
+    counters.push_back(counter);
+  }
+  std::vector<L2Flag> flags = {L2Flag("F", "C129", "==", 2)};
+  std::vector<L2DataAcceptance> accepts = {L2DataAcceptance({"F"}, "AND")};
+  L2Selector selector(table, counters, flags, accepts);
+
+  // Counter 129 counts module 0 channel 1
+  EXPECT_TRUE(selector.Accept({Hit(0, 1), Hit(0, 1), Hit(1, 1)}));
+  EXPECT_FALSE(selector.Accept({Hit(0, 1), Hit(1, 1)}));
+}
+
+TEST_F(L2SelectorTest, ResultMovesToAnotherCopy) {
+  auto selector = MakeSelector();
+  auto bound = selector;
+  selector.Accept({Hit(0, 1), Hit(0, 2), Hit(1, 2)});
+
+  L2Result_t result;
+  selector.GetResult(result);
+  ASSERT_EQ(result.counters.size(), 2);
+  EXPECT_EQ(result.counters[0], 2);
+  EXPECT_EQ(result.counters[1], 1);
+  EXPECT_EQ(result.flags, std::vector<uint8_t>({1, 1}));
+
+  bound.SetResult(result);
+  L2Result_t copied;
+  bound.GetResult(copied);
+  EXPECT_EQ(copied.counters, result.counters);
+  EXPECT_EQ(copied.flags, result.flags);
+}
+
+TEST_F(L2SelectorTest, CountsFlagsAndAcceptance) {
+  auto selector = MakeSelector();
+
+  selector.Accept({Hit(0, 1), Hit(1, 2)});
+  selector.Accept({Hit(0, 1), Hit(0, 2)});
+  selector.Accept({});
+
+  EXPECT_EQ(selector.GetNumberOfEvaluated(), 3);
+  EXPECT_EQ(selector.GetNumberOfAccepted(), 1);
+  EXPECT_EQ(selector.GetFlagNames(),
+            (std::vector<std::string>{"E_Flag", "dE_Flag"}));
+  EXPECT_EQ(selector.GetFlagCounts(), (std::vector<uint64_t>{2, 1}));
+  // A fresh copy of the prototype starts from zero
+  EXPECT_EQ(MakeSelector().GetNumberOfEvaluated(), 0);
+}
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include "OutputSettings.hpp"
+
+#include <nlohmann/json.hpp>
+
+using namespace DELILA;
+
+//=============================================================================
+// OutputSettings Tests
+//=============================================================================
+
+TEST(OutputSettingsTest, DefaultsKeepROOTSettings) {
+  auto settings = OutputSettings::FromJSON(nlohmann::json::object());
+
+  EXPECT_EQ(settings.compression, CompressionType::Default);
+  EXPECT_EQ(settings.GetCompressionSettings(), -1);
+  EXPECT_EQ(settings.basketSize, 0);
+  EXPECT_EQ(settings.autoFlush, 0);
+}
+
+TEST(OutputSettingsTest, ParseAllKeys) {
+  nlohmann::json j = {{"Compression", "zstd"},
+                      {"CompressionLevel", 3},
+                      {"BasketSize", 1 << 20},
+                      {"AutoFlush", -50000000}};
+
+  auto settings = OutputSettings::FromJSON(j);
+
+  EXPECT_EQ(settings.compression, CompressionType::ZSTD);
+  EXPECT_EQ(settings.compressionLevel, 3);
+  EXPECT_EQ(settings.basketSize, 1 << 20);
+  EXPECT_EQ(settings.autoFlush, -50000000);
+  EXPECT_EQ(settings.GetCompressionSettings(), 503);
+}
+
+TEST(OutputSettingsTest, CompressionSettingsValues) {
+  OutputSettings settings;
+
+  settings.compression = CompressionType::None;
+  EXPECT_EQ(settings.GetCompressionSettings(), 0);
+
+  // Default level of each algorithm
+  settings.compression = CompressionType::ZLIB;
+  EXPECT_EQ(settings.GetCompressionSettings(), 101);
+  settings.compression = CompressionType::LZMA;
+  EXPECT_EQ(settings.GetCompressionSettings(), 207);
+  settings.compression = CompressionType::LZ4;
+  EXPECT_EQ(settings.GetCompressionSettings(), 404);
+  settings.compression = CompressionType::ZSTD;
+  EXPECT_EQ(settings.GetCompressionSettings(), 505);
+
+  settings.compressionLevel = 9;
+  EXPECT_EQ(settings.GetCompressionSettings(), 509);
+}
+
+TEST(OutputSettingsTest, JSONRoundTrip) {
+  OutputSettings settings;
+  settings.compression = CompressionType::LZ4;
+  settings.compressionLevel = 1;
+  settings.basketSize = 256000;
+  settings.autoFlush = 100000;
+
+  auto copy = OutputSettings::FromJSON(settings.ToJSON());
+
+  EXPECT_EQ(copy.compression, settings.compression);
+  EXPECT_EQ(copy.compressionLevel, settings.compressionLevel);
+  EXPECT_EQ(copy.basketSize, settings.basketSize);
+  EXPECT_EQ(copy.autoFlush, settings.autoFlush);
+}
+
+TEST(OutputSettingsTest, InvalidSettingsThrow) {
+  EXPECT_THROW(OutputSettings::FromJSON({{"Compression", "gzip"}}),
+               ConfigException);
+  EXPECT_THROW(OutputSettings::FromJSON({{"CompressionLevel", 12}}),
+               ConfigException);
+  EXPECT_THROW(OutputSettings::FromJSON({{"BasketSize", -1}}),
+               ConfigException);
+  EXPECT_THROW(OutputSettings::FromJSON({{"BasketSize", "large"}}),
+               ConfigException);
+  EXPECT_THROW(OutputSettings::FromJSON(nlohmann::json::array()),
+               ConfigException);
+}
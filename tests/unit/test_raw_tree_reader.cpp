@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+
+#include "RawTreeReader.hpp"
+#include "TFileRAII.hpp"
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <filesystem>
+#include <string>
+
+using namespace DELILA;
+
+//=============================================================================
+// RawTreeReader Tests
+//=============================================================================
+
+class RawTreeReaderTest : public ::testing::Test {
+ protected:
+  std::string testFileName = "test_raw_tree_reader.root";
+  static constexpr Long64_t nEntries = 25000;
+
+  void SetUp() override
+  {
+    // Small ELIADE_Tree with several clusters and baskets per branch
+    TFile *f = new TFile(testFileName.c_str(), "RECREATE");
+    TTree *tree = new TTree("ELIADE_Tree", "Raw data");
+    UChar_t mod, ch;
+    Double_t fineTS;
+    UShort_t chargeLong, chargeShort;
+    ULong64_t timeStamp;
+    UInt_t recordLength;
+    tree->Branch("Mod", &mod, "Mod/b");
+    tree->Branch("Ch", &ch, "Ch/b");
+    tree->Branch("FineTS", &fineTS, "FineTS/D");
+    tree->Branch("ChargeLong", &chargeLong, "ChargeLong/s");
+    tree->Branch("ChargeShort", &chargeShort, "ChargeShort/s");
+    tree->Branch("TimeStamp", &timeStamp, "TimeStamp/l");
+    tree->Branch("RecordLength", &recordLength, "RecordLength/i");
+    tree->SetAutoFlush(4000);
+    for (Long64_t i = 0; i < nEntries; i++) {
+      mod = i % 7;
+      ch = i % 16;
+      fineTS = i * 1000.5;
+      chargeLong = i % 60000;
+      chargeShort = (i * 3) % 60000;
+      timeStamp = i * 1000;
+      recordLength = i % 3 * 100;
+      tree->Fill();
+    }
+    tree->Write();
+    f->Close();
+    delete f;
+  }
+
+  void TearDown() override
+  {
+    if (std::filesystem::exists(testFileName)) {
+      std::filesystem::remove(testFileName);
+    }
+  }
+
+  static void CheckBlock(const RawColumns &block)
+  {
+    for (size_t i = 0; i < block.size(); i++) {
+      const auto entry = block.firstEntry + Long64_t(i);
+      ASSERT_EQ(block.mod[i], entry % 7);
+      ASSERT_EQ(block.ch[i], entry % 16);
+      ASSERT_DOUBLE_EQ(block.fineTS[i], entry * 1000.5);
+      ASSERT_EQ(block.chargeLong[i], entry % 60000);
+      ASSERT_EQ(block.chargeShort[i], (entry * 3) % 60000);
+    }
+  }
+
+  // Reads [first, last) and checks continuity and contents
+  static Long64_t ReadAll(RawTreeReader &reader, Long64_t first)
+  {
+    RawColumns block;
+    Long64_t next = first;
+    while (reader.Next(block)) {
+      EXPECT_EQ(block.firstEntry, next);
+      CheckBlock(block);
+      next += block.size();
+    }
+    return next;
+  }
+};
+
+TEST_F(RawTreeReaderTest, ReadsAllEntries) {
+  auto file = MakeTFile(testFileName.c_str(), "READ");
+  auto tree = static_cast<TTree *>(file->Get("ELIADE_Tree"));
+  ASSERT_NE(tree, nullptr);
+
+  RawTreeReader reader(tree);
+  EXPECT_EQ(reader.GetEntries(), nEntries);
+  EXPECT_EQ(ReadAll(reader, 0), nEntries);
+}
+
+TEST_F(RawTreeReaderTest, RangeStartsInsideBasket) {
+  auto file = MakeTFile(testFileName.c_str(), "READ");
+  auto tree = static_cast<TTree *>(file->Get("ELIADE_Tree"));
+
+  RawTreeReader reader(tree);
+  reader.SetRange(1234, 17777);
+  EXPECT_EQ(ReadAll(reader, 1234), 17777);
+}
+
+TEST_F(RawTreeReaderTest, PrefetchGivesSameResult) {
+  auto file = MakeTFile(testFileName.c_str(), "READ");
+  auto tree = static_cast<TTree *>(file->Get("ELIADE_Tree"));
+
+  RawTreeReader reader(tree);
+  reader.SetPrefetch(true);
+  reader.SetRange(10, nEntries);
+  EXPECT_EQ(ReadAll(reader, 10), nEntries);
+}
+
+TEST_F(RawTreeReaderTest, SelectedColumnsOnly) {
+  auto file = MakeTFile(testFileName.c_str(), "READ");
+  auto tree = static_cast<TTree *>(file->Get("ELIADE_Tree"));
+
+  RawTreeReader reader(tree, RawTreeReader::kFineTS);
+  RawColumns block;
+  Long64_t n = 0;
+  while (reader.Next(block)) {
+    EXPECT_TRUE(block.mod.empty());
+    EXPECT_EQ(block.fineTS.size(), block.size());
+    n += block.size();
+  }
+  EXPECT_EQ(n, nEntries);
+}
+
+TEST_F(RawTreeReaderTest, TimeStampAndRecordLengthOnRequest) {
+  auto file = MakeTFile(testFileName.c_str(), "READ");
+  auto tree = static_cast<TTree *>(file->Get("ELIADE_Tree"));
+
+  RawTreeReader hits(tree);
+  RawColumns block;
+  ASSERT_TRUE(hits.Next(block));
+  EXPECT_TRUE(block.timeStamp.empty());
+  EXPECT_TRUE(block.recordLength.empty());
+
+  RawTreeReader reader(tree, RawTreeReader::kAll);
+  Long64_t n = 0;
+  while (reader.Next(block)) {
+    CheckBlock(block);
+    for (size_t i = 0; i < block.size(); i++) {
+      const auto entry = block.firstEntry + Long64_t(i);
+      ASSERT_EQ(block.timeStamp[i], ULong64_t(entry * 1000));
+      ASSERT_EQ(block.recordLength[i], UInt_t(entry % 3 * 100));
+    }
+    n += block.size();
+  }
+  EXPECT_EQ(n, nEntries);
+}
+
+TEST_F(RawTreeReaderTest, RangeBeyondEndIsClamped) {
+  auto file = MakeTFile(testFileName.c_str(), "READ");
+  auto tree = static_cast<TTree *>(file->Get("ELIADE_Tree"));
+
+  RawTreeReader reader(tree);
+  reader.SetRange(nEntries - 5, nEntries + 100);
+  EXPECT_EQ(ReadAll(reader, nEntries - 5), nEntries);
+
+  RawTreeReader empty(tree);
+  empty.SetRange(nEntries, nEntries + 10);
+  RawColumns block;
+  EXPECT_FALSE(empty.Next(block));
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+
+#include "RunCatalog.hpp"
+#include "TempDirTest.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+using namespace DELILA;
+
+//=============================================================================
+// RunCatalog Tests
+//=============================================================================
+
+class RunCatalogTest : public TempDirTest {
+ protected:
+  void Touch(const std::string &name, const std::string &content = "")
+  {
+    std::ofstream ofs(dir / name);
+    ofs << content;
+  }
+};
+
+TEST_F(RunCatalogTest, ParseFileName) {
+  uint32_t run = 0;
+  uint32_t version = 0;
+
+  EXPECT_TRUE(RunCatalog::ParseFileName("run0012_0003_eliade.root", run,
+                                        version));
+  EXPECT_EQ(run, 12);
+  EXPECT_EQ(version, 3);
+
+  EXPECT_TRUE(RunCatalog::ParseFileName("data_run7_15_x.root", run, version));
+  EXPECT_EQ(run, 7);
+  EXPECT_EQ(version, 15);
+
+  EXPECT_FALSE(RunCatalog::ParseFileName("run0012_0003_eliade.txt", run,
+                                         version));
+  EXPECT_FALSE(RunCatalog::ParseFileName("run0012.root", run, version));
+  EXPECT_FALSE(RunCatalog::ParseFileName("run_0012_0003_.root", run, version));
+}
+
+TEST_F(RunCatalogTest, VersionRangeInOrder) {
+  Touch("run0001_0002_a.root");
+  Touch("run0001_0000_a.root");
+  Touch("run0001_0001_a.root");
+  Touch("run0002_0001_a.root");
+  Touch("run0001_0003_a.txt");
+  Touch("notes.root");
+
+  RunCatalog catalog;
+  ASSERT_TRUE(catalog.Scan(dir.string()));
+  EXPECT_EQ(catalog.Size(), 4);
+
+  auto files = catalog.GetFileList(1, 0, 999);
+  ASSERT_EQ(files.size(), 3);
+  EXPECT_EQ(std::filesystem::path(files[0]).filename(), "run0001_0000_a.root");
+  EXPECT_EQ(std::filesystem::path(files[2]).filename(), "run0001_0002_a.root");
+
+  EXPECT_EQ(catalog.GetFileList(1, 1, 1).size(), 1);
+  EXPECT_TRUE(catalog.GetFileList(3, 0, 999).empty());
+}
+
+TEST_F(RunCatalogTest, DuplicateVersionUsesFirstPath) {
+  Touch("run0001_0000_b.root");
+  Touch("run0001_0000_a.root");
+
+  RunCatalog catalog;
+  catalog.Scan(dir.string());
+  auto files = catalog.GetFileList(1, 0, 0);
+
+  ASSERT_EQ(files.size(), 1);
+  EXPECT_EQ(std::filesystem::path(files[0]).filename(), "run0001_0000_a.root");
+}
+
+TEST_F(RunCatalogTest, MissingDirectory) {
+  RunCatalog catalog;
+  EXPECT_FALSE(catalog.Scan((dir / "missing").string()));
+  EXPECT_EQ(catalog.Size(), 0);
+}
+
+TEST_F(RunCatalogTest, NumberedFilesStopAtGap) {
+  Touch("L1_0.root");
+  Touch("L1_1.root");
+  Touch("L1_3.root");
+  Touch("L1_x.root");
+  Touch("L2_2.root");
+
+  auto files = RunCatalog::FindNumberedFiles(dir.string(), "L1");
+
+  ASSERT_EQ(files.size(), 2);
+  EXPECT_EQ(std::filesystem::path(files[1]).filename(), "L1_1.root");
+}
+
+TEST_F(RunCatalogTest, CacheIsValidatedBySize) {
+  Touch("run0001_0000_a.root", "abc");
+  Touch("run0001_0001_a.root", "abcd");
+  const auto cacheName = (dir / "cache.json").string();
+
+  RunCatalog catalog;
+  catalog.Scan(dir.string());
+  auto files = catalog.GetFiles(1, 0, 1);
+  ASSERT_EQ(files.size(), 2);
+  nlohmann::json j;
+  for (const auto *info : files) {
+    j[info->path] = {{"FileSize", info->fileSize}, {"ModTime", info->modTime},
+                     {"Entries", 100},             {"FirstTS", 1.},
+                     {"LastTS", 2.}};
+  }
+  j[files[1]->path]["FileSize"] = 1;  // Changed since it was cached
+  std::ofstream(cacheName) << j.dump();
+
+  catalog.LoadCache(cacheName);
+
+  EXPECT_EQ(files[0]->entries, 100);
+  EXPECT_EQ(files[0]->lastTS, 2.);
+  EXPECT_EQ(files[1]->entries, -1);
+}
+
+TEST_F(RunCatalogTest, FindRestarts) {
+  const auto info = [](int64_t entries, double_t firstTS, double_t lastTS) {
+    RunFileInfo_t file;
+    file.entries = entries;
+    file.firstTS = firstTS;
+    file.lastTS = lastTS;
+    return file;
+  };
+  std::vector<RunFileInfo_t> infos = {info(10, 0., 100e9),
+                                      info(10, 95e9, 200e9),
+                                      info(10, 1e9, 50e9),
+                                      info(0, 0., 0.)};  // Empty, skipped
+  std::vector<RunFileInfo_t *> files;
+  for (auto &file : infos) files.push_back(&file);
+
+  auto restarts = RunCatalog::FindRestarts(files);
+
+  ASSERT_EQ(restarts.size(), 1);
+  EXPECT_EQ(restarts[0], 2);
+}
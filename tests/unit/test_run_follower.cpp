@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+
+#include "RunFollower.hpp"
+#include "TempDirTest.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+using namespace DELILA;
+
+//=============================================================================
+// RunFollower Tests
+//=============================================================================
+
+class RunFollowerTest : public TempDirTest {
+ protected:
+  void Touch(const std::string &name, const std::string &content = "")
+  {
+    std::ofstream ofs(dir / name, std::ios::app);
+    ofs << content;
+  }
+
+  static std::vector<uint32_t> Versions(
+      const std::vector<RunFileInfo_t> &files)
+  {
+    std::vector<uint32_t> versions;
+    for (const auto &file : files) {
+      versions.push_back(file.version);
+    }
+    return versions;
+  }
+};
+
+TEST_F(RunFollowerTest, NewerVersionClosesOlderOnes) {
+  RunFollower follower(dir.string(), 1, 0, 100);
+
+  EXPECT_TRUE(follower.Poll().empty());
+  Touch("run0001_0000_a.root", "x");
+  // Only version, still written
+  EXPECT_TRUE(follower.Poll().empty());
+
+  Touch("run0001_0001_a.root", "x");
+  Touch("run0001_0002_a.root", "x");
+  EXPECT_EQ(Versions(follower.Poll()), (std::vector<uint32_t>{0, 1}));
+  // Handed out once
+  EXPECT_TRUE(follower.Poll().empty());
+  EXPECT_FALSE(follower.IsFinished());
+
+  Touch("run0001_0003_a.root", "x");
+  const auto closed = follower.Poll();
+  EXPECT_EQ(Versions(closed), (std::vector<uint32_t>{2}));
+  EXPECT_EQ(closed[0].run, 1);
+  EXPECT_EQ(closed[0].entries, -1);
+}
+
+TEST_F(RunFollowerTest, LaterRunEndsTheRun) {
+  RunFollower follower(dir.string(), 1, 0, 100);
+  Touch("run0001_0000_a.root", "x");
+  Touch("run0001_0001_a.root", "x");
+  EXPECT_EQ(Versions(follower.Poll()), (std::vector<uint32_t>{0}));
+
+  Touch("run0002_0000_a.root", "x");
+  EXPECT_EQ(Versions(follower.Poll()), (std::vector<uint32_t>{1}));
+  EXPECT_TRUE(follower.IsFinished());
+  EXPECT_TRUE(follower.Poll().empty());
+}
+
+TEST_F(RunFollowerTest, EndVersionEndsTheRun) {
+  RunFollower follower(dir.string(), 1, 1, 2);
+  Touch("run0001_0000_a.root", "x");
+  Touch("run0001_0001_a.root", "x");
+  Touch("run0001_0002_a.root", "x");
+  Touch("run0001_0003_a.root", "x");
+
+  EXPECT_EQ(Versions(follower.Poll()), (std::vector<uint32_t>{1, 2}));
+  EXPECT_TRUE(follower.IsFinished());
+}
+
+TEST_F(RunFollowerTest, IdleTimeoutClosesTheLastVersion) {
+  RunFollower follower(dir.string(), 1, 0, 100);
+  follower.SetPollInterval(0.01);
+  follower.SetIdleTimeout(0.1);
+  Touch("run0001_0000_a.root", "x");
+
+  std::atomic<bool> cancelled{false};
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(Versions(follower.Next(cancelled)), (std::vector<uint32_t>{0}));
+  EXPECT_GE(std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          start)
+                .count(),
+            0.09);
+  EXPECT_TRUE(follower.IsFinished());
+  EXPECT_TRUE(follower.Next(cancelled).empty());
+}
+
+TEST_F(RunFollowerTest, CancelStopsWaiting) {
+  RunFollower follower(dir.string(), 1, 0, 100);
+  follower.SetPollInterval(10.);
+  Touch("run0001_0000_a.root", "x");
+
+  std::atomic<bool> cancelled{false};
+  std::thread stopper([&cancelled] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    cancelled.store(true);
+  });
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_TRUE(follower.Next(cancelled).empty());
+  stopper.join();
+  EXPECT_LT(std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          start)
+                .count(),
+            2.);
+  EXPECT_FALSE(follower.IsFinished());
+}
+
+TEST_F(RunFollowerTest, InvalidIntervals) {
+  RunFollower follower(dir.string(), 1, 0, 100);
+  EXPECT_THROW(follower.SetPollInterval(0.), ValidationException);
+  EXPECT_THROW(follower.SetIdleTimeout(-1.), ValidationException);
+}
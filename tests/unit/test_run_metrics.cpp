@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+
+#include "RunMetrics.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace DELILA;
+
+//=============================================================================
+// RunMetrics Tests
+//=============================================================================
+
+class RunMetricsTest : public ::testing::Test {
+ protected:
+  std::string reportFileName = "test_run_metrics.json";
+  std::string liveFileName = "test_run_metrics_live.jsonl";
+
+  void TearDown() override
+  {
+    for (const auto &name : {reportFileName, liveFileName}) {
+      if (std::filesystem::exists(name)) {
+        std::filesystem::remove(name);
+      }
+    }
+  }
+};
+
+TEST_F(RunMetricsTest, TotalsSumThreadsAndTakeLongestWallTime) {
+  RunMetrics metrics;
+  auto &first = metrics.GetStage("build", 0);
+  auto &second = metrics.GetStage("build", 1);
+  first.events.Add(10);
+  second.events.Add(5);
+  first.busyTime.Add(1.5);
+  second.busyTime.Add(0.5);
+  first.wallTime.Set(2.);
+  second.wallTime.Set(3.);
+
+  const auto total = metrics.GetTotal("build");
+  EXPECT_EQ(total["events"].get<uint64_t>(), 15);
+  EXPECT_DOUBLE_EQ(total["busyTime"].get<double>(), 2.);
+  EXPECT_DOUBLE_EQ(total["wallTime"].get<double>(), 3.);
+  EXPECT_EQ(&metrics.GetStage("build", 1), &second);
+}
+
+TEST_F(RunMetricsTest, UnknownStageHasZeroTotals) {
+  RunMetrics metrics;
+
+  const auto total = metrics.GetTotal("read");
+  EXPECT_EQ(total["entries"].get<uint64_t>(), 0);
+  EXPECT_FALSE(metrics.Snapshot()["stages"].contains("read"));
+}
+
+TEST_F(RunMetricsTest, OneEntryPerCallingThread) {
+  RunMetrics metrics;
+  auto &own = metrics.GetStage("read");
+  EXPECT_EQ(&metrics.GetStage("read"), &own);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 3; i++) {
+    threads.emplace_back([&metrics] {
+      for (int k = 0; k < 1000; k++) {
+        metrics.GetStage("read").hits.Add(1);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  const auto snapshot = metrics.Snapshot();
+  EXPECT_EQ(snapshot["stages"]["read"]["threadCount"].get<size_t>(), 4);
+  EXPECT_EQ(snapshot["stages"]["read"]["total"]["hits"].get<uint64_t>(),
+            3000);
+}
+
+TEST_F(RunMetricsTest, ScopedTimerAddsElapsedTime) {
+  RunMetrics metrics;
+  auto &stage = metrics.GetStage("fit", 0);
+  {
+    ScopedTimer timer(stage.busyTime);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+
+  EXPECT_GE(stage.busyTime.Get(), 0.015);
+}
+
+TEST_F(RunMetricsTest, QueueDepthIsSampled) {
+  RunMetrics metrics;
+  std::atomic<size_t> depth{3};
+  metrics.Start();
+  {
+    auto watch = metrics.WatchQueue(
+        "slices", [&depth] { return depth.load(); }, 8);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    depth.store(7);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    depth.store(1);
+  }
+  // The watch is gone, later depths are not read
+  depth.store(100);
+  metrics.Stop();
+
+  const auto queue = metrics.ToJSON()["queues"]["slices"];
+  EXPECT_EQ(queue["max"].get<size_t>(), 7);
+  EXPECT_EQ(queue["depth"].get<size_t>(), 1);
+  EXPECT_EQ(queue["capacity"].get<size_t>(), 8);
+  EXPECT_GT(queue["mean"].get<double>(), 1.);
+  EXPECT_LT(queue["mean"].get<double>(), 7.);
+}
+
+TEST_F(RunMetricsTest, L2CountsAreSummedByName) {
+  RunMetrics metrics;
+  metrics.AddL2Counts(10, 4, {"E_Flag", "dE_Flag"}, {6, 5});
+  metrics.AddL2Counts(20, 8, {"E_Flag", "dE_Flag"}, {12, 9});
+
+  const auto l2 = metrics.ToJSON()["l2"];
+  EXPECT_EQ(l2["evaluated"].get<uint64_t>(), 30);
+  EXPECT_EQ(l2["accepted"].get<uint64_t>(), 12);
+  EXPECT_EQ(l2["flags"]["E_Flag"].get<uint64_t>(), 18);
+  EXPECT_EQ(l2["flags"]["dE_Flag"].get<uint64_t>(), 14);
+}
+
+TEST_F(RunMetricsTest, ReportRoundTrip) {
+  RunMetrics metrics;
+  metrics.SetMode("L1");
+  metrics.SetConfig({{"CoincidenceWindow", 500.}});
+  metrics.Start();
+  auto &read = metrics.GetStage("read", 0);
+  read.entries.Add(1000);
+  read.bytesIn.Add(4096);
+  metrics.Stop();
+  metrics.WriteReport(reportFileName);
+
+  std::ifstream file(reportFileName);
+  ASSERT_TRUE(file.is_open());
+  nlohmann::json report;
+  file >> report;
+  EXPECT_EQ(report["mode"], "L1");
+  EXPECT_TRUE(report["final"].get<bool>());
+  EXPECT_GE(report["wallTime"].get<double>(), 0.);
+  EXPECT_EQ(report["config"]["CoincidenceWindow"].get<double>(), 500.);
+  EXPECT_EQ(report["stages"]["read"]["total"]["entries"].get<uint64_t>(),
+            1000);
+  ASSERT_EQ(report["stages"]["read"]["threads"].size(), 1);
+  EXPECT_EQ(report["stages"]["read"]["threads"][0]["bytesIn"].get<uint64_t>(),
+            4096);
+  // Every stage has the same keys
+  EXPECT_TRUE(report["stages"]["read"]["total"].contains("fillTime"));
+}
+
+TEST_F(RunMetricsTest, LiveSnapshotsAreJSONLines) {
+  RunMetrics metrics;
+  metrics.SetMode("L2");
+  metrics.SetLive(liveFileName, 0.02);
+  metrics.Start();
+  metrics.GetStage("l2", 0).events.Add(42);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  metrics.Stop();
+
+  std::ifstream file(liveFileName);
+  ASSERT_TRUE(file.is_open());
+  std::vector<nlohmann::json> snapshots;
+  for (std::string line; std::getline(file, line);) {
+    snapshots.push_back(nlohmann::json::parse(line));
+  }
+  ASSERT_GE(snapshots.size(), 2);
+  EXPECT_FALSE(snapshots.front()["final"].get<bool>());
+  EXPECT_TRUE(snapshots.back()["final"].get<bool>());
+  EXPECT_EQ(snapshots.back()["mode"], "L2");
+  EXPECT_EQ(
+      snapshots.back()["stages"]["l2"]["total"]["events"].get<uint64_t>(),
+      42);
+}
+
+TEST_F(RunMetricsTest, InvalidLiveSettings) {
+  RunMetrics metrics;
+  EXPECT_THROW(metrics.SetLive(liveFileName, 0.), ValidationException);
+
+  metrics.SetLive("udp://no-port");
+  EXPECT_THROW(metrics.Start(), ConfigException);
+}
+
+TEST_F(RunMetricsTest, UDPTarget) {
+  RunMetrics metrics;
+  metrics.SetLive("udp://127.0.0.1:9", 0.02);
+
+  EXPECT_NO_THROW(metrics.Start());
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_NO_THROW(metrics.Stop());
+}
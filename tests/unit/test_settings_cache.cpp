@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+
+#include "ChSettings.hpp"
+#include "SettingsCache.hpp"
+#include "TempDirTest.hpp"
+#include "TimeSettings.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+using namespace DELILA;
+
+//=============================================================================
+// SettingsCache / ChSettings / TimeSettings Tests
+//=============================================================================
+
+class SettingsCacheTest : public TempDirTest {
+ protected:
+  std::string chFileName;
+  std::string timeFileName;
+
+  void SetUp() override
+  {
+    TempDirTest::SetUp();
+    chFileName = (dir / "chSettings.json").string();
+    timeFileName = (dir / "timeSettings.json").string();
+    SettingsCache::SetEnabled(true);
+  }
+  void TearDown() override
+  {
+    SettingsCache::SetEnabled(true);
+    TempDirTest::TearDown();
+  }
+
+  // [refMod][refCh][mod][ch], offset = 1000 refMod + 100 refCh + 10 mod + ch
+  void WriteTimeSettings(const std::vector<uint32_t> &nChs)
+  {
+    nlohmann::json j = nlohmann::json::array();
+    for (uint32_t rm = 0; rm < nChs.size(); rm++) {
+      nlohmann::json refMod = nlohmann::json::array();
+      for (uint32_t rc = 0; rc < nChs[rm]; rc++) {
+        nlohmann::json row = nlohmann::json::array();
+        for (uint32_t m = 0; m < nChs.size(); m++) {
+          nlohmann::json mod = nlohmann::json::array();
+          for (uint32_t c = 0; c < nChs[m]; c++) {
+            mod.push_back({{"TimeOffset", 1000. * rm + 100. * rc + 10. * m + c}});
+          }
+          row.push_back(mod);
+        }
+        refMod.push_back(row);
+      }
+      j.push_back(refMod);
+    }
+    std::ofstream ofs(timeFileName);
+    ofs << j.dump() << std::endl;
+  }
+};
+
+TEST_F(SettingsCacheTest, CacheFileNameReplacesExtension) {
+  EXPECT_EQ(SettingsCache::GetCacheFileName("chSettings.json"),
+            "chSettings.bin");
+  EXPECT_EQ(SettingsCache::GetCacheFileName("conf/timeSettings.json"),
+            "conf/timeSettings.bin");
+}
+
+TEST_F(SettingsCacheTest, HashFollowsTheContent) {
+  EXPECT_EQ(SettingsCache::Hash("{\"a\": 1}"), SettingsCache::Hash("{\"a\": 1}"));
+  EXPECT_NE(SettingsCache::Hash("{\"a\": 1}"), SettingsCache::Hash("{\"a\": 2}"));
+  // Only the tail differs, and a longer content of the same words
+  EXPECT_NE(SettingsCache::Hash("12345678a"), SettingsCache::Hash("12345678b"));
+  EXPECT_NE(SettingsCache::Hash("12345678"),
+            SettingsCache::Hash(std::string("12345678\0", 9)));
+}
+
+TEST_F(SettingsCacheTest, ChSettingsFromTheCache) {
+  ChSettings::GenerateTemplate({3, 2}, chFileName);
+  const auto fromJSON = ChSettings::GetChSettings(chFileName);
+  ASSERT_TRUE(std::filesystem::exists(dir / "chSettings.bin"));
+
+  const auto fromCache = ChSettings::GetChSettings(chFileName);
+  ASSERT_EQ(fromCache.size(), 2);
+  ASSERT_EQ(fromCache[0].size(), 3);
+  ASSERT_EQ(fromCache[1].size(), 2);
+  for (size_t m = 0; m < fromJSON.size(); m++) {
+    for (size_t c = 0; c < fromJSON[m].size(); c++) {
+      EXPECT_EQ(fromCache[m][c].ID, fromJSON[m][c].ID);
+      EXPECT_EQ(fromCache[m][c].mod, m);
+      EXPECT_EQ(fromCache[m][c].ch, c);
+      EXPECT_EQ(fromCache[m][c].thresholdADC, fromJSON[m][c].thresholdADC);
+      EXPECT_EQ(fromCache[m][c].ACMod, fromJSON[m][c].ACMod);
+      EXPECT_DOUBLE_EQ(fromCache[m][c].p1, fromJSON[m][c].p1);
+      EXPECT_EQ(fromCache[m][c].tags, fromJSON[m][c].tags);
+    }
+  }
+}
+
+TEST_F(SettingsCacheTest, EditedJSONIsParsedAgain) {
+  ChSettings::GenerateTemplate({2}, chFileName);
+  ChSettings::GetChSettings(chFileName);
+
+  // Same sizes, other values
+  std::ifstream ifs(chFileName);
+  auto j = nlohmann::json::parse(ifs);
+  ifs.close();
+  j[0][1]["Tags"] = {"Si", "dE"};
+  j[0][1]["p1"] = 2.5;
+  j[0][0]["IsEventTrigger"] = true;
+  std::ofstream(chFileName) << j.dump(4) << std::endl;
+
+  const auto chSettings = ChSettings::GetChSettings(chFileName);
+  ASSERT_EQ(chSettings.size(), 1);
+  EXPECT_TRUE(chSettings[0][0].isEventTrigger);
+  EXPECT_DOUBLE_EQ(chSettings[0][1].p1, 2.5);
+  EXPECT_EQ(chSettings[0][1].tags, (std::vector<std::string>{"Si", "dE"}));
+  // And the rewritten cache gives the same
+  EXPECT_EQ(ChSettings::GetChSettings(chFileName)[0][1].tags,
+            chSettings[0][1].tags);
+}
+
+TEST_F(SettingsCacheTest, CorruptCacheFallsBackToTheJSON) {
+  ChSettings::GenerateTemplate({4}, chFileName);
+  ChSettings::GetChSettings(chFileName);
+  const auto cacheName = dir / "chSettings.bin";
+  std::filesystem::resize_file(cacheName,
+                               std::filesystem::file_size(cacheName) - 3);
+
+  const auto chSettings = ChSettings::GetChSettings(chFileName);
+  ASSERT_EQ(chSettings.size(), 1);
+  EXPECT_EQ(chSettings[0].size(), 4);
+  EXPECT_EQ(chSettings[0][3].ID, 3);
+}
+
+TEST_F(SettingsCacheTest, DisabledCacheIsNotWritten) {
+  SettingsCache::SetEnabled(false);
+  ChSettings::GenerateTemplate({2}, chFileName);
+  EXPECT_EQ(ChSettings::GetChSettings(chFileName).size(), 1);
+  EXPECT_FALSE(std::filesystem::exists(dir / "chSettings.bin"));
+}
+
+TEST_F(SettingsCacheTest, TimeSettingsRowFromJSONAndCache) {
+  WriteTimeSettings({3, 2});
+
+  TimeSettings fromJSON;
+  fromJSON.Load(timeFileName);
+  ASSERT_TRUE(std::filesystem::exists(dir / "timeSettings.bin"));
+  TimeSettings fromCache;
+  fromCache.Load(timeFileName);
+
+  for (auto *settings : {&fromJSON, &fromCache}) {
+    EXPECT_EQ(settings->GetNumberOfModules(), 2);
+    EXPECT_EQ(settings->GetNumberOfChannels(0), 3);
+    EXPECT_EQ(settings->GetNumberOfChannels(1), 2);
+    EXPECT_EQ(settings->GetNumberOfChannels(2), 0);
+    for (uint32_t rm = 0; rm < 2; rm++) {
+      for (uint32_t rc = 0; rc < settings->GetNumberOfChannels(rm); rc++) {
+        const auto offsets = settings->GetOffsets(rm, rc);
+        ASSERT_EQ(offsets.size(), 2);
+        ASSERT_EQ(offsets[0].size(), 3);
+        ASSERT_EQ(offsets[1].size(), 2);
+        for (uint32_t m = 0; m < 2; m++) {
+          for (uint32_t c = 0; c < offsets[m].size(); c++) {
+            // The reference channel has no offset
+            const auto expected =
+                (rm == m && rc == c) ? 0. : 1000. * rm + 100. * rc + 10. * m + c;
+            EXPECT_DOUBLE_EQ(offsets[m][c], expected);
+          }
+        }
+      }
+    }
+    EXPECT_THROW(settings->GetOffsets(1, 2), RangeException);
+    EXPECT_THROW(settings->GetOffsets(2, 0), RangeException);
+  }
+}
+
+TEST_F(SettingsCacheTest, TimeSettingsErrors) {
+  TimeSettings settings;
+  EXPECT_THROW(settings.Load(timeFileName), FileException);
+
+  std::ofstream(timeFileName) << "[[[" << std::endl;
+  EXPECT_THROW(settings.Load(timeFileName), JSONException);
+  std::ofstream(timeFileName) << "[]" << std::endl;
+  EXPECT_THROW(settings.Load(timeFileName), ConfigException);
+
+  // A cache cut within the rows: the header is read, the row is not
+  WriteTimeSettings({2, 2});
+  settings.Load(timeFileName);
+  const auto cacheName = dir / "timeSettings.bin";
+  std::filesystem::resize_file(cacheName,
+                               std::filesystem::file_size(cacheName) - 8);
+  TimeSettings truncated;
+  truncated.Load(timeFileName);
+  EXPECT_NO_THROW(truncated.GetOffsets(0, 0));
+  EXPECT_THROW(truncated.GetOffsets(1, 1), FileException);
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include "ShardPlan.hpp"
+#include "TempDirTest.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+using namespace DELILA;
+
+//=============================================================================
+// ShardPlan Tests
+//=============================================================================
+
+class ShardPlanTest : public TempDirTest {
+ protected:
+  std::vector<RunFileInfo_t> infos;
+
+  void SetUp() override
+  {
+    TempDirTest::SetUp();
+    EnterDir();
+  }
+
+  // One version per entry of firstTS [ns], 100 ns long, 1000 entries
+  void MakeFiles(const std::vector<double> &firstTS)
+  {
+    infos.clear();
+    for (size_t i = 0; i < firstTS.size(); i++) {
+      RunFileInfo_t info;
+      info.path = "run0001_" + std::to_string(i) + "_a.root";
+      info.run = 1;
+      info.version = i;
+      info.entries = 1000;
+      info.firstTS = firstTS[i];
+      info.lastTS = firstTS[i] + 100.;
+      infos.push_back(info);
+    }
+  }
+  std::vector<RunFileInfo_t *> Pointers()
+  {
+    std::vector<RunFileInfo_t *> files;
+    for (auto &info : infos) {
+      files.push_back(&info);
+    }
+    return files;
+  }
+
+  void Touch(const std::filesystem::path &name)
+  {
+    if (name.has_parent_path()) {
+      std::filesystem::create_directories(name.parent_path());
+    }
+    std::ofstream(name) << "x";
+  }
+};
+
+TEST_F(ShardPlanTest, CutsShareTheirTimeAndHaveGuardFiles) {
+  MakeFiles({0., 100., 200., 300., 400., 500.});
+
+  const auto plan = ShardPlan::Make(Pointers(), 3, 10.);
+  const auto &shards = plan.GetShards();
+  ASSERT_EQ(shards.size(), 3);
+
+  EXPECT_EQ(shards[0].startTS, kMinTimestamp);
+  EXPECT_EQ(shards[0].endTS, NsToTimestamp(200.));
+  EXPECT_EQ(shards[1].startTS, shards[0].endTS);
+  EXPECT_EQ(shards[1].endTS, NsToTimestamp(400.));
+  EXPECT_EQ(shards[2].startTS, shards[1].endTS);
+  EXPECT_EQ(shards[2].endTS, kMaxTimestamp);
+
+  // Owned files plus the neighbour on every cut side
+  EXPECT_EQ(shards[0].files.size(), 3);
+  EXPECT_EQ(shards[0].firstOwned, 0);
+  EXPECT_EQ(shards[1].files.size(), 4);
+  EXPECT_EQ(shards[1].firstOwned, 1);
+  EXPECT_EQ(shards[1].nOwned, 2);
+  EXPECT_EQ(std::filesystem::path(shards[1].files[1]).filename(),
+            "run0001_2_a.root");
+  EXPECT_TRUE(std::filesystem::path(shards[1].files[1]).is_absolute());
+  EXPECT_EQ(shards[2].files.size(), 3);
+}
+
+TEST_F(ShardPlanTest, WideGuardTakesMoreFiles) {
+  MakeFiles({0., 100., 200., 300., 400., 500.});
+
+  // 250 ns around the cut at 300 ns reach the end of version 0 and the
+  // start of version 5
+  const auto plan = ShardPlan::Make(Pointers(), 2, 250.);
+  const auto &shards = plan.GetShards();
+  ASSERT_EQ(shards.size(), 2);
+  EXPECT_EQ(shards[0].nOwned, 3);
+  EXPECT_EQ(shards[0].files.size(), 6);
+  EXPECT_EQ(shards[1].firstOwned, 3);
+  EXPECT_EQ(shards[1].files.size(), 6);
+}
+
+TEST_F(ShardPlanTest, RestartIsAlwaysACutWithoutGuard) {
+  // The acquisition restarts with version 2
+  MakeFiles({20e9, 20e9 + 100., 0., 100.});
+
+  const auto plan = ShardPlan::Make(Pointers(), 1, 10.);
+  const auto &shards = plan.GetShards();
+  ASSERT_EQ(shards.size(), 2);
+  EXPECT_EQ(shards[0].endTS, kMaxTimestamp);
+  EXPECT_EQ(shards[0].files.size(), 2);
+  EXPECT_EQ(shards[1].startTS, kMinTimestamp);
+  EXPECT_EQ(shards[1].files.size(), 2);
+}
+
+TEST_F(ShardPlanTest, EmptyFilesAreSkipped) {
+  MakeFiles({0., 100., 200.});
+  infos[1].entries = 0;
+
+  const auto plan = ShardPlan::Make(Pointers(), 1, 10.);
+  ASSERT_EQ(plan.GetShards().size(), 1);
+  EXPECT_EQ(plan.GetShards()[0].files.size(), 2);
+  EXPECT_THROW(ShardPlan::Make(Pointers(), 0, 10.), ValidationException);
+}
+
+TEST_F(ShardPlanTest, SaveAndLoad) {
+  MakeFiles({0., 100., 200., 300.});
+  ShardPlan::Make(Pointers(), 2, 10.).Save();
+
+  const auto plan = ShardPlan::Load();
+  ASSERT_EQ(plan.GetShards().size(), 2);
+  const auto &shard = plan.GetShard(1);
+  EXPECT_EQ(shard.startTS, NsToTimestamp(200.));
+  EXPECT_EQ(shard.endTS, kMaxTimestamp);
+  EXPECT_EQ(shard.files.size(), 3);
+  EXPECT_EQ(shard.entries, (std::vector<int64_t>{1000, 1000, 1000}));
+  EXPECT_THROW(plan.GetShard(2), RangeException);
+
+  std::ofstream(kShardPlanFileName) << "{\"Shards\": [{\"Index\": 0}]}";
+  EXPECT_THROW(ShardPlan::Load(), JSONException);
+  EXPECT_THROW(ShardPlan::Load("missing.json"), FileException);
+}
+
+TEST_F(ShardPlanTest, CollectOutputsInShardOrder) {
+  MakeFiles({0., 100., 200., 300.});
+  const auto plan = ShardPlan::Make(Pointers(), 2, 10.);
+  Touch("shard_0/L1_0.root");
+  Touch("shard_0/L1_1.root");
+  Touch("shard_1/L1_0.root");
+  Touch("shard_1/L1_0.idx");
+  Touch("L1_5.root");
+
+  std::string level;
+  // Shard 1 is not done yet
+  std::filesystem::current_path("shard_0");
+  ShardPlan::MarkDone(0, "L1");
+  std::filesystem::current_path(dir);
+  EXPECT_THROW(plan.CollectOutputs(level), FileException);
+  EXPECT_TRUE(std::filesystem::exists("shard_0/L1_0.root"));
+
+  std::filesystem::current_path("shard_1");
+  ShardPlan::MarkDone(1, "L1");
+  std::filesystem::current_path(dir);
+  EXPECT_EQ(plan.CollectOutputs(level), 3);
+  EXPECT_EQ(level, "L1");
+  EXPECT_EQ(RunCatalog::FindNumberedFiles(".", "L1").size(), 3);
+  EXPECT_FALSE(std::filesystem::exists("shard_1/L1_0.root"));
+  // The index goes with its output, the outputs without one have none
+  EXPECT_TRUE(std::filesystem::exists("L1_2.idx"));
+  EXPECT_FALSE(std::filesystem::exists("L1_0.idx"));
+}
+
+TEST_F(ShardPlanTest, MixedLevelsAreRejected) {
+  MakeFiles({0., 100., 200., 300.});
+  const auto plan = ShardPlan::Make(Pointers(), 2, 10.);
+  for (uint32_t i = 0; i < 2; i++) {
+    Touch("shard_" + std::to_string(i) + "/L1_0.root");
+    std::filesystem::current_path("shard_" + std::to_string(i));
+    ShardPlan::MarkDone(i, i == 0 ? "L1" : "L2");
+    std::filesystem::current_path(dir);
+  }
+
+  std::string level;
+  EXPECT_THROW(plan.CollectOutputs(level), ValidationException);
+}
@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include "SPSCQueue.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace DELILA;
+
+//=============================================================================
+// SPSCQueue Tests
+//=============================================================================
+
+TEST(SPSCQueueTest, CapacityIsPowerOfTwo) {
+  EXPECT_EQ(SPSCQueue<int>(5).Capacity(), 8);
+  EXPECT_EQ(SPSCQueue<int>(8).Capacity(), 8);
+  EXPECT_EQ(SPSCQueue<int>(0).Capacity(), 1);
+}
+
+TEST(SPSCQueueTest, FifoAndFull) {
+  SPSCQueue<int> queue(4);
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(queue.TryPush(int(i)));
+  }
+  EXPECT_FALSE(queue.TryPush(4));
+  EXPECT_EQ(queue.Size(), 4);
+
+  for (int i = 0; i < 4; i++) {
+    EXPECT_EQ(*queue.TryPop(), i);
+  }
+  EXPECT_FALSE(queue.TryPop().has_value());
+}
+
+TEST(SPSCQueueTest, FailedPushKeepsItem) {
+  SPSCQueue<std::unique_ptr<int>> queue(1);
+  queue.TryPush(std::make_unique<int>(1));
+
+  auto item = std::make_unique<int>(2);
+  EXPECT_FALSE(queue.TryPush(std::move(item)));
+  ASSERT_NE(item, nullptr);
+  EXPECT_EQ(*item, 2);
+}
+
+TEST(SPSCQueueTest, CloseDrainsPendingItems) {
+  SPSCQueue<int> queue(4);
+  queue.Push(1);
+  queue.Push(2);
+  queue.Close();
+
+  EXPECT_FALSE(queue.Push(3));
+  EXPECT_EQ(*queue.Pop(), 1);
+  EXPECT_EQ(*queue.Pop(), 2);
+  EXPECT_FALSE(queue.Pop().has_value());
+}
+
+TEST(SPSCQueueTest, CloseWakesWaitingConsumer) {
+  SPSCQueue<int> queue(4);
+  std::thread consumer([&queue] { EXPECT_FALSE(queue.Pop().has_value()); });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  queue.Close();
+  consumer.join();
+}
+
+TEST(SPSCQueueTest, ThreadedOrderIsKept) {
+  // Small ring, so both sides wait on each other many times
+  const uint64_t n = 200000;
+  SPSCQueue<uint64_t> queue(16);
+  std::thread producer([&queue, n] {
+    for (uint64_t i = 0; i < n; i++) {
+      queue.Push(uint64_t(i));
+    }
+    queue.Close();
+  });
+
+  uint64_t expected = 0;
+  auto ordered = true;
+  while (auto item = queue.Pop()) {
+    ordered &= (*item == expected);
+    expected++;
+  }
+  producer.join();
+
+  EXPECT_TRUE(ordered);
+  EXPECT_EQ(expected, n);
+}
@@ -0,0 +1,514 @@
+#include <gtest/gtest.h>
+
+#include "DELILAExceptions.hpp"
+#include "TimeOrderedMerger.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace DELILA;
+
+//=============================================================================
+// TimeOrderedMerger Tests
+//=============================================================================
+
+class TimeOrderedMergerTest : public ::testing::Test {
+ protected:
+  // Time stamps [ns] of every chunk, indexed like the task list
+  std::vector<std::vector<double>> chunkTimes;
+  // Channel of every hit, all 0 if empty
+  std::vector<std::vector<uint8_t>> chunkChannels;
+
+  std::vector<ChunkTask> MakeTasks()
+  {
+    std::vector<ChunkTask> tasks;
+    for (size_t i = 0; i < chunkTimes.size(); i++) {
+      ChunkTask task;
+      task.fileIndex = i;
+      task.firstEntry = 0;
+      task.lastEntry = chunkTimes[i].size();
+      tasks.push_back(task);
+    }
+    return tasks;
+  }
+
+  TimeOrderedMerger::ChunkLoader MakeLoader()
+  {
+    return [this](const ChunkTask &task, HitVec_t &&hits) {
+      const auto &times = chunkTimes[task.fileIndex];
+      for (size_t k = 0; k < times.size(); k++) {
+        const uint8_t ch =
+            chunkChannels.empty() ? 0 : chunkChannels[task.fileIndex][k];
+        hits.emplace_back(false, task.fileIndex, ch, 100, 50,
+                          NsToTimestamp(times[k]));
+      }
+      std::sort(hits.begin(), hits.end(),
+                [](const auto &a, const auto &b) { return a.ts < b.ts; });
+      return std::move(hits);
+    };
+  }
+
+  // Runs the merger and collects all slices in slice order
+  std::vector<HitSlice> RunMerger(size_t sliceSize, double window,
+                                  uint32_t nReaders = 2,
+                                  uint32_t *nResets = nullptr)
+  {
+    BoundedQueue<HitSlice> queue(4);
+    TimeOrderedMerger merger(MakeTasks(), MakeLoader(), queue);
+    merger.SetNumberOfReaders(nReaders);
+    merger.SetSliceSize(sliceSize);
+    merger.SetContextWindow(NsToTimestamp(window));
+
+    std::vector<HitSlice> slices;
+    std::thread consumer([&]() {
+      while (auto slice = queue.Pop()) {
+        slices.push_back(std::move(*slice));
+      }
+    });
+
+    std::atomic<bool> cancelled{false};
+    merger.Run(cancelled);
+    queue.Close();
+    consumer.join();
+
+    if (nResets) *nResets = merger.GetNumberOfResets();
+    std::sort(slices.begin(), slices.end(),
+              [](const auto &a, const auto &b) { return a.sliceID < b.sliceID; });
+    return slices;
+  }
+
+  // Follow mode: one Run() per chunk, the last one ends the data.
+  // restart: every Run() is done by a new merger from the saved state.
+  std::vector<HitSlice> RunMergerIncrements(size_t sliceSize, double window,
+                                            uint64_t *nLateHits = nullptr,
+                                            bool restart = false)
+  {
+    const auto tasks = MakeTasks();
+    auto makeMerger = [&]() {
+      auto merger = std::make_unique<TimeOrderedMerger>(
+          std::vector<ChunkTask>(), MakeLoader());
+      merger->SetSliceSize(sliceSize);
+      merger->SetContextWindow(NsToTimestamp(window));
+      return merger;
+    };
+    auto merger = makeMerger();
+
+    std::vector<HitSlice> slices;
+    std::atomic<bool> cancelled{false};
+    for (size_t i = 0; i < tasks.size(); i++) {
+      if (restart && i > 0) {
+        std::stringstream state;
+        merger->SaveState(state);
+        merger = makeMerger();
+        merger->AddTasks({tasks.begin(), tasks.begin() + i});
+        merger->LoadState(state);
+      }
+      BoundedQueue<HitSlice> queue(4);
+      merger->SetOutput(queue);
+      merger->SetNumberOfReaders(2);
+      merger->AddTasks({tasks[i]});
+      std::thread consumer([&]() {
+        while (auto slice = queue.Pop()) {
+          slices.push_back(std::move(*slice));
+        }
+      });
+      merger->Run(cancelled, i + 1 == tasks.size());
+      queue.Close();
+      consumer.join();
+    }
+
+    if (nLateHits) *nLateHits = merger->GetNumberOfLateHits();
+    std::sort(slices.begin(), slices.end(),
+              [](const auto &a, const auto &b) { return a.sliceID < b.sliceID; });
+    return slices;
+  }
+
+  static std::vector<double> CoreTimes(const std::vector<HitSlice> &slices)
+  {
+    std::vector<double> times;
+    for (const auto &slice : slices) {
+      for (size_t i = slice.coreBegin; i < slice.coreEnd; i++) {
+        times.push_back(ToNs(slice.hits[i].ts));
+      }
+    }
+    return times;
+  }
+};
+
+TEST_F(TimeOrderedMergerTest, SingleChunkSingleSlice) {
+  chunkTimes = {{3., 1., 2.}};
+
+  auto slices = RunMerger(100, 10.);
+
+  ASSERT_EQ(slices.size(), 1);
+  EXPECT_EQ(slices[0].coreBegin, 0);
+  EXPECT_EQ(slices[0].coreEnd, 3);
+  EXPECT_EQ(CoreTimes(slices), (std::vector<double>{1., 2., 3.}));
+}
+
+TEST_F(TimeOrderedMergerTest, OverlappingFilesAreMergedInTimeOrder) {
+  // The end of file 0 and the start of file 1 overlap in time
+  chunkTimes = {{0., 10., 20., 30., 40.}, {35., 45., 50., 60.},
+                {55., 70., 80.}};
+
+  auto times = CoreTimes(RunMerger(100, 10.));
+
+  ASSERT_EQ(times.size(), 12);
+  EXPECT_TRUE(std::is_sorted(times.begin(), times.end()));
+}
+
+TEST_F(TimeOrderedMergerTest, EveryHitIsInExactlyOneCore) {
+  chunkTimes.resize(5);
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 100; j++) {
+      chunkTimes[i].push_back(i * 90. + j);  // 10 ns overlap between files
+    }
+  }
+
+  auto slices = RunMerger(37, 5.);
+  auto times = CoreTimes(slices);
+
+  EXPECT_EQ(times.size(), 500);
+  EXPECT_TRUE(std::is_sorted(times.begin(), times.end()));
+  EXPECT_GT(slices.size(), 10);
+}
+
+TEST_F(TimeOrderedMergerTest, ChunkStartingEarlierThanThePreviousOne) {
+  // File 2 starts within file 0, file 1 has already been merged up to it
+  chunkTimes.resize(3);
+  for (int j = 0; j < 100; j++) {
+    chunkTimes[0].push_back(j);
+    chunkTimes[1].push_back(100. + j);
+  }
+  for (int j = 0; j <= 10; j++) {
+    chunkTimes[2].push_back(50.5 + j);
+  }
+
+  auto slices = RunMerger(10, 5.);
+
+  // The file is the module of the hit, so every hit is told apart
+  std::map<std::pair<uint8_t, Timestamp_t>, int> cores;
+  for (const auto &slice : slices) {
+    for (size_t i = slice.coreBegin; i < slice.coreEnd; i++) {
+      cores[{slice.hits[i].mod, slice.hits[i].ts}]++;
+    }
+  }
+  EXPECT_EQ(cores.size(), 211);
+  for (const auto &[hit, count] : cores) {
+    EXPECT_EQ(count, 1) << "file " << int(hit.first) << ", " << hit.second;
+  }
+  auto times = CoreTimes(slices);
+  EXPECT_TRUE(std::is_sorted(times.begin(), times.end()));
+}
+
+TEST_F(TimeOrderedMergerTest, LateHitsAreSortedIntoTheirSlice) {
+  // File 3 starts earlier than the two files before it: its hits come after
+  // the 99 ns of file 0, into the open slice [90, 100) ns
+  chunkTimes.resize(4);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 100; j++) {
+      chunkTimes[i].push_back(i * 100. + j);
+    }
+  }
+  chunkTimes[3] = {93.5, 97.5};
+  const double window = 2.;
+
+  auto slices = RunMerger(10, window);
+
+  std::map<std::pair<uint8_t, Timestamp_t>, int> cores;
+  for (const auto &slice : slices) {
+    EXPECT_TRUE(std::is_sorted(
+        slice.hits.begin(), slice.hits.end(),
+        [](const auto &a, const auto &b) { return a.ts < b.ts; }));
+    for (size_t i = 0; i < slice.hits.size(); i++) {
+      const bool inCore = (i >= slice.coreBegin && i < slice.coreEnd);
+      EXPECT_EQ(inCore, slice.IsOwner(slice.hits[i].ts));
+      if (inCore) cores[{slice.hits[i].mod, slice.hits[i].ts}]++;
+    }
+    // The pads hold every hit of the window, the late ones too
+    size_t nWindow = 0;
+    for (const auto &times : chunkTimes) {
+      for (const auto ts : times) {
+        const auto hitTS = NsToTimestamp(ts);
+        nWindow += (slice.coreStartTS == kMinTimestamp ||
+                    hitTS >= slice.coreStartTS - NsToTimestamp(window)) &&
+                   (slice.coreEndTS == kMaxTimestamp ||
+                    hitTS <= slice.coreEndTS + NsToTimestamp(window));
+      }
+    }
+    EXPECT_EQ(slice.hits.size(), nWindow) << "slice " << slice.sliceID;
+  }
+  EXPECT_EQ(cores.size(), 302);
+  for (const auto &[hit, count] : cores) {
+    EXPECT_EQ(count, 1) << "file " << int(hit.first) << ", " << hit.second;
+  }
+}
+
+TEST_F(TimeOrderedMergerTest, HitOfAPushedSliceFails) {
+  // As above, but 85.5 ns belongs to the slice [80, 90) ns already pushed
+  chunkTimes.resize(4);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 100; j++) {
+      chunkTimes[i].push_back(i * 100. + j);
+    }
+  }
+  chunkTimes[3] = {85.5};
+
+  BoundedQueue<HitSlice> queue(4);
+  TimeOrderedMerger merger(MakeTasks(), MakeLoader(), queue);
+  merger.SetSliceSize(10);
+  merger.SetContextWindow(NsToTimestamp(2.));
+  std::thread consumer([&]() {
+    while (queue.Pop()) {
+    }
+  });
+
+  std::atomic<bool> cancelled{false};
+  EXPECT_THROW(merger.Run(cancelled), ValidationException);
+  queue.Close();
+  consumer.join();
+}
+
+TEST_F(TimeOrderedMergerTest, PadsCoverExactlyTheWindow) {
+  chunkTimes = {{}};
+  for (int j = 0; j < 50; j++) {
+    chunkTimes[0].push_back(j);
+  }
+
+  auto slices = RunMerger(10, 2.5);
+
+  ASSERT_EQ(slices.size(), 5);
+  for (const auto &slice : slices) {
+    for (size_t i = 0; i < slice.hits.size(); i++) {
+      auto ts = slice.hits[i].ts;
+      bool inCore = (i >= slice.coreBegin && i < slice.coreEnd);
+      EXPECT_EQ(inCore, slice.IsOwner(ts));
+      // The first and last cores are open ended (kMin / kMaxTimestamp)
+      EXPECT_GE(ts + NsToTimestamp(2.5), slice.coreStartTS);
+      EXPECT_LE(ts - NsToTimestamp(2.5), slice.coreEndTS);
+    }
+  }
+  // Hits at 8, 9 lead slice 1 (core starts at 10), 10, 11, 12 trail slice 0
+  EXPECT_EQ(slices[1].coreBegin, 2);
+  EXPECT_EQ(slices[1].hits[0].ts, NsToTimestamp(8.));
+  EXPECT_EQ(slices[0].hits.size() - slices[0].coreEnd, 3);
+}
+
+TEST_F(TimeOrderedMergerTest, SliceSmallerThanWindow) {
+  chunkTimes = {{}};
+  for (int j = 0; j < 40; j++) {
+    chunkTimes[0].push_back(j);
+  }
+
+  // Each slice holds 4 ns, the window reaches two slices further
+  auto slices = RunMerger(4, 10.);
+
+  EXPECT_EQ(CoreTimes(slices).size(), 40);
+  for (const auto &slice : slices) {
+    size_t nWindow = 0;
+    auto center = ToNs(slice.hits[slice.coreBegin].ts);
+    for (const auto &hit : slice.hits) {
+      if (std::abs(ToNs(hit.ts) - center) <= 10.) nWindow++;
+    }
+    // Every hit within the window of the first core hit is available
+    EXPECT_EQ(nWindow, std::min(40., center + 11.) - std::max(0., center - 10.));
+  }
+}
+
+TEST_F(TimeOrderedMergerTest, EqualTimeStampsAreNotSplit) {
+  chunkTimes = {{1., 1., 1., 1., 2., 2., 3.}};
+
+  auto slices = RunMerger(2, 0.);
+
+  ASSERT_EQ(slices.size(), 3);
+  EXPECT_EQ(slices[0].coreEnd - slices[0].coreBegin, 4);
+  EXPECT_EQ(slices[1].coreEnd - slices[1].coreBegin, 2);
+  EXPECT_EQ(slices[2].coreEnd - slices[2].coreBegin, 1);
+}
+
+TEST_F(TimeOrderedMergerTest, EachTimeHasExactlyOneOwner) {
+  chunkTimes = {{}, {}};
+  for (int j = 0; j < 100; j++) {
+    chunkTimes[0].push_back(j * 0.5);
+    chunkTimes[1].push_back(40. + j * 0.5);
+  }
+
+  auto slices = RunMerger(7, 3.);
+
+  std::map<double, int> owners;
+  for (const auto &slice : slices) {
+    for (const auto &hit : slice.hits) {
+      if (slice.IsOwner(hit.ts)) owners[ToNs(hit.ts)]++;
+    }
+  }
+  for (const auto &[ts, count] : owners) {
+    // Times present in both files show up twice in the same owning core
+    EXPECT_EQ(count, (ts >= 40. && ts < 50.) ? 2 : 1) << "ts = " << ts;
+  }
+}
+
+TEST_F(TimeOrderedMergerTest, AcquisitionRestartSplitsSegments) {
+  // Second file starts again from 0 ns: new acquisition
+  chunkTimes = {{0., 1e10, 2e10, 3e10}, {0., 1., 2.}};
+
+  uint32_t nResets = 0;
+  auto slices = RunMerger(100, 10., 2, &nResets);
+
+  EXPECT_EQ(nResets, 1);
+  ASSERT_EQ(slices.size(), 2);
+  // No context is carried over the restart
+  EXPECT_EQ(slices[0].hits.size(), slices[0].coreEnd);
+  EXPECT_EQ(slices[0].hits.size(), 4);
+  EXPECT_EQ(slices[1].coreBegin, 0);
+  EXPECT_EQ(slices[1].coreEnd, 3);
+}
+
+TEST_F(TimeOrderedMergerTest, ResultIndependentOfReaderCount) {
+  chunkTimes.resize(8);
+  for (int i = 0; i < 8; i++) {
+    for (int j = 0; j < 200; j++) {
+      chunkTimes[i].push_back(i * 150. + j * 1.01);
+    }
+  }
+
+  auto reference = CoreTimes(RunMerger(64, 8., 1));
+  for (uint32_t nReaders : {2u, 4u, 8u}) {
+    EXPECT_EQ(CoreTimes(RunMerger(64, 8., nReaders)), reference);
+  }
+}
+
+TEST_F(TimeOrderedMergerTest, EmptyChunksAreSkipped) {
+  chunkTimes = {{}, {1., 2.}, {}, {3.}};
+
+  auto times = CoreTimes(RunMerger(100, 10.));
+
+  EXPECT_EQ(times, (std::vector<double>{1., 2., 3.}));
+}
+
+TEST_F(TimeOrderedMergerTest, CancelledBeforeStart) {
+  chunkTimes = {{1., 2.}, {3., 4.}};
+
+  BoundedQueue<HitSlice> queue(4);
+  TimeOrderedMerger merger(MakeTasks(), MakeLoader(), queue);
+  std::atomic<bool> cancelled{true};
+
+  EXPECT_NO_THROW(merger.Run(cancelled));
+  EXPECT_EQ(merger.GetNumberOfSlices(), 0);
+}
+
+TEST_F(TimeOrderedMergerTest, IncrementsGiveTheSameCores) {
+  // Every channel is in time order over the files, but the next file
+  // starts before the last hits of the other channels of this one
+  chunkTimes.resize(4);
+  chunkChannels.resize(4);
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 100; j++) {
+      chunkTimes[i].push_back(i * 100. + j);
+      chunkChannels[i].push_back(j % 4);
+    }
+    if (i > 0) {
+      // Channel 1 goes on before the last hit of channel 3 of file i - 1
+      chunkTimes[i].push_back(i * 100. - 1.5);
+      chunkChannels[i].push_back(1);
+    }
+  }
+
+  const auto reference = RunMerger(30, 5.);
+  uint64_t nLateHits = 0;
+  const auto slices = RunMergerIncrements(30, 5., &nLateHits);
+
+  EXPECT_EQ(nLateHits, 0);
+  EXPECT_EQ(CoreTimes(slices), CoreTimes(reference));
+  ASSERT_EQ(slices.size(), reference.size());
+  for (size_t i = 0; i < slices.size(); i++) {
+    EXPECT_EQ(slices[i].hits.size(), reference[i].hits.size());
+    EXPECT_EQ(slices[i].coreStartTS, reference[i].coreStartTS);
+    EXPECT_EQ(slices[i].coreEndTS, reference[i].coreEndTS);
+  }
+}
+
+TEST_F(TimeOrderedMergerTest, IncrementKeepsHitsAfterTheHorizon) {
+  chunkTimes = {{0., 1., 2., 3., 4., 5., 20.}};
+  chunkChannels = {{0, 1, 0, 1, 0, 1, 0}};
+
+  BoundedQueue<HitSlice> queue(4);
+  TimeOrderedMerger merger(MakeTasks(), MakeLoader(), queue);
+  merger.SetSliceSize(2);
+  merger.SetContextWindow(0);
+  std::atomic<bool> cancelled{false};
+  merger.Run(cancelled, false);
+  queue.Close();
+
+  // Channel 1 ends at 5 ns, so 5 and 20 ns wait for the next file, and
+  // with them the trailing pad of the slice of 2 and 3 ns
+  std::vector<double> times;
+  while (auto slice = queue.Pop()) {
+    for (size_t i = slice->coreBegin; i < slice->coreEnd; i++) {
+      times.push_back(ToNs(slice->hits[i].ts));
+    }
+  }
+  EXPECT_EQ(times, (std::vector<double>{0., 1.}));
+}
+
+TEST_F(TimeOrderedMergerTest, SavedStateGivesTheSameSlices) {
+  chunkTimes.resize(4);
+  chunkChannels.resize(4);
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 100; j++) {
+      chunkTimes[i].push_back(i * 100. + j);
+      chunkChannels[i].push_back(j % 4);
+    }
+    if (i > 0) {
+      chunkTimes[i].push_back(i * 100. - 1.5);
+      chunkChannels[i].push_back(1);
+    }
+  }
+  // Earlier than the horizon of file 1, but after the last slice pushed
+  chunkTimes[2].push_back(190.5);
+  chunkChannels[2].push_back(2);
+
+  uint64_t nLateHits = 0;
+  const auto reference = RunMergerIncrements(30, 5., &nLateHits);
+  uint64_t nLateHitsRestarted = 0;
+  const auto slices = RunMergerIncrements(30, 5., &nLateHitsRestarted, true);
+
+  EXPECT_EQ(nLateHits, 1);
+  EXPECT_EQ(nLateHitsRestarted, nLateHits);
+  EXPECT_EQ(CoreTimes(slices), CoreTimes(reference));
+  ASSERT_EQ(slices.size(), reference.size());
+  for (size_t i = 0; i < slices.size(); i++) {
+    EXPECT_EQ(slices[i].sliceID, reference[i].sliceID);
+    EXPECT_EQ(slices[i].hits.size(), reference[i].hits.size());
+    EXPECT_EQ(slices[i].coreStartTS, reference[i].coreStartTS);
+    EXPECT_EQ(slices[i].coreEndTS, reference[i].coreEndTS);
+  }
+}
+
+TEST_F(TimeOrderedMergerTest, InvalidStateIsRejected) {
+  chunkTimes = {{0., 1., 2.}};
+  TimeOrderedMerger merger({}, MakeLoader());
+
+  std::stringstream foreign("not a merger state");
+  EXPECT_THROW(merger.LoadState(foreign), FileException);
+
+  // Saved after one task, loaded into a merger without tasks
+  TimeOrderedMerger saved(MakeTasks(), MakeLoader());
+  BoundedQueue<HitSlice> queue(4);
+  saved.SetOutput(queue);
+  std::atomic<bool> cancelled{false};
+  saved.Run(cancelled, false);
+  std::stringstream state;
+  saved.SaveState(state);
+  EXPECT_THROW(merger.LoadState(state), FileException);
+
+  std::stringstream truncated(state.str().substr(0, 20));
+  merger.AddTasks(MakeTasks());
+  EXPECT_THROW(merger.LoadState(truncated), FileException);
+  EXPECT_EQ(merger.GetNumberOfMergedTasks(), 0);
+}
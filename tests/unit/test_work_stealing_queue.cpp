@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "WorkStealingQueue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace DELILA;
+
+//=============================================================================
+// WorkStealingQueue Tests
+//=============================================================================
+
+TEST(WorkStealingQueueTest, OwnTasksInPushOrder) {
+  WorkStealingQueue<int> queue(2);
+  for (int i = 0; i < 3; i++) queue.Push(0, int(i));
+  queue.Push(1, 10);
+
+  EXPECT_EQ(*queue.Pop(0), 0);
+  EXPECT_EQ(*queue.Pop(0), 1);
+  EXPECT_EQ(*queue.Pop(1), 10);
+  EXPECT_EQ(queue.GetNumberOfSteals(), 0);
+}
+
+TEST(WorkStealingQueueTest, StealsFromTheBack) {
+  WorkStealingQueue<int> queue(3);
+  for (int i = 0; i < 4; i++) queue.Push(1, int(i));
+
+  EXPECT_EQ(*queue.Pop(0), 3);
+  EXPECT_EQ(*queue.Pop(2), 2);
+  EXPECT_EQ(*queue.Pop(1), 0);
+  EXPECT_EQ(queue.GetNumberOfSteals(), 2);
+}
+
+TEST(WorkStealingQueueTest, EmptyReturnsNullopt) {
+  WorkStealingQueue<int> queue(4);
+
+  EXPECT_FALSE(queue.Pop(0).has_value());
+  EXPECT_FALSE(queue.Pop(3).has_value());
+}
+
+TEST(WorkStealingQueueTest, ZeroWorkersActsAsOne) {
+  WorkStealingQueue<int> queue(0);
+  queue.Push(5, 1);
+
+  EXPECT_EQ(queue.GetNumberOfWorkers(), 1);
+  EXPECT_EQ(*queue.Pop(0), 1);
+}
+
+TEST(WorkStealingQueueTest, EveryTaskRunsOnceUnderContention) {
+  constexpr int nWorkers = 4;
+  constexpr int nTasks = 2000;
+  WorkStealingQueue<int> queue(nWorkers);
+  // All work on worker 0, slow tasks there, the others must steal
+  for (int i = 0; i < nTasks; i++) queue.Push(0, int(i));
+
+  std::vector<std::atomic<int>> runs(nTasks);
+  std::vector<int> perWorker(nWorkers, 0);
+  std::vector<std::thread> threads;
+  for (int w = 0; w < nWorkers; w++) {
+    threads.emplace_back([&, w]() {
+      while (auto task = queue.Pop(w)) {
+        runs[*task]++;
+        perWorker[w]++;
+        if (w == 0) {
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+
+  for (int i = 0; i < nTasks; i++) {
+    ASSERT_EQ(runs[i].load(), 1) << "task " << i;
+  }
+  EXPECT_GT(queue.GetNumberOfSteals(), 0);
+  EXPECT_LT(perWorker[0], nTasks);
+}
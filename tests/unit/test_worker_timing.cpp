@@ -0,0 +1,31 @@
+#include <gtest/gtest.h>
+
+#include "WorkerTiming.hpp"
+
+using namespace DELILA;
+
+//=============================================================================
+// WorkerTiming Tests
+//=============================================================================
+
+TEST(WorkerTimingTest, BalancedWorkers) {
+  std::vector<WorkerTiming_t> timings(4);
+  for (auto &timing : timings) timing.wallTime = 2.;
+
+  EXPECT_DOUBLE_EQ(GetImbalance(timings), 1.);
+}
+
+TEST(WorkerTimingTest, OneSlowWorker) {
+  std::vector<WorkerTiming_t> timings(4);
+  timings[0].wallTime = 5.;
+  timings[1].wallTime = 1.;
+  timings[2].wallTime = 1.;
+  timings[3].wallTime = 1.;
+
+  EXPECT_DOUBLE_EQ(GetImbalance(timings), 2.5);
+}
+
+TEST(WorkerTimingTest, NoTimeIsBalanced) {
+  EXPECT_DOUBLE_EQ(GetImbalance({}), 1.);
+  EXPECT_DOUBLE_EQ(GetImbalance(std::vector<WorkerTiming_t>(3)), 1.);
+}